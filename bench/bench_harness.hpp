@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Minimal benchmark harness. A benchmark runs `iterations` operations and
+// returns the nanoseconds spent in the measured part, so setup can be left
+// out; it lowers `ops` when fewer operations completed (e.g. dropped frames).
+// Iterations grow until a run takes at least the minimum time.
+
+struct BenchResult {
+  std::string name;
+  std::string transport;  // "none" for benchmarks without I/O
+  uint64_t    iterations  = 0;
+  double      ns_per_op   = 0;
+  double      ops_per_sec = 0;
+};
+
+using BenchFunction =
+  std::function<uint64_t(uint64_t iterations, uint64_t& ops)>;
+
+// Keeps the compiler from optimizing away a computed value
+template <typename T>
+inline void bench_do_not_optimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline uint64_t bench_now_ns() {
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch())
+      .count());
+}
+
+class BenchRunner {
+public:
+  explicit BenchRunner(double min_seconds = 0.2, std::string filter = "")
+    : min_ns_(static_cast<uint64_t>(min_seconds * 1e9)),
+      filter_(std::move(filter)) {
+  }
+
+  void run(const std::string&   name,
+           const std::string&   transport,
+           const BenchFunction& fn,
+           uint64_t             start_iterations = 1000) {
+    std::string full_name = name + "/" + transport;
+    if (!filter_.empty() && full_name.find(filter_) == std::string::npos)
+      return;
+
+    uint64_t iterations = start_iterations;
+    uint64_t elapsed    = 0;
+    uint64_t ops        = 0;
+    for (;;) {
+      ops     = iterations;
+      elapsed = fn(iterations, ops);
+      if (elapsed >= min_ns_ || iterations >= (1ull << 40))
+        break;
+      // Aim past the minimum in one step when the last run was long enough
+      // to extrapolate from
+      uint64_t next = elapsed > min_ns_ / 10
+                        ? iterations * min_ns_ / elapsed * 12 / 10 + 1
+                        : iterations * 10;
+      iterations = next > iterations ? next : iterations * 2;
+    }
+
+    BenchResult result;
+    result.name        = name;
+    result.transport   = transport;
+    result.iterations  = ops;
+    result.ns_per_op   = ops ? static_cast<double>(elapsed) / ops : 0;
+    result.ops_per_sec = result.ns_per_op > 0 ? 1e9 / result.ns_per_op : 0;
+    results_.push_back(result);
+    std::cerr << full_name << ": " << result.ns_per_op << " ns/op ("
+              << static_cast<uint64_t>(result.ops_per_sec) << " ops/s)"
+              << std::endl;
+  }
+
+  const std::vector<BenchResult>& results() const {
+    return results_;
+  }
+
+  void write_json(FILE* out, const std::string& suite) const {
+    fprintf(out,
+            "{\n  \"suite\": \"%s\",\n  \"timestamp\": %lld,\n"
+            "  \"results\": [\n",
+            suite.c_str(),
+            static_cast<long long>(time(nullptr)));
+    for (size_t i = 0; i < results_.size(); ++i) {
+      const BenchResult& r = results_[i];
+      fprintf(out,
+              "    {\"name\": \"%s\", \"transport\": \"%s\", "
+              "\"iterations\": %llu, \"ns_per_op\": %.3f, "
+              "\"ops_per_sec\": %.1f}%s\n",
+              r.name.c_str(),
+              r.transport.c_str(),
+              static_cast<unsigned long long>(r.iterations),
+              r.ns_per_op,
+              r.ops_per_sec,
+              i + 1 < results_.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+  }
+
+private:
+  uint64_t                 min_ns_;
+  std::string              filter_;
+  std::vector<BenchResult> results_;
+};
@@ -0,0 +1,553 @@
+#include "bench_harness.hpp"
+#include "socket_can/basic_socket_can.hpp"
+#include "socket_can/bus_load.hpp"
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/frame_filter.hpp"
+#include "socket_can/frame_formatter.hpp"
+#include "socket_can/socket_can.hpp"
+#include "socket_can/traffic_generator.hpp"
+#include "socket_can/traffic_statistics.hpp"
+#include "socket_can/virtual_can_bus.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// Microbenchmarks for the hot paths: event loop dispatch, frame RX/TX through
+// SocketCanIntf, FrameProcessor invocation and text formatting. RX/TX run on
+// the in-process virtual bus and, when present, on a vcan interface; the
+// rx_dispatch_* ones compare SocketCanIntf with BasicSocketCan over a local
+// socket pair, the filter_* ones the batch filter kernels with the plain
+// per-frame loop.
+
+namespace {
+
+can_frame make_frame(uint32_t i) {
+  can_frame frame = {};
+  frame.can_id    = 0x100 + (i & 0x3FF);
+  frame.can_dlc   = 8;
+  std::memcpy(frame.data, &i, sizeof(i));
+  return frame;
+}
+
+// One EpollEvent set + dispatched per operation (eventfd write, epoll_wait,
+// eventfd read, callback)
+uint64_t bench_event_round_trip(uint64_t iterations, uint64_t&) {
+  EpollEventLoop loop;
+  EpollEvent     event;
+  uint64_t       fired = 0;
+  event.init(&loop, [&fired](uint32_t) { fired++; });
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    event.set();
+    loop.run_once(0);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  event.deinit();
+  bench_do_not_optimize(fired);
+  return elapsed;
+}
+
+// epoll_wait + dispatch of an always-ready descriptor: the loop's own cost
+uint64_t bench_dispatch_ready_fd(uint64_t iterations, uint64_t&) {
+  int fds[2];
+  socketpair(AF_UNIX, SOCK_DGRAM, 0, fds);
+  char byte = 0;
+  if (write(fds[1], &byte, 1) != 1)
+    return 0;
+
+  EpollEventLoop        loop;
+  EpollEventLoop::EvtId evt;
+  uint64_t              fired = 0;
+  loop.register_event(&evt, fds[0], EPOLLIN, [&fired](uint32_t) { fired++; });
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i)
+    loop.run_once(0);
+  uint64_t elapsed = bench_now_ns() - start;
+  loop.deregister_event(evt);
+  close(fds[0]);
+  close(fds[1]);
+  bench_do_not_optimize(fired);
+  return elapsed;
+}
+
+// Frames per second through SocketCanIntf::init() callbacks while another
+// node streams frames at full speed; frames the transport dropped are not
+// counted
+uint64_t bench_rx(const std::string& iface,
+                  uint64_t           iterations,
+                  uint64_t&          ops) {
+  EpollEventLoop loop;
+  SocketCanIntf  rx;
+  uint64_t       received = 0;
+  if (!rx.init(iface, &loop, [&received](const can_frame&) { received++; }))
+    return 0;
+  std::unique_ptr<CanTransport> tx = make_can_transport(iface);
+  if (!tx->open(iface))
+    return 0;
+
+  std::atomic<bool> sent{false};
+  uint64_t          start = bench_now_ns();
+  std::thread       sender([&]() {
+    for (uint64_t i = 0; i < iterations; ++i) {
+      can_frame frame = make_frame(static_cast<uint32_t>(i));
+      while (!tx->send(frame))
+        tx->wait_writable(10);
+    }
+    sent = true;
+  });
+  while (received < iterations) {
+    int n = loop.run_once(50);
+    if (n < 0 || (n == 0 && sent))
+      break;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  sender.join();
+  rx.deinit();
+  ops = received;
+  return elapsed;
+}
+
+// Datagram transport over a SOCK_SEQPACKET pair: the benchmark writes frames
+// into the peer end, so receive paths are measured without a bus thread
+class PairTransport : public DatagramCanTransport {
+public:
+  ~PairTransport() override {
+    close();
+  }
+  bool open(const std::string&) override {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0,
+                   fds) != 0)
+      return false;
+    fd_   = fds[0];
+    peer_ = fds[1];
+    return true;
+  }
+  void close() override {
+    DatagramCanTransport::close();
+    if (peer_ >= 0)
+      ::close(peer_);
+    peer_ = -1;
+  }
+  int peer() const {
+    return peer_;
+  }
+
+private:
+  int peer_ = -1;
+};
+
+constexpr size_t kPairChunk = 64;
+
+// Writes frames into the pair a chunk at a time and times only the loop
+// draining them: epoll_wait, the batched reads and the per-frame handler
+uint64_t drain_pair(int             peer,
+                    EpollEventLoop& loop,
+                    uint64_t        iterations,
+                    const uint64_t& received) {
+  can_frame chunk[kPairChunk];
+  for (size_t i = 0; i < kPairChunk; ++i)
+    chunk[i] = make_frame(static_cast<uint32_t>(i));
+  uint64_t elapsed = 0;
+  for (uint64_t done = 0; done < iterations; done += kPairChunk) {
+    size_t n = static_cast<size_t>(
+      std::min<uint64_t>(kPairChunk, iterations - done));
+    for (size_t i = 0; i < n; ++i) {
+      if (send(peer, &chunk[i], sizeof(can_frame), 0) != sizeof(can_frame))
+        return 0;
+    }
+    uint64_t target = received + n;
+    uint64_t start  = bench_now_ns();
+    while (received < target)
+      loop.run_once(0);
+    elapsed += bench_now_ns() - start;
+  }
+  return elapsed;
+}
+
+uint64_t bench_rx_dispatch_intf(uint64_t iterations, uint64_t&) {
+  EpollEventLoop loop;
+  SocketCanIntf  rx;
+  uint64_t       received = 0, sum = 0;
+  auto           pair     = std::make_unique<PairTransport>();
+  PairTransport* raw      = pair.get();
+  if (!pair->open("") ||
+      !rx.init(std::move(pair), &loop, [&](const can_frame& frame) {
+        received++;
+        sum += frame.can_id;
+      }))
+    return 0;
+  uint64_t elapsed = drain_pair(raw->peer(), loop, iterations, received);
+  rx.deinit();
+  bench_do_not_optimize(sum);
+  return elapsed;
+}
+
+template <typename Intf>
+uint64_t bench_rx_dispatch(Intf&           rx,
+                           const uint64_t& received,
+                           uint64_t        iterations) {
+  EpollEventLoop loop;
+  auto           pair = std::make_unique<PairTransport>();
+  PairTransport* raw  = pair.get();
+  if (!pair->open("") || !rx.init(std::move(pair), &loop))
+    return 0;
+  uint64_t elapsed = drain_pair(raw->peer(), loop, iterations, received);
+  rx.deinit();
+  return elapsed;
+}
+
+// Same work as the SocketCanIntf processor above, as a named type
+struct CountingHandler {
+  uint64_t received = 0;
+  uint64_t sum      = 0;
+
+  void operator()(const can_frame& frame) {
+    received++;
+    sum += frame.can_id;
+  }
+  void operator()(const can_frame& frame, uint64_t timestamp_ns) {
+    received++;
+    sum += frame.can_id + timestamp_ns;
+  }
+};
+
+uint64_t bench_rx_dispatch_function(uint64_t iterations, uint64_t&) {
+  uint64_t          received = 0, sum = 0;
+  FunctionSocketCan rx([&](const can_frame& frame) {
+    received++;
+    sum += frame.can_id;
+  });
+  uint64_t elapsed = bench_rx_dispatch(rx, received, iterations);
+  bench_do_not_optimize(sum);
+  return elapsed;
+}
+
+uint64_t bench_rx_dispatch_inlined(uint64_t iterations, uint64_t&) {
+  BasicSocketCan<CountingHandler, CanBatching<16>> rx;
+  uint64_t elapsed = bench_rx_dispatch(rx, rx.handler().received, iterations);
+  bench_do_not_optimize(rx.handler().sum);
+  return elapsed;
+}
+
+uint64_t bench_rx_dispatch_inlined_ts(uint64_t iterations, uint64_t&) {
+  BasicSocketCan<CountingHandler, CanBatching<16>, CanTimestamps,
+                 CanStatistics>
+           rx;
+  uint64_t elapsed = bench_rx_dispatch(rx, rx.handler().received, iterations);
+  bench_do_not_optimize(rx.handler().sum);
+  return elapsed;
+}
+
+// send_can_frame() throughput, waiting for room when the TX queue is full
+uint64_t bench_tx(const std::string& iface, uint64_t iterations, uint64_t&) {
+  EpollEventLoop loop;
+  SocketCanIntf  tx;
+  if (!tx.init(iface, &loop, [](const can_frame&) {}))
+    return 0;
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    can_frame frame = make_frame(static_cast<uint32_t>(i));
+    while (!tx.send_can_frame(frame))
+      tx.wait_writable(10);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  tx.deinit();
+  return elapsed;
+}
+
+uint64_t bench_frame_processor(uint64_t iterations, uint64_t&) {
+  uint64_t       sum       = 0;
+  FrameProcessor processor = [&sum](const can_frame& frame) {
+    sum += frame.can_id;
+  };
+  can_frame frame = make_frame(1);
+  uint64_t  start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    frame.can_id = static_cast<canid_t>(i);
+    processor(frame);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(sum);
+  return elapsed;
+}
+
+uint64_t bench_format_candump(uint64_t iterations, uint64_t&) {
+  char          line[FrameFormatter::kMaxLineLength + 16];
+  CaptureRecord record = {};
+  record.frame         = make_frame(7);
+  size_t   total       = 0;
+  uint64_t start       = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    record.timestamp_ns = 1700000000000000000ull + i * 250000;
+    total += FrameFormatter::format_candump(line, record, "vcan0", 5) - line;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(total);
+  return elapsed;
+}
+
+uint64_t bench_format_human(uint64_t iterations, uint64_t&) {
+  char           line[FrameFormatter::kMaxLineLength];
+  FrameFormatter formatter;
+  can_frame      frame = make_frame(7);
+  size_t         total = 0;
+  uint64_t       start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    total += formatter.format_human(
+               line, frame, 1700000000000000000ull + i * 250000, i) -
+             line;
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(total);
+  return elapsed;
+}
+
+// snprintf baseline for the candump line
+uint64_t bench_format_snprintf(uint64_t iterations, uint64_t&) {
+  char      line[FrameFormatter::kMaxLineLength + 16];
+  can_frame frame = make_frame(7);
+  size_t    total = 0;
+  uint64_t  start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    uint64_t ts = 1700000000000000000ull + i * 250000;
+    total += static_cast<size_t>(
+      snprintf(line,
+               sizeof(line),
+               "(%llu.%06llu) vcan0 %03X#%02X%02X%02X%02X%02X%02X%02X%02X\n",
+               static_cast<unsigned long long>(ts / 1000000000ull),
+               static_cast<unsigned long long>(ts % 1000000000ull / 1000),
+               frame.can_id,
+               frame.data[0],
+               frame.data[1],
+               frame.data[2],
+               frame.data[3],
+               frame.data[4],
+               frame.data[5],
+               frame.data[6],
+               frame.data[7]));
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(total);
+  return elapsed;
+}
+
+// Per-ID statistics update for 8 buses, one TrafficStatistics each as with
+// one loop per bus; frames come from the default traffic mix
+uint64_t bench_traffic_statistics(uint64_t iterations, uint64_t&) {
+  constexpr size_t kBuses  = 8;
+  constexpr size_t kFrames = 4096;
+  std::vector<can_frame> frames(kFrames);
+  TrafficGenerator generator(TrafficProfile::default_mix());
+  generator.start(0);
+  for (size_t n = 0; n < kFrames;)
+    n += generator.poll(UINT64_MAX, &frames[n], kFrames - n);
+
+  std::vector<std::unique_ptr<TrafficStatistics>> stats;
+  for (size_t i = 0; i < kBuses; ++i)
+    stats.emplace_back(new TrafficStatistics());
+  uint64_t start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i)
+    stats[i % kBuses]->record(frames[i % kFrames], start + i * 100);
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(stats[0]->frames());
+  return elapsed;
+}
+
+// Exact frame length (CRC-15 + table-driven stuffing) and the sliding-window
+// update, per received frame
+uint64_t bench_bus_load(uint64_t iterations, uint64_t&) {
+  BusLoadEstimator estimator(500000);
+  can_frame        frame = make_frame(0);
+  uint64_t         start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    frame.data[0] = static_cast<uint8_t>(i);
+    frame.can_id  = 0x100 + (i & 0x3FF);
+    estimator.add(frame, start + i * 200);
+  }
+  uint64_t elapsed = bench_now_ns() - start;
+  bench_do_not_optimize(estimator.busy_ns());
+  return elapsed;
+}
+
+// Rules and a batch of 64 frames from the default traffic mix for the
+// filter benchmarks; a quarter of the rules are ranges, the rest exact IDs
+std::vector<can_filter> filter_rules(size_t count) {
+  std::vector<can_filter> rules;
+  for (size_t i = 0; i < count; ++i) {
+    canid_t id = 0x100 + static_cast<canid_t>(i) * 0x11;
+    rules.push_back(i % 4 ? can_filter{id, CAN_EFF_FLAG | CAN_SFF_MASK}
+                          : can_filter{id, CAN_EFF_FLAG | 0x7F0});
+  }
+  return rules;
+}
+
+std::vector<can_frame> filter_frames() {
+  std::vector<can_frame> frames(64);
+  TrafficGenerator       generator(TrafficProfile::default_mix());
+  generator.start(0);
+  for (size_t n = 0; n < frames.size();)
+    n += generator.poll(UINT64_MAX, &frames[n], frames.size() - n);
+  return frames;
+}
+
+// One batch of 64 frames per operation, each frame checked against every
+// rule in turn, into the same per-rule bitmaps
+uint64_t bench_filter_loop(size_t rule_count, uint64_t iterations, uint64_t&) {
+  std::vector<can_filter> rules  = filter_rules(rule_count);
+  std::vector<can_frame>  frames = filter_frames();
+  std::vector<uint64_t>   bits(rule_count);
+  uint64_t                start  = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    std::fill(bits.begin(), bits.end(), 0);
+    for (size_t f = 0; f < frames.size(); ++f) {
+      for (size_t r = 0; r < rules.size(); ++r) {
+        if ((frames[f].can_id & rules[r].can_mask) ==
+            (rules[r].can_id & rules[r].can_mask))
+          bits[r] |= 1ull << f;
+      }
+    }
+    bench_do_not_optimize(bits[0]);
+  }
+  return bench_now_ns() - start;
+}
+
+// Same batch already in a FrameBatch, classified by `kernel`
+uint64_t bench_filter_kernel(FilterKernel kernel,
+                             size_t       rule_count,
+                             uint64_t     iterations,
+                             uint64_t&) {
+  FrameFilterSet filters(filter_rules(rule_count));
+  filters.set_kernel(kernel);
+  std::vector<can_frame> frames = filter_frames();
+  FrameBatch             batch;
+  batch.assign(frames.data(), frames.size());
+  FilterResult result;
+  uint64_t     start = bench_now_ns();
+  for (uint64_t i = 0; i < iterations; ++i) {
+    filters.classify(batch, result);
+    bench_do_not_optimize(result.bits(0)[0]);
+  }
+  return bench_now_ns() - start;
+}
+
+bool interface_present(const std::string& iface) {
+  return if_nametoindex(iface.c_str()) != 0;
+}
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options]" << std::endl;
+  std::cout << "  -i <iface>   kernel interface for RX/TX benchmarks (default: "
+               "vcan0, skipped when missing)"
+            << std::endl;
+  std::cout << "  -f <filter>  only run benchmarks whose name/transport "
+               "contains <filter>"
+            << std::endl;
+  std::cout << "  -t <sec>     minimum time per benchmark (default: 0.2)"
+            << std::endl;
+  std::cout << "  -o <file>    write JSON results to <file> (default: stdout)"
+            << std::endl;
+  std::cout << "  -q           quick run (0.01 s per benchmark)" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::string iface  = "vcan0";
+  std::string filter = "";
+  std::string output = "";
+  double      min_s  = 0.2;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:f:t:o:qh")) != -1) {
+    switch (opt) {
+      case 'i':
+        iface = optarg;
+        break;
+      case 'f':
+        filter = optarg;
+        break;
+      case 't':
+        min_s = std::atof(optarg);
+        break;
+      case 'o':
+        output = optarg;
+        break;
+      case 'q':
+        min_s = 0.01;
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+
+  BenchRunner runner(min_s, filter);
+  runner.run("event_round_trip", "none", bench_event_round_trip);
+  runner.run("dispatch_ready_fd", "none", bench_dispatch_ready_fd);
+  runner.run("frame_processor_call", "none", bench_frame_processor, 100000);
+  runner.run("format_candump", "none", bench_format_candump, 100000);
+  runner.run("format_human", "none", bench_format_human, 100000);
+  runner.run("format_snprintf", "none", bench_format_snprintf, 100000);
+  runner.run("traffic_statistics_8_buses",
+             "none",
+             bench_traffic_statistics,
+             100000);
+  runner.run("bus_load_exact_bits", "none", bench_bus_load, 100000);
+  runner.run("rx_dispatch_intf", "socketpair", bench_rx_dispatch_intf);
+  runner.run("rx_dispatch_function", "socketpair", bench_rx_dispatch_function);
+  runner.run("rx_dispatch_inlined", "socketpair", bench_rx_dispatch_inlined);
+  runner.run("rx_dispatch_inlined_stats_timestamps",
+             "socketpair",
+             bench_rx_dispatch_inlined_ts);
+  for (size_t rules : {4, 16, 64}) {
+    std::string suffix = "_" + std::to_string(rules) + "_rules";
+    runner.run("filter_loop" + suffix, "none",
+               [rules](uint64_t n, uint64_t& ops) {
+                 return bench_filter_loop(rules, n, ops);
+               });
+    for (FilterKernel kernel :
+         {FilterKernel::kScalar, FilterKernel::kSse2, FilterKernel::kAvx2}) {
+      if (!filter_kernel_supported(kernel))
+        continue;
+      runner.run(std::string("filter_") + filter_kernel_name(kernel) + suffix,
+                 "none", [kernel, rules](uint64_t n, uint64_t& ops) {
+                   return bench_filter_kernel(kernel, rules, n, ops);
+                 });
+    }
+  }
+
+  std::vector<std::string> transports = {"vbus:bench"};
+  if (interface_present(iface))
+    transports.push_back(iface);
+  else
+    std::cerr << iface << " not present, skipping kernel transport"
+              << std::endl;
+  for (const std::string& transport : transports) {
+    runner.run("rx_frames", transport, [&transport](uint64_t n, uint64_t& ops) {
+      return bench_rx(transport, n, ops);
+    });
+    runner.run("tx_frames", transport, [&transport](uint64_t n, uint64_t& ops) {
+      return bench_tx(transport, n, ops);
+    });
+  }
+
+  FILE* out = output.empty() ? stdout : fopen(output.c_str(), "w");
+  if (!out) {
+    std::cerr << "Cannot open " << output << std::endl;
+    return 1;
+  }
+  runner.write_json(out, "socket_can_bench");
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
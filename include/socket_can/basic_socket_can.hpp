@@ -0,0 +1,293 @@
+#pragma once
+
+#include "socket_can/can_datagram.hpp"
+#include "socket_can/can_transport.hpp"
+#include "socket_can/epoll_event_loop.hpp"
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Compile-time options of BasicSocketCan, in any order
+
+// Reads up to N frames per recvmmsg; without it, one recv per frame
+template <size_t N>
+struct CanBatching {
+  static_assert(N >= 1 && N <= 64, "1 to 64 frames per batch");
+  static constexpr size_t kBatch = N;
+};
+// The handler is called as handler(frame, timestamp_ns) with the kernel
+// receive time (SO_TIMESTAMPNS, CLOCK_REALTIME)
+struct CanTimestamps {};
+// Frames are canfd_frame (CAN_RAW_FD_FRAMES, SocketCAN interfaces only).
+// Received FD frames carry CANFD_FDF; a frame is sent as FD when it has
+// CANFD_FDF or more than 8 bytes.
+struct CanFd {};
+// Counts frames, batches and errors, see stats()
+struct CanStatistics {};
+
+struct CanIntfStats {
+  uint64_t rx_frames  = 0;
+  uint64_t rx_batches = 0;  // receive syscalls that returned frames
+  uint64_t tx_frames  = 0;
+  uint64_t errors     = 0;
+};
+struct CanNoStats {};
+
+namespace socket_can_detail {
+
+template <typename Policy, typename... Policies>
+constexpr bool has_policy = (std::is_same_v<Policy, Policies> || ...);
+
+template <typename... Policies>
+struct BatchSize {
+  static constexpr size_t value = 1;
+};
+template <size_t N, typename... Rest>
+struct BatchSize<CanBatching<N>, Rest...> {
+  static constexpr size_t value = N;
+};
+template <typename First, typename... Rest>
+struct BatchSize<First, Rest...> : BatchSize<Rest...> {};
+
+struct NoControl {};
+
+}  // namespace socket_can_detail
+
+// SocketCanIntf with its options fixed at compile time. The handler is held
+// by value and called directly from the receive loop, so a lambda is inlined
+// there instead of going through a std::function per frame; features not
+// selected by a policy leave no code or state behind. The event loop still
+// calls in once per wakeup.
+//
+//   auto on_frame = [&](const can_frame& frame) { ... };
+//   BasicSocketCan<decltype(on_frame), CanBatching<16>> intf(on_frame);
+//   intf.init("can0", &loop);
+//
+// Without the recovery, error frame decoding and metrics of SocketCanIntf:
+// EPOLLERR closes the interface. Frames are sent and read with the same
+// datagram helpers (can_datagram.hpp) as SocketCanIntf's transports.
+template <typename Handler, typename... Policies>
+class BasicSocketCan {
+public:
+  static constexpr size_t kBatch =
+    socket_can_detail::BatchSize<Policies...>::value;
+  static constexpr bool kTimestamps =
+    socket_can_detail::has_policy<CanTimestamps, Policies...>;
+  static constexpr bool kFd =
+    socket_can_detail::has_policy<CanFd, Policies...>;
+  static constexpr bool kStatistics =
+    socket_can_detail::has_policy<CanStatistics, Policies...>;
+
+  using Frame = std::conditional_t<kFd, canfd_frame, can_frame>;
+  using Stats = std::conditional_t<kStatistics, CanIntfStats, CanNoStats>;
+
+  explicit BasicSocketCan(Handler handler = Handler())
+    : handler_(std::move(handler)) {
+    for (size_t i = 0; i < kBatch; ++i) {
+      socket_can_detail::prepare_datagram(msgs_[i], iovs_[i], &rx_[i],
+                                          sizeof(Frame));
+      if constexpr (kTimestamps)
+        msgs_[i].msg_hdr.msg_control = control_[i].data();
+    }
+  }
+  ~BasicSocketCan() {
+    deinit();
+  }
+  BasicSocketCan(const BasicSocketCan&)            = delete;
+  BasicSocketCan& operator=(const BasicSocketCan&) = delete;
+
+  // Same interface names as SocketCanIntf::init()
+  bool init(const std::string& interface, EpollEventLoop* event_loop) {
+    std::unique_ptr<CanTransport> transport = make_can_transport(interface);
+    if (!transport->open(interface))
+      return false;
+    return init(std::move(transport), event_loop);
+  }
+  // Uses an already opened transport; frames are read from its descriptor
+  // as one datagram each
+  bool init(std::unique_ptr<CanTransport> transport,
+            EpollEventLoop*               event_loop) {
+    transport_  = std::move(transport);
+    event_loop_ = event_loop;
+    fd_         = transport_->fd();
+    int enable  = 1;
+    if constexpr (kFd) {
+      if (setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &enable,
+                     sizeof(enable)) != 0) {
+        std::cerr << "Failed to enable CAN FD frames: " << strerror(errno)
+                  << std::endl;
+        deinit();
+        return false;
+      }
+    }
+    if constexpr (kTimestamps) {
+      if (setsockopt(fd_, SOL_SOCKET, SO_TIMESTAMPNS, &enable,
+                     sizeof(enable)) != 0) {
+        std::cerr << "Failed to enable timestamps: " << strerror(errno)
+                  << std::endl;
+        deinit();
+        return false;
+      }
+    }
+    if (!event_loop_->register_event(
+          &evt_, fd_, EPOLLIN,
+          [this](uint32_t mask) { on_socket_event(mask); })) {
+      std::cerr << "Failed to register socket with event loop" << std::endl;
+      deinit();
+      return false;
+    }
+    return true;
+  }
+
+  void deinit() {
+    if (evt_) {
+      event_loop_->deregister_event(evt_);
+      evt_ = nullptr;
+    }
+    if (transport_) {
+      transport_->close();
+      transport_.reset();
+    }
+    fd_ = -1;
+  }
+
+  // Non-blocking; false with errno EAGAIN/ENOBUFS when the TX queue is full
+  bool send(const Frame& frame) {
+    if (fd_ < 0)
+      return false;
+    if (!socket_can_detail::send_datagram(fd_, frame)) {
+      if constexpr (kStatistics) {
+        if (!socket_can_detail::tx_queue_full(errno))
+          stats_.errors++;
+      }
+      return false;
+    }
+    if constexpr (kStatistics)
+      stats_.tx_frames++;
+    return true;
+  }
+  // Sends in order until the TX queue is full; returns the number sent
+  size_t send_frames(const Frame* frames, size_t count) {
+    if (fd_ < 0)
+      return 0;
+    int    error;
+    size_t n_sent =
+      socket_can_detail::send_datagrams(fd_, frames, count, error);
+    if constexpr (kStatistics) {
+      stats_.tx_frames += n_sent;
+      stats_.errors += error != 0;
+    }
+    return n_sent;
+  }
+
+  bool set_filters(const std::vector<can_filter>& filters) {
+    return transport_ &&
+           transport_->set_filters(filters.data(), filters.size());
+  }
+
+  const Stats& stats() const {
+    return stats_;
+  }
+  Handler& handler() {
+    return handler_;
+  }
+
+private:
+  // Room for SCM_TIMESTAMPNS
+  using Control = std::array<char, CMSG_SPACE(sizeof(struct timespec))>;
+
+  static uint64_t timestamp_ns(struct msghdr& header) {
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&header); cmsg;
+         cmsg                 = CMSG_NXTHDR(&header, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET &&
+          cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+        struct timespec ts;
+        std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+               static_cast<uint64_t>(ts.tv_nsec);
+      }
+    }
+    return 0;
+  }
+
+  void on_socket_event(uint32_t mask) {
+    if (mask & EPOLLIN) {
+      int n;
+      do {
+        n = receive_batch();
+      } while (n == static_cast<int>(kBatch) && fd_ >= 0);
+    }
+    if (fd_ >= 0 && (mask & (EPOLLERR | EPOLLHUP))) {
+      if constexpr (kStatistics)
+        stats_.errors++;
+      std::cerr << "interface disappeared" << std::endl;
+      deinit();
+    }
+  }
+
+  // Reads one batch and hands it to the handler; returns the number of
+  // datagrams read, 0 when none were pending
+  int receive_batch() {
+    int n;
+    if constexpr (kBatch == 1 && !kTimestamps) {
+      n = socket_can_detail::receive_datagram(fd_, &rx_[0], sizeof(Frame),
+                                              msgs_[0].msg_len);
+    } else {
+      if constexpr (kTimestamps) {
+        for (size_t i = 0; i < kBatch; ++i)
+          msgs_[i].msg_hdr.msg_controllen = sizeof(Control);
+      }
+      n = socket_can_detail::receive_datagrams(fd_, msgs_, kBatch);
+    }
+    if (n < 0) {
+      if constexpr (kStatistics)
+        stats_.errors++;
+      return -1;
+    }
+
+    for (int i = 0; i < n && fd_ >= 0; ++i) {
+      Frame& frame = rx_[i];
+      if (!socket_can_detail::accept_datagram(frame, msgs_[i].msg_len)) {
+        if constexpr (kStatistics)
+          stats_.errors++;
+        continue;
+      }
+      if constexpr (kStatistics)
+        stats_.rx_frames++;
+      if constexpr (kTimestamps)
+        handler_(frame, timestamp_ns(msgs_[i].msg_hdr));
+      else
+        handler_(frame);
+    }
+    if constexpr (kStatistics)
+      stats_.rx_batches += n > 0;
+    return n;
+  }
+
+  Handler                       handler_;
+  std::unique_ptr<CanTransport> transport_;
+  EpollEventLoop*               event_loop_ = nullptr;
+  EpollEventLoop::EvtId         evt_        = nullptr;
+  int                           fd_         = -1;
+  Stats                         stats_;
+
+  // Receive buffers, set up once
+  std::array<Frame, kBatch>          rx_;
+  std::array<struct iovec, kBatch>   iovs_;
+  struct mmsghdr                     msgs_[kBatch];
+  std::conditional_t<kTimestamps,
+                     std::array<Control, kBatch>,
+                     socket_can_detail::NoControl>
+    control_;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Single-buffer file writer. Callers format straight into the buffer through
+// reserve()/commit(), so steady-state writing performs no allocation and one
+// write() per buffer fill.
+class BufferedFileWriter {
+public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+
+  explicit BufferedFileWriter(size_t capacity = kDefaultCapacity);
+  ~BufferedFileWriter();
+
+  BufferedFileWriter(const BufferedFileWriter&)            = delete;
+  BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+  bool open(const std::string& path);
+  // Writes to an already open descriptor, e.g. STDOUT_FILENO. close() flushes
+  // but leaves the descriptor open.
+  bool attach(int fd);
+  bool close();
+  bool is_open() const {
+    return fd_ >= 0;
+  }
+
+  // Returns room for at least n bytes (n <= capacity), flushing first if
+  // needed. Returns nullptr if the flush failed.
+  char* reserve(size_t n) {
+    if (capacity_ - size_ < n && !flush())
+      return nullptr;
+    return buffer_ + size_;
+  }
+  void commit(size_t n) {
+    size_ += n;
+  }
+
+  bool append(const void* data, size_t n);
+  bool flush();
+
+  // Overwrites already written bytes, e.g. to patch a file header on close
+  bool write_at(uint64_t offset, const void* data, size_t n);
+
+  uint64_t position() const {
+    return written_ + size_;
+  }
+
+private:
+  int      fd_      = -1;
+  bool     owns_fd_ = true;
+  char*    buffer_;
+  size_t   capacity_;
+  size_t   size_    = 0;
+  uint64_t written_ = 0;
+};
+
+// Single-buffer file reader for line-oriented and record-oriented formats.
+// Returned views point into the internal buffer and stay valid until the next
+// call.
+class BufferedFileReader {
+public:
+  static constexpr size_t kDefaultCapacity = 1 << 20;
+
+  explicit BufferedFileReader(size_t capacity = kDefaultCapacity);
+  ~BufferedFileReader();
+
+  BufferedFileReader(const BufferedFileReader&)            = delete;
+  BufferedFileReader& operator=(const BufferedFileReader&) = delete;
+
+  bool open(const std::string& path);
+  void close();
+  bool is_open() const {
+    return fd_ >= 0;
+  }
+
+  // Next line without its terminator ("\n" or "\r\n")
+  bool read_line(const char** begin, const char** end);
+
+  bool read_exact(void* dst, size_t n);
+  bool skip(size_t n);
+
+private:
+  bool fill();
+
+  int    fd_ = -1;
+  char*  buffer_;
+  size_t capacity_;
+  size_t begin_ = 0;
+  size_t end_   = 0;
+  bool   eof_   = false;
+};
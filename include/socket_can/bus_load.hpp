@@ -0,0 +1,91 @@
+#pragma once
+
+#include <linux/can.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Sum of values over a sliding time window, kept in a ring of fixed-width
+// buckets. add() is O(1): it only ever touches the bucket of its timestamp,
+// resetting it when the ring has wrapped. One thread adds; sum() may be
+// called from any thread.
+class SlidingWindowSum {
+public:
+  SlidingWindowSum(uint64_t window_ns, size_t buckets = 10);
+
+  void add(uint64_t timestamp_ns, uint64_t value) {
+    // Consecutive frames almost always fall in the same bucket
+    if (timestamp_ns - current_start_ >= bucket_ns_)
+      advance(timestamp_ns);
+    Bucket& bucket = buckets_[current_index_];
+    bucket.sum.store(bucket.sum.load(std::memory_order_relaxed) + value,
+                     std::memory_order_release);
+  }
+
+  // Sum over the buckets that overlap (now - window, now]; `covered_ns`
+  // receives the time they span, up to `now_ns`
+  uint64_t sum(uint64_t now_ns, uint64_t* covered_ns = nullptr) const;
+
+  uint64_t window_ns() const {
+    return bucket_ns_ * n_buckets_;
+  }
+
+private:
+  struct Bucket {
+    std::atomic<uint64_t> start{UINT64_MAX};
+    std::atomic<uint64_t> sum{0};
+  };
+
+  void advance(uint64_t timestamp_ns);
+
+  const uint64_t            bucket_ns_;
+  const size_t              n_buckets_;
+  std::unique_ptr<Bucket[]> buckets_;
+  uint64_t                  current_start_ = UINT64_MAX / 2;  // writer side
+  size_t                    current_index_ = 0;
+};
+
+// Bus load of one interface: each frame's time on the wire (stuff bits
+// included, CAN FD data phase at the data bitrate) summed over sliding
+// windows of 100 ms, 1 s and 10 s. Loads are fractions of the wall time.
+// Classic frames use their exact length, or the cheaper worst-case bound
+// when `exact_stuffing` is false.
+class BusLoadEstimator {
+public:
+  static constexpr size_t   kWindows = 3;
+  static constexpr uint64_t kWindowNs[kWindows] = {
+    100000000ull, 1000000000ull, 10000000000ull};
+
+  explicit BusLoadEstimator(uint32_t bitrate,
+                            uint32_t data_bitrate   = 0,
+                            bool     exact_stuffing = true);
+
+  // `timestamp_ns` is monotonic (CLOCK_MONOTONIC); error frames are ignored
+  void add(const can_frame& frame, uint64_t timestamp_ns);
+  void add(const canfd_frame& frame, uint64_t timestamp_ns);
+
+  // Any thread; 0-1 over window `window` (index into kWindowNs)
+  double load(size_t window, uint64_t now_ns) const;
+
+  uint32_t bitrate() const {
+    return bitrate_;
+  }
+  uint32_t data_bitrate() const {
+    return data_bitrate_;
+  }
+  // Total time frames spent on the wire since creation
+  uint64_t busy_ns() const {
+    return busy_ns_.load(std::memory_order_relaxed);
+  }
+
+private:
+  void add_busy(uint64_t busy_ns, uint64_t timestamp_ns);
+
+  const uint32_t        bitrate_;
+  const uint32_t        data_bitrate_;
+  const bool            exact_stuffing_;
+  SlidingWindowSum      windows_[kWindows];
+  std::atomic<uint64_t> busy_ns_{0};
+  std::atomic<uint64_t> first_ns_{0};
+};
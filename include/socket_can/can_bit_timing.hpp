@@ -0,0 +1,53 @@
+#pragma once
+
+#include <linux/can.h>
+#include <cstdint>
+
+// Wire-level properties of classic CAN frames, used to pace and arbitrate
+// simulated buses.
+
+// Upper bound on the bits a frame occupies on the bus: header, data, CRC, ACK,
+// EOF, 3 bits of intermission and the worst-case number of stuff bits
+// (Davis et al., "Controller Area Network (CAN) schedulability analysis").
+inline uint32_t can_frame_bits_worst_case(const can_frame& frame) {
+  uint32_t data_bits =
+    8u * (frame.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame.can_dlc);
+  if (frame.can_id & CAN_RTR_FLAG)
+    data_bits = 0;
+  uint32_t stuffed = (frame.can_id & CAN_EFF_FLAG ? 54u : 34u) + data_bits;
+  return stuffed + 13u + (stuffed - 1u) / 4u;
+}
+
+// Exact number of bits the frame occupies on the bus: the frame is serialized
+// with its CRC-15 and the stuff bits counted (table-driven, a byte at a
+// time), plus CRC delimiter, ACK, EOF and 3 bits of intermission
+uint32_t can_frame_bits_exact(const can_frame& frame);
+
+// CAN-15 CRC of the first `bits` bits of `data` (most significant bit first)
+uint16_t can_crc15(const uint8_t* data, uint32_t bits);
+
+inline uint64_t can_frame_duration_ns(uint32_t bits, uint32_t bitrate) {
+  return bitrate ? static_cast<uint64_t>(bits) * 1000000000ull / bitrate : 0;
+}
+
+// Time a CAN FD frame occupies the bus. The arbitration phase and the
+// trailer (ACK, EOF, intermission) run at `nominal_bitrate`; ESI, DLC, data,
+// stuff count and CRC run at `data_bitrate` when the frame has CANFD_BRS.
+// Dynamic stuff bits are counted worst case, the fixed stuff bits of the
+// CRC field exactly.
+uint64_t canfd_frame_duration_ns(const canfd_frame& frame,
+                                 uint32_t           nominal_bitrate,
+                                 uint32_t           data_bitrate);
+
+// Orders frames like bitwise arbitration: the lower key wins. Bits follow the
+// wire order of the arbitration field: 11-bit base ID, RTR (standard) or SRR
+// (extended, always recessive), IDE, 18-bit ID extension, RTR (extended).
+inline uint32_t can_arbitration_key(const can_frame& frame) {
+  bool rtr = (frame.can_id & CAN_RTR_FLAG) != 0;
+  if (frame.can_id & CAN_EFF_FLAG) {
+    uint32_t id = frame.can_id & CAN_EFF_MASK;
+    return (id >> 18) << 21 | 1u << 20 | 1u << 19 | (id & 0x3FFFF) << 1 |
+           (rtr ? 1u : 0u);
+  }
+  return (frame.can_id & CAN_SFF_MASK) << 21 | (rtr ? 1u << 20 : 0u);
+}
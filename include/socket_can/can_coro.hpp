@@ -0,0 +1,386 @@
+#pragma once
+
+// C++20 coroutines driven by EpollEventLoop. Built as the SocketCANCoro
+// library when the compiler supports them; the core library stays C++17.
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/socket_can.hpp"
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Size-class free lists for coroutine frames, one set per thread. Freed
+// frames are kept for reuse, so once warmed up, starting a coroutine does
+// not reach the heap. Frames above kMaxPooledSize use operator new.
+class CoFramePool {
+public:
+  static constexpr size_t kGranularity   = 64;
+  static constexpr size_t kMaxPooledSize = 4096;
+
+  static void* allocate(size_t size);
+  static void  deallocate(void* frame, size_t size);
+
+  // Blocks this thread's pool took from the heap so far
+  static uint64_t heap_allocations();
+};
+
+template <typename T>
+class CoTask;
+
+struct CoPromiseBase {
+  std::coroutine_handle<> continuation;
+  bool                    detached = false;
+
+  static void* operator new(size_t size) {
+    return CoFramePool::allocate(size);
+  }
+  static void operator delete(void* frame, size_t size) {
+    CoFramePool::deallocate(frame, size);
+  }
+
+  // Resumes whoever awaited the task, or frees a detached one
+  struct FinalAwaiter {
+    bool await_ready() noexcept {
+      return false;
+    }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<Promise> handle) noexcept {
+      CoPromiseBase& promise = handle.promise();
+      if (promise.continuation)
+        return promise.continuation;
+      if (promise.detached)
+        handle.destroy();
+      return std::noop_coroutine();
+    }
+    void await_resume() noexcept {
+    }
+  };
+
+  std::suspend_always initial_suspend() noexcept {
+    return {};
+  }
+  FinalAwaiter final_suspend() noexcept {
+    return {};
+  }
+  // The library does not use exceptions
+  void unhandled_exception() {
+    std::terminate();
+  }
+};
+
+template <typename T>
+struct CoPromise : CoPromiseBase {
+  std::optional<T> value;
+
+  CoTask<T> get_return_object();
+  void      return_value(T result) {
+    value.emplace(std::move(result));
+  }
+};
+
+template <>
+struct CoPromise<void> : CoPromiseBase {
+  CoTask<void> get_return_object();
+  void         return_void() {
+  }
+};
+
+// Lazily started coroutine. Awaiting it runs it to completion and resumes
+// the awaiter by symmetric transfer; CoScheduler::spawn() runs it detached.
+template <typename T = void>
+class CoTask {
+public:
+  using promise_type = CoPromise<T>;
+  using Handle       = std::coroutine_handle<promise_type>;
+
+  explicit CoTask(Handle handle) : handle_(handle) {
+  }
+  CoTask(CoTask&& other) noexcept : handle_(std::exchange(other.handle_, {})) {
+  }
+  CoTask& operator=(CoTask&& other) noexcept {
+    if (this != &other) {
+      if (handle_)
+        handle_.destroy();
+      handle_ = std::exchange(other.handle_, {});
+    }
+    return *this;
+  }
+  CoTask(const CoTask&)            = delete;
+  CoTask& operator=(const CoTask&) = delete;
+  ~CoTask() {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  bool await_ready() const noexcept {
+    return false;
+  }
+  std::coroutine_handle<> await_suspend(
+    std::coroutine_handle<> awaiter) noexcept {
+    handle_.promise().continuation = awaiter;
+    return handle_;
+  }
+  T await_resume() {
+    if constexpr (!std::is_void_v<T>)
+      return std::move(*handle_.promise().value);
+  }
+
+  bool done() const {
+    return !handle_ || handle_.done();
+  }
+  // Gives up ownership; the caller starts or destroys the coroutine
+  Handle release() {
+    return std::exchange(handle_, {});
+  }
+
+private:
+  Handle handle_;
+};
+
+template <typename T>
+CoTask<T> CoPromise<T>::get_return_object() {
+  return CoTask<T>(CoTask<T>::Handle::from_promise(*this));
+}
+
+inline CoTask<void> CoPromise<void>::get_return_object() {
+  return CoTask<void>(CoTask<void>::Handle::from_promise(*this));
+}
+
+// Deadline in a CoScheduler's timer heap. Awaiters embed it, so arming a
+// timeout does not allocate.
+struct CoTimer {
+  uint64_t deadline_ns = 0;  // CLOCK_MONOTONIC
+  size_t   heap_index  = SIZE_MAX;
+  // Runs on the loop thread after the timer left the heap
+  void (*expire)(CoTimer* timer) = nullptr;
+
+  bool armed() const {
+    return heap_index != SIZE_MAX;
+  }
+};
+
+// Timers and detached tasks of one EpollEventLoop: a binary heap of CoTimer
+// behind a single timerfd, re-armed only when the earliest deadline changes.
+// Everything runs on the loop's thread.
+class CoScheduler {
+public:
+  explicit CoScheduler(EpollEventLoop* event_loop);
+  ~CoScheduler();
+
+  CoScheduler(const CoScheduler&)            = delete;
+  CoScheduler& operator=(const CoScheduler&) = delete;
+
+  // The scheduler most recently created on this thread, for sleep_for()
+  static CoScheduler* current();
+  static uint64_t     now_ns();
+
+  // Runs `task` until its first suspension; it then continues from the
+  // event loop and frees its frame when it finishes
+  void spawn(CoTask<void> task);
+
+  class SleepAwaiter : public CoTimer {
+  public:
+    SleepAwaiter(CoScheduler* scheduler, uint64_t deadline_ns)
+      : scheduler_(scheduler) {
+      this->deadline_ns = deadline_ns;
+    }
+    // Destroying a suspended coroutine drops its timer
+    ~SleepAwaiter() {
+      if (armed())
+        scheduler_->cancel_timer(*this);
+    }
+    bool await_ready() const {
+      return deadline_ns <= now_ns();
+    }
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+      expire  = [](CoTimer* timer) {
+        static_cast<SleepAwaiter*>(timer)->handle_.resume();
+      };
+      scheduler_->add_timer(*this);
+    }
+    void await_resume() const {
+    }
+
+  private:
+    CoScheduler*            scheduler_;
+    std::coroutine_handle<> handle_;
+  };
+
+  SleepAwaiter sleep_for(std::chrono::nanoseconds duration) {
+    return SleepAwaiter(this, now_ns() + static_cast<uint64_t>(
+                                           duration.count() > 0
+                                             ? duration.count()
+                                             : 0));
+  }
+
+  void add_timer(CoTimer& timer);
+  void cancel_timer(CoTimer& timer);
+  size_t pending_timers() const {
+    return heap_.size();
+  }
+
+private:
+  void on_timer(uint32_t mask);
+  void arm();
+  void sift_up(size_t index);
+  void sift_down(size_t index);
+  void place(size_t index, CoTimer* timer) {
+    heap_[index]       = timer;
+    timer->heap_index  = index;
+  }
+
+  EpollEventLoop*       event_loop_;
+  EpollEventLoop::EvtId evt_     = nullptr;
+  int                   timerfd_ = -1;
+  uint64_t              armed_ns_ = UINT64_MAX;  // what the timerfd is set to
+  std::vector<CoTimer*> heap_;
+};
+
+// co_await sleep_for(10ms) on the thread's CoScheduler
+inline CoScheduler::SleepAwaiter sleep_for(std::chrono::nanoseconds duration) {
+  return CoScheduler::current()->sleep_for(duration);
+}
+
+// ID match for awaiting frames: exact by default (flags included), or a
+// can_filter-style id/mask pair
+struct CanIdMatch {
+  canid_t id;
+  canid_t mask;
+
+  CanIdMatch(canid_t can_id) : id(can_id), mask(exact_mask(can_id)) {
+  }
+  CanIdMatch(canid_t can_id, canid_t id_mask) : id(can_id), mask(id_mask) {
+  }
+
+  static canid_t exact_mask(canid_t can_id) {
+    return CAN_EFF_FLAG | CAN_RTR_FLAG |
+           (can_id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK);
+  }
+  // Key exact matches are indexed by
+  static canid_t key_of(canid_t can_id) {
+    return can_id & exact_mask(can_id);
+  }
+  bool exact() const {
+    return mask == exact_mask(id);
+  }
+  bool matches(canid_t can_id) const {
+    return ((can_id ^ id) & mask) == 0;
+  }
+};
+
+// Coroutine front end of a SocketCanIntf. Awaiting coroutines are indexed
+// by exact ID (or kept in one list for masked matches), so a frame only
+// visits its own waiters; every waiter whose match accepts the frame gets a
+// copy. The FrameProcessor passed to init() still sees every frame, so
+// callback code keeps working alongside.
+class CoCanBus {
+public:
+  explicit CoCanBus(CoScheduler& scheduler) : scheduler_(scheduler) {
+  }
+  ~CoCanBus();
+
+  CoCanBus(const CoCanBus&)            = delete;
+  CoCanBus& operator=(const CoCanBus&) = delete;
+
+  bool init(const std::string& interface,
+            EpollEventLoop*    event_loop,
+            FrameProcessor     frame_processor = nullptr);
+  // Pending awaits resume with std::nullopt, and so do awaits started
+  // afterwards, without suspending
+  void deinit();
+  // True after deinit(), to tell shutdown from a timeout
+  bool closed() const {
+    return closed_;
+  }
+
+  bool send(const can_frame& frame) {
+    return intf_.send_can_frame(frame);
+  }
+  SocketCanIntf& intf() {
+    return intf_;
+  }
+
+  class FrameAwaiter : public CoTimer {
+  public:
+    // Destroying a suspended coroutine withdraws its await
+    ~FrameAwaiter() {
+      if (linked_)
+        bus_->unlink(*this);
+      if (armed())
+        bus_->scheduler_.cancel_timer(*this);
+    }
+
+    bool await_ready() const {
+      return false;
+    }
+    bool await_suspend(std::coroutine_handle<> handle);
+    std::optional<can_frame> await_resume() const {
+      if (!received_)
+        return std::nullopt;
+      return frame_;
+    }
+
+  private:
+    friend class CoCanBus;
+
+    FrameAwaiter(CoCanBus* bus, CanIdMatch match, uint64_t timeout_ns)
+      : bus_(bus), match_(match), timeout_ns_(timeout_ns) {
+    }
+
+    CoCanBus*               bus_;
+    CanIdMatch              match_;
+    uint64_t                timeout_ns_;
+    can_frame               tx_     = {};
+    bool                    has_tx_ = false;
+    bool                    received_ = false;
+    bool                    linked_   = false;
+    bool                    sending_  = false;  // within request()'s send
+    can_frame               frame_    = {};
+    std::coroutine_handle<> handle_;
+    FrameAwaiter*           prev_ = nullptr;  // waiter list links
+    FrameAwaiter*           next_ = nullptr;
+  };
+
+  // Next frame accepted by `match`; std::nullopt after `timeout` (zero
+  // waits forever) or deinit()
+  FrameAwaiter next_frame(CanIdMatch               match,
+                          std::chrono::nanoseconds timeout = {});
+  // Sends `tx` and waits for the first frame accepted by `rx_match`; the
+  // waiter is registered first, so a fast response is not missed.
+  // std::nullopt when the send fails, on timeout or deinit().
+  FrameAwaiter request(const can_frame&         tx,
+                       CanIdMatch               rx_match,
+                       std::chrono::nanoseconds timeout);
+
+  size_t pending() const {
+    return pending_;
+  }
+
+private:
+  struct WaiterList {
+    FrameAwaiter* head = nullptr;
+    FrameAwaiter* tail = nullptr;
+  };
+
+  WaiterList& list_for(const CanIdMatch& match);
+  void        link(FrameAwaiter& waiter);
+  void        unlink(FrameAwaiter& waiter);
+  void        on_frame(const can_frame& frame);
+
+  CoScheduler&                            scheduler_;
+  SocketCanIntf                           intf_;
+  FrameProcessor                          frame_processor_;
+  std::unordered_map<canid_t, WaiterList> exact_;
+  WaiterList                              masked_;
+  size_t                                  pending_ = 0;
+  bool                                    closed_  = false;
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <linux/can.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+// Frame I/O on a socket that carries one frame per datagram (raw PF_CAN
+// sockets, the virtual bus), for can_frame and canfd_frame. Shared by
+// DatagramCanTransport, which SocketCanIntf reads and writes through, and
+// BasicSocketCan, so both go through the same send and receive code.
+namespace socket_can_detail {
+
+// Frames per sendmmsg / recvmmsg
+constexpr size_t kMaxDatagramBatch = 64;
+
+inline bool tx_queue_full(int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS;
+}
+
+// Bytes on the wire: CAN_MTU, or CANFD_MTU for FD frames
+inline size_t datagram_size(const can_frame&) {
+  return CAN_MTU;
+}
+inline size_t datagram_size(const canfd_frame& frame) {
+  return (frame.flags & CANFD_FDF) || frame.len > CAN_MAX_DLEN ? CANFD_MTU
+                                                               : CAN_MTU;
+}
+
+// Whether a received datagram of `length` bytes is a whole frame; FD frames
+// are marked with CANFD_FDF
+inline bool accept_datagram(can_frame&, unsigned length) {
+  return length == CAN_MTU;
+}
+inline bool accept_datagram(canfd_frame& frame, unsigned length) {
+  if (length == CANFD_MTU)
+    frame.flags |= CANFD_FDF;
+  return length == CAN_MTU || length == CANFD_MTU;
+}
+
+// Points `msg` at a single buffer; msg_control is left empty
+inline void prepare_datagram(struct mmsghdr& msg,
+                             struct iovec&   iov,
+                             const void*     buffer,
+                             size_t          size) {
+  iov                    = {const_cast<void*>(buffer), size};
+  msg.msg_hdr            = {};
+  msg.msg_hdr.msg_iov    = &iov;
+  msg.msg_hdr.msg_iovlen = 1;
+  msg.msg_len            = 0;
+}
+
+// Non-blocking; false with errno EAGAIN/ENOBUFS when the TX queue is full
+template <typename Frame>
+bool send_datagram(int fd, const Frame& frame) {
+  size_t size = datagram_size(frame);
+  return ::send(fd, &frame, size, MSG_DONTWAIT) == static_cast<ssize_t>(size);
+}
+
+// Sends in order until the TX queue is full; returns the number sent.
+// `error` is the errno that stopped it, 0 for a full queue.
+template <typename Frame>
+size_t send_datagrams(int          fd,
+                      const Frame* frames,
+                      size_t       count,
+                      int&         error) {
+  size_t n_sent = 0;
+  error         = 0;
+  while (n_sent < count) {
+    size_t         n = count - n_sent < kMaxDatagramBatch
+                         ? count - n_sent
+                         : kMaxDatagramBatch;
+    struct mmsghdr msgs[kMaxDatagramBatch];
+    struct iovec   iovs[kMaxDatagramBatch];
+    for (size_t i = 0; i < n; ++i) {
+      const Frame& frame = frames[n_sent + i];
+      prepare_datagram(msgs[i], iovs[i], &frame, datagram_size(frame));
+    }
+    int n_batch = sendmmsg(fd, msgs, static_cast<unsigned>(n), MSG_DONTWAIT);
+    if (n_batch < 0) {
+      if (!tx_queue_full(errno))
+        error = errno;
+      break;
+    }
+    n_sent += static_cast<size_t>(n_batch);
+    if (static_cast<size_t>(n_batch) < n)
+      break;
+  }
+  return n_sent;
+}
+
+// recv of one datagram without blocking: 1 when read (`length` bytes), 0
+// when none is pending, -1 on error
+inline int receive_datagram(int       fd,
+                            void*     buffer,
+                            size_t    size,
+                            unsigned& length) {
+  ssize_t bytes = recv(fd, buffer, size, MSG_DONTWAIT);
+  if (bytes < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    std::cerr << "Socket read failed: " << std::strerror(errno) << std::endl;
+    return -1;
+  }
+  length = static_cast<unsigned>(bytes);
+  return 1;
+}
+
+// recvmmsg without blocking: the number of datagrams read (see msg_len),
+// 0 when none are pending, -1 on error
+inline int receive_datagrams(int fd, struct mmsghdr* msgs, size_t count) {
+  int n = recvmmsg(fd, msgs, static_cast<unsigned>(count), MSG_DONTWAIT,
+                   nullptr);
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    std::cerr << "Socket read failed: " << std::strerror(errno) << std::endl;
+  }
+  return n;
+}
+
+}  // namespace socket_can_detail
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <cstdint>
+#include <string>
+
+// Fault confinement state of a CAN controller, ordered by severity
+enum class CanControllerState : uint8_t {
+  kErrorActive,
+  kErrorWarning,
+  kErrorPassive,
+  kBusOff,
+};
+
+const char* to_string(CanControllerState state);
+
+// Decoded error frame (CAN_ERR_FLAG, see linux/can/error.h)
+struct CanErrorInfo {
+  uint32_t classes = 0;  // CAN_ERR_* class bits of the frame's ID
+  // State the frame reports; only meaningful when `state_known`
+  CanControllerState state       = CanControllerState::kErrorActive;
+  bool               state_known = false;
+  bool               restarted   = false;  // controller left bus-off
+  uint8_t            controller  = 0;      // CAN_ERR_CRTL_* (data[1])
+  uint8_t            protocol    = 0;      // CAN_ERR_PROT_* (data[2])
+  uint8_t            location    = 0;      // CAN_ERR_PROT_LOC_* (data[3])
+  uint8_t            transceiver = 0;      // CAN_ERR_TRX_* (data[4])
+  uint8_t            tx_errors   = 0;      // with CAN_ERR_CNT
+  uint8_t            rx_errors   = 0;
+
+  // "bus-off", "error-passive (tx 130, rx 0)", "protocol stuff, no ack", ...
+  std::string describe() const;
+};
+
+// False for frames without CAN_ERR_FLAG
+bool decode_can_error(const can_frame& frame, CanErrorInfo& info);
+
+// Follows a controller through its error frames. The kernel reports the
+// side (RX or TX) that sets the new state, so each state-changing frame
+// carries the overall state.
+class CanErrorTracker {
+public:
+  // True when the controller state changed
+  bool update(const CanErrorInfo& info) {
+    if (!info.state_known || info.state == state_)
+      return false;
+    state_ = info.state;
+    return true;
+  }
+
+  CanControllerState state() const {
+    return state_;
+  }
+
+private:
+  CanControllerState state_ = CanControllerState::kErrorActive;
+};
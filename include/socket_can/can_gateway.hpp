@@ -0,0 +1,144 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/metrics.hpp"
+#include "socket_can/socket_can.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// One forwarding route. A frame received on `from` matches when
+// ((can_id ^ id) & mask) == 0, flags included, so mask 0 forwards
+// everything. Matching frames are modified the way can-gw does it (AND,
+// then OR, then XOR) and sent on `to`.
+struct GatewayRule {
+  std::string name;  // metrics label; "<from>-><to>" when empty
+  std::string from;
+  std::string to;
+  canid_t     id   = 0;
+  canid_t     mask = 0;
+
+  // ID bits in `id_rewrite_mask` are replaced by those of `new_id`
+  canid_t id_rewrite_mask = 0;
+  canid_t new_id          = 0;
+  // Applied to all 8 data bytes, the DLC is kept
+  std::array<uint8_t, CAN_MAX_DLEN> data_and = {0xFF, 0xFF, 0xFF, 0xFF,
+                                                0xFF, 0xFF, 0xFF, 0xFF};
+  std::array<uint8_t, CAN_MAX_DLEN> data_or  = {};
+  std::array<uint8_t, CAN_MAX_DLEN> data_xor = {};
+
+  // Token bucket in frames per second (0 = unlimited); `burst` frames may
+  // pass back to back (0 = a tenth of a second's worth, at least 1)
+  double   rate_limit = 0;
+  uint32_t burst      = 0;
+
+  // Rules between two SocketCAN interfaces without a rate limit are handed
+  // to the kernel's can-gw (needs CAP_NET_ADMIN and the can-gw module) so
+  // their frames never reach user space. Falls back to user space routing.
+  bool allow_offload = true;
+};
+
+// Routes frames between interfaces it opens itself, from a rule table
+// compiled at init(): per input interface, a flat table over every 11-bit
+// ID lists the routes each data frame takes, 29-bit IDs go through a hash
+// map of exact rules and a short list of masked ones. Each input socket gets
+// kernel filters for the IDs it routes.
+//
+// Frames arrive in recvmmsg batches; forwarded copies are queued per output
+// in fixed arrays and sent with one sendmmsg when the batch ends, so the
+// forwarding path does not allocate. A full TX queue drops frames instead of
+// stalling the other buses.
+//
+// Each route exports socket_can_gateway_frames, socket_can_gateway_drops
+// {reason=rate|queue} and socket_can_gateway_latency_seconds (from the start
+// of handling the RX batch to the send) to MetricsRegistry::global().
+class CanGateway {
+public:
+  struct RouteStats {
+    uint64_t forwarded     = 0;
+    uint64_t rate_dropped  = 0;
+    uint64_t queue_dropped = 0;
+    bool     offloaded     = false;  // counters stay 0, see `cangw -L`
+  };
+
+  ~CanGateway();
+
+  // Opens every interface the rules name; `offload` enables can-gw
+  bool init(EpollEventLoop*                 event_loop,
+            const std::vector<GatewayRule>& rules,
+            bool                            offload = true);
+  // Closes the interfaces and removes the can-gw rules
+  void deinit();
+
+  size_t routes() const {
+    return routes_.size();
+  }
+  RouteStats stats(size_t route) const;
+
+  // The rule's modification of `frame`, as done on the forwarding path
+  static void modify(const GatewayRule& rule, can_frame& frame);
+
+private:
+  static constexpr size_t kTxBatch = 64;
+  static constexpr size_t kSffIds  = CAN_SFF_MASK + 1;
+
+  struct Route {
+    GatewayRule rule;
+    size_t      in        = 0;  // port indexes
+    size_t      out       = 0;
+    bool        offloaded = false;
+    // Compiled modification
+    canid_t  id_and   = ~0u;
+    canid_t  id_or    = 0;
+    uint64_t data_and = ~0ull;
+    uint64_t data_or  = 0;
+    uint64_t data_xor = 0;
+    // Token bucket
+    double   tokens    = 0;
+    double   capacity  = 0;
+    uint64_t refill_ns = 0;
+
+    std::shared_ptr<MetricCounter>   forwarded;
+    std::shared_ptr<MetricCounter>   rate_dropped;
+    std::shared_ptr<MetricCounter>   queue_dropped;
+    std::shared_ptr<MetricHistogram> latency;
+  };
+
+  using RouteList = std::vector<uint16_t>;
+
+  struct Port {
+    std::string   name;
+    SocketCanIntf intf;
+    bool          kernel = false;  // a SocketCAN interface, not vbus:
+
+    // Routes of 11-bit data frame `id`: sff_routes[sff_begin[id] ..
+    // sff_begin[id + 1])
+    std::vector<uint32_t>                  sff_begin;
+    RouteList                              sff_routes;
+    std::unordered_map<canid_t, RouteList> eff_exact;
+    RouteList                              other;  // checked in full
+
+    std::array<can_frame, kTxBatch> tx;
+    std::array<uint16_t, kTxBatch>  tx_route;
+    size_t                          tx_count = 0;
+    bool                            queued   = false;  // in pending_ports_
+  };
+
+  size_t port_index(const std::string& name);
+  bool   compile(size_t in);
+  void   on_frame(size_t in, const can_frame& frame);
+  void   forward(uint16_t route, const can_frame& frame);
+  bool   take_token(Route& route);
+  void   flush(Port& port);
+  void   flush_all();
+  bool   offload(Route& route, bool add);
+
+  EpollEventLoop*                    event_loop_ = nullptr;
+  std::vector<std::unique_ptr<Port>> ports_;
+  std::vector<Route>                 routes_;
+  std::vector<size_t>                pending_ports_;
+  uint64_t                           batch_ns_ = 0;  // 0 between batches
+};
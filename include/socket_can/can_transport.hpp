@@ -0,0 +1,96 @@
+#pragma once
+
+#include <linux/can.h>
+#include <linux/can/error.h>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <sys/types.h>
+
+// Frame I/O underneath SocketCanIntf. A transport exposes one descriptor that
+// becomes readable (EPOLLIN) when frames are pending, so every backend plugs
+// into EpollEventLoop the same way.
+class CanTransport {
+public:
+  virtual ~CanTransport() = default;
+
+  virtual bool open(const std::string& interface) = 0;
+  virtual void close()                            = 0;
+  virtual int  fd() const                         = 0;
+
+  // Non-blocking; false with errno EAGAIN/ENOBUFS when the TX queue is full
+  virtual bool send(const can_frame& frame) = 0;
+  // Non-blocking; sends frames in order until the TX queue is full. Returns
+  // the number sent, or -1 on an error other than a full queue.
+  virtual ssize_t send_batch(const can_frame* frames, size_t count);
+  // Non-blocking; up to `max` frames, 0 when none are pending, -1 on error
+  virtual ssize_t receive_batch(can_frame* frames, size_t max) = 0;
+  // As receive_batch(), into separate buffers (e.g. FramePool slots); the
+  // default reads one frame at a time
+  virtual ssize_t receive_scatter(can_frame* const* frames, size_t max);
+  // Waits up to timeout_ms for room in the TX queue
+  virtual bool wait_writable(int timeout_ms) = 0;
+
+  // Kernel-side receive filters (CAN_RAW_FILTER); none means every frame.
+  // False with errno EOPNOTSUPP on backends without filtering.
+  virtual bool set_filters(const can_filter* filters, size_t count);
+  // Error classes delivered as CAN_ERR_FLAG frames (CAN_RAW_ERR_FILTER)
+  virtual bool set_error_mask(can_err_mask_t mask);
+
+  // 1 when a frame was read, 0 when none is pending, -1 on error
+  int receive(can_frame& frame) {
+    ssize_t n = receive_batch(&frame, 1);
+    return n < 0 ? -1 : static_cast<int>(n);
+  }
+
+  // Interface of the last successful open(); empty for transports opened
+  // some other way
+  const std::string& name() const {
+    return name_;
+  }
+  // True for kernel network interfaces, whose link state LinkMonitor sees
+  virtual bool has_link_state() const {
+    return false;
+  }
+
+protected:
+  std::string name_;
+};
+
+// Transport whose frames travel as one datagram per can_frame over a single
+// descriptor; send/receive are shared by the SocketCAN and loopback backends
+class DatagramCanTransport : public CanTransport {
+public:
+  static constexpr size_t kMaxBatch = 64;
+
+  ~DatagramCanTransport() override;
+
+  void close() override;
+  int  fd() const override {
+    return fd_;
+  }
+  bool    send(const can_frame& frame) override;
+  ssize_t send_batch(const can_frame* frames, size_t count) override;
+  ssize_t receive_batch(can_frame* frames, size_t max) override;
+  ssize_t receive_scatter(can_frame* const* frames, size_t max) override;
+  bool    wait_writable(int timeout_ms) override;
+
+protected:
+  int fd_ = -1;
+};
+
+// Raw PF_CAN socket bound to a kernel interface (can0, vcan0, ...)
+class SocketCanTransport : public DatagramCanTransport {
+public:
+  bool open(const std::string& interface) override;
+  bool has_link_state() const override {
+    return true;
+  }
+  bool set_filters(const can_filter* filters, size_t count) override;
+  bool set_error_mask(can_err_mask_t mask) override;
+};
+
+// "vbus:<name>[@<bitrate>]" selects the in-process virtual bus (see
+// virtual_can_bus.hpp); anything else is a SocketCAN interface. The
+// transport is not opened yet.
+std::unique_ptr<CanTransport> make_can_transport(const std::string& interface);
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "socket_can/buffered_file.hpp"
+#include "socket_can/socket_can.hpp"
+#include <linux/can.h>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <string>
+
+// Direction flag of a CaptureRecord; frames are received unless set
+constexpr uint32_t kCaptureFlagTx = 1u << 0;
+
+// One timestamped frame. This is also the on-disk record layout of the native
+// capture format, so mapped capture files can be read in place.
+struct CaptureRecord {
+  uint64_t  timestamp_ns;  // CLOCK_REALTIME, nanoseconds since the epoch
+  uint32_t  channel;       // 0-based bus index
+  uint32_t  flags;
+  can_frame frame;
+};
+
+static_assert(sizeof(CaptureRecord) == 32, "CaptureRecord is an on-disk type");
+
+inline uint64_t capture_now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// Pull-style stream of frames: capture file readers, replay inputs, ...
+class FrameSource {
+public:
+  virtual ~FrameSource() = default;
+
+  // Returns false at the end of the stream or on unrecoverable input
+  virtual bool next(CaptureRecord& record) = 0;
+};
+
+// Push-style consumer of frames: capture file writers, ...
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+
+  virtual bool write(const CaptureRecord& record) = 0;
+  virtual bool flush()                            = 0;
+  // Finalizes the output (headers, trailers); further writes fail
+  virtual bool close() = 0;
+
+  // Stamps the frame with the current time and writes it
+  bool log_frame(const can_frame& frame, uint32_t channel = 0) {
+    return write(CaptureRecord{capture_now_ns(), channel, 0, frame});
+  }
+
+  // Adapter to plug the sink into SocketCanIntf::init()
+  FrameProcessor frame_processor(uint32_t channel = 0) {
+    return [this, channel](const can_frame& frame) {
+      log_frame(frame, channel);
+    };
+  }
+};
+
+// Native capture file layout: a CaptureFileHeader followed by CaptureRecords
+constexpr char     kCaptureFileMagic[8]  = {'S', 'C', 'A', 'N', 'C', 'A', 'P', 0};
+constexpr uint32_t kCaptureFormatVersion = 1;
+
+struct CaptureFileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t record_count;  // 0 if the logger did not close the file
+  uint64_t first_timestamp_ns;
+  uint64_t last_timestamp_ns;
+  uint64_t reserved[3];
+};
+
+static_assert(sizeof(CaptureFileHeader) == 64, "CaptureFileHeader is on-disk");
+
+// Records per block of the sidecar time/ID index (see capture_index.hpp)
+constexpr uint32_t kDefaultIndexBlockRecords = 4096;
+
+class CaptureIndexWriter;
+
+// Writes the native capture format
+class CaptureLogger : public FrameSink {
+public:
+  CaptureLogger();
+  ~CaptureLogger() override;
+
+  // Also writes the "<path>.idx" index unless index_block_records is 0
+  bool open(const std::string& path,
+            uint32_t           index_block_records = kDefaultIndexBlockRecords);
+
+  bool write(const CaptureRecord& record) override;
+  bool flush() override;
+  bool close() override;
+
+  uint64_t record_count() const {
+    return header_.record_count;
+  }
+
+private:
+  BufferedFileWriter                  writer_;
+  CaptureFileHeader                   header_ = {};
+  std::unique_ptr<CaptureIndexWriter> index_;
+};
+
+// Reads the native capture format through a read-only memory mapping; only the
+// pages that are touched are brought into memory.
+class CaptureFileReader : public FrameSource {
+public:
+  ~CaptureFileReader() override;
+
+  bool open(const std::string& path);
+  void close();
+
+  bool next(CaptureRecord& record) override;
+
+  void rewind() {
+    position_ = 0;
+  }
+  void seek(size_t index) {
+    position_ = index < count_ ? index : count_;
+  }
+
+  size_t size() const {
+    return count_;
+  }
+  const CaptureRecord* records() const {
+    return records_;
+  }
+  const CaptureFileHeader& header() const {
+    return *reinterpret_cast<const CaptureFileHeader*>(map_);
+  }
+
+private:
+  void*                map_      = nullptr;
+  size_t               map_size_ = 0;
+  const CaptureRecord* records_  = nullptr;
+  size_t               count_    = 0;
+  size_t               position_ = 0;
+};
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "socket_can/capture.hpp"
+#include "socket_can/frame_filter.hpp"
+#include "socket_can/trigger_signal.hpp"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Frames a query looks at: any of `ids` (CAN_RAW_FILTER semantics, empty =
+// every ID), one channel or all, and a time range [begin_ns, end_ns)
+struct AnalysisFilter {
+  std::vector<can_filter> ids;
+  int                     channel  = -1;
+  uint64_t                begin_ns = 0;
+  uint64_t                end_ns   = UINT64_MAX;
+};
+
+struct CaptureScanResult {
+  uint64_t records       = 0;  // in the capture
+  uint64_t matched       = 0;
+  uint64_t payload_bytes = 0;  // sum of the matched DLCs
+  uint64_t first_ns      = 0;  // of the matched frames
+  uint64_t last_ns       = 0;
+};
+
+// Gaps between consecutive frames of an ID: bucket 0 below 1 us, bucket b
+// from 2^(b-1) us up to 2^b us, the last one open-ended
+constexpr size_t kPeriodBuckets = 32;
+
+inline uint64_t period_bucket_floor_ns(size_t bucket) {
+  return bucket == 0 ? 0 : (uint64_t{1} << (bucket - 1)) * 1000;
+}
+
+struct IdSummary {
+  canid_t  id            = 0;  // IdTable::key_of() form
+  uint64_t count         = 0;
+  uint64_t first_ns      = 0;
+  uint64_t last_ns       = 0;
+  uint64_t periods       = 0;  // count - 1 unless the capture is unsorted
+  uint64_t min_period_ns = UINT64_MAX;
+  uint64_t max_period_ns = 0;
+  uint64_t period_sum_ns = 0;
+  uint8_t  min_dlc       = 0xFF;
+  uint8_t  max_dlc       = 0;
+
+  std::array<uint64_t, kPeriodBuckets> period_histogram = {};
+
+  double mean_period_ns() const {
+    return periods ? static_cast<double>(period_sum_ns) / periods : 0;
+  }
+};
+
+// Frames of one signal; `id`/`mask` as in can_filter
+struct SignalQuery {
+  canid_t       id   = 0;
+  canid_t       mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK;  // exact
+  TriggerSignal signal;
+  // Width of the statistics buckets, aligned to the epoch (60 s = per
+  // wall-clock minute)
+  uint64_t bucket_ns = 60000000000ull;
+};
+
+struct SignalBucket {
+  uint64_t start_ns = 0;
+  uint64_t count    = 0;
+  double   min      = 0;
+  double   max      = 0;
+  double   sum      = 0;
+
+  double mean() const {
+    return count ? sum / count : 0;
+  }
+};
+
+struct SignalSample {
+  uint64_t timestamp_ns;
+  double   value;
+};
+
+// Offline queries over a capture file. Native captures (.scap) are read in
+// place through their memory mapping; other formats are loaded into memory
+// first. A query splits the records into one contiguous range per thread;
+// each thread converts its range into columnar chunks (timestamps, IDs,
+// DLCs, payloads) that stay in cache while the chunk is scanned, selects
+// frames with the FrameFilterSet kernels and aggregates into thread-local
+// state, merged in capture order at the end.
+//
+// Captures are expected in time order, as CaptureLogger writes them; period
+// statistics skip negative gaps.
+class CaptureAnalyzer {
+public:
+  // Records per columnar chunk
+  static constexpr size_t kChunkRecords = 16384;
+
+  // 0 = one thread per core
+  explicit CaptureAnalyzer(unsigned threads = 0);
+  ~CaptureAnalyzer();
+
+  // Any open_capture_source() format
+  bool open(const std::string& path);
+  void close();
+
+  size_t size() const {
+    return count_;
+  }
+  unsigned threads() const {
+    return threads_;
+  }
+  // Time of the first record, 0 when empty
+  uint64_t first_timestamp_ns() const {
+    return count_ ? records_[0].timestamp_ns : 0;
+  }
+
+  CaptureScanResult scan(const AnalysisFilter& filter) const;
+  // One summary per ID, standard IDs first, ascending. Only the first 6144
+  // extended IDs of each thread's range are tracked; `untracked` receives the
+  // number of matching frames of the others.
+  std::vector<IdSummary> group_by_id(const AnalysisFilter& filter,
+                                     uint64_t* untracked = nullptr) const;
+  // Statistics of the decoded signal per time bucket, in time order
+  std::vector<SignalBucket> signal_buckets(
+    const SignalQuery&    query,
+    const AnalysisFilter& filter = AnalysisFilter()) const;
+  // Every decoded value, in capture order
+  std::vector<SignalSample> extract_signal(
+    const SignalQuery&    query,
+    const AnalysisFilter& filter = AnalysisFilter()) const;
+
+private:
+  // Calls fn(worker, begin, end) for each thread's range, in parallel, and
+  // returns the number of workers used
+  template <typename F>
+  unsigned parallel_ranges(F&& fn) const;
+
+  unsigned                     threads_;
+  std::unique_ptr<FrameSource> source_;
+  std::vector<CaptureRecord>   loaded_;  // formats that are not mapped
+  const CaptureRecord*         records_ = nullptr;
+  size_t                       count_   = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "socket_can/buffered_file.hpp"
+#include "socket_can/capture.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Streaming readers and writers for third-party capture formats. All of them
+// format and parse in place in a fixed file buffer; per-frame work performs no
+// allocation and no iostream calls.
+
+// Maps channel numbers to interface names for formats that store names
+class ChannelNames {
+public:
+  static constexpr size_t kMaxChannels = 64;
+
+  void set(uint32_t channel, const std::string& name);
+  // Name of a channel; defaults to "can<channel>"
+  const std::string& name(uint32_t channel);
+  // Channel of a name, assigning the next free channel on first sight
+  bool lookup(const char* begin, const char* end, uint32_t* channel);
+
+private:
+  std::vector<std::string> names_;
+};
+
+// candump -l / log format: "(1436509052.249713) vcan0 123#DEADBEEF"
+class CandumpLogWriter : public FrameSink {
+public:
+  ~CandumpLogWriter() override;
+
+  bool open(const std::string& path);
+  void set_channel_name(uint32_t channel, const std::string& name) {
+    channels_.set(channel, name);
+  }
+
+  bool write(const CaptureRecord& record) override;
+  bool flush() override;
+  bool close() override;
+
+private:
+  BufferedFileWriter writer_;
+  ChannelNames       channels_;
+};
+
+class CandumpLogReader : public FrameSource {
+public:
+  bool open(const std::string& path);
+  void set_channel_name(uint32_t channel, const std::string& name) {
+    channels_.set(channel, name);
+  }
+
+  bool next(CaptureRecord& record) override;
+
+private:
+  BufferedFileReader reader_;
+  ChannelNames       channels_;
+};
+
+// Vector ASC text format. Channels are 1-based in the file and 0-based in
+// CaptureRecord; timestamps are stored relative to the measurement start.
+class AscWriter : public FrameSink {
+public:
+  ~AscWriter() override;
+
+  bool open(const std::string& path);
+
+  bool write(const CaptureRecord& record) override;
+  bool flush() override;
+  bool close() override;
+
+private:
+  bool write_header(uint64_t start_ns);
+
+  BufferedFileWriter writer_;
+  uint64_t           start_ns_       = 0;
+  bool               header_written_ = false;
+};
+
+class AscReader : public FrameSource {
+public:
+  bool open(const std::string& path);
+
+  bool next(CaptureRecord& record) override;
+
+private:
+  bool parse_header_line(const char* p, const char* end);
+
+  BufferedFileReader reader_;
+  uint64_t           start_ns_ = 0;
+  bool               hex_base_ = true;
+};
+
+// Vector BLF binary format. Frames are grouped into LOG_CONTAINER objects that
+// are deflate-compressed when zlib is available.
+class BlfWriter : public FrameSink {
+public:
+  static constexpr size_t kContainerSize = 128 * 1024;
+
+  // compression_level: 0 stores containers uncompressed, 1-9 as in zlib
+  explicit BlfWriter(int compression_level = 1);
+  ~BlfWriter() override;
+
+  bool open(const std::string& path);
+
+  bool write(const CaptureRecord& record) override;
+  bool flush() override;
+  bool close() override;
+
+private:
+  bool write_container();
+  bool write_file_header();
+
+  BufferedFileWriter   writer_;
+  int                  compression_level_;
+  std::vector<uint8_t> container_;
+  std::vector<uint8_t> compressed_;
+  size_t               container_size_    = 0;
+  uint64_t             start_ns_          = 0;
+  uint64_t             last_ns_           = 0;
+  uint64_t             uncompressed_size_ = 0;
+  uint32_t             object_count_      = 0;
+};
+
+class BlfReader : public FrameSource {
+public:
+  bool open(const std::string& path);
+
+  bool next(CaptureRecord& record) override;
+
+private:
+  bool read_container();
+
+  BufferedFileReader   reader_;
+  std::vector<uint8_t> compressed_;
+  std::vector<uint8_t> data_;
+  size_t               data_pos_ = 0;
+  size_t               data_end_ = 0;
+  uint64_t             start_ns_ = 0;
+};
+
+// Picks a format from the file extension: .scap (native), .zcap (compressed
+// native), .log (candump), .asc or .blf. Returns nullptr for unknown
+// extensions or open failures.
+std::unique_ptr<FrameSource> open_capture_source(const std::string& path);
+std::unique_ptr<FrameSink>   open_capture_sink(const std::string& path);
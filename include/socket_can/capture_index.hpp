@@ -0,0 +1,131 @@
+#pragma once
+
+#include "socket_can/buffered_file.hpp"
+#include "socket_can/capture.hpp"
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Sidecar index ("<capture>.idx") for native capture files. The capture is cut
+// into blocks of a fixed number of records; every block gets one entry with
+// its time range, an exact bitmap of the 11-bit IDs it contains and a bloom
+// filter over its 29-bit IDs. Entries are appended as blocks complete, so the
+// index is written incrementally and survives a logger crash.
+
+constexpr char     kCaptureIndexMagic[8] = {'S', 'C', 'A', 'N', 'I', 'D', 'X', 0};
+constexpr uint32_t kCaptureIndexVersion  = 1;
+
+struct CaptureIndexHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t entry_size;
+  uint32_t block_records;
+  uint32_t reserved[3];
+};
+
+static_assert(sizeof(CaptureIndexHeader) == 32, "CaptureIndexHeader is on-disk");
+
+struct CaptureIndexEntry {
+  uint64_t first_record;
+  uint64_t min_timestamp_ns;
+  uint64_t max_timestamp_ns;
+  uint64_t running_max_ns;  // max timestamp of this and all earlier blocks
+  uint32_t record_count;
+  uint32_t channel_mask;  // bit min(channel, 31)
+  uint64_t sff_bitmap[32];
+  uint64_t eff_bloom[8];
+
+  void add(const CaptureRecord& record);
+  bool may_contain(canid_t id) const;
+};
+
+static_assert(sizeof(CaptureIndexEntry) == 360, "CaptureIndexEntry is on-disk");
+
+inline std::string capture_index_path(const std::string& capture_path) {
+  return capture_path + ".idx";
+}
+
+// Accumulates the current block and appends finished entries to the sidecar
+class CaptureIndexWriter {
+public:
+  CaptureIndexWriter() : writer_(64 * 1024) {
+  }
+  ~CaptureIndexWriter();
+
+  bool open(const std::string& capture_path,
+            uint32_t           block_records = kDefaultIndexBlockRecords);
+  bool add(const CaptureRecord& record) {
+    if (!writer_.is_open())
+      return true;
+    current_.add(record);
+    return current_.record_count < block_records_ || finish_block();
+  }
+  bool flush() {
+    return writer_.flush();
+  }
+  // Writes the trailing partial block
+  bool close();
+
+private:
+  bool finish_block();
+  void start_block();
+
+  BufferedFileWriter writer_;
+  CaptureIndexEntry  current_        = {};
+  uint32_t           block_records_  = kDefaultIndexBlockRecords;
+  uint64_t           next_record_    = 0;
+  uint64_t           running_max_ns_ = 0;
+};
+
+// Builds the sidecar of an existing capture, e.g. one produced by can_convert
+bool write_capture_index(const std::string& capture_path,
+                         uint32_t block_records = kDefaultIndexBlockRecords);
+
+struct CaptureQuery {
+  uint64_t begin_ns = 0;  // inclusive
+  uint64_t end_ns   = std::numeric_limits<uint64_t>::max();  // exclusive
+  // can_id values (EFF flag significant, RTR/ERR flags ignored); empty = all
+  std::vector<canid_t> ids;
+};
+
+// Random access over a memory-mapped capture through its sidecar index.
+// Queries assume timestamps are non-decreasing from block to block, which
+// holds for files written by CaptureLogger.
+class CaptureIndex {
+public:
+  ~CaptureIndex();
+
+  // A sidecar of another format version, or a damaged one, is rebuilt from
+  // the capture
+  bool open(const std::string& capture_path);
+  void close();
+
+  // Calls fn for each matching record in file order; returns the match count
+  size_t query(const CaptureQuery&                               query,
+               const std::function<void(const CaptureRecord&)>& fn) const;
+
+  // Indices of the blocks a query has to scan
+  std::vector<size_t> candidate_blocks(const CaptureQuery& query) const;
+
+  size_t block_count() const {
+    return entry_count_;
+  }
+  const CaptureIndexEntry& block(size_t i) const {
+    return entries_[i];
+  }
+  const CaptureFileReader& capture() const {
+    return capture_;
+  }
+
+private:
+  // Maps the sidecar; false when it is truncated or of another version
+  bool map_index(int fd, const std::string& path);
+
+  CaptureFileReader        capture_;
+  void*                    map_         = nullptr;
+  size_t                   map_size_    = 0;
+  const CaptureIndexEntry* entries_     = nullptr;
+  size_t                   entry_count_ = 0;
+};
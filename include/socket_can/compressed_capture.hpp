@@ -0,0 +1,141 @@
+#pragma once
+
+#include "socket_can/buffered_file.hpp"
+#include "socket_can/capture.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Compressed capture format (".zcap"). Frames are buffered into blocks and
+// stored column-wise:
+//   - an ID dictionary per block and one dictionary index per frame
+//   - timestamps as delta-of-delta against the previous frame of the same ID,
+//     which is close to zero for periodic traffic
+//   - channel/direction and DLC columns
+//   - payloads XOR-ed with the previous payload of the same ID
+// The columns of a block are then deflate-compressed as one unit.
+
+constexpr char kCompressedCaptureMagic[8] = {'S', 'C', 'A', 'N',
+                                             'Z', 'C', 'A', 'P'};
+constexpr uint32_t kCompressedCaptureVersion = 1;
+
+struct CompressedCaptureHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t block_records;
+};
+
+struct CompressedBlockHeader {
+  char     magic[4];  // "ZBLK"
+  uint32_t record_count;
+  uint32_t raw_size;
+  uint32_t stored_size;
+  uint32_t method;  // 0 = stored, 1 = deflate
+  uint32_t reserved;
+  uint64_t first_timestamp_ns;
+  uint64_t last_timestamp_ns;
+};
+
+static_assert(sizeof(CompressedBlockHeader) == 40, "on-disk type");
+
+// Encodes and decodes one block; shared by the logger and the reader
+class CompressedBlockCodec {
+public:
+  // Encodes records into raw column data, then compresses it into `out`
+  bool encode(const CaptureRecord*   records,
+              uint32_t               count,
+              int                    compression_level,
+              CompressedBlockHeader* header,
+              std::vector<uint8_t>*  out);
+  bool decode(const CompressedBlockHeader& header,
+              const uint8_t*               data,
+              std::vector<CaptureRecord>*  records);
+
+private:
+  struct IdState {
+    uint64_t last_ts;
+    int64_t  last_delta;
+    uint8_t  last_payload[8];
+  };
+
+  std::vector<uint8_t>  raw_;
+  std::vector<uint8_t>  columns_[6];
+  std::vector<canid_t>  dictionary_;
+  std::vector<IdState>  state_;
+  std::vector<uint32_t> slots_;  // open-addressing ID -> dictionary index
+};
+
+// Writes the compressed format. write() only copies the record into the
+// current block; encoding, compression and file I/O run on a background
+// thread, so the caller (typically the EpollEventLoop thread) never does.
+class CompressedCaptureLogger : public FrameSink {
+public:
+  static constexpr uint32_t kDefaultBlockRecords = 8192;
+  static constexpr size_t   kMaxPendingBlocks    = 8;
+
+  explicit CompressedCaptureLogger(
+    uint32_t block_records     = kDefaultBlockRecords,
+    int      compression_level = 1);
+  ~CompressedCaptureLogger() override;
+
+  bool open(const std::string& path);
+
+  bool write(const CaptureRecord& record) override;
+  // Waits until everything written so far is on disk
+  bool flush() override;
+  bool close() override;
+
+  uint64_t raw_bytes() const;
+  uint64_t stored_bytes() const;
+  // Number of times write() had to wait for the compressor to catch up
+  uint64_t stalls() const;
+
+private:
+  using Block = std::vector<CaptureRecord>;
+
+  bool submit_current();
+  void worker();
+
+  uint32_t block_records_;
+  int      compression_level_;
+
+  Block current_;
+
+  mutable std::mutex      mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::deque<Block>       pending_;
+  std::vector<Block>      free_blocks_;
+  bool                    busy_         = false;
+  bool                    stopping_     = false;
+  bool                    failed_       = false;
+  uint64_t                raw_bytes_    = 0;
+  uint64_t                stored_bytes_ = 0;
+  uint64_t                stalls_       = 0;
+  std::thread             thread_;
+
+  // Owned by the worker thread while it runs
+  BufferedFileWriter   writer_;
+  CompressedBlockCodec codec_;
+  std::vector<uint8_t> encoded_;
+};
+
+class CompressedCaptureReader : public FrameSource {
+public:
+  bool open(const std::string& path);
+
+  bool next(CaptureRecord& record) override;
+
+private:
+  bool read_block();
+
+  BufferedFileReader         reader_;
+  CompressedBlockCodec       codec_;
+  std::vector<uint8_t>       stored_;
+  std::vector<CaptureRecord> records_;
+  size_t                     position_ = 0;
+};
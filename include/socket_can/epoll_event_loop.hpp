@@ -4,9 +4,15 @@
 #include <sys/eventfd.h>
 #include <iostream>
 #include <functional>
+#include <memory>
+#include <string>
 #include <vector>
 #include <unistd.h>
 
+class LatencyHistogram;
+class MetricsRegistry;
+struct LoopMetrics;
+
 using std::placeholders::_1;
 using Callback = std::function<void(uint32_t)>;
 
@@ -32,14 +38,32 @@ public:
 
   bool run_until_empty();
 
+  // Waits up to timeout_ms (-1 = forever) and dispatches one batch of events.
+  // Returns the number of events dispatched, 0 on timeout or signal, -1 on
+  // error.
+  int run_once(int timeout_ms);
+
+  // Records how long each dispatched batch of callbacks took (ns); nullptr
+  // disables. Only touched from the thread running the loop.
+  void set_dispatch_histogram(LatencyHistogram* histogram) {
+    dispatch_histogram_ = histogram;
+  }
+
+  // Exports iterations, events per wait and callback time per batch into
+  // `registry`, labelled loop="<name>". Adds two clock reads per dispatched
+  // batch; call before running the loop.
+  void enable_metrics(const std::string& name, MetricsRegistry& registry);
+
   void drop_event(EvtId evt);
 
 private:
-  static constexpr size_t kMaxEventsPerIteration = 16;
-  int                     epollfd                = -1;
-  size_t                  n_events_              = 0;
-  int                     n_triggered_events_    = 0;
-  struct epoll_event      triggered_events_[kMaxEventsPerIteration];
+  static constexpr size_t      kMaxEventsPerIteration = 16;
+  int                          epollfd                = -1;
+  size_t                       n_events_              = 0;
+  int                          n_triggered_events_    = 0;
+  LatencyHistogram*            dispatch_histogram_    = nullptr;
+  std::unique_ptr<LoopMetrics> metrics_;
+  struct epoll_event           triggered_events_[kMaxEventsPerIteration];
 };
 
 class EpollEvent {
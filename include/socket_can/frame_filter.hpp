@@ -0,0 +1,186 @@
+#pragma once
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Implementations of the filter kernel. kSse2 is part of every x86-64 CPU;
+// kAvx2 is used when the CPU reports it. Other architectures only have
+// kScalar.
+enum class FilterKernel {
+  kScalar,
+  kSse2,
+  kAvx2,
+};
+
+const char* filter_kernel_name(FilterKernel kernel);
+bool        filter_kernel_supported(FilterKernel kernel);
+// Fastest kernel of this CPU, detected once
+FilterKernel best_filter_kernel();
+
+// A batch of frames in structure-of-arrays layout: IDs, lengths and payloads
+// each in their own array, so a kernel loads the IDs of 8 frames with one
+// instruction. Storage grows to the largest batch seen and is then reused.
+class FrameBatch {
+public:
+  explicit FrameBatch(size_t capacity = 64) {
+    reserve(capacity);
+  }
+
+  void reserve(size_t capacity) {
+    ids_.reserve(capacity);
+    lengths_.reserve(capacity);
+    payloads_.reserve(capacity);
+  }
+  void clear() {
+    ids_.clear();
+    lengths_.clear();
+    payloads_.clear();
+  }
+  void push(const can_frame& frame);
+  void assign(const can_frame* frames, size_t count) {
+    clear();
+    for (size_t i = 0; i < count; ++i)
+      push(frames[i]);
+  }
+
+  size_t size() const {
+    return ids_.size();
+  }
+  bool empty() const {
+    return ids_.empty();
+  }
+  const canid_t* ids() const {
+    return ids_.data();
+  }
+  const uint8_t* lengths() const {
+    return lengths_.data();
+  }
+  // Payload bytes in frame order, as one little-endian word per frame
+  const uint64_t* payloads() const {
+    return payloads_.data();
+  }
+  can_frame frame(size_t index) const;
+
+private:
+  std::vector<canid_t>  ids_;
+  std::vector<uint8_t>  lengths_;
+  std::vector<uint64_t> payloads_;
+};
+
+// Output of FrameFilterSet::classify(): one bitmap per rule, bit i of a
+// rule's bitmap set when frame i of the batch matches it
+class FilterResult {
+public:
+  size_t frames() const {
+    return frames_;
+  }
+  size_t rules() const {
+    return rules_;
+  }
+  // 64 frames per word
+  size_t words() const {
+    return words_;
+  }
+  const uint64_t* bits(size_t rule) const {
+    return &bits_[rule * words_];
+  }
+  // Frames matching at least one rule
+  const uint64_t* any() const {
+    return any_.data();
+  }
+  bool matches(size_t rule, size_t frame) const {
+    return (bits(rule)[frame / 64] >> (frame % 64)) & 1;
+  }
+  size_t count(size_t rule) const;
+  // Indices of the frames matching `rule`, ascending; `out` needs room for
+  // count(rule) entries. Returns the number written.
+  size_t indices(size_t rule, uint32_t* out) const;
+  size_t any_indices(uint32_t* out) const;
+
+private:
+  friend class FrameFilterSet;
+
+  size_t                frames_ = 0;
+  size_t                rules_  = 0;
+  size_t                words_  = 0;
+  std::vector<uint64_t> bits_;
+  std::vector<uint64_t> any_;
+};
+
+// ID/mask rules checked against every frame of a batch at once. A rule has
+// the semantics of a CAN_RAW_FILTER entry: a frame matches when
+// (can_id & mask) == (rule.can_id & mask), flags included, and CAN_INV_FILTER
+// in rule.can_id inverts the result. The kernel is chosen at run time; all
+// kernels give the same result.
+class FrameFilterSet {
+public:
+  FrameFilterSet();
+  explicit FrameFilterSet(const std::vector<can_filter>& rules);
+
+  void set_rules(const std::vector<can_filter>& rules);
+  size_t rule_count() const {
+    return values_.size();
+  }
+  // False (and no change) when the CPU lacks `kernel`
+  bool set_kernel(FilterKernel kernel);
+  FilterKernel kernel() const {
+    return kernel_;
+  }
+
+  void classify(const FrameBatch& batch, FilterResult& result) const;
+
+  // Kernel entry point: bitmaps for `count` IDs, `words` per rule, into
+  // `bits`; inverted rules are applied by the caller
+  using KernelFunction = void (*)(const canid_t* ids,
+                                  size_t         count,
+                                  const canid_t* masks,
+                                  const canid_t* values,
+                                  size_t         rules,
+                                  size_t         words,
+                                  uint64_t*      bits);
+
+private:
+  std::vector<canid_t> masks_;
+  std::vector<canid_t> values_;  // already masked
+  std::vector<bool>    inverted_;
+  FilterKernel         kernel_   = FilterKernel::kScalar;
+  KernelFunction       function_ = nullptr;
+};
+
+// Filter stage after the batched receive of SocketCanIntf: collects the
+// frames of a receive batch, classifies them when the batch ends and hands
+// the batch and its bitmaps to the handler.
+//
+//   FrameClassifier classifier(rules, handler);
+//   intf.init("can0", &loop, classifier.frame_processor());
+//   intf.set_batch_end_handler([&] { classifier.flush(); });
+class FrameClassifier {
+public:
+  using BatchHandler =
+    std::function<void(const FrameBatch& batch, const FilterResult& result)>;
+
+  FrameClassifier(const std::vector<can_filter>& rules, BatchHandler handler);
+
+  void push(const can_frame& frame) {
+    batch_.push(frame);
+  }
+  std::function<void(const can_frame&)> frame_processor() {
+    return [this](const can_frame& frame) { batch_.push(frame); };
+  }
+  // Classifies and hands over the frames pushed since the last flush
+  void flush();
+
+  FrameFilterSet& filters() {
+    return filters_;
+  }
+
+private:
+  FrameFilterSet filters_;
+  BatchHandler   handler_;
+  FrameBatch     batch_;
+  FilterResult   result_;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "socket_can/capture.hpp"
+#include <linux/can.h>
+#include <cstddef>
+#include <cstdint>
+
+// Formats local wall-clock time of day. localtime_r() runs once per second;
+// within the same second only the fractional part is formatted.
+class TimestampFormatter {
+public:
+  // "HH:MM:SS.fff" with frac_digits (0-9) fractional digits
+  char* format(char* out, uint64_t timestamp_ns, int frac_digits = 3);
+
+private:
+  int64_t cached_sec_ = -1;
+  char    cached_[8];
+};
+
+// Writes frame lines into a caller-provided buffer with table-driven hex and
+// no allocation. Every function returns the end of what it wrote; the caller
+// provides at least kMaxLineLength bytes plus the interface name length.
+class FrameFormatter {
+public:
+  static constexpr size_t kMaxLineLength = 192;
+
+  // candump frame text: "123#DEADBEEF", "12345678#R", ...
+  static char* format_candump_frame(char* out, const can_frame& frame);
+
+  // candump log line: "(1436509052.249713) vcan0 123#DEADBEEF\n"
+  static char* format_candump(char*                out,
+                              const CaptureRecord& record,
+                              const char*          iface,
+                              size_t               iface_len);
+
+  // Monitor line (lower-case hex): "[10:00:00.000] Frame #     1 - ID: 0x123
+  // (STD) DLC: 2 Data: [0x01 0x02] ASCII: "..""
+  char* format_human(char*            out,
+                     const can_frame& frame,
+                     uint64_t         timestamp_ns,
+                     uint64_t         sequence);
+
+private:
+  TimestampFormatter timestamp_;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <linux/can.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+class FramePool;
+
+// One pool slot. Only `frame` is public; the rest is bookkeeping for the
+// handles below.
+struct alignas(64) PooledFrame {
+  can_frame frame;
+
+private:
+  friend class FramePool;
+  friend class FrameRef;
+  friend class SharedFrameRef;
+
+  FramePool*   pool      = nullptr;
+  PooledFrame* next_free = nullptr;  // owner thread
+  uint32_t     refs      = 0;        // owner thread handles, +1 while shared
+  // Handles held on other threads, and how many times their count dropped
+  // to zero since the owner last looked
+  std::atomic<uint32_t> shared_refs{0};
+  std::atomic<uint32_t> returns{0};
+  PooledFrame*          next_return = nullptr;
+};
+
+class SharedFrameRef;
+
+// Handle to a pooled frame on the pool's owner thread. Copies only bump a
+// plain counter; the slot goes back to the free list with the last handle.
+class FrameRef {
+public:
+  FrameRef() = default;
+  explicit FrameRef(PooledFrame* slot) : slot_(slot) {
+  }
+  FrameRef(const FrameRef& other) : slot_(other.slot_) {
+    if (slot_)
+      slot_->refs++;
+  }
+  FrameRef(FrameRef&& other) noexcept : slot_(other.slot_) {
+    other.slot_ = nullptr;
+  }
+  FrameRef& operator=(FrameRef other) noexcept {
+    std::swap(slot_, other.slot_);
+    return *this;
+  }
+  ~FrameRef() {
+    reset();
+  }
+
+  inline void reset();
+
+  explicit operator bool() const {
+    return slot_ != nullptr;
+  }
+  const can_frame& operator*() const {
+    return slot_->frame;
+  }
+  const can_frame* operator->() const {
+    return &slot_->frame;
+  }
+  // For the producer filling a freshly taken slot
+  can_frame* data() {
+    return &slot_->frame;
+  }
+  uint32_t use_count() const {
+    return slot_ ? slot_->refs : 0;
+  }
+
+  // Handle that may be passed to and released on another thread
+  inline SharedFrameRef share() const;
+
+private:
+  PooledFrame* slot_ = nullptr;
+};
+
+// Handle to a pooled frame for other threads: an atomic count per slot, and
+// the last one released hands the slot back to the owner through a
+// lock-free return stack, without touching the owner's counters
+class SharedFrameRef {
+public:
+  SharedFrameRef() = default;
+  SharedFrameRef(const SharedFrameRef& other) : slot_(other.slot_) {
+    if (slot_)
+      slot_->shared_refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  SharedFrameRef(SharedFrameRef&& other) noexcept : slot_(other.slot_) {
+    other.slot_ = nullptr;
+  }
+  SharedFrameRef& operator=(SharedFrameRef other) noexcept {
+    std::swap(slot_, other.slot_);
+    return *this;
+  }
+  ~SharedFrameRef() {
+    reset();
+  }
+
+  inline void reset();
+
+  explicit operator bool() const {
+    return slot_ != nullptr;
+  }
+  const can_frame& operator*() const {
+    return slot_->frame;
+  }
+  const can_frame* operator->() const {
+    return &slot_->frame;
+  }
+
+private:
+  friend class FrameRef;
+  explicit SharedFrameRef(PooledFrame* slot) : slot_(slot) {
+  }
+
+  PooledFrame* slot_ = nullptr;
+};
+
+// Fixed set of frame slots allocated up front, so memory stays bounded and
+// the data path never calls malloc: a burst larger than the pool is dropped
+// by the reader instead of growing anything. The pool belongs to one thread
+// (the event loop reading into it), which takes and frees slots through a
+// plain free list; slots released on other threads come back through the
+// return stack on the owner's next take(). Handles must not outlive the pool.
+class FramePool {
+public:
+  explicit FramePool(size_t capacity);
+  FramePool(const FramePool&)            = delete;
+  FramePool& operator=(const FramePool&) = delete;
+
+  // Up to `max` fresh slots, each in a handle with one reference; fewer when
+  // the pool runs dry
+  size_t take(FrameRef* refs, size_t max);
+  FrameRef take() {
+    FrameRef ref;
+    take(&ref, 1);
+    return ref;
+  }
+  // Moves slots released on other threads back to the free list
+  void reclaim();
+
+  size_t capacity() const {
+    return capacity_;
+  }
+  // Slots on the free list (returns not yet reclaimed are not counted)
+  size_t available() const {
+    return available_;
+  }
+  // take() calls that got fewer slots than asked for
+  uint64_t exhausted() const {
+    return exhausted_;
+  }
+  // Frames readers dropped for lack of slots
+  uint64_t dropped() const {
+    return dropped_;
+  }
+  void count_dropped(uint64_t n) {
+    dropped_ += n;
+  }
+
+private:
+  friend class FrameRef;
+  friend class SharedFrameRef;
+
+  void release(PooledFrame* slot) {
+    slot->next_free = free_;
+    free_           = slot;
+    available_++;
+  }
+  // Any thread
+  void return_slot(PooledFrame* slot);
+
+  size_t                         capacity_;
+  std::unique_ptr<PooledFrame[]> slots_;
+  PooledFrame*                   free_      = nullptr;
+  size_t                         available_ = 0;
+  uint64_t                       exhausted_ = 0;
+  uint64_t                       dropped_   = 0;
+
+  alignas(64) std::atomic<PooledFrame*> return_head_{nullptr};
+};
+
+inline void FrameRef::reset() {
+  if (slot_ && --slot_->refs == 0)
+    slot_->pool->release(slot_);
+  slot_ = nullptr;
+}
+
+inline SharedFrameRef FrameRef::share() const {
+  // The first shared handle holds one owner reference for all of them,
+  // given back through the return stack
+  if (slot_ &&
+      slot_->shared_refs.fetch_add(1, std::memory_order_acq_rel) == 0)
+    slot_->refs++;
+  return SharedFrameRef(slot_);
+}
+
+inline void SharedFrameRef::reset() {
+  if (slot_ &&
+      slot_->shared_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    slot_->pool->return_slot(slot_);
+  slot_ = nullptr;
+}
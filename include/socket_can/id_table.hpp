@@ -0,0 +1,141 @@
+#pragma once
+
+#include "socket_can/ring_buffer.hpp"
+#include <linux/can.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Per-ID state with constant-time lookup: standard IDs index a flat table of
+// 2048 entries, extended IDs go to a fixed-size open-addressing hash (linear
+// probing, Fibonacci hashing). Entries are never removed, so the layout stays
+// stable for concurrent readers.
+//
+// A single thread inserts. Other threads may call find() and for_each() at
+// any time and see only fully constructed entries; changes to an entry's
+// value after insertion need their own synchronization (see
+// traffic_statistics.hpp for a seqlock).
+template <typename T>
+class IdTable {
+public:
+  static constexpr size_t kSffSize = CAN_SFF_MASK + 1;
+
+  // The hash holds up to 3/4 of `eff_capacity` (rounded up to a power of two)
+  explicit IdTable(size_t eff_capacity = 4096)
+    : eff_capacity_(ring_capacity_for(eff_capacity)),
+      eff_limit_(eff_capacity_ / 4 * 3),
+      eff_shift_(32 - log2(eff_capacity_)),
+      sff_(new SffSlot[kSffSize]),
+      eff_(new EffSlot[eff_capacity_]) {
+  }
+
+  IdTable(const IdTable&)            = delete;
+  IdTable& operator=(const IdTable&) = delete;
+
+  // Key of a frame's ID: the 29-bit ID with CAN_EFF_FLAG, or the 11-bit ID.
+  // RTR and error flags are ignored.
+  static canid_t key_of(canid_t can_id) {
+    return can_id & CAN_EFF_FLAG ? can_id & (CAN_EFF_FLAG | CAN_EFF_MASK)
+                                 : can_id & CAN_SFF_MASK;
+  }
+
+  // Writer side: the entry for `can_id`, inserted (value-initialized) on
+  // first use. nullptr when the extended-ID hash is full.
+  T* get(canid_t can_id) {
+    canid_t key = key_of(can_id);
+    if (!(key & CAN_EFF_FLAG)) {
+      SffSlot& slot = sff_[key];
+      if (!slot.used.load(std::memory_order_relaxed)) {
+        slot.used.store(true, std::memory_order_release);
+        sff_size_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return &slot.value;
+    }
+    for (size_t i = hash(key);; i = (i + 1) & (eff_capacity_ - 1)) {
+      EffSlot& slot  = eff_[i];
+      canid_t  found = slot.key.load(std::memory_order_relaxed);
+      if (found == key)
+        return &slot.value;
+      if (found == 0) {
+        if (eff_size_.load(std::memory_order_relaxed) >= eff_limit_) {
+          eff_overflow_.fetch_add(1, std::memory_order_relaxed);
+          return nullptr;
+        }
+        slot.key.store(key, std::memory_order_release);
+        eff_size_.fetch_add(1, std::memory_order_relaxed);
+        return &slot.value;
+      }
+    }
+  }
+
+  // Any thread; nullptr when the ID has not been seen
+  const T* find(canid_t can_id) const {
+    canid_t key = key_of(can_id);
+    if (!(key & CAN_EFF_FLAG)) {
+      const SffSlot& slot = sff_[key];
+      return slot.used.load(std::memory_order_acquire) ? &slot.value : nullptr;
+    }
+    for (size_t i = hash(key);; i = (i + 1) & (eff_capacity_ - 1)) {
+      canid_t found = eff_[i].key.load(std::memory_order_acquire);
+      if (found == key)
+        return &eff_[i].value;
+      if (found == 0)
+        return nullptr;
+    }
+  }
+
+  // Any thread; calls fn(key, value) for every entry, standard IDs in
+  // ascending order first
+  template <typename F>
+  void for_each(F&& fn) const {
+    for (size_t id = 0; id < kSffSize; ++id) {
+      if (sff_[id].used.load(std::memory_order_acquire))
+        fn(static_cast<canid_t>(id), sff_[id].value);
+    }
+    for (size_t i = 0; i < eff_capacity_; ++i) {
+      canid_t key = eff_[i].key.load(std::memory_order_acquire);
+      if (key)
+        fn(key, eff_[i].value);
+    }
+  }
+
+  size_t size() const {
+    return sff_size_.load(std::memory_order_relaxed) +
+           eff_size_.load(std::memory_order_relaxed);
+  }
+  // Lookups of new extended IDs that found the hash full; any thread
+  uint64_t eff_overflow() const {
+    return eff_overflow_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct SffSlot {
+    std::atomic<bool> used{false};
+    T                 value{};
+  };
+  struct EffSlot {
+    std::atomic<canid_t> key{0};  // 0 = empty; keys carry CAN_EFF_FLAG
+    T                    value{};
+  };
+
+  static unsigned log2(size_t n) {
+    unsigned bits = 0;
+    while ((size_t{1} << bits) < n)
+      ++bits;
+    return bits;
+  }
+
+  size_t hash(canid_t key) const {
+    return (key * 0x9E3779B1u) >> eff_shift_;
+  }
+
+  const size_t               eff_capacity_;
+  const size_t               eff_limit_;
+  const unsigned             eff_shift_;
+  std::unique_ptr<SffSlot[]> sff_;
+  std::unique_ptr<EffSlot[]> eff_;
+  std::atomic<size_t>        sff_size_{0};
+  std::atomic<size_t>        eff_size_{0};
+  std::atomic<uint64_t>      eff_overflow_{0};
+};
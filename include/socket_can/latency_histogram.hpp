@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// HDR-style histogram of non-negative integer values (typically ns). Buckets
+// are log-linear: every power of two is split into kSubBuckets / 2 linear
+// sub-buckets, so any value is stored with a relative error below
+// 2 / kSubBuckets (< 1.6%) over the full 64-bit range. Recording is a few
+// integer operations on preallocated counters.
+class LatencyHistogram {
+public:
+  static constexpr int      kSubBucketBits = 7;
+  static constexpr uint64_t kSubBuckets    = 1ull << kSubBucketBits;
+  static constexpr size_t   kBucketCount =
+    (64 - kSubBucketBits + 2) * (kSubBuckets / 2);
+
+  LatencyHistogram();
+
+  void record(uint64_t value) {
+    record(value, 1);
+  }
+  void record(uint64_t value, uint64_t count) {
+    counts_[index_of(value)] += count;
+    count_ += count;
+    sum_ += static_cast<double>(value) * static_cast<double>(count);
+    if (value < min_)
+      min_ = value;
+    if (value > max_)
+      max_ = value;
+  }
+
+  void reset();
+  void merge(const LatencyHistogram& other);
+
+  uint64_t count() const {
+    return count_;
+  }
+  uint64_t min() const {
+    return count_ ? min_ : 0;
+  }
+  uint64_t max() const {
+    return max_;
+  }
+  double mean() const {
+    return count_ ? sum_ / static_cast<double>(count_) : 0;
+  }
+  // Highest value equivalent to the bucket holding the given percentile
+  // (0-100), clamped to the recorded maximum
+  uint64_t percentile(double percent) const;
+
+  // "n=... min=... p50=... p90=... p99=... p99.9=... p99.99=... max=..." with
+  // values divided by `divisor` (e.g. 1000 for ns -> us)
+  std::string summary(double divisor = 1) const;
+
+  static size_t index_of(uint64_t value) {
+    if (value < kSubBuckets)
+      return static_cast<size_t>(value);
+    int shift = 63 - __builtin_clzll(value) - (kSubBucketBits - 1);
+    return static_cast<size_t>((shift + 1) * (kSubBuckets / 2) +
+                               (value >> shift) - kSubBuckets / 2);
+  }
+  static uint64_t highest_equivalent(size_t index);
+
+  // Raw bucket counts, indexed by index_of(); zero-filled (and so resident)
+  // at construction
+  const std::vector<uint64_t>& counts() const {
+    return counts_;
+  }
+
+private:
+  std::vector<uint64_t> counts_;
+  uint64_t              count_ = 0;
+  uint64_t              min_   = UINT64_MAX;
+  uint64_t              max_   = 0;
+  double                sum_   = 0;
+};
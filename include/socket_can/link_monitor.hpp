@@ -0,0 +1,76 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+struct nlmsghdr;
+struct rtattr;
+
+// Appends an attribute to the rtnetlink message at the start of a buffer of
+// `capacity` bytes; nullptr when it does not fit. Without data it opens a
+// nested attribute, closed by rtnetlink_end_nested() after its children.
+struct rtattr* rtnetlink_add_attribute(struct nlmsghdr* message,
+                                       size_t           capacity,
+                                       uint16_t         type,
+                                       const void*      data,
+                                       size_t           size);
+void           rtnetlink_end_nested(struct nlmsghdr* message,
+                                    struct rtattr*   nested);
+
+// Link state of one network interface, from an rtnetlink message
+struct LinkEvent {
+  int         ifindex = 0;
+  std::string name;
+  bool        up      = false;  // administratively up (IFF_UP)
+  bool        running = false;  // carrier (IFF_RUNNING); off while bus-off
+  bool        removed = false;  // the interface was deleted
+};
+
+// Watches link changes through an rtnetlink socket (RTMGRP_LINK) registered
+// on an EpollEventLoop, so interface recovery runs on the loop's thread
+// without polling. One monitor can serve every interface of the loop.
+class LinkMonitor {
+public:
+  using Handler = std::function<void(const LinkEvent&)>;
+
+  ~LinkMonitor();
+
+  bool init(EpollEventLoop* event_loop);
+  void deinit();
+
+  // Handlers run on the loop thread; the id is for remove_handler(), which
+  // may be called from within a handler
+  int  add_handler(Handler handler);
+  void remove_handler(int id);
+
+  // Asks the kernel to restart a bus-off CAN controller now, like
+  // `ip link set <interface> type can restart`. Needs CAP_NET_ADMIN and is
+  // refused while automatic restart (restart-ms) is configured; failures
+  // are reported asynchronously on std::cerr.
+  bool request_can_restart(const std::string& interface);
+
+  // Appends the link events found in a buffer of rtnetlink messages; false
+  // when it is malformed
+  static bool parse(const void*             data,
+                    size_t                  size,
+                    std::vector<LinkEvent>& events);
+  // Whether `interface` exists and is administratively up
+  static bool is_up(const std::string& interface);
+
+private:
+  void on_readable(uint32_t mask);
+  bool request_dump();
+  void dispatch(const LinkEvent& event);
+
+  EpollEventLoop*        event_loop_ = nullptr;
+  EpollEventLoop::EvtId  evt_        = nullptr;
+  int                    fd_         = -1;
+  uint32_t               seq_        = 0;
+  int                    next_id_    = 0;
+  std::map<int, Handler> handlers_;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// Monotonic counter on its own cache line; inc() is one relaxed atomic add
+class MetricCounter {
+public:
+  void inc(uint64_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+  uint64_t value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<uint64_t> value_{0};
+};
+
+class MetricGauge {
+public:
+  void set(int64_t value) {
+    value_.store(value, std::memory_order_relaxed);
+  }
+  void add(int64_t delta) {
+    value_.fetch_add(delta, std::memory_order_relaxed);
+  }
+  int64_t value() const {
+    return value_.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<int64_t> value_{0};
+};
+
+// Histogram with power-of-two bucket bounds 2^min_exp .. 2^max_exp plus
+// +Inf. observe() finds the bucket with one bit scan and does two relaxed
+// adds. `scale` converts recorded units to exported ones (1e-9 for ns
+// recorded as seconds).
+class MetricHistogram {
+public:
+  MetricHistogram(int min_exp, int max_exp, double scale);
+
+  void observe(uint64_t value) {
+    int exp = value <= 1 ? 0 : 64 - __builtin_clzll(value - 1);
+    int index = exp < min_exp_ ? 0 : exp - min_exp_;
+    if (index > n_bounds_)
+      index = n_bounds_;
+    buckets_[index].fetch_add(1, std::memory_order_relaxed);
+    sum_.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  // Upper bound of bucket `index` in exported units (+Inf past the last)
+  double bound(int index) const;
+  int bounds() const {
+    return n_bounds_;
+  }
+  // Observations in bucket `index` alone (not cumulative)
+  uint64_t bucket(int index) const {
+    return buckets_[index].load(std::memory_order_relaxed);
+  }
+  uint64_t sum() const {
+    return sum_.load(std::memory_order_relaxed);
+  }
+  double scale() const {
+    return scale_;
+  }
+
+private:
+  const int                                min_exp_;
+  const int                                n_bounds_;
+  const double                             scale_;
+  std::unique_ptr<std::atomic<uint64_t>[]> buckets_;
+  alignas(64) std::atomic<uint64_t> sum_{0};
+};
+
+// Counter or gauge computed on the scraping thread, for values the owner
+// already keeps (queue depths, bus load). reset() waits for a running read
+// and disables later ones; owners call it before releasing what `read`
+// touches.
+class MetricCallback {
+public:
+  using Read = std::function<bool(double&)>;
+
+  explicit MetricCallback(Read read) : read_(std::move(read)) {
+  }
+
+  // False when disabled or the value is unavailable
+  bool read(double& value);
+  void reset();
+
+private:
+  std::mutex mutex_;
+  Read       read_;
+};
+
+// Named metric families with labelled series, rendered as OpenMetrics text.
+// The registry only holds weak references: a series disappears from the
+// output once its owner drops the returned pointer. Registration and
+// rendering take a mutex; updating a metric never does.
+//
+// Asking again for an existing counter, gauge or histogram with the same
+// name and labels returns the same object, so several owners aggregate into
+// one series. Callback series with equal labels are summed.
+class MetricsRegistry {
+public:
+  enum class Type { kCounter, kGauge, kHistogram };
+
+  // Process-wide registry the library instruments itself into
+  static MetricsRegistry& global();
+
+  // Names follow Prometheus rules; counters are exported with "_total"
+  std::shared_ptr<MetricCounter> counter(const std::string&  name,
+                                         const std::string&  help,
+                                         const MetricLabels& labels = {});
+  std::shared_ptr<MetricGauge>   gauge(const std::string&  name,
+                                       const std::string&  help,
+                                       const MetricLabels& labels = {});
+  std::shared_ptr<MetricHistogram> histogram(const std::string&  name,
+                                             const std::string&  help,
+                                             const MetricLabels& labels,
+                                             int                 min_exp,
+                                             int                 max_exp,
+                                             double              scale);
+  // `type` is kCounter or kGauge
+  std::shared_ptr<MetricCallback> callback(const std::string&    name,
+                                           const std::string&    help,
+                                           Type                  type,
+                                           const MetricLabels&   labels,
+                                           MetricCallback::Read read);
+
+  // OpenMetrics text exposition, ending with "# EOF"
+  std::string render() const;
+  // Writes render() to `path` through a temporary file and rename(), so
+  // readers (e.g. a node_exporter textfile collector) never see a partial
+  // snapshot
+  bool write_file(const std::string& path) const;
+
+private:
+  enum class Kind { kCounter, kGauge, kHistogram, kCallback };
+
+  struct Series {
+    MetricLabels        labels;
+    Kind                kind;
+    std::weak_ptr<void> metric;
+  };
+  struct Family {
+    Type                type;
+    std::string         help;
+    std::vector<Series> series;
+  };
+
+  // Live metric of `kind` with these labels, nullptr if none
+  std::shared_ptr<void> find(Family& family,
+                             Kind kind,
+                             const MetricLabels& labels);
+  Family* family(const std::string& name, const std::string& help, Type type);
+
+  mutable std::mutex mutex_;
+  // render() drops expired series
+  mutable std::map<std::string, Family> families_;
+};
+
+// Serves a registry's snapshot on a Unix domain stream socket from an event
+// loop; run it on a loop other than the receiving one so scrapes stay off
+// the hot path. A client that sends an HTTP GET
+// (curl --unix-socket PATH http://localhost/metrics) gets an HTTP/1.0
+// response; one that just shuts down its side
+// (socat - UNIX-CONNECT:PATH </dev/null) gets the bare text.
+class MetricsServer {
+public:
+  explicit MetricsServer(MetricsRegistry& registry = MetricsRegistry::global())
+    : registry_(registry) {
+  }
+  ~MetricsServer();
+
+  MetricsServer(const MetricsServer&)            = delete;
+  MetricsServer& operator=(const MetricsServer&) = delete;
+
+  // Replaces a stale socket at `path`; fails when `path` is any other file
+  bool init(const std::string& path, EpollEventLoop* event_loop);
+  void deinit();
+
+private:
+  static constexpr size_t kMaxClients = 16;
+
+  void on_accept(uint32_t mask);
+  void on_client(int fd, uint32_t mask);
+  void close_client(int fd);
+
+  MetricsRegistry&                     registry_;
+  EpollEventLoop*                      event_loop_ = nullptr;
+  EpollEventLoop::EvtId                listen_evt_ = nullptr;
+  int                                  listen_fd_  = -1;
+  std::string                          path_;
+  std::map<int, EpollEventLoop::EvtId> clients_;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/latency_histogram.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Thread setup for a latency-critical EpollEventLoop: CPU affinity, SCHED_FIFO,
+// locked memory and prefaulted stack and buffers, so the loop takes no page
+// faults or migrations once it runs.
+struct RealtimeConfig {
+  std::vector<int> cpus;                  // CPUs to pin to; empty = no pinning
+  int              fifo_priority = 0;     // 1-99 selects SCHED_FIFO; 0 = keep
+  bool             lock_memory   = false;  // mlockall(MCL_CURRENT | MCL_FUTURE)
+  size_t           stack_prefault_bytes = 256 * 1024;
+  bool             require_all = false;  // refuse to run if any step failed
+};
+
+// Outcome of each step; failures are also printed to std::cerr
+struct RealtimeReport {
+  bool                     affinity_set    = false;
+  bool                     scheduler_set   = false;
+  bool                     memory_locked   = false;
+  size_t                   prefaulted_bytes = 0;
+  std::vector<std::string> errors;
+
+  bool ok() const {
+    return errors.empty();
+  }
+};
+
+// Applies the configuration to the calling thread and prefaults its stack
+RealtimeReport apply_realtime_config(const RealtimeConfig& config);
+
+// Writes every page of a writable region so it is resident (and, after
+// mlockall, stays resident)
+void prefault_region(void* data, size_t size);
+
+// Runs an EpollEventLoop on a dedicated thread configured by RealtimeConfig.
+// The duration of every dispatched batch is recorded in dispatch_latency(),
+// which may be read after stop().
+class RealtimeLoopRunner {
+public:
+  RealtimeLoopRunner(EpollEventLoop* event_loop, RealtimeConfig config);
+  ~RealtimeLoopRunner();
+
+  // Preallocated buffers (rings, pools, capture buffers) to prefault on the
+  // loop thread before it enters the loop; call before start()
+  void add_prefault_region(void* data, size_t size);
+
+  // Starts the thread and waits until it has applied the configuration.
+  // Returns false if the thread could not start, or if require_all is set and
+  // a step failed.
+  bool start();
+  void stop();
+
+  const RealtimeReport& report() const {
+    return report_;
+  }
+  const LatencyHistogram& dispatch_latency() const {
+    return dispatch_latency_;
+  }
+
+private:
+  struct Region {
+    void*  data;
+    size_t size;
+  };
+
+  void thread_main();
+
+  EpollEventLoop*     event_loop_;
+  RealtimeConfig      config_;
+  std::vector<Region> regions_;
+  RealtimeReport      report_;
+  LatencyHistogram    dispatch_latency_;
+  EpollEvent          wakeup_;
+
+  std::mutex              mutex_;
+  std::condition_variable ready_cv_;
+  bool                    ready_   = false;
+  bool                    running_ = false;
+  std::atomic<bool>       stop_{false};
+  std::thread             thread_;
+};
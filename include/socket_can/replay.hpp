@@ -0,0 +1,96 @@
+#pragma once
+
+#include "socket_can/capture.hpp"
+#include "socket_can/socket_can.hpp"
+#include <linux/can.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Waits for absolute CLOCK_MONOTONIC deadlines. Sleeps with clock_nanosleep
+// until spin_ns before the deadline, then busy-waits the remainder, which keeps
+// wake-up error well below the scheduler's timer slack.
+class DeadlineScheduler {
+public:
+  static constexpr uint64_t kDefaultSpinNs = 200000;
+
+  explicit DeadlineScheduler(uint64_t spin_ns = kDefaultSpinNs)
+    : spin_ns_(spin_ns) {
+  }
+
+  static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+           static_cast<uint64_t>(ts.tv_nsec);
+  }
+
+  // Returns how late the caller was released (ns), or a negative value if the
+  // wait was interrupted by `cancel`
+  int64_t wait_until(uint64_t                 deadline_ns,
+                     const std::atomic<bool>* cancel = nullptr);
+
+private:
+  uint64_t spin_ns_;
+};
+
+struct ReplayStats {
+  uint64_t frames_read     = 0;
+  uint64_t frames_sent     = 0;
+  uint64_t frames_filtered = 0;  // dropped by ID filters or unmapped channels
+  uint64_t send_errors     = 0;
+  uint64_t late_frames     = 0;  // released more than 100 us after deadline
+  int64_t  max_lateness_ns = 0;
+  double   sum_lateness_ns = 0;
+};
+
+// Retransmits a capture through SocketCanIntf with the original inter-frame
+// timing, scaled by a speed factor.
+class ReplayEngine {
+public:
+  static constexpr double kMinSpeed = 0.1;
+  static constexpr double kMaxSpeed = 100.0;
+
+  // 1.0 replays in real time; 0 sends as fast as the interfaces accept frames
+  bool set_speed(double speed);
+
+  // Frames recorded on `channel` go out through `output`; unmapped channels
+  // are skipped unless a default output is set
+  void map_channel(uint32_t channel, SocketCanIntf* output);
+  void set_default_output(SocketCanIntf* output) {
+    default_output_ = output;
+  }
+
+  // Kernel-style ID filters (CAN_INV_FILTER supported). A frame is replayed if
+  // it matches any filter; no filters means everything is replayed.
+  void add_filter(const can_filter& filter) {
+    filters_.push_back(filter);
+  }
+
+  void set_spin_ns(uint64_t spin_ns) {
+    scheduler_ = DeadlineScheduler(spin_ns);
+  }
+
+  // Blocks until the source is exhausted or stop() is called
+  bool run(FrameSource& source);
+  void stop() {
+    stop_ = true;
+  }
+
+  const ReplayStats& stats() const {
+    return stats_;
+  }
+
+private:
+  bool           accepts(const can_frame& frame) const;
+  SocketCanIntf* output_for(uint32_t channel) const;
+  bool           send(SocketCanIntf* output, const can_frame& frame);
+
+  double                      speed_          = 1.0;
+  SocketCanIntf*              default_output_ = nullptr;
+  std::vector<SocketCanIntf*> outputs_;
+  std::vector<can_filter>     filters_;
+  DeadlineScheduler           scheduler_;
+  std::atomic<bool>           stop_{false};
+  ReplayStats                 stats_;
+};
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/socket_can.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Matches responses to outstanding requests on one SocketCanIntf.
+//
+// Outstanding requests are indexed by (response ID, match key), so a
+// response completes its request in O(1) however many are pending; requests
+// with equal ID and key complete in submission order. Timeouts sit in a
+// timer wheel driven by a timerfd that only ticks while requests are
+// outstanding, and expire slot by slot in batches.
+//
+// Requests are grouped by target (the request frame's ID, i.e. the ECU's
+// physical address). Each target has a limit of outstanding requests; the
+// rest wait in a FIFO and go out as earlier ones complete.
+//
+// Everything runs on the loop's thread: call on_frame() from the
+// interface's FrameProcessor.
+class RequestCorrelator {
+public:
+  enum class Result { kResponse, kTimeout, kSendFailed, kCancelled };
+
+  // `response` is only set for kResponse
+  using Handler =
+    std::function<void(Result result, const can_frame* response)>;
+  // Match key of a response frame; the default returns 0, matching by ID only
+  using KeyExtractor = std::function<uint32_t(const can_frame& response)>;
+
+  struct Request {
+    can_frame                 tx          = {};
+    canid_t                   response_id = 0;  // with CAN_EFF_FLAG if 29-bit
+    uint32_t                  key         = 0;  // expected KeyExtractor value
+    std::chrono::milliseconds timeout{100};
+    Handler                   handler;
+  };
+
+  static constexpr uint64_t kInvalidId = 0;
+
+  ~RequestCorrelator();
+
+  bool init(SocketCanIntf*            intf,
+            EpollEventLoop*           event_loop,
+            std::chrono::milliseconds tick = std::chrono::milliseconds(1));
+  // Cancels every request
+  void deinit();
+
+  void set_key_extractor(KeyExtractor key_extractor) {
+    key_extractor_ = std::move(key_extractor);
+  }
+  // Outstanding requests per target; 0 means unlimited. Default 1.
+  void set_default_limit(size_t limit) {
+    default_limit_ = limit;
+  }
+  void set_limit(canid_t target, size_t limit);
+
+  // Sends the request now, or queues it behind its target's limit. The
+  // handler runs exactly once, possibly from within submit() when sending
+  // fails. Returns an id for cancel(), kInvalidId when not initialized.
+  uint64_t submit(Request request);
+  // Completes a pending request with kCancelled; false if already done
+  bool cancel(uint64_t id);
+
+  // True when `frame` completed a request
+  bool on_frame(const can_frame& frame);
+
+  size_t outstanding() const {
+    return outstanding_;
+  }
+  size_t queued() const {
+    return queued_;
+  }
+
+private:
+  static constexpr uint32_t kNone       = UINT32_MAX;
+  static constexpr size_t   kWheelSlots = 512;
+
+  enum class State : uint8_t { kFree, kQueued, kOutstanding };
+
+  struct Entry {
+    Request  request;
+    uint32_t generation = 0;
+    State    state      = State::kFree;
+    canid_t  target     = 0;
+    uint64_t match_key  = 0;
+    uint64_t deadline   = 0;  // wheel tick
+    // Match list while outstanding, target queue while queued
+    uint32_t prev       = kNone;
+    uint32_t next       = kNone;
+    uint32_t wheel_prev = kNone;
+    uint32_t wheel_next = kNone;
+  };
+
+  struct List {
+    uint32_t head = kNone;
+    uint32_t tail = kNone;
+  };
+
+  struct Target {
+    size_t limit  = SIZE_MAX;  // SIZE_MAX: use the default
+    size_t active = 0;
+    List   queue;
+  };
+
+  static canid_t normalize(canid_t can_id) {
+    return can_id & CAN_EFF_FLAG
+             ? can_id & (CAN_EFF_FLAG | CAN_EFF_MASK)
+             : can_id & CAN_SFF_MASK;
+  }
+  static uint64_t match_key(canid_t response_id, uint32_t key) {
+    return static_cast<uint64_t>(normalize(response_id)) << 32 | key;
+  }
+  static uint64_t make_id(uint32_t index, uint32_t generation) {
+    return static_cast<uint64_t>(generation) << 32 | (index + 1);
+  }
+
+  size_t limit_of(const Target& target) const {
+    size_t limit = target.limit == SIZE_MAX ? default_limit_ : target.limit;
+    return limit ? limit : SIZE_MAX;
+  }
+
+  void     push(List& list, uint32_t index);
+  void     remove(List& list, uint32_t index);
+  void     wheel_insert(uint32_t index);
+  void     wheel_remove(uint32_t index);
+  bool     activate(uint32_t index);
+  void     pump(canid_t target);
+  void     finish(uint32_t index, Result result, const can_frame* response);
+  uint64_t current_tick() const;
+  void     start_ticking();
+  void     stop_ticking();
+  void     on_tick(uint32_t mask);
+
+  SocketCanIntf*        intf_       = nullptr;
+  EpollEventLoop*       event_loop_ = nullptr;
+  EpollEventLoop::EvtId timer_evt_  = nullptr;
+  int                   timerfd_    = -1;
+  uint64_t              tick_ns_    = 1000000;
+  uint64_t              base_ns_    = 0;
+  uint64_t              processed_  = 0;  // last wheel tick expired
+  bool                  ticking_    = false;
+  KeyExtractor          key_extractor_;
+  size_t                default_limit_ = 1;
+  size_t                outstanding_   = 0;
+  size_t                queued_        = 0;
+
+  std::vector<Entry>                  entries_;
+  std::vector<uint32_t>               free_;
+  std::unordered_map<uint64_t, List>  matches_;
+  std::unordered_map<canid_t, Target> targets_;
+  std::vector<List>                   wheel_;
+  std::vector<uint64_t>               expired_;  // on_tick() batch
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include "socket_can/socket_can.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+
+// Lock-free rings for handing frames from the EpollEventLoop thread to worker
+// threads. Slots are preallocated and cache-line aligned; push() copies the
+// value once and never blocks.
+
+constexpr size_t kCacheLineSize = 64;
+
+inline size_t ring_capacity_for(size_t n) {
+  size_t capacity = 2;
+  while (capacity < n)
+    capacity <<= 1;
+  return capacity;
+}
+
+// Single producer, single consumer. When the consumer falls behind, push()
+// drops the new value and counts it instead of waiting.
+template <typename T>
+class SpscRing {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ring values are copied with plain assignment");
+
+public:
+  explicit SpscRing(size_t capacity)
+    : capacity_(ring_capacity_for(capacity)),
+      mask_(capacity_ - 1),
+      slots_(new Slot[capacity_]) {
+  }
+
+  SpscRing(const SpscRing&)            = delete;
+  SpscRing& operator=(const SpscRing&) = delete;
+
+  // Producer side
+  bool push(const T& value) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - cached_tail_ >= capacity_) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head - cached_tail_ >= capacity_) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+    }
+    slots_[head & mask_].value = value;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side
+  bool pop(T& value) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == cached_head_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail == cached_head_)
+        return false;
+    }
+    value = slots_[tail & mask_].value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const {
+    return static_cast<size_t>(head_.load(std::memory_order_acquire) -
+                               tail_.load(std::memory_order_acquire));
+  }
+  size_t capacity() const {
+    return capacity_;
+  }
+  // Values rejected because the ring was full
+  uint64_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct alignas(kCacheLineSize) Slot {
+    T value;
+  };
+
+  const size_t            capacity_;
+  const size_t            mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  alignas(kCacheLineSize) std::atomic<uint64_t> head_{0};
+  uint64_t              cached_tail_ = 0;
+  std::atomic<uint64_t> dropped_{0};
+  alignas(kCacheLineSize) std::atomic<uint64_t> tail_{0};
+  uint64_t cached_head_ = 0;
+};
+
+// Single writer, any number of readers, each with its own cursor. The writer
+// always overwrites the oldest slot; a reader that was lapped skips ahead to
+// the oldest value still in the ring and adds the skipped count to its
+// overrun counter. Every slot carries a sequence number that works as a
+// per-slot seqlock, so readers never write shared state.
+template <typename T>
+class BroadcastRing {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "ring values are copied with plain assignment");
+
+public:
+  class Reader {
+  public:
+    // Next value; false when the reader has caught up with the writer
+    bool read(T& value);
+
+    // Values published but not yet read, capped at the ring capacity
+    size_t pending() const;
+    // Values lost because the writer lapped this reader
+    uint64_t overruns() const {
+      return overruns_;
+    }
+
+  private:
+    friend class BroadcastRing;
+    Reader(const BroadcastRing* ring, uint64_t cursor)
+      : ring_(ring), cursor_(cursor) {
+    }
+
+    const BroadcastRing* ring_;
+    uint64_t             cursor_;
+    uint64_t             overruns_ = 0;
+  };
+
+  explicit BroadcastRing(size_t capacity)
+    : capacity_(ring_capacity_for(capacity)),
+      mask_(capacity_ - 1),
+      slots_(new Slot[capacity_]) {
+  }
+
+  BroadcastRing(const BroadcastRing&)            = delete;
+  BroadcastRing& operator=(const BroadcastRing&) = delete;
+
+  // Writer side; always succeeds
+  bool push(const T& value) {
+    uint64_t pos  = head_.load(std::memory_order_relaxed);
+    Slot&    slot = slots_[pos & mask_];
+    slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.value = value;
+    slot.seq.store(2 * pos + 2, std::memory_order_release);
+    head_.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // A reader that starts with the next published value
+  Reader subscribe() const {
+    return Reader(this, head_.load(std::memory_order_acquire));
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+  uint64_t published() const {
+    return head_.load(std::memory_order_acquire);
+  }
+
+private:
+  struct alignas(kCacheLineSize) Slot {
+    std::atomic<uint64_t> seq{0};
+    T                     value;
+  };
+
+  const size_t            capacity_;
+  const size_t            mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  alignas(kCacheLineSize) std::atomic<uint64_t> head_{0};
+};
+
+template <typename T>
+bool BroadcastRing<T>::Reader::read(T& value) {
+  for (;;) {
+    const Slot& slot     = ring_->slots_[cursor_ & ring_->mask_];
+    uint64_t    expected = 2 * cursor_ + 2;
+    uint64_t    seq      = slot.seq.load(std::memory_order_acquire);
+    if (seq == expected) {
+      value = slot.value;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == expected) {
+        ++cursor_;
+        return true;
+      }
+    } else if (seq < expected) {
+      return false;  // not written yet
+    }
+
+    // Lapped: resume from the oldest slot; if the writer is still in the
+    // middle of overwriting it, report empty and let the caller retry
+    uint64_t head   = ring_->head_.load(std::memory_order_acquire);
+    uint64_t oldest = head > ring_->capacity_ ? head - ring_->capacity_ : 0;
+    if (oldest <= cursor_)
+      return false;
+    overruns_ += oldest - cursor_;
+    cursor_ = oldest;
+  }
+}
+
+template <typename T>
+size_t BroadcastRing<T>::Reader::pending() const {
+  uint64_t head = ring_->head_.load(std::memory_order_acquire);
+  uint64_t n    = head - cursor_;
+  return static_cast<size_t>(n < ring_->capacity_ ? n : ring_->capacity_);
+}
+
+// FrameProcessor that publishes every received frame into a ring, for
+// SocketCanIntf::init(). The ring must outlive the interface.
+template <typename Ring>
+FrameProcessor ring_frame_processor(Ring& ring) {
+  return [&ring](const can_frame& frame) { ring.push(frame); };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/socket_can.hpp"
+#include <linux/can.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Shared-memory frame bus: one process reads the CAN socket and publishes
+// frames into a POSIX shared-memory ring, any number of subscriber processes
+// read them without their own sockets. The ring is a broadcast ring with
+// per-slot sequence numbers (see BroadcastRing); idle subscribers sleep on a
+// futex in the shared segment that the publisher only wakes when someone is
+// waiting.
+
+struct ShmBusHeader {
+  static constexpr char     kMagic[8] = {'S', 'C', 'A', 'N', 'S', 'H', 'M', 0};
+  static constexpr uint32_t kVersion  = 1;
+
+  char     magic[8];
+  uint32_t version;
+  uint32_t slot_size;
+  uint64_t slot_count;
+
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint32_t> wake_seq;
+  std::atomic<uint32_t> waiters;
+};
+
+struct alignas(32) ShmBusSlot {
+  std::atomic<uint64_t> seq;
+  can_frame             frame;
+};
+
+static_assert(sizeof(ShmBusSlot) == 32, "two slots per cache line");
+static_assert(std::atomic<uint64_t>::is_always_lock_free &&
+                std::atomic<uint32_t>::is_always_lock_free,
+              "shared atomics must be address-free");
+
+// Shared-memory object name of a bus: "/socket_can.<name>"
+std::string shm_bus_path(const std::string& name);
+
+class ShmFramePublisher {
+public:
+  static constexpr size_t kDefaultSlots = 64 * 1024;
+
+  ~ShmFramePublisher();
+
+  // Creates (or recreates) the bus. Subscribers attached to an older
+  // instance of the same name keep the old segment and must re-attach.
+  bool open(const std::string& name, size_t slot_count = kDefaultSlots);
+  void close();
+
+  // Never blocks; the oldest frame is overwritten when the ring is full.
+  // Returns false if the bus is not open.
+  bool publish(const can_frame& frame);
+
+  // Publishes every received frame, for SocketCanIntf::init()
+  FrameProcessor frame_processor() {
+    return [this](const can_frame& frame) { publish(frame); };
+  }
+
+  uint64_t published() const;
+
+private:
+  std::string   path_;
+  ShmBusHeader* header_ = nullptr;
+  ShmBusSlot*   slots_  = nullptr;
+  size_t        size_   = 0;
+  uint64_t      mask_   = 0;
+};
+
+// Mirrors SocketCanIntf::init(): frames arrive through a FrameProcessor on
+// the EpollEventLoop thread, so a consumer switches by changing its member
+// type. A helper thread sleeps on the bus futex and signals the loop through
+// an EpollEvent; the loop then drains everything that is available.
+class ShmFrameSubscriber {
+public:
+  ~ShmFrameSubscriber();
+
+  bool init(const std::string& name,
+            EpollEventLoop*    event_loop,
+            FrameProcessor     frame_processor);
+  void deinit();
+
+  // Frames delivered to the FrameProcessor
+  uint64_t received() const {
+    return received_;
+  }
+  // Frames lost because the publisher lapped this subscriber
+  uint64_t overruns() const {
+    return overruns_;
+  }
+
+private:
+  bool attach(const std::string& name);
+  void detach();
+  void on_event(uint32_t mask);
+  void drain();
+  void waiter();
+
+  ShmBusHeader*  header_ = nullptr;
+  ShmBusSlot*    slots_  = nullptr;
+  size_t         size_   = 0;
+  uint64_t       mask_   = 0;
+  FrameProcessor frame_processor_;
+  EpollEvent     event_;
+
+  uint64_t              cursor_   = 0;  // loop thread only
+  uint64_t              received_ = 0;
+  uint64_t              overruns_ = 0;
+  std::atomic<uint64_t> delivered_{0};  // cursor published to the waiter
+
+  std::mutex              mutex_;
+  std::condition_variable drained_cv_;
+  bool                    notified_ = false;
+  bool                    stopping_ = false;
+  std::thread             thread_;
+};
@@ -1,33 +1,151 @@
 #pragma once
 
+#include "socket_can/basic_socket_can.hpp"
+#include "socket_can/can_error.hpp"
+#include "socket_can/can_transport.hpp"
 #include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/frame_pool.hpp"
+#include "socket_can/link_monitor.hpp"
+#include "socket_can/metrics.hpp"
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <memory>
 #include <string>
 #include <functional>
+#include <vector>
 
 using FrameProcessor = std::function<void(const can_frame&)>;
+using ErrorHandler   = std::function<void(const CanErrorInfo&)>;
+// Consumers keep a pooled frame by copying the handle
+using PooledFrameProcessor = std::function<void(const FrameRef&)>;
 
+// Exports its RX/TX counters, socket queue depths, controller state and
+// recoveries to MetricsRegistry::global(), labelled with the interface name.
+// Everything is configured at run time and frames reach the processor
+// through a std::function; BasicSocketCan is the compile-time variant for
+// hot receive paths.
 class SocketCanIntf {
 public:
+  // "vbus:<name>" opens a node on an in-process VirtualCanBus, anything else
+  // a SocketCAN interface
   bool init(const std::string& interface,
             EpollEventLoop*    event_loop,
             FrameProcessor     frame_processor);
+  // Uses an already opened transport, named after CanTransport::name()
+  bool init(std::unique_ptr<CanTransport> transport,
+            EpollEventLoop*               event_loop,
+            FrameProcessor                frame_processor);
   void deinit();
   bool send_can_frame(const can_frame& frame);
+  // Sends in order until the TX queue is full; returns the number sent
+  size_t send_can_frames(const can_frame* frames, size_t count);
+  // Waits up to timeout_ms for room in the socket send buffer
+  bool wait_writable(int timeout_ms);
 
   bool read_nonblocking();
+  // Runs after each received batch has gone through the frame processor,
+  // e.g. to flush work the processor queued per frame
+  void set_batch_end_handler(std::function<void()> handler) {
+    batch_end_handler_ = std::move(handler);
+  }
+
+  // Frames are read straight into slots of `pool` and passed as handles to
+  // `processor` instead of the frame processor, so stages that keep a frame
+  // share one copy. When the pool runs dry, the rest of the batch is read
+  // and dropped (pool->dropped()). The pool must belong to the loop thread.
+  void set_frame_pool(FramePool* pool, PooledFrameProcessor processor) {
+    frame_pool_       = pool;
+    pooled_processor_ = std::move(processor);
+  }
+
+  // Kernel receive filters; empty receives every frame. Kept and re-applied
+  // when the socket is re-opened.
+  bool set_filters(const std::vector<can_filter>& filters);
+  // Subscribes to the error classes in `mask`. Error frames are decoded and
+  // passed to `handler` (may be empty) instead of the frame processor.
+  bool set_error_handler(ErrorHandler   handler,
+                         can_err_mask_t mask = CAN_ERR_MASK);
+  // From the error frames seen so far
+  CanControllerState controller_state() const {
+    return error_tracker_.state();
+  }
+
+  // Instead of giving up on EPOLLERR, closes the socket and re-opens and
+  // re-binds it (with its filters and error mask) as soon as `monitor`
+  // reports the interface up again. Transports without a kernel link (see
+  // CanTransport::has_link_state()) still give up on EPOLLERR. The monitor
+  // must run on the same event loop and outlive the interface. With
+  // `restart_bus_off`, a controller that goes bus-off is restarted through
+  // rtnetlink right away.
+  void enable_recovery(LinkMonitor* monitor, bool restart_bus_off = false);
+  // False while waiting for the interface to come back; sends fail with
+  // ENETDOWN meanwhile
+  bool link_up() const {
+    return !down_;
+  }
+  // Link change for any interface, as delivered by LinkMonitor
+  void on_link_event(const LinkEvent& event);
 
 private:
-  std::string           interface_;
-  int                   socket_id_  = -1;
-  EpollEventLoop*       event_loop_ = nullptr;
-  EpollEventLoop::EvtId socket_evt_id_;
-  FrameProcessor        frame_processor_;
-  bool                  broken_ = false;
+  static constexpr size_t kReadBatch = 16;
+
+  struct Metrics {
+    std::shared_ptr<MetricCounter>               rx_frames;
+    std::shared_ptr<MetricCounter>               rx_error_frames;
+    std::shared_ptr<MetricCounter>               tx_frames;
+    std::shared_ptr<MetricCounter>               tx_queue_full;
+    std::shared_ptr<MetricCounter>               errors;
+    std::shared_ptr<MetricGauge>                 controller_state;
+    std::shared_ptr<MetricGauge>                 link_up;
+    std::shared_ptr<MetricCounter>               bus_off;
+    std::shared_ptr<MetricCounter>               link_recoveries;
+    std::shared_ptr<MetricCounter>               bus_off_recoveries;
+    std::shared_ptr<MetricHistogram>             link_downtime;
+    std::shared_ptr<MetricHistogram>             bus_off_downtime;
+    std::vector<std::shared_ptr<MetricCallback>> queues;
+  };
+
+  std::string                   interface_;
+  std::unique_ptr<CanTransport> transport_;
+  EpollEventLoop*               event_loop_ = nullptr;
+  EpollEventLoop::EvtId         socket_evt_id_;
+  FrameProcessor                frame_processor_;
+  FramePool*                    frame_pool_ = nullptr;
+  PooledFrameProcessor          pooled_processor_;
+  std::function<void()>         batch_end_handler_;
+  bool                          broken_ = false;
+  Metrics                       metrics_;
 
+  std::vector<can_filter> filters_;
+  ErrorHandler            error_handler_;
+  can_err_mask_t          error_mask_ = 0;
+  CanErrorTracker         error_tracker_;
+  uint64_t                bus_off_ns_ = 0;  // when the controller went bus-off
+
+  LinkMonitor* link_monitor_    = nullptr;
+  int          link_handler_    = -1;
+  bool         restart_bus_off_ = false;
+  bool         down_            = false;
+  uint64_t     down_ns_         = 0;
+
+  void register_metrics();
+  void register_queue_metrics();
+  void release_metrics();
+  bool register_socket();
+  bool apply_socket_options();
+  void link_lost(const char* reason);
+  bool reopen();
   void on_socket_event(uint32_t mask);
+  ssize_t receive_pooled(size_t max, uint64_t& error_frames);
+  void on_error_frame(const can_frame& frame);
   void process_can_frame(const can_frame& frame) {
-    frame_processor_(frame);
+    if (frame.can_id & CAN_ERR_FLAG)
+      on_error_frame(frame);
+    else
+      frame_processor_(frame);
   }
 };
+
+// SocketCanIntf's receive path on BasicSocketCan: a type-erased processor
+// and batches of 16
+using FunctionSocketCan = BasicSocketCan<FrameProcessor, CanBatching<16>>;
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Allocation-free formatting and parsing primitives shared by the text capture
+// formats. Writers take a destination pointer and return the advanced pointer;
+// the caller guarantees enough room.
+namespace text_format {
+
+struct HexTable {
+  char upper[256][2];
+  char lower[256][2];
+
+  constexpr HexTable() : upper(), lower() {
+    const char* u = "0123456789ABCDEF";
+    const char* l = "0123456789abcdef";
+    for (int i = 0; i < 256; ++i) {
+      upper[i][0] = u[i >> 4];
+      upper[i][1] = u[i & 0xF];
+      lower[i][0] = l[i >> 4];
+      lower[i][1] = l[i & 0xF];
+    }
+  }
+};
+
+inline constexpr HexTable kHexTable{};
+
+inline char* put_hex_byte(char* out, uint8_t value) {
+  out[0] = kHexTable.upper[value][0];
+  out[1] = kHexTable.upper[value][1];
+  return out + 2;
+}
+
+// Fixed-width upper-case hex, most significant nibble first
+inline char* put_hex(char* out, uint32_t value, int digits) {
+  for (int i = digits - 1; i >= 0; --i) {
+    out[i] = kHexTable.upper[value & 0xF][1];
+    value >>= 4;
+  }
+  return out + digits;
+}
+
+inline char* put_hex_byte_lower(char* out, uint8_t value) {
+  out[0] = kHexTable.lower[value][0];
+  out[1] = kHexTable.lower[value][1];
+  return out + 2;
+}
+
+inline char* put_hex_lower(char* out, uint32_t value, int digits) {
+  for (int i = digits - 1; i >= 0; --i) {
+    out[i] = kHexTable.lower[value & 0xF][1];
+    value >>= 4;
+  }
+  return out + digits;
+}
+
+inline char* put_uint(char* out, uint64_t value) {
+  char  tmp[20];
+  char* p = tmp + sizeof(tmp);
+  do {
+    *--p = static_cast<char>('0' + value % 10);
+    value /= 10;
+  } while (value);
+  while (p < tmp + sizeof(tmp))
+    *out++ = *p++;
+  return out;
+}
+
+// Zero-padded decimal of exactly `digits` digits
+inline char* put_uint_padded(char* out, uint64_t value, int digits) {
+  for (int i = digits - 1; i >= 0; --i) {
+    out[i] = static_cast<char>('0' + value % 10);
+    value /= 10;
+  }
+  return out + digits;
+}
+
+inline char* put_str(char* out, const char* s, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    out[i] = s[i];
+  return out + n;
+}
+
+inline int hex_value(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  return -1;
+}
+
+inline const char* skip_spaces(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+  return p;
+}
+
+// Parses hex digits up to a non-hex character; returns nullptr if none
+inline const char* parse_hex(const char* p, const char* end, uint32_t* value) {
+  uint32_t    v     = 0;
+  const char* start = p;
+  int         d;
+  while (p < end && (d = hex_value(*p)) >= 0) {
+    v = (v << 4) | static_cast<uint32_t>(d);
+    ++p;
+  }
+  if (p == start)
+    return nullptr;
+  *value = v;
+  return p;
+}
+
+inline const char* parse_uint(const char* p, const char* end, uint64_t* value) {
+  uint64_t    v     = 0;
+  const char* start = p;
+  while (p < end && *p >= '0' && *p <= '9') {
+    v = v * 10 + static_cast<uint64_t>(*p - '0');
+    ++p;
+  }
+  if (p == start)
+    return nullptr;
+  *value = v;
+  return p;
+}
+
+// Parses "<sec>.<frac>" into nanoseconds; the fraction may have 0-9 digits
+inline const char* parse_seconds_ns(const char* p,
+                                    const char* end,
+                                    uint64_t*   ns) {
+  uint64_t sec = 0;
+  p            = parse_uint(p, end, &sec);
+  if (!p)
+    return nullptr;
+  uint64_t frac   = 0;
+  int      digits = 0;
+  if (p < end && *p == '.') {
+    ++p;
+    while (p < end && *p >= '0' && *p <= '9') {
+      if (digits < 9) {
+        frac = frac * 10 + static_cast<uint64_t>(*p - '0');
+        ++digits;
+      }
+      ++p;
+    }
+  }
+  for (; digits < 9; ++digits)
+    frac *= 10;
+  *ns = sec * 1000000000ull + frac;
+  return p;
+}
+
+}  // namespace text_format
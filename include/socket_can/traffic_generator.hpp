@@ -0,0 +1,113 @@
+#pragma once
+
+#include <linux/can.h>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Synthetic bus traffic for load and stress tests. A profile describes a mix
+// of message sources; the generator turns it into frames on absolute
+// deadlines, optionally scaled so the mix reaches a target bus load.
+//
+// Profile file, one directive per line, '#' starts a comment; IDs are hex,
+// 3 digits for standard and 8 for extended frames (as in candump logs):
+//
+//   bitrate 500000
+//   load 80                          # percent of bitrate; 0 = as written
+//   periodic 123 8 10                # id dlc period_ms
+//   burst 7E8 8 16 500               # id dlc frames mean_interval_ms
+//   random 600-6FF 0-8 5             # ids dlcs mean_interval_ms
+//
+// Periodic sources never drift; bursts and random frames arrive with
+// exponentially distributed gaps around their mean interval.
+struct TrafficSource {
+  enum Kind { kPeriodic, kBurst, kRandom };
+
+  Kind     kind         = kPeriodic;
+  canid_t  id           = 0;  // with CAN_EFF_FLAG for extended frames
+  canid_t  id_max       = 0;  // random: last ID of the range
+  uint8_t  dlc          = 8;
+  uint8_t  dlc_max      = 8;  // random: largest DLC
+  double   interval_ms  = 100;
+  uint32_t burst_frames = 1;
+
+  // Average frames per second and wire bits per frame
+  double frames_per_second() const;
+  double bits_per_frame() const;
+};
+
+struct TrafficProfile {
+  uint32_t                   bitrate = 500000;
+  double                     load    = 0;  // percent; 0 keeps the intervals
+  std::vector<TrafficSource> sources;
+
+  // Parse errors are reported with their line number on std::cerr
+  bool parse(std::istream& in);
+  bool load_file(const std::string& path);
+
+  // Bits per second the sources offer as written
+  double offered_bits_per_second() const;
+
+  // Periodic powertrain-like messages, an extended-ID message, a diagnostic
+  // burst and random low-priority fill
+  static TrafficProfile default_mix();
+};
+
+// Single-threaded and allocation-free after construction, so one thread can
+// drive generators for several buses.
+class TrafficGenerator {
+public:
+  explicit TrafficGenerator(const TrafficProfile& profile, uint64_t seed = 1);
+
+  // Schedules every source from `now_ns` (CLOCK_MONOTONIC)
+  void start(uint64_t now_ns);
+
+  // Earliest pending deadline
+  uint64_t next_deadline() const {
+    return heap_.empty() ? UINT64_MAX : heap_.front().deadline_ns;
+  }
+
+  // Writes up to `max` frames due at or before `until_ns`, in deadline order
+  size_t poll(uint64_t until_ns, can_frame* frames, size_t max);
+
+  // Interval scale applied to reach the profile's load (1 = as written)
+  double scale() const {
+    return scale_;
+  }
+  uint64_t generated() const {
+    return generated_;
+  }
+  uint64_t generated_bits() const {
+    return generated_bits_;
+  }
+
+private:
+  struct Source {
+    TrafficSource config;
+    uint64_t      interval_ns;
+    uint64_t      counter    = 0;
+    uint32_t      burst_left = 0;
+  };
+  struct Entry {
+    uint64_t deadline_ns;
+    uint32_t source;
+  };
+  struct Later {
+    bool operator()(const Entry& a, const Entry& b) const {
+      return a.deadline_ns > b.deadline_ns;
+    }
+  };
+
+  void     make_frame(Source& source, can_frame& frame);
+  uint64_t random_interval(uint64_t mean_ns);
+  uint64_t random_u64();
+
+  std::vector<Source> sources_;
+  std::vector<Entry>  heap_;  // min-heap on deadline_ns
+  double              scale_          = 1;
+  uint64_t            rng_state_      = 0;
+  uint64_t            generated_      = 0;
+  uint64_t            generated_bits_ = 0;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "socket_can/bus_load.hpp"
+#include "socket_can/id_table.hpp"
+#include "socket_can/socket_can.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Streaming per-ID statistics: count, observed period, jitter and largest gap
+// between frames, and DLC changes. Intervals use Welford's running mean and
+// variance, so every update is constant time.
+struct IdStats {
+  uint64_t count            = 0;
+  uint64_t first_ns         = 0;
+  uint64_t last_ns          = 0;
+  uint64_t min_interval_ns  = 0;
+  uint64_t max_interval_ns  = 0;  // largest gap seen
+  double   mean_interval_ns = 0;
+  double   m2_interval      = 0;  // sum of squared deviations
+  uint32_t dlc_changes      = 0;
+  uint8_t  dlc              = 0;
+
+  // Standard deviation of the interval (sample), 0 with fewer than 3 frames
+  double jitter_ns() const;
+  // Frames per second over the observed span
+  double rate_hz() const;
+  // How far past its usual period the ID is at `now_ns`: time since the last
+  // frame minus the mean interval, 0 when not late
+  uint64_t overdue_ns(uint64_t now_ns) const;
+};
+
+// One instance per receiving loop: record() runs on that thread only, while
+// snapshot() and snapshot_all() may be called from any thread without pausing
+// reception. Each entry is guarded by a seqlock; readers retry if the entry
+// changed while they copied it.
+class TrafficStatistics {
+public:
+  // `eff_capacity` bounds the number of distinct extended IDs tracked
+  explicit TrafficStatistics(size_t eff_capacity = 4096)
+    : table_(eff_capacity) {
+  }
+
+  // `timestamp_ns` must be monotonic (CLOCK_MONOTONIC); error frames are
+  // ignored
+  void record(const can_frame& frame, uint64_t timestamp_ns) {
+    if (frame.can_id & CAN_ERR_FLAG)
+      return;
+    if (bus_load_)
+      bus_load_->add(frame, timestamp_ns);
+    Entry* entry = table_.get(frame.can_id);
+    if (!entry)
+      return;
+
+    uint32_t seq = entry->seq.load(std::memory_order_relaxed);
+    entry->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    update(entry->stats, frame, timestamp_ns);
+    entry->seq.store(seq + 2, std::memory_order_release);
+    frames_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Records with the current CLOCK_MONOTONIC time
+  FrameProcessor frame_processor();
+
+  // Also feeds a BusLoadEstimator for the interface's bitrate(s); call
+  // before recording starts
+  void enable_bus_load(uint32_t bitrate, uint32_t data_bitrate = 0) {
+    bus_load_.reset(new BusLoadEstimator(bitrate, data_bitrate));
+  }
+  // nullptr unless enabled; its load() may be read from any thread
+  const BusLoadEstimator* bus_load() const {
+    return bus_load_.get();
+  }
+
+  // Consistent copy of one ID's statistics; false when it has not been seen
+  bool snapshot(canid_t can_id, IdStats& stats) const;
+  // Consistent copy of every ID's statistics, keyed like IdTable::key_of()
+  std::vector<std::pair<canid_t, IdStats>> snapshot_all() const;
+
+  size_t ids() const {
+    return table_.size();
+  }
+  // Frames of extended IDs that did not fit in the table
+  uint64_t untracked() const {
+    return table_.eff_overflow();
+  }
+  uint64_t frames() const {
+    return frames_.load(std::memory_order_relaxed);
+  }
+
+private:
+  struct Entry {
+    std::atomic<uint32_t> seq{0};
+    IdStats               stats;
+  };
+
+  static void update(IdStats& s, const can_frame& frame, uint64_t now) {
+    if (s.count == 0) {
+      s.first_ns = now;
+      s.dlc      = frame.can_dlc;
+    } else {
+      uint64_t interval = now - s.last_ns;
+      uint64_t n        = s.count;  // intervals including this one
+      double   delta    = static_cast<double>(interval) - s.mean_interval_ns;
+      s.mean_interval_ns += delta / static_cast<double>(n);
+      s.m2_interval +=
+        delta * (static_cast<double>(interval) - s.mean_interval_ns);
+      if (n == 1 || interval < s.min_interval_ns)
+        s.min_interval_ns = interval;
+      if (interval > s.max_interval_ns)
+        s.max_interval_ns = interval;
+      if (frame.can_dlc != s.dlc) {
+        s.dlc_changes++;
+        s.dlc = frame.can_dlc;
+      }
+    }
+    s.last_ns = now;
+    s.count++;
+  }
+
+  static bool read(const Entry& entry, IdStats& stats);
+
+  IdTable<Entry>                    table_;
+  std::unique_ptr<BusLoadEstimator> bus_load_;
+  std::atomic<uint64_t>             frames_{0};
+};
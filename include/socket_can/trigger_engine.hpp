@@ -0,0 +1,206 @@
+#pragma once
+
+#include "socket_can/capture.hpp"
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/id_table.hpp"
+#include "socket_can/socket_can.hpp"
+#include "socket_can/trigger_signal.hpp"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class TriggerCompare {
+  kAny,  // the frame match is enough
+  kEqual,
+  kNotEqual,
+  kGreater,
+  kLess,
+  kOutside,  // below `threshold` or above `threshold_high`
+};
+
+// Matches a frame when ((can_id ^ id) & mask) == 0 (flags included), the
+// masked payload equals `data_value` and the decoded signal passes the
+// comparison
+struct TriggerCondition {
+  canid_t id   = 0;
+  canid_t mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK;  // exact
+
+  std::array<uint8_t, CAN_MAX_DLEN> data_mask  = {};
+  std::array<uint8_t, CAN_MAX_DLEN> data_value = {};
+
+  TriggerSignal  signal;
+  TriggerCompare compare        = TriggerCompare::kAny;
+  double         threshold      = 0;
+  double         threshold_high = 0;
+};
+
+struct TriggerRule {
+  enum class Kind {
+    kFrame,     // conditions[0] matches
+    kSequence,  // conditions match in order within `window_ns`
+    kMissing,   // no frame matching conditions[0] for `window_ns`
+  };
+
+  std::string                   name;
+  Kind                          kind = Kind::kFrame;
+  int                           bus  = -1;  // -1 = any bus
+  std::vector<TriggerCondition> conditions;
+  uint64_t                      window_ns  = 0;
+  uint64_t                      holdoff_ns = 1000000000;  // between firings
+};
+
+struct TriggerConfig {
+  std::string directory = ".";
+  std::string extension = ".scap";  // any open_capture_sink() format
+  // Rolling pre-trigger ring per bus
+  size_t   pre_frames = 65536;
+  uint64_t pre_ns     = 5000000000ull;
+  // Frames of every bus are kept for `post_ns` after the last trigger of a
+  // capture, up to `max_post_frames`
+  uint64_t post_ns         = 2000000000ull;
+  size_t   max_post_frames = 262144;
+  // Period of the missing-message and end-of-capture checks
+  uint64_t check_interval_ns = 10000000;
+};
+
+struct TriggerEvent {
+  size_t             rule;
+  const std::string* name;
+  uint32_t           bus;
+  uint64_t           timestamp_ns;
+  can_frame          frame;  // last matching frame (zero for kMissing)
+};
+
+// Evaluates trigger rules on the RX stream of several buses and writes the
+// frames around each firing to a capture file. Conditions on exact IDs are
+// compiled into an IdTable of (rule, step) probes, so a frame only checks
+// the rules that mention its ID; masked conditions are checked on every
+// frame. Captures are assembled on the loop thread from the pre-trigger
+// rings and the frames that follow, then sorted and written by a writer
+// thread. A trigger during a capture extends it instead of starting another.
+class TriggerEngine {
+public:
+  using TriggerHandler = std::function<void(const TriggerEvent& event)>;
+  // Runs on the writer thread once a capture is on disk (`ok` false if not)
+  using CaptureHandler =
+    std::function<void(const std::string& path, uint64_t records, bool ok)>;
+
+  struct Stats {
+    uint64_t frames     = 0;
+    uint64_t checks     = 0;  // conditions evaluated
+    uint64_t triggers   = 0;
+    uint64_t suppressed = 0;  // within a rule's holdoff
+    uint64_t captures   = 0;  // handed to the writer
+    uint64_t truncated  = 0;  // post-trigger frames over max_post_frames
+    uint64_t written    = 0;
+    uint64_t failed     = 0;
+  };
+
+  TriggerEngine();
+  ~TriggerEngine();
+
+  // Calling it again ends the previous session first
+  bool init(EpollEventLoop*                 event_loop,
+            const std::vector<TriggerRule>& rules,
+            size_t                          buses,
+            const TriggerConfig&            config = TriggerConfig());
+  // Ends an open capture and waits for the writer
+  void deinit();
+
+  void on_frame(uint32_t bus, const can_frame& frame, uint64_t timestamp_ns);
+  // Adapter for SocketCanIntf::init(); stamps frames with capture_now_ns()
+  FrameProcessor frame_processor(uint32_t bus);
+
+  void set_trigger_handler(TriggerHandler handler) {
+    trigger_handler_ = std::move(handler);
+  }
+  void set_capture_handler(CaptureHandler handler) {
+    capture_handler_ = std::move(handler);
+  }
+
+  // Ends the open capture now and waits until every capture is written
+  void flush();
+  bool capturing() const {
+    return capture_ != nullptr;
+  }
+  Stats stats() const;
+
+private:
+  struct Probe {
+    uint16_t rule;
+    uint16_t step;
+  };
+  using ProbeList = std::vector<Probe>;
+
+  struct RuleState {
+    TriggerRule rule;
+    size_t      next_step    = 0;  // kSequence
+    uint64_t    sequence_ns  = 0;  // first step of the running sequence
+    uint64_t    last_seen_ns = 0;  // kMissing, or init time
+    bool        missing      = false;
+    uint64_t    fired_ns     = 0;
+    bool        fired        = false;
+  };
+
+  struct Ring {
+    std::vector<CaptureRecord> records;
+    size_t                     head  = 0;
+    size_t                     count = 0;
+  };
+
+  struct Capture {
+    std::string                path;
+    std::vector<CaptureRecord> records;
+    size_t                     post_frames = 0;
+  };
+
+  bool matches(const TriggerCondition& condition, const can_frame& frame);
+  void evaluate(const Probe&     probe,
+                uint32_t         bus,
+                const can_frame& frame,
+                uint64_t         timestamp_ns);
+  void fire(size_t           rule,
+            uint32_t         bus,
+            const can_frame& frame,
+            uint64_t         timestamp_ns);
+  void start_capture(size_t rule, uint64_t timestamp_ns);
+  void finish_capture();
+  void on_timer(uint32_t mask);
+  void writer_main();
+
+  EpollEventLoop*                     event_loop_ = nullptr;
+  int                                 timerfd_    = -1;
+  EpollEventLoop::EvtId               timer_evt_  = nullptr;
+  TriggerConfig                       config_;
+  std::vector<RuleState>              rules_;
+  std::unique_ptr<IdTable<ProbeList>> exact_;
+  ProbeList                           masked_;
+  std::vector<size_t>                 missing_rules_;
+  std::vector<Ring>                   rings_;
+  TriggerHandler                      trigger_handler_;
+  uint64_t                            capture_serial_ = 0;
+
+  // Loop thread
+  std::unique_ptr<Capture> capture_;
+  uint64_t                 capture_end_ns_ = 0;
+  Stats                    stats_;
+
+  // Writer thread
+  CaptureHandler                       capture_handler_;
+  std::thread                          writer_;
+  std::mutex                           mutex_;
+  std::condition_variable              cv_;
+  std::deque<std::unique_ptr<Capture>> queue_;
+  bool                                 writing_  = false;
+  bool                                 stopping_ = false;
+  std::atomic<uint64_t>                written_{0};
+  std::atomic<uint64_t>                failed_{0};
+};
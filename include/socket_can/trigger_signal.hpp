@@ -0,0 +1,25 @@
+#pragma once
+
+#include <linux/can.h>
+#include <cstdint>
+
+// A signal inside the payload, DBC style: `start_bit` is the LSB for Intel
+// (little-endian) signals and the MSB for Motorola (big-endian) ones
+struct TriggerSignal {
+  uint16_t start_bit  = 0;
+  uint8_t  length     = 0;  // bits, 0 = no signal
+  bool     big_endian = false;
+  bool     is_signed  = false;
+  double   scale      = 1;
+  double   offset     = 0;
+};
+
+// Raw value of `signal` in `frame`; false when the DLC does not cover it
+bool decode_trigger_signal(const TriggerSignal& signal,
+                           const can_frame&     frame,
+                           double&              value);
+// Same on the payload bytes copied into a word, as in FrameBatch::payloads()
+bool decode_trigger_signal(const TriggerSignal& signal,
+                           uint64_t             payload,
+                           uint8_t              length,
+                           double&              value);
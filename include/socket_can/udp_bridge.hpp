@@ -0,0 +1,196 @@
+#pragma once
+
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/metrics.hpp"
+#include "socket_can/socket_can.hpp"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+// CAN-over-UDP wire format, little-endian. A datagram is a header followed
+// by `count` records; sequence numbers count datagrams per stream, and a
+// sender picks a new random stream id each time it starts.
+struct UdpBridgeHeader {
+  static constexpr uint32_t kMagic   = 0x42434E43;  // "CNCB"
+  static constexpr uint8_t  kVersion = 1;
+  static constexpr size_t   kSize    = 24;
+
+  uint32_t magic;
+  uint8_t  version;
+  uint8_t  header_size;
+  uint16_t count;
+  uint32_t sequence;
+  uint32_t stream;
+  uint64_t base_ns;  // CLOCK_REALTIME of the first frame
+};
+
+struct UdpBridgeRecord {
+  static constexpr size_t kSize = 20;
+
+  uint32_t offset_ns;  // after UdpBridgeHeader::base_ns
+  uint32_t can_id;
+  uint8_t  channel;
+  uint8_t  can_dlc;
+  uint8_t  reserved[2];
+  uint8_t  data[CAN_MAX_DLEN];
+};
+
+static_assert(sizeof(UdpBridgeHeader) == UdpBridgeHeader::kSize,
+              "packed header");
+static_assert(sizeof(UdpBridgeRecord) == UdpBridgeRecord::kSize,
+              "packed record");
+
+// "host:port", "[v6 address]:port" or ":port" (any address)
+bool parse_udp_endpoint(const std::string&       text,
+                        struct sockaddr_storage& address,
+                        socklen_t&               length);
+
+// Packs frames from the interfaces it opens (channel = index in the list)
+// into UDP datagrams. A datagram goes out when it is full or when its first
+// frame has waited `flush_budget`; completed datagrams are sent together
+// with sendmmsg at the end of each RX batch, so a saturated bus costs one
+// syscall per batch rather than one per frame.
+class UdpBridgeSender {
+public:
+  struct Stats {
+    uint64_t frames            = 0;
+    uint64_t datagrams         = 0;
+    uint64_t send_calls        = 0;  // sendmmsg syscalls
+    uint64_t dropped_datagrams = 0;  // socket buffer full
+  };
+
+  ~UdpBridgeSender();
+
+  // `max_datagram` bytes per datagram (1472 fits an Ethernet MTU)
+  bool init(EpollEventLoop*                 event_loop,
+            const std::vector<std::string>& interfaces,
+            const std::string&              destination,
+            std::chrono::microseconds       flush_budget =
+              std::chrono::milliseconds(1),
+            size_t max_datagram = 1472);
+  void deinit();
+
+  // Queues a frame from any other source
+  void enqueue(uint8_t channel, const can_frame& frame);
+  // Completes the partial datagram and sends everything pending
+  void flush();
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+private:
+  static constexpr size_t kQueueDatagrams = 32;
+
+  struct Datagram {
+    std::vector<uint8_t> bytes;
+    size_t               count    = 0;
+    uint64_t             first_ns = 0;  // CLOCK_MONOTONIC, for the budget
+  };
+
+  Datagram& current() {
+    return queue_[(head_ + pending_) % kQueueDatagrams];
+  }
+  void complete();
+  void send_pending();
+  void arm_timer(uint64_t deadline_ns);
+  void on_timer(uint32_t mask);
+
+  EpollEventLoop*                             event_loop_  = nullptr;
+  std::vector<std::unique_ptr<SocketCanIntf>> interfaces_;
+  int                                         fd_          = -1;
+  int                                         timerfd_     = -1;
+  EpollEventLoop::EvtId                       timer_evt_   = nullptr;
+  bool                                        timer_armed_ = false;
+  uint64_t                                    budget_ns_   = 1000000;
+  size_t                                      capacity_    = 0;  // records
+  uint32_t                                    stream_      = 0;
+  uint32_t                                    sequence_    = 0;
+
+  // Ring of datagrams: `pending_` completed ones from `head_`, then the
+  // one being filled
+  std::array<Datagram, kQueueDatagrams> queue_;
+  size_t                                head_    = 0;
+  size_t                                pending_ = 0;
+  Stats                                 stats_;
+
+  std::shared_ptr<MetricCounter> frames_metric_;
+  std::shared_ptr<MetricCounter> datagrams_metric_;
+  std::shared_ptr<MetricCounter> dropped_metric_;
+};
+
+// Receives bridge datagrams and replays their frames into local interfaces
+// (channel N goes to output N, e.g. a vcan or a vbus: loopback), in batches
+// per output. Expects one sender; sequence gaps within its stream are
+// counted as lost datagrams, and a new stream (sender restart) starts over.
+class UdpBridgeReceiver {
+public:
+  // Called for every frame before it is replayed; `timestamp_ns` is the
+  // sender's CLOCK_REALTIME
+  using FrameHandler = std::function<
+    void(uint8_t channel, const can_frame& frame, uint64_t timestamp_ns)>;
+
+  struct Stats {
+    uint64_t frames          = 0;
+    uint64_t datagrams       = 0;
+    uint64_t receive_calls   = 0;  // recvmmsg syscalls
+    uint64_t lost_datagrams  = 0;
+    uint64_t reordered       = 0;  // late or duplicate datagrams
+    uint64_t malformed       = 0;  // datagrams, or records with DLC > 8
+    uint64_t unrouted_frames = 0;  // no output for the channel
+    uint64_t replay_dropped  = 0;  // output TX queue full
+  };
+
+  ~UdpBridgeReceiver();
+
+  // `listen` as for parse_udp_endpoint(), e.g. ":29536"
+  bool init(EpollEventLoop*                 event_loop,
+            const std::string&              listen,
+            const std::vector<std::string>& outputs);
+  void deinit();
+
+  void set_frame_handler(FrameHandler handler) {
+    frame_handler_ = std::move(handler);
+  }
+  // Bound port, useful after listening on port 0
+  uint16_t port() const;
+
+  const Stats& stats() const {
+    return stats_;
+  }
+
+private:
+  static constexpr size_t kReceiveBatch = 16;
+  static constexpr size_t kBufferSize   = 65536;
+  static constexpr size_t kTxBatch      = 64;
+
+  struct Output {
+    std::unique_ptr<SocketCanIntf>  intf;
+    std::array<can_frame, kTxBatch> tx;
+    size_t                          tx_count = 0;
+  };
+
+  void on_readable(uint32_t mask);
+  void on_datagram(const uint8_t* data, size_t size);
+  void flush(Output& output);
+
+  EpollEventLoop*       event_loop_ = nullptr;
+  int                   fd_         = -1;
+  EpollEventLoop::EvtId evt_        = nullptr;
+  std::vector<Output>   outputs_;
+  FrameHandler          frame_handler_;
+  bool                  have_stream_ = false;
+  uint32_t              stream_      = 0;
+  uint32_t              expected_    = 0;  // next sequence number
+  std::vector<uint8_t>  buffers_;          // kReceiveBatch * kBufferSize
+  Stats                 stats_;
+
+  std::shared_ptr<MetricCounter> frames_metric_;
+  std::shared_ptr<MetricCounter> lost_metric_;
+};
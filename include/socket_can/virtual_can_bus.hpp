@@ -0,0 +1,94 @@
+#pragma once
+
+#include "socket_can/can_transport.hpp"
+#include <linux/can.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr char   kVirtualBusPrefix[]     = "vbus:";
+constexpr size_t kVirtualBusPrefixLength = sizeof(kVirtualBusPrefix) - 1;
+
+// In-process CAN bus for tests and benchmarks without vcan or root. Every node
+// talks to the bus through its own SOCK_SEQPACKET socketpair; a bus thread
+// takes one pending frame per node, lets the lowest arbitration key win,
+// optionally holds the bus for the frame's worst-case duration at the
+// configured bitrate, and delivers the frame to every other node. Like
+// CAN_RAW, a sender does not receive its own frames, and a node whose receive
+// buffer is full loses frames.
+class VirtualCanBus {
+public:
+  ~VirtualCanBus();
+
+  // Bus with this name, created on first use. It lives as long as someone
+  // holds the returned pointer or a node is attached.
+  static std::shared_ptr<VirtualCanBus> get(const std::string& name);
+
+  // 0 (default) delivers frames as fast as the bus thread can
+  void set_bitrate(uint32_t bitrate) {
+    bitrate_ = bitrate;
+  }
+  uint32_t bitrate() const {
+    return bitrate_;
+  }
+
+  // Returns the node's end of a new socketpair, or -1
+  int attach();
+
+  uint64_t frames_delivered() const {
+    return delivered_;
+  }
+  // Frames lost because a receiving node's buffer was full
+  uint64_t frames_dropped() const {
+    return dropped_;
+  }
+
+private:
+  struct Node {
+    explicit Node(int fd) : fd(fd) {
+    }
+
+    int       fd;  // bus end of the socketpair
+    bool      pending = false;
+    bool      closed  = false;
+    can_frame frame   = {};
+  };
+
+  VirtualCanBus();
+  bool start();
+  void run();
+  void fill(Node& node);
+  void deliver(const Node& sender);
+
+  int                   epollfd_ = -1;
+  int                   wakefd_  = -1;
+  std::atomic<uint32_t> bitrate_{0};
+  std::atomic<uint64_t> delivered_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<bool>     stopping_{false};
+
+  std::mutex                         mutex_;
+  std::vector<std::unique_ptr<Node>> nodes_;
+  std::thread                        thread_;
+};
+
+// CanTransport endpoint on a VirtualCanBus, opened with "vbus:<name>" or
+// "vbus:<name>@<bitrate>"
+class LoopbackTransport : public DatagramCanTransport {
+public:
+  bool open(const std::string& interface) override;
+  void close() override;
+
+  const std::shared_ptr<VirtualCanBus>& bus() const {
+    return bus_;
+  }
+
+private:
+  std::shared_ptr<VirtualCanBus> bus_;
+};
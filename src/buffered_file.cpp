@@ -0,0 +1,185 @@
+#include "socket_can/buffered_file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+BufferedFileWriter::BufferedFileWriter(size_t capacity)
+  : buffer_(new char[capacity]), capacity_(capacity) {
+}
+
+BufferedFileWriter::~BufferedFileWriter() {
+  close();
+  delete[] buffer_;
+}
+
+bool BufferedFileWriter::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  owns_fd_ = true;
+  size_    = 0;
+  written_ = 0;
+  return fd_ >= 0;
+}
+
+bool BufferedFileWriter::attach(int fd) {
+  close();
+  fd_      = fd;
+  owns_fd_ = false;
+  size_    = 0;
+  written_ = 0;
+  return fd_ >= 0;
+}
+
+bool BufferedFileWriter::close() {
+  if (fd_ < 0)
+    return true;
+  bool ok = flush();
+  if (owns_fd_ && ::close(fd_) == -1)
+    ok = false;
+  fd_ = -1;
+  return ok;
+}
+
+bool BufferedFileWriter::append(const void* data, size_t n) {
+  const char* src = static_cast<const char*>(data);
+  while (n > 0) {
+    if (size_ == capacity_ && !flush())
+      return false;
+    size_t chunk = std::min(n, capacity_ - size_);
+    std::memcpy(buffer_ + size_, src, chunk);
+    size_ += chunk;
+    src += chunk;
+    n -= chunk;
+  }
+  return true;
+}
+
+bool BufferedFileWriter::flush() {
+  if (fd_ < 0)
+    return false;
+  size_t done = 0;
+  while (done < size_) {
+    ssize_t n = ::write(fd_, buffer_ + done, size_ - done);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  written_ += size_;
+  size_ = 0;
+  return true;
+}
+
+bool BufferedFileWriter::write_at(uint64_t    offset,
+                                  const void* data,
+                                  size_t      n) {
+  if (!flush())
+    return false;
+  return ::pwrite(fd_, data, n, static_cast<off_t>(offset)) ==
+         static_cast<ssize_t>(n);
+}
+
+BufferedFileReader::BufferedFileReader(size_t capacity)
+  : buffer_(new char[capacity]), capacity_(capacity) {
+}
+
+BufferedFileReader::~BufferedFileReader() {
+  close();
+  delete[] buffer_;
+}
+
+bool BufferedFileReader::open(const std::string& path) {
+  close();
+  fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0)
+    return false;
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  begin_ = end_ = 0;
+  eof_          = false;
+  return true;
+}
+
+void BufferedFileReader::close() {
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+}
+
+bool BufferedFileReader::fill() {
+  if (eof_ || fd_ < 0)
+    return false;
+  if (begin_ > 0) {
+    std::memmove(buffer_, buffer_ + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (end_ == capacity_)
+    return false;
+  ssize_t n;
+  do {
+    n = ::read(fd_, buffer_ + end_, capacity_ - end_);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    eof_ = true;
+    return false;
+  }
+  end_ += static_cast<size_t>(n);
+  return true;
+}
+
+bool BufferedFileReader::read_line(const char** begin, const char** end) {
+  size_t scanned = begin_;
+  for (;;) {
+    const void* nl = std::memchr(buffer_ + scanned, '\n', end_ - scanned);
+    if (nl) {
+      const char* line_end = static_cast<const char*>(nl);
+      *begin               = buffer_ + begin_;
+      begin_               = static_cast<size_t>(line_end - buffer_) + 1;
+      if (line_end > *begin && line_end[-1] == '\r')
+        --line_end;
+      *end = line_end;
+      return true;
+    }
+    size_t pending = end_ - begin_;
+    if (!fill()) {
+      // Last line without a terminator
+      if (end_ > begin_ && eof_) {
+        *begin = buffer_ + begin_;
+        *end   = buffer_ + end_;
+        begin_ = end_;
+        return true;
+      }
+      return false;
+    }
+    scanned = begin_ + pending;
+  }
+}
+
+bool BufferedFileReader::read_exact(void* dst, size_t n) {
+  char* out = static_cast<char*>(dst);
+  while (n > 0) {
+    if (begin_ == end_ && !fill())
+      return false;
+    size_t chunk = std::min(n, end_ - begin_);
+    std::memcpy(out, buffer_ + begin_, chunk);
+    begin_ += chunk;
+    out += chunk;
+    n -= chunk;
+  }
+  return true;
+}
+
+bool BufferedFileReader::skip(size_t n) {
+  while (n > 0) {
+    if (begin_ == end_ && !fill())
+      return false;
+    size_t chunk = std::min(n, end_ - begin_);
+    begin_ += chunk;
+    n -= chunk;
+  }
+  return true;
+}
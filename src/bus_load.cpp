@@ -0,0 +1,93 @@
+#include "socket_can/bus_load.hpp"
+#include "socket_can/can_bit_timing.hpp"
+#include <algorithm>
+
+SlidingWindowSum::SlidingWindowSum(uint64_t window_ns, size_t buckets)
+  : bucket_ns_(std::max<uint64_t>(1, window_ns / std::max<size_t>(1, buckets))),
+    n_buckets_(std::max<size_t>(1, buckets)),
+    buckets_(new Bucket[n_buckets_]) {
+}
+
+void SlidingWindowSum::advance(uint64_t timestamp_ns) {
+  current_start_ = timestamp_ns - timestamp_ns % bucket_ns_;
+  current_index_ = (timestamp_ns / bucket_ns_) % n_buckets_;
+  Bucket& bucket = buckets_[current_index_];
+  if (bucket.start.load(std::memory_order_relaxed) != current_start_) {
+    bucket.sum.store(0, std::memory_order_relaxed);
+    bucket.start.store(current_start_, std::memory_order_release);
+  }
+}
+
+uint64_t SlidingWindowSum::sum(uint64_t now_ns, uint64_t* covered_ns) const {
+  // The current bucket is partial; together with the n - 1 before it the
+  // buckets cover (n - 1) full widths plus the time since it started
+  uint64_t current = now_ns - now_ns % bucket_ns_;
+  uint64_t oldest  = current >= bucket_ns_ * (n_buckets_ - 1)
+                       ? current - bucket_ns_ * (n_buckets_ - 1)
+                       : 0;
+  uint64_t total   = 0;
+  for (size_t i = 0; i < n_buckets_; ++i) {
+    const Bucket& bucket = buckets_[i];
+    uint64_t      start  = bucket.start.load(std::memory_order_acquire);
+    uint64_t      sum    = bucket.sum.load(std::memory_order_acquire);
+    // Skip buckets reset for another period while we read them
+    if (start < oldest || start > current ||
+        bucket.start.load(std::memory_order_acquire) != start)
+      continue;
+    total += sum;
+  }
+  if (covered_ns)
+    *covered_ns = now_ns - oldest;
+  return total;
+}
+
+BusLoadEstimator::BusLoadEstimator(uint32_t bitrate,
+                                   uint32_t data_bitrate,
+                                   bool     exact_stuffing)
+  : bitrate_(bitrate),
+    data_bitrate_(data_bitrate ? data_bitrate : bitrate),
+    exact_stuffing_(exact_stuffing),
+    windows_{SlidingWindowSum(kWindowNs[0]),
+             SlidingWindowSum(kWindowNs[1]),
+             SlidingWindowSum(kWindowNs[2])} {
+}
+
+void BusLoadEstimator::add(const can_frame& frame, uint64_t timestamp_ns) {
+  if (frame.can_id & CAN_ERR_FLAG)
+    return;
+  uint32_t bits = exact_stuffing_ ? can_frame_bits_exact(frame)
+                                 : can_frame_bits_worst_case(frame);
+  add_busy(can_frame_duration_ns(bits, bitrate_), timestamp_ns);
+}
+
+void BusLoadEstimator::add(const canfd_frame& frame, uint64_t timestamp_ns) {
+  if (frame.can_id & CAN_ERR_FLAG)
+    return;
+  add_busy(canfd_frame_duration_ns(frame, bitrate_, data_bitrate_),
+           timestamp_ns);
+}
+
+void BusLoadEstimator::add_busy(uint64_t busy_ns, uint64_t timestamp_ns) {
+  // The first frame was on the wire before it was received
+  if (first_ns_.load(std::memory_order_relaxed) == 0)
+    first_ns_.store(timestamp_ns > busy_ns ? timestamp_ns - busy_ns : 1,
+                    std::memory_order_relaxed);
+  for (SlidingWindowSum& window : windows_)
+    window.add(timestamp_ns, busy_ns);
+  busy_ns_.store(busy_ns_.load(std::memory_order_relaxed) + busy_ns,
+                 std::memory_order_relaxed);
+}
+
+double BusLoadEstimator::load(size_t window, uint64_t now_ns) const {
+  if (window >= kWindows)
+    return 0;
+  uint64_t covered = 0;
+  uint64_t busy    = windows_[window].sum(now_ns, &covered);
+  // Before the estimator has seen a full window, only count time since the
+  // first frame
+  uint64_t first = first_ns_.load(std::memory_order_relaxed);
+  if (first && now_ns >= first && now_ns - first < covered)
+    covered = now_ns - first;
+  return covered ? static_cast<double>(busy) / static_cast<double>(covered)
+                 : 0;
+}
@@ -0,0 +1,215 @@
+#include "socket_can/can_bit_timing.hpp"
+#include <cstring>
+
+namespace {
+
+constexpr uint16_t kCrc15Polynomial = 0x4599;
+
+// CRC-15 tables for a register kept left-aligned in 16 bits: `next` advances
+// it by one byte, `after` by a byte followed by a zero byte, so two input
+// bytes take two independent lookups (slicing-by-2)
+struct Crc15Table {
+  uint16_t next[256];
+  uint16_t after[256];
+
+  constexpr Crc15Table() : next(), after() {
+    for (int byte = 0; byte < 256; ++byte) {
+      uint16_t crc = static_cast<uint16_t>(byte << 8);
+      for (int bit = 0; bit < 8; ++bit) {
+        bool top = crc & 0x8000;
+        crc      = static_cast<uint16_t>(crc << 1);
+        if (top)
+          crc ^= kCrc15Polynomial << 1;
+      }
+      next[byte] = crc;
+    }
+    for (int byte = 0; byte < 256; ++byte)
+      after[byte] = static_cast<uint16_t>((next[byte] << 8) ^
+                                          next[next[byte] >> 8]);
+  }
+};
+
+constexpr Crc15Table kCrc15Table{};
+
+// Bit-stuffing state between bytes: the level of the last bit on the wire
+// and how many equal bits precede it (0-4; a fifth forces a stuff bit).
+// State 0 is the idle bus before SOF. Each table step consumes one byte; the
+// next state is stored as its row offset so the lookup chain stays short.
+struct StuffStep {
+  uint16_t next_row;
+  uint8_t  stuff_bits;
+};
+
+constexpr int kStuffStates = 10;
+
+// Feeds one bit; returns true when a stuff bit follows it
+constexpr bool stuff_bit(int& level, int& run, int bit) {
+  if (run > 0 && bit == level) {
+    run++;
+  } else {
+    level = bit;
+    run   = 1;
+  }
+  if (run == 5) {
+    // The complementary stuff bit starts a new run
+    level = !level;
+    run   = 1;
+    return true;
+  }
+  return false;
+}
+
+struct StuffTable {
+  StuffStep steps[kStuffStates * 256];
+
+  constexpr StuffTable() : steps() {
+    for (int state = 0; state < kStuffStates; ++state) {
+      for (int byte = 0; byte < 256; ++byte) {
+        int level = state / 5;
+        int run   = state % 5;
+        int count = 0;
+        for (int bit = 7; bit >= 0; --bit)
+          count += stuff_bit(level, run, (byte >> bit) & 1);
+        steps[state * 256 + byte] = {
+          static_cast<uint16_t>((level * 5 + run) * 256),
+          static_cast<uint8_t>(count)};
+      }
+    }
+  }
+};
+
+constexpr StuffTable kStuffTable{};
+
+// The frame from SOF to the end of the CRC (at most 118 bits) as a
+// big-endian bit string
+struct FrameBits {
+  uint8_t  bytes[16];
+  uint32_t size;
+
+  // Places `value` (the top `bits` bits of a left-aligned 128-bit word)
+  // right after the current end
+  void append(unsigned __int128 value, uint32_t bits) {
+    unsigned __int128 word = load() | (value >> size);
+    uint64_t hi = __builtin_bswap64(static_cast<uint64_t>(word >> 64));
+    uint64_t lo = __builtin_bswap64(static_cast<uint64_t>(word));
+    std::memcpy(bytes, &hi, 8);
+    std::memcpy(bytes + 8, &lo, 8);
+    size += bits;
+  }
+
+  unsigned __int128 load() const {
+    uint64_t hi, lo;
+    std::memcpy(&hi, bytes, 8);
+    std::memcpy(&lo, bytes + 8, 8);
+    return static_cast<unsigned __int128>(__builtin_bswap64(hi)) << 64 |
+           __builtin_bswap64(lo);
+  }
+};
+
+uint32_t count_stuff_bits(const uint8_t* data, uint32_t bits) {
+  uint32_t count = 0;
+  uint32_t row   = 0;
+  uint32_t bytes = bits / 8;
+  for (uint32_t i = 0; i < bytes; ++i) {
+    const StuffStep& step = kStuffTable.steps[row + data[i]];
+    count += step.stuff_bits;
+    row = step.next_row;
+  }
+  // Trailing bits: the same state machine without data-dependent branches
+  int level = static_cast<int>(row / 256) / 5;
+  int run   = static_cast<int>(row / 256) % 5;
+  for (uint32_t i = bytes * 8; i < bits; ++i) {
+    int bit   = (data[i >> 3] >> (7 - (i & 7))) & 1;
+    run       = (run > 0 && bit == level) ? run + 1 : 1;
+    int stuff = run == 5;
+    level     = bit ^ stuff;
+    run       = stuff ? 1 : run;
+    count += static_cast<uint32_t>(stuff);
+  }
+  return count;
+}
+
+// ACK slot and delimiter, 7 bits EOF, 3 bits intermission
+constexpr uint32_t kFrameTrailerBits = 12;
+
+}  // namespace
+
+uint16_t can_crc15(const uint8_t* data, uint32_t bits) {
+  uint16_t crc   = 0;  // left-aligned
+  uint32_t bytes = bits / 8;
+  uint32_t i     = 0;
+  for (; i + 2 <= bytes; i += 2) {
+    crc ^= static_cast<uint16_t>(data[i] << 8 | data[i + 1]);
+    crc = kCrc15Table.after[crc >> 8] ^ kCrc15Table.next[crc & 0xFF];
+  }
+  if (i < bytes)
+    crc = static_cast<uint16_t>((crc << 8) ^
+                                kCrc15Table.next[(crc >> 8) ^ data[i]]);
+  // Trailing bits: branch-free, as they are data-dependent
+  for (uint32_t b = bytes * 8; b < bits; ++b) {
+    uint16_t in = static_cast<uint16_t>(((data[b >> 3] >> (7 - (b & 7))) & 1)
+                                        << 15);
+    uint16_t top = (crc ^ in) >> 15;
+    crc          = static_cast<uint16_t>((crc << 1) ^
+                                ((0u - top) & (kCrc15Polynomial << 1)));
+  }
+  return crc >> 1;
+}
+
+uint32_t can_frame_bits_exact(const can_frame& frame) {
+  bool    rtr = (frame.can_id & CAN_RTR_FLAG) != 0;
+  uint8_t dlc = frame.can_dlc > 15 ? 15 : frame.can_dlc;
+  uint8_t len = rtr ? 0 : (dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : dlc);
+
+  // SOF (0), ID, RTR/SRR/IDE/reserved bits and DLC
+  uint64_t header;
+  uint32_t header_bits;
+  if (frame.can_id & CAN_EFF_FLAG) {
+    uint32_t id = frame.can_id & CAN_EFF_MASK;
+    // SOF, base ID, SRR, IDE, ID extension, RTR, r1, r0, DLC
+    header      = uint64_t{id >> 18} << 27 | uint64_t{0x3} << 25 |
+             uint64_t{id & 0x3FFFF} << 7 | uint64_t{rtr} << 6 | dlc;
+    header_bits = 39;
+  } else {
+    // SOF, ID, RTR, IDE, r0, DLC
+    header      = uint64_t{frame.can_id & CAN_SFF_MASK} << 7 |
+             uint64_t{rtr} << 6 | dlc;
+    header_bits = 19;
+  }
+
+  uint64_t data = 0;
+  std::memcpy(&data, frame.data, len);
+  data = __builtin_bswap64(data);  // first byte in the top bits
+
+  FrameBits bits = {};
+  bits.append(static_cast<unsigned __int128>(header) << (128 - header_bits),
+              header_bits);
+  if (len)
+    bits.append(static_cast<unsigned __int128>(data) << 64, 8u * len);
+  uint16_t crc = can_crc15(bits.bytes, bits.size);
+  bits.append(static_cast<unsigned __int128>(crc) << 113, 15);
+
+  uint32_t stuffed = bits.size + count_stuff_bits(bits.bytes, bits.size);
+  return stuffed + 1 + kFrameTrailerBits;  // + CRC delimiter
+}
+
+uint64_t canfd_frame_duration_ns(const canfd_frame& frame,
+                                 uint32_t           nominal_bitrate,
+                                 uint32_t           data_bitrate) {
+  uint32_t len = frame.len > CANFD_MAX_DLEN ? CANFD_MAX_DLEN : frame.len;
+  // SOF, ID, RRS, IDE (+ SRR and ID extension), FDF, res, BRS
+  uint32_t arbitration = frame.can_id & CAN_EFF_FLAG ? 36 : 17;
+  // ESI, DLC, data, then stuff count (gray code + parity) and CRC-17/21
+  // with their fixed stuff bits, and the CRC delimiter
+  uint32_t data = 1 + 4 + 8 * len;
+  uint32_t crc  = len > 16 ? 4 + 21 + 7 : 4 + 17 + 6;
+  // Dynamic stuffing covers SOF to the end of the data field
+  uint32_t arbitration_bits = arbitration + (arbitration - 1) / 4;
+  uint32_t data_phase_bits  = data + data / 4 + crc + 1;
+
+  if (!(frame.flags & CANFD_BRS) || !data_bitrate)
+    data_bitrate = nominal_bitrate;
+  return can_frame_duration_ns(arbitration_bits + kFrameTrailerBits,
+                               nominal_bitrate) +
+         can_frame_duration_ns(data_phase_bits, data_bitrate);
+}
@@ -0,0 +1,355 @@
+#include "socket_can/can_coro.hpp"
+#include <array>
+#include <ctime>
+#include <iostream>
+#include <new>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kSizeClasses =
+  CoFramePool::kMaxPooledSize / CoFramePool::kGranularity;
+
+struct FreeBlock {
+  FreeBlock* next;
+};
+
+struct FramePoolState {
+  std::array<FreeBlock*, kSizeClasses> free = {};
+  uint64_t                             heap_allocations = 0;
+
+  ~FramePoolState() {
+    for (FreeBlock* head : free) {
+      while (head) {
+        FreeBlock* next = head->next;
+        ::operator delete(head);
+        head = next;
+      }
+    }
+  }
+};
+
+thread_local FramePoolState pool_state;
+thread_local CoScheduler*   current_scheduler = nullptr;
+
+size_t size_class(size_t size) {
+  return (size + CoFramePool::kGranularity - 1) / CoFramePool::kGranularity -
+         1;
+}
+
+}  // namespace
+
+void* CoFramePool::allocate(size_t size) {
+  if (size == 0 || size > kMaxPooledSize)
+    return ::operator new(size);
+  size_t     index = size_class(size);
+  FreeBlock* block = pool_state.free[index];
+  if (block) {
+    pool_state.free[index] = block->next;
+    return block;
+  }
+  ++pool_state.heap_allocations;
+  return ::operator new((index + 1) * kGranularity);
+}
+
+void CoFramePool::deallocate(void* frame, size_t size) {
+  if (size == 0 || size > kMaxPooledSize) {
+    ::operator delete(frame);
+    return;
+  }
+  // Frames go back to the freeing thread's pool, which is fine for frames
+  // resumed on another thread
+  size_t     index = size_class(size);
+  FreeBlock* block = static_cast<FreeBlock*>(frame);
+  block->next      = pool_state.free[index];
+  pool_state.free[index] = block;
+}
+
+uint64_t CoFramePool::heap_allocations() {
+  return pool_state.heap_allocations;
+}
+
+CoScheduler::CoScheduler(EpollEventLoop* event_loop)
+  : event_loop_(event_loop) {
+  timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd_ < 0) {
+    std::cerr << "Failed to create coroutine timer" << std::endl;
+  } else if (!event_loop_->register_event(
+               &evt_, timerfd_, EPOLLIN,
+               [this](uint32_t mask) { on_timer(mask); })) {
+    std::cerr << "Failed to register coroutine timer" << std::endl;
+    close(timerfd_);
+    timerfd_ = -1;
+  }
+  current_scheduler = this;
+}
+
+CoScheduler::~CoScheduler() {
+  if (evt_)
+    event_loop_->deregister_event(evt_);
+  if (timerfd_ >= 0)
+    close(timerfd_);
+  if (current_scheduler == this)
+    current_scheduler = nullptr;
+}
+
+CoScheduler* CoScheduler::current() {
+  return current_scheduler;
+}
+
+uint64_t CoScheduler::now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void CoScheduler::spawn(CoTask<void> task) {
+  CoTask<void>::Handle handle = task.release();
+  if (!handle)
+    return;
+  handle.promise().detached = true;
+  handle.resume();
+}
+
+void CoScheduler::add_timer(CoTimer& timer) {
+  heap_.push_back(&timer);
+  place(heap_.size() - 1, &timer);
+  sift_up(timer.heap_index);
+  if (timer.heap_index == 0)
+    arm();
+}
+
+void CoScheduler::cancel_timer(CoTimer& timer) {
+  if (!timer.armed())
+    return;
+  size_t index = timer.heap_index;
+  CoTimer* last = heap_.back();
+  heap_.pop_back();
+  timer.heap_index = SIZE_MAX;
+  if (last != &timer) {
+    place(index, last);
+    sift_up(index);
+    sift_down(last->heap_index);
+  }
+  // The timerfd stays set; an early expiry just re-arms it
+}
+
+void CoScheduler::on_timer(uint32_t) {
+  uint64_t expirations;
+  while (read(timerfd_, &expirations, sizeof(expirations)) > 0) {
+  }
+  armed_ns_ = UINT64_MAX;
+
+  uint64_t now = now_ns();
+  while (!heap_.empty() && heap_.front()->deadline_ns <= now) {
+    CoTimer* timer = heap_.front();
+    cancel_timer(*timer);
+    // May resume a coroutine that adds or cancels timers
+    timer->expire(timer);
+  }
+  arm();
+}
+
+void CoScheduler::arm() {
+  if (timerfd_ < 0 || heap_.empty())
+    return;
+  uint64_t deadline = heap_.front()->deadline_ns;
+  if (deadline == armed_ns_)
+    return;
+  // A zero it_value would disarm the timer
+  if (deadline == 0)
+    deadline = 1;
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec   = static_cast<time_t>(deadline / 1000000000ULL);
+  spec.it_value.tv_nsec  = static_cast<long>(deadline % 1000000000ULL);
+  if (timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    std::cerr << "Failed to arm coroutine timer" << std::endl;
+    return;
+  }
+  armed_ns_ = deadline;
+}
+
+void CoScheduler::sift_up(size_t index) {
+  CoTimer* timer = heap_[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (heap_[parent]->deadline_ns <= timer->deadline_ns)
+      break;
+    place(index, heap_[parent]);
+    index = parent;
+  }
+  place(index, timer);
+}
+
+void CoScheduler::sift_down(size_t index) {
+  CoTimer* timer = heap_[index];
+  size_t   size  = heap_.size();
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= size)
+      break;
+    if (child + 1 < size &&
+        heap_[child + 1]->deadline_ns < heap_[child]->deadline_ns)
+      ++child;
+    if (timer->deadline_ns <= heap_[child]->deadline_ns)
+      break;
+    place(index, heap_[child]);
+    index = child;
+  }
+  place(index, timer);
+}
+
+CoCanBus::~CoCanBus() {
+  deinit();
+}
+
+bool CoCanBus::init(const std::string& interface,
+                    EpollEventLoop*    event_loop,
+                    FrameProcessor     frame_processor) {
+  frame_processor_ = std::move(frame_processor);
+  closed_          = false;
+  return intf_.init(interface, event_loop,
+                    [this](const can_frame& frame) { on_frame(frame); });
+}
+
+void CoCanBus::deinit() {
+  // Set first: waiters resumed below that await again get nullopt right away
+  closed_ = true;
+  intf_.deinit();
+  while (masked_.head || pending_) {
+    FrameAwaiter* waiter = masked_.head;
+    for (auto it = exact_.begin(); !waiter && it != exact_.end(); ++it)
+      waiter = it->second.head;
+    if (!waiter)
+      break;
+    unlink(*waiter);
+    scheduler_.cancel_timer(*waiter);
+    waiter->handle_.resume();
+  }
+}
+
+CoCanBus::FrameAwaiter CoCanBus::next_frame(CanIdMatch               match,
+                                            std::chrono::nanoseconds timeout) {
+  return FrameAwaiter(
+    this, match,
+    timeout.count() > 0 ? static_cast<uint64_t>(timeout.count()) : 0);
+}
+
+CoCanBus::FrameAwaiter CoCanBus::request(const can_frame&         tx,
+                                         CanIdMatch               rx_match,
+                                         std::chrono::nanoseconds timeout) {
+  FrameAwaiter waiter = next_frame(rx_match, timeout);
+  waiter.tx_          = tx;
+  waiter.has_tx_      = true;
+  return waiter;
+}
+
+bool CoCanBus::FrameAwaiter::await_suspend(std::coroutine_handle<> handle) {
+  if (bus_->closed_)
+    return false;
+  handle_ = handle;
+  bus_->link(*this);
+  if (has_tx_) {
+    // A loopback transport may deliver the response within send(); on_frame()
+    // then completes the await without resuming, and so does a failed send
+    sending_ = true;
+    bool sent = bus_->send(tx_);
+    sending_  = false;
+    if (!sent && linked_)
+      bus_->unlink(*this);
+    if (!sent || received_)
+      return false;
+  }
+  if (timeout_ns_) {
+    deadline_ns = CoScheduler::now_ns() + timeout_ns_;
+    expire      = [](CoTimer* timer) {
+      FrameAwaiter* waiter = static_cast<FrameAwaiter*>(timer);
+      waiter->bus_->unlink(*waiter);
+      waiter->handle_.resume();
+    };
+    bus_->scheduler_.add_timer(*this);
+  }
+  return true;
+}
+
+CoCanBus::WaiterList& CoCanBus::list_for(const CanIdMatch& match) {
+  if (!match.exact())
+    return masked_;
+  // Entries are kept once created, so steady traffic does not allocate
+  return exact_[CanIdMatch::key_of(match.id)];
+}
+
+void CoCanBus::link(FrameAwaiter& waiter) {
+  WaiterList& list = list_for(waiter.match_);
+  waiter.prev_     = list.tail;
+  waiter.next_     = nullptr;
+  if (list.tail)
+    list.tail->next_ = &waiter;
+  else
+    list.head = &waiter;
+  list.tail     = &waiter;
+  waiter.linked_ = true;
+  ++pending_;
+}
+
+void CoCanBus::unlink(FrameAwaiter& waiter) {
+  WaiterList& list = list_for(waiter.match_);
+  if (waiter.prev_)
+    waiter.prev_->next_ = waiter.next_;
+  else
+    list.head = waiter.next_;
+  if (waiter.next_)
+    waiter.next_->prev_ = waiter.prev_;
+  else
+    list.tail = waiter.prev_;
+  waiter.prev_   = waiter.next_ = nullptr;
+  waiter.linked_ = false;
+  --pending_;
+}
+
+void CoCanBus::on_frame(const can_frame& frame) {
+  if (frame_processor_)
+    frame_processor_(frame);
+  if (!pending_)
+    return;
+
+  // Collect first: resumed coroutines may await again, which links a new
+  // waiter that must wait for the next frame
+  FrameAwaiter* ready = nullptr;
+  FrameAwaiter* last  = nullptr;
+  auto          take  = [&](WaiterList& list) {
+    FrameAwaiter* waiter = list.head;
+    while (waiter) {
+      FrameAwaiter* next = waiter->next_;
+      if (waiter->match_.matches(frame.can_id)) {
+        unlink(*waiter);
+        scheduler_.cancel_timer(*waiter);
+        waiter->received_ = true;
+        waiter->frame_    = frame;
+        if (waiter->sending_) {
+          waiter = next;
+          continue;
+        }
+        if (last)
+          last->next_ = waiter;
+        else
+          ready = waiter;
+        last = waiter;
+      }
+      waiter = next;
+    }
+  };
+  auto it = exact_.find(CanIdMatch::key_of(frame.can_id));
+  if (it != exact_.end())
+    take(it->second);
+  take(masked_);
+
+  while (ready) {
+    FrameAwaiter* next = ready->next_;
+    ready->next_       = nullptr;
+    ready->handle_.resume();
+    ready = next;
+  }
+}
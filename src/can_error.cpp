@@ -0,0 +1,109 @@
+#include "socket_can/can_error.hpp"
+
+const char* to_string(CanControllerState state) {
+  switch (state) {
+    case CanControllerState::kErrorActive:
+      return "error-active";
+    case CanControllerState::kErrorWarning:
+      return "error-warning";
+    case CanControllerState::kErrorPassive:
+      return "error-passive";
+    case CanControllerState::kBusOff:
+      return "bus-off";
+  }
+  return "unknown";
+}
+
+bool decode_can_error(const can_frame& frame, CanErrorInfo& info) {
+  if (!(frame.can_id & CAN_ERR_FLAG))
+    return false;
+  info         = CanErrorInfo();
+  info.classes = frame.can_id & CAN_ERR_MASK;
+  if (info.classes & CAN_ERR_CRTL)
+    info.controller = frame.data[1];
+  if (info.classes & CAN_ERR_PROT) {
+    info.protocol = frame.data[2];
+    info.location = frame.data[3];
+  }
+  if (info.classes & CAN_ERR_TRX)
+    info.transceiver = frame.data[4];
+  if (info.classes & CAN_ERR_CNT) {
+    info.tx_errors = frame.data[6];
+    info.rx_errors = frame.data[7];
+  }
+
+  // Most severe first: a bus-off frame may also carry the passive bits
+  if (info.classes & CAN_ERR_BUSOFF) {
+    info.state       = CanControllerState::kBusOff;
+    info.state_known = true;
+  } else if (info.classes & CAN_ERR_RESTARTED) {
+    info.state       = CanControllerState::kErrorActive;
+    info.state_known = true;
+    info.restarted   = true;
+  } else if (info.classes & CAN_ERR_CRTL) {
+    uint8_t c = info.controller;
+    if (c & (CAN_ERR_CRTL_RX_PASSIVE | CAN_ERR_CRTL_TX_PASSIVE)) {
+      info.state       = CanControllerState::kErrorPassive;
+      info.state_known = true;
+    } else if (c & (CAN_ERR_CRTL_RX_WARNING | CAN_ERR_CRTL_TX_WARNING)) {
+      info.state       = CanControllerState::kErrorWarning;
+      info.state_known = true;
+    } else if (c & CAN_ERR_CRTL_ACTIVE) {
+      info.state       = CanControllerState::kErrorActive;
+      info.state_known = true;
+    }
+  }
+  return true;
+}
+
+std::string CanErrorInfo::describe() const {
+  std::string text;
+  auto add = [&text](const char* part) {
+    if (!text.empty())
+      text += ", ";
+    text += part;
+  };
+  if (restarted)
+    add("restarted");
+  else if (state_known)
+    add(to_string(state));
+  if (classes & CAN_ERR_TX_TIMEOUT)
+    add("tx timeout");
+  if (classes & CAN_ERR_LOSTARB)
+    add("lost arbitration");
+  if (controller & (CAN_ERR_CRTL_RX_OVERFLOW | CAN_ERR_CRTL_TX_OVERFLOW))
+    add("controller overflow");
+  if (classes & CAN_ERR_PROT) {
+    static const struct {
+      uint8_t     bit;
+      const char* name;
+    } kProtocol[] = {
+      {CAN_ERR_PROT_BIT, "protocol bit"},
+      {CAN_ERR_PROT_FORM, "protocol form"},
+      {CAN_ERR_PROT_STUFF, "protocol stuff"},
+      {CAN_ERR_PROT_BIT0, "protocol bit0"},
+      {CAN_ERR_PROT_BIT1, "protocol bit1"},
+      {CAN_ERR_PROT_OVERLOAD, "overload"},
+    };
+    bool named = false;
+    for (const auto& p : kProtocol) {
+      if (protocol & p.bit) {
+        add(p.name);
+        named = true;
+      }
+    }
+    if (!named)
+      add("protocol violation");
+  }
+  if (classes & CAN_ERR_TRX)
+    add("transceiver");
+  if (classes & CAN_ERR_ACK)
+    add("no ack");
+  if (classes & CAN_ERR_BUSERROR)
+    add("bus error");
+  if (classes & CAN_ERR_CNT) {
+    text += " (tx " + std::to_string(tx_errors) + ", rx " +
+            std::to_string(rx_errors) + ")";
+  }
+  return text.empty() ? "error" : text;
+}
@@ -0,0 +1,401 @@
+#include "socket_can/can_gateway.hpp"
+#include "socket_can/link_monitor.hpp"
+#include "socket_can/replay.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <linux/can/gw.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr canid_t kEffKey = CAN_EFF_FLAG | CAN_EFF_MASK;
+
+uint64_t load_data(const uint8_t* data) {
+  uint64_t value;
+  std::memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+bool matches(const GatewayRule& rule, canid_t can_id) {
+  return ((can_id ^ rule.id) & rule.mask) == 0;
+}
+
+bool is_virtual(const std::string& interface) {
+  return interface.compare(0, 5, "vbus:") == 0;
+}
+
+// Sends one rtnetlink request and waits for its acknowledgement; false with
+// errno set to the kernel's error
+bool netlink_request(struct nlmsghdr* message) {
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0)
+    return false;
+  struct timeval timeout = {1, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_nl kernel = {};
+  kernel.nl_family          = AF_NETLINK;
+  if (sendto(fd, message, message->nlmsg_len, 0,
+             reinterpret_cast<struct sockaddr*>(&kernel),
+             sizeof(kernel)) < 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return false;
+  }
+  char    buf[1024];
+  ssize_t n     = recv(fd, buf, sizeof(buf), 0);
+  int     error = n < 0 ? errno : EPROTO;
+  if (n > 0) {
+    struct nlmsghdr* reply = reinterpret_cast<struct nlmsghdr*>(buf);
+    if (NLMSG_OK(reply, static_cast<size_t>(n)) &&
+        reply->nlmsg_type == NLMSG_ERROR)
+      error = -static_cast<struct nlmsgerr*>(NLMSG_DATA(reply))->error;
+  }
+  close(fd);
+  errno = error;
+  return error == 0;
+}
+
+}  // namespace
+
+CanGateway::~CanGateway() {
+  deinit();
+}
+
+bool CanGateway::init(EpollEventLoop*                 event_loop,
+                      const std::vector<GatewayRule>& rules,
+                      bool                            offload_rules) {
+  if (rules.size() > UINT16_MAX) {
+    std::cerr << "Too many gateway rules" << std::endl;
+    return false;
+  }
+  event_loop_ = event_loop;
+
+  uint64_t now = DeadlineScheduler::now_ns();
+  routes_.reserve(rules.size());
+  for (const GatewayRule& rule : rules) {
+    if (rule.from == rule.to || rule.from.empty() || rule.to.empty()) {
+      std::cerr << "Invalid gateway rule " << rule.from << " -> " << rule.to
+                << std::endl;
+      deinit();
+      return false;
+    }
+    Route route;
+    route.rule = rule;
+    if (route.rule.name.empty())
+      route.rule.name = rule.from + "->" + rule.to;
+    route.in       = port_index(rule.from);
+    route.out      = port_index(rule.to);
+    route.id_and   = ~rule.id_rewrite_mask;
+    route.id_or    = rule.new_id & rule.id_rewrite_mask;
+    route.data_and = load_data(rule.data_and.data());
+    route.data_or  = load_data(rule.data_or.data());
+    route.data_xor = load_data(rule.data_xor.data());
+    if (rule.rate_limit > 0) {
+      route.capacity =
+        rule.burst ? rule.burst : std::max(1.0, rule.rate_limit / 10);
+      route.tokens    = route.capacity;
+      route.refill_ns = now;
+    }
+
+    MetricsRegistry& registry = MetricsRegistry::global();
+    MetricLabels     labels   = {{"route", route.rule.name}};
+    MetricLabels     rate     = labels, queue = labels;
+    rate.push_back({"reason", "rate"});
+    queue.push_back({"reason", "queue"});
+    route.forwarded = registry.counter(
+      "socket_can_gateway_frames", "Frames forwarded by a route", labels);
+    route.rate_dropped = registry.counter(
+      "socket_can_gateway_drops", "Frames a route dropped", rate);
+    route.queue_dropped = registry.counter(
+      "socket_can_gateway_drops", "Frames a route dropped", queue);
+    // 128 ns to 134 ms
+    route.latency = registry.histogram(
+      "socket_can_gateway_latency_seconds",
+      "Time from handling the RX batch to sending the forwarded frame",
+      labels, 7, 27, 1e-9);
+    routes_.push_back(std::move(route));
+  }
+
+  for (size_t i = 0; i < ports_.size(); ++i) {
+    Port& port  = *ports_[i];
+    port.kernel = !is_virtual(port.name);
+    if (!port.intf.init(port.name, event_loop_,
+                        [this, i](const can_frame& frame) {
+                          on_frame(i, frame);
+                        })) {
+      deinit();
+      return false;
+    }
+    port.intf.set_batch_end_handler([this]() { flush_all(); });
+  }
+
+  for (Route& route : routes_) {
+    if (!offload_rules || !route.rule.allow_offload ||
+        route.rule.rate_limit > 0 || !ports_[route.in]->kernel ||
+        !ports_[route.out]->kernel)
+      continue;
+    if (!offload(route, true)) {
+      std::cerr << "can-gw offload unavailable (" << strerror(errno)
+                << "), routing in user space" << std::endl;
+      offload_rules = false;
+      continue;
+    }
+    route.offloaded = true;
+  }
+
+  for (size_t i = 0; i < ports_.size(); ++i) {
+    if (!compile(i)) {
+      deinit();
+      return false;
+    }
+  }
+  pending_ports_.reserve(ports_.size());
+  return true;
+}
+
+void CanGateway::deinit() {
+  for (Route& route : routes_) {
+    if (route.offloaded && !offload(route, false))
+      std::cerr << "Failed to remove can-gw rule " << route.rule.name << ": "
+                << strerror(errno) << std::endl;
+  }
+  for (auto& port : ports_)
+    port->intf.deinit();
+  ports_.clear();
+  routes_.clear();
+  pending_ports_.clear();
+  batch_ns_ = 0;
+}
+
+CanGateway::RouteStats CanGateway::stats(size_t route) const {
+  const Route& r = routes_[route];
+  RouteStats   stats;
+  stats.forwarded     = r.forwarded->value();
+  stats.rate_dropped  = r.rate_dropped->value();
+  stats.queue_dropped = r.queue_dropped->value();
+  stats.offloaded     = r.offloaded;
+  return stats;
+}
+
+void CanGateway::modify(const GatewayRule& rule, can_frame& frame) {
+  frame.can_id = (frame.can_id & ~rule.id_rewrite_mask) |
+                 (rule.new_id & rule.id_rewrite_mask);
+  for (size_t i = 0; i < CAN_MAX_DLEN; ++i) {
+    frame.data[i] = static_cast<uint8_t>(
+      ((frame.data[i] & rule.data_and[i]) | rule.data_or[i]) ^
+      rule.data_xor[i]);
+  }
+}
+
+size_t CanGateway::port_index(const std::string& name) {
+  for (size_t i = 0; i < ports_.size(); ++i) {
+    if (ports_[i]->name == name)
+      return i;
+  }
+  ports_.push_back(std::make_unique<Port>());
+  ports_.back()->name = name;
+  return ports_.size() - 1;
+}
+
+bool CanGateway::compile(size_t in) {
+  Port&     port = *ports_[in];
+  RouteList routes;
+  for (size_t r = 0; r < routes_.size(); ++r) {
+    if (routes_[r].in == in && !routes_[r].offloaded)
+      routes.push_back(static_cast<uint16_t>(r));
+  }
+
+  // Plain 11-bit data frames: every rule evaluated once per ID here
+  port.sff_begin.assign(kSffIds + 1, 0);
+  port.sff_routes.clear();
+  for (canid_t id = 0; id < kSffIds; ++id) {
+    port.sff_begin[id] = static_cast<uint32_t>(port.sff_routes.size());
+    for (uint16_t r : routes) {
+      if (matches(routes_[r].rule, id))
+        port.sff_routes.push_back(r);
+    }
+  }
+  port.sff_begin[kSffIds] = static_cast<uint32_t>(port.sff_routes.size());
+
+  port.eff_exact.clear();
+  port.other.clear();
+  for (uint16_t r : routes) {
+    const GatewayRule& rule = routes_[r].rule;
+    if ((rule.mask & kEffKey) == kEffKey && (rule.id & CAN_EFF_FLAG))
+      port.eff_exact[rule.id & kEffKey].push_back(r);
+    else
+      port.other.push_back(r);
+  }
+
+  if (!port.kernel)
+    return true;
+  // Let the kernel drop what no route takes
+  std::vector<can_filter> filters;
+  for (uint16_t r : routes)
+    filters.push_back({routes_[r].rule.id, routes_[r].rule.mask});
+  if (filters.empty())
+    filters.push_back({CAN_INV_FILTER, 0});  // matches nothing
+  if (filters.size() > CAN_RAW_FILTER_MAX)
+    filters.clear();
+  if (!port.intf.set_filters(filters)) {
+    std::cerr << "Failed to set gateway filters on " << port.name
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void CanGateway::on_frame(size_t in, const can_frame& frame) {
+  if (!batch_ns_)
+    batch_ns_ = DeadlineScheduler::now_ns();
+  Port&   port = *ports_[in];
+  canid_t id   = frame.can_id;
+  if (!(id & (CAN_EFF_FLAG | CAN_RTR_FLAG))) {
+    for (uint32_t i = port.sff_begin[id]; i < port.sff_begin[id + 1]; ++i)
+      forward(port.sff_routes[i], frame);
+    return;
+  }
+  if (id & CAN_EFF_FLAG) {
+    auto it = port.eff_exact.find(id & kEffKey);
+    if (it != port.eff_exact.end()) {
+      for (uint16_t r : it->second) {
+        if (matches(routes_[r].rule, id))
+          forward(r, frame);
+      }
+    }
+  }
+  for (uint16_t r : port.other) {
+    if (matches(routes_[r].rule, id))
+      forward(r, frame);
+  }
+}
+
+void CanGateway::forward(uint16_t r, const can_frame& frame) {
+  Route& route = routes_[r];
+  if (route.capacity > 0 && !take_token(route)) {
+    route.rate_dropped->inc();
+    return;
+  }
+  Port& out = *ports_[route.out];
+  if (out.tx_count == kTxBatch)
+    flush(out);
+
+  can_frame& copy = out.tx[out.tx_count];
+  copy            = frame;
+  copy.can_id     = (copy.can_id & route.id_and) | route.id_or;
+  uint64_t data   = load_data(copy.data);
+  data            = ((data & route.data_and) | route.data_or) ^ route.data_xor;
+  std::memcpy(copy.data, &data, sizeof(data));
+  out.tx_route[out.tx_count++] = r;
+
+  if (!out.queued) {
+    out.queued = true;
+    pending_ports_.push_back(route.out);
+  }
+}
+
+bool CanGateway::take_token(Route& route) {
+  if (batch_ns_ > route.refill_ns) {
+    route.tokens = std::min(route.capacity,
+                            route.tokens + (batch_ns_ - route.refill_ns) *
+                                             route.rule.rate_limit / 1e9);
+    route.refill_ns = batch_ns_;
+  }
+  if (route.tokens < 1)
+    return false;
+  route.tokens -= 1;
+  return true;
+}
+
+void CanGateway::flush(Port& port) {
+  size_t   n_sent  = port.intf.send_can_frames(port.tx.data(), port.tx_count);
+  uint64_t latency = DeadlineScheduler::now_ns() - batch_ns_;
+  for (size_t i = 0; i < port.tx_count; ++i) {
+    Route& route = routes_[port.tx_route[i]];
+    if (i < n_sent) {
+      route.forwarded->inc();
+      route.latency->observe(latency);
+    } else {
+      route.queue_dropped->inc();
+    }
+  }
+  port.tx_count = 0;
+}
+
+void CanGateway::flush_all() {
+  for (size_t index : pending_ports_) {
+    Port& port = *ports_[index];
+    flush(port);
+    port.queued = false;
+  }
+  pending_ports_.clear();
+  batch_ns_ = 0;
+}
+
+bool CanGateway::offload(Route& route, bool add) {
+  unsigned src = if_nametoindex(ports_[route.in]->name.c_str());
+  unsigned dst = if_nametoindex(ports_[route.out]->name.c_str());
+  if (!src || !dst) {
+    errno = ENODEV;
+    return false;
+  }
+
+  alignas(struct nlmsghdr) char buf[512] = {};
+  auto* message        = reinterpret_cast<struct nlmsghdr*>(buf);
+  message->nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+  message->nlmsg_type  = add ? RTM_NEWROUTE : RTM_DELROUTE;
+  message->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+  auto* rtcan          = static_cast<struct rtcanmsg*>(NLMSG_DATA(message));
+  rtcan->can_family    = AF_CAN;
+  rtcan->gwtype        = CGW_TYPE_CAN_CAN;
+
+  const GatewayRule& rule   = route.rule;
+  struct can_filter  filter = {rule.id, rule.mask};
+  bool               ok =
+    rtnetlink_add_attribute(message, sizeof(buf), CGW_SRC_IF, &src,
+                            sizeof(uint32_t)) &&
+    rtnetlink_add_attribute(message, sizeof(buf), CGW_DST_IF, &dst,
+                            sizeof(uint32_t)) &&
+    rtnetlink_add_attribute(message, sizeof(buf), CGW_FILTER, &filter,
+                            sizeof(filter));
+
+  // Same order as the forwarding path: AND, OR, XOR
+  struct Modification {
+    uint16_t attribute;
+    canid_t  id;
+    uint64_t data;
+    bool     id_used;
+    bool     data_used;
+  };
+  const Modification modifications[] = {
+    {CGW_MOD_AND, route.id_and, route.data_and, route.id_and != ~0u,
+     route.data_and != ~0ull},
+    {CGW_MOD_OR, route.id_or, route.data_or, route.id_or != 0,
+     route.data_or != 0},
+    {CGW_MOD_XOR, 0, route.data_xor, false, route.data_xor != 0},
+  };
+  for (const Modification& m : modifications) {
+    if (!m.id_used && !m.data_used)
+      continue;
+    struct cgw_frame_mod mod = {};
+    mod.cf.can_id            = m.id;
+    std::memcpy(mod.cf.data, &m.data, sizeof(m.data));
+    mod.modtype = static_cast<uint8_t>((m.id_used ? CGW_MOD_ID : 0) |
+                                       (m.data_used ? CGW_MOD_DATA : 0));
+    ok = ok && rtnetlink_add_attribute(message, sizeof(buf), m.attribute, &mod,
+                                       CGW_MODATTR_LEN);
+  }
+  if (!ok) {
+    errno = EMSGSIZE;
+    return false;
+  }
+  return netlink_request(message);
+}
@@ -0,0 +1,197 @@
+#include "socket_can/can_transport.hpp"
+#include "socket_can/can_datagram.hpp"
+#include "socket_can/virtual_can_bus.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using socket_can_detail::tx_queue_full;
+
+ssize_t CanTransport::send_batch(const can_frame* frames, size_t count) {
+  size_t n_sent = 0;
+  while (n_sent < count && send(frames[n_sent]))
+    n_sent++;
+  if (n_sent < count && !tx_queue_full(errno))
+    return -1;
+  return static_cast<ssize_t>(n_sent);
+}
+
+ssize_t CanTransport::receive_scatter(can_frame* const* frames, size_t max) {
+  size_t n = 0;
+  while (n < max) {
+    ssize_t n_batch = receive_batch(frames[n], 1);
+    if (n_batch < 0)
+      return n ? static_cast<ssize_t>(n) : -1;
+    if (n_batch == 0)
+      break;
+    n++;
+  }
+  return static_cast<ssize_t>(n);
+}
+
+bool CanTransport::set_filters(const can_filter*, size_t count) {
+  if (count == 0)
+    return true;
+  errno = EOPNOTSUPP;
+  return false;
+}
+
+bool CanTransport::set_error_mask(can_err_mask_t mask) {
+  if (mask == 0)
+    return true;
+  errno = EOPNOTSUPP;
+  return false;
+}
+
+DatagramCanTransport::~DatagramCanTransport() {
+  close();
+}
+
+void DatagramCanTransport::close() {
+  if (fd_ >= 0)
+    ::close(fd_);
+  fd_ = -1;
+}
+
+bool DatagramCanTransport::send(const can_frame& frame) {
+  return socket_can_detail::send_datagram(fd_, frame);
+}
+
+ssize_t DatagramCanTransport::send_batch(const can_frame* frames,
+                                         size_t           count) {
+  int    error;
+  size_t n_sent = socket_can_detail::send_datagrams(fd_, frames, count, error);
+  if (error) {
+    errno = error;
+    return -1;
+  }
+  return static_cast<ssize_t>(n_sent);
+}
+
+ssize_t DatagramCanTransport::receive_batch(can_frame* frames, size_t max) {
+  if (max > kMaxBatch)
+    max = kMaxBatch;
+  can_frame* buffers[kMaxBatch];
+  for (size_t i = 0; i < max; ++i)
+    buffers[i] = &frames[i];
+  return receive_scatter(buffers, max);
+}
+
+ssize_t DatagramCanTransport::receive_scatter(can_frame* const* frames,
+                                              size_t            max) {
+  if (max > kMaxBatch)
+    max = kMaxBatch;
+  struct mmsghdr msgs[kMaxBatch];
+  struct iovec   iovs[kMaxBatch];
+  for (size_t i = 0; i < max; ++i)
+    socket_can_detail::prepare_datagram(msgs[i], iovs[i], frames[i],
+                                        sizeof(can_frame));
+  int n_received = socket_can_detail::receive_datagrams(fd_, msgs, max);
+  if (n_received < 0)
+    return -1;
+
+  // Drop short datagrams, keeping the valid frames in the first buffers
+  size_t n_valid = 0;
+  for (int i = 0; i < n_received; ++i) {
+    if (!socket_can_detail::accept_datagram(*frames[i], msgs[i].msg_len)) {
+      std::cerr << "invalid message length " << msgs[i].msg_len << std::endl;
+      continue;
+    }
+    if (n_valid != static_cast<size_t>(i))
+      *frames[n_valid] = *frames[i];
+    n_valid++;
+  }
+  if (n_valid == 0 && n_received > 0)
+    return receive_scatter(frames, max);
+  return static_cast<ssize_t>(n_valid);
+}
+
+bool DatagramCanTransport::wait_writable(int timeout_ms) {
+  struct pollfd pfd = {.fd = fd_, .events = POLLOUT, .revents = 0};
+  return poll(&pfd, 1, timeout_ms) == 1 && (pfd.revents & POLLOUT);
+}
+
+bool SocketCanTransport::open(const std::string& interface) {
+  close();
+  fd_ = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_RAW);
+  if (fd_ == -1) {
+    std::cerr << "Failed to create socket" << std::endl;
+    return false;
+  }
+
+  struct ifreq ifr;
+  std::memset(&ifr, 0, sizeof(ifr));
+  std::strncpy(ifr.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+  if (ioctl(fd_, SIOCGIFINDEX, &ifr) == -1) {
+    std::cerr << "Failed to get interface index" << std::endl;
+    close();
+    return false;
+  }
+
+  struct sockaddr_can addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.can_family  = AF_CAN;
+  addr.can_ifindex = ifr.ifr_ifindex;
+  if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) ==
+      -1) {
+    std::cerr << "Failed to bind socket" << std::endl;
+    close();
+    return false;
+  }
+
+  struct msghdr message = {.msg_name       = nullptr,
+                           .msg_namelen    = 0,
+                           .msg_iov        = nullptr,
+                           .msg_iovlen     = 0,
+                           .msg_control    = nullptr,
+                           .msg_controllen = 0,
+                           .msg_flags      = 0};
+
+  int retcode = recvmsg(fd_, &message, 0);
+  if (retcode < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    close();
+    return false;
+  }
+  name_ = interface;
+  return true;
+}
+
+bool SocketCanTransport::set_filters(const can_filter* filters, size_t count) {
+  // A zero-length list would block everything; restore the default filter
+  // that matches every frame instead
+  static const can_filter kAll = {0, 0};
+  if (count == 0) {
+    filters = &kAll;
+    count   = 1;
+  }
+  if (setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+                 static_cast<socklen_t>(count * sizeof(can_filter))) != 0) {
+    std::cerr << "Failed to set CAN filters: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool SocketCanTransport::set_error_mask(can_err_mask_t mask) {
+  if (setsockopt(fd_, SOL_CAN_RAW, CAN_RAW_ERR_FILTER, &mask, sizeof(mask)) !=
+      0) {
+    std::cerr << "Failed to set CAN error mask: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<CanTransport> make_can_transport(const std::string& interface) {
+  if (interface.compare(0, kVirtualBusPrefixLength, kVirtualBusPrefix) == 0)
+    return std::unique_ptr<CanTransport>(new LoopbackTransport());
+  return std::unique_ptr<CanTransport>(new SocketCanTransport());
+}
@@ -0,0 +1,124 @@
+#include "socket_can/capture.hpp"
+#include "socket_can/capture_index.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+CaptureLogger::CaptureLogger() : index_(new CaptureIndexWriter) {
+}
+
+CaptureLogger::~CaptureLogger() {
+  close();
+}
+
+bool CaptureLogger::open(const std::string& path,
+                         uint32_t           index_block_records) {
+  if (!writer_.open(path)) {
+    std::cerr << "Failed to open capture file " << path << std::endl;
+    return false;
+  }
+  index_->close();
+  if (index_block_records == 0) {
+    ::unlink(capture_index_path(path).c_str());  // never leave a stale index
+  } else if (!index_->open(path, index_block_records)) {
+    std::cerr << "Failed to open capture index for " << path << std::endl;
+    writer_.close();
+    return false;
+  }
+  header_ = {};
+  std::memcpy(header_.magic, kCaptureFileMagic, sizeof(header_.magic));
+  header_.version     = kCaptureFormatVersion;
+  header_.record_size = sizeof(CaptureRecord);
+  return writer_.append(&header_, sizeof(header_));
+}
+
+bool CaptureLogger::write(const CaptureRecord& record) {
+  // Not open: nothing would ever reach a file or the index
+  if (!writer_.is_open())
+    return false;
+  if (!writer_.append(&record, sizeof(record)) || !index_->add(record))
+    return false;
+  if (header_.record_count++ == 0)
+    header_.first_timestamp_ns = record.timestamp_ns;
+  header_.last_timestamp_ns = record.timestamp_ns;
+  return true;
+}
+
+bool CaptureLogger::flush() {
+  // Records first: index entries must never point past the data on disk
+  return writer_.flush() && index_->flush();
+}
+
+bool CaptureLogger::close() {
+  if (!writer_.is_open())
+    return true;
+  bool ok = writer_.write_at(0, &header_, sizeof(header_));
+  ok      = writer_.close() && ok;
+  return index_->close() && ok;
+}
+
+CaptureFileReader::~CaptureFileReader() {
+  close();
+}
+
+bool CaptureFileReader::open(const std::string& path) {
+  close();
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) == -1 ||
+      static_cast<size_t>(st.st_size) < sizeof(CaptureFileHeader)) {
+    ::close(fd);
+    return false;
+  }
+
+  map_size_ = static_cast<size_t>(st.st_size);
+  map_      = mmap(nullptr, map_size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (map_ == MAP_FAILED) {
+    map_ = nullptr;
+    return false;
+  }
+
+  const CaptureFileHeader& hdr = header();
+  if (std::memcmp(hdr.magic, kCaptureFileMagic, sizeof(hdr.magic)) != 0 ||
+      hdr.record_size != sizeof(CaptureRecord)) {
+    std::cerr << "Not a capture file: " << path << std::endl;
+    close();
+    return false;
+  }
+
+  // An unclosed file has no record count; trust the file length instead
+  size_t available = (map_size_ - sizeof(CaptureFileHeader)) /
+                     sizeof(CaptureRecord);
+  count_   = hdr.record_count && hdr.record_count <= available
+               ? static_cast<size_t>(hdr.record_count)
+               : available;
+  records_ = reinterpret_cast<const CaptureRecord*>(
+    static_cast<const char*>(map_) + sizeof(CaptureFileHeader));
+  position_ = 0;
+  madvise(map_, map_size_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void CaptureFileReader::close() {
+  if (map_)
+    munmap(map_, map_size_);
+  map_      = nullptr;
+  map_size_ = 0;
+  records_  = nullptr;
+  count_    = 0;
+  position_ = 0;
+}
+
+bool CaptureFileReader::next(CaptureRecord& record) {
+  if (position_ >= count_)
+    return false;
+  record = records_[position_++];
+  return true;
+}
@@ -0,0 +1,377 @@
+#include "socket_can/capture_analysis.hpp"
+#include "socket_can/capture_formats.hpp"
+#include "socket_can/id_table.hpp"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace {
+
+// Extended IDs tracked per thread by group_by_id(), 3/4 of the hash size
+constexpr size_t kEffIdCapacity = 8192;
+
+// One chunk of records in columns, and the bitmap of the selected ones
+struct Chunk {
+  std::vector<uint64_t> timestamps;
+  std::vector<uint32_t> channels;
+  FrameBatch            frames{CaptureAnalyzer::kChunkRecords};
+  std::vector<uint64_t> selected;
+
+  void load(const CaptureRecord* records, size_t count) {
+    timestamps.resize(count);
+    channels.resize(count);
+    frames.clear();
+    for (size_t i = 0; i < count; ++i) {
+      timestamps[i] = records[i].timestamp_ns;
+      channels[i]   = records[i].channel;
+      frames.push(records[i].frame);
+    }
+  }
+
+  template <typename F>
+  void for_each_selected(F&& fn) const {
+    for (size_t w = 0; w < selected.size(); ++w) {
+      for (uint64_t word = selected[w]; word; word &= word - 1)
+        fn(w * 64 + static_cast<size_t>(__builtin_ctzll(word)));
+    }
+  }
+};
+
+// Builds the selection bitmap of a chunk from an AnalysisFilter and an
+// optional extra rule that must match as well
+class Selector {
+public:
+  explicit Selector(const AnalysisFilter& filter,
+                    const can_filter*     rule = nullptr)
+    : filter_(filter),
+      ids_(filter.ids),
+      by_time_(filter.begin_ns > 0 || filter.end_ns != UINT64_MAX),
+      by_channel_(filter.channel >= 0) {
+    if (rule)
+      rule_.set_rules({*rule});
+  }
+
+  void select(Chunk& chunk, FilterResult& result) const {
+    size_t frames = chunk.frames.size();
+    size_t words  = (frames + 63) / 64;
+    chunk.selected.assign(words, ~0ull);
+    if (frames % 64)
+      chunk.selected[words - 1] = (1ull << (frames % 64)) - 1;
+
+    if (ids_.rule_count()) {
+      ids_.classify(chunk.frames, result);
+      for (size_t w = 0; w < words; ++w)
+        chunk.selected[w] &= result.any()[w];
+    }
+    if (rule_.rule_count()) {
+      rule_.classify(chunk.frames, result);
+      for (size_t w = 0; w < words; ++w)
+        chunk.selected[w] &= result.bits(0)[w];
+    }
+    if (!by_time_ && !by_channel_)
+      return;
+    uint32_t channel = static_cast<uint32_t>(filter_.channel);
+    for (size_t w = 0; w < words; ++w) {
+      size_t          lanes = std::min<size_t>(64, frames - w * 64);
+      const uint64_t* ts    = &chunk.timestamps[w * 64];
+      const uint32_t* ch    = &chunk.channels[w * 64];
+      uint64_t        word  = 0;
+      for (size_t j = 0; j < lanes; ++j) {
+        bool keep = ts[j] >= filter_.begin_ns && ts[j] < filter_.end_ns &&
+                    (!by_channel_ || ch[j] == channel);
+        word |= static_cast<uint64_t>(keep) << j;
+      }
+      chunk.selected[w] &= word;
+    }
+  }
+
+private:
+  const AnalysisFilter& filter_;
+  FrameFilterSet        ids_;
+  FrameFilterSet        rule_;
+  bool                  by_time_;
+  bool                  by_channel_;
+};
+
+// Loads [begin, end) chunk by chunk and calls fn(chunk) with the selection
+template <typename F>
+void for_each_chunk(const CaptureRecord* records,
+                    size_t               begin,
+                    size_t               end,
+                    const Selector&      selector,
+                    F&&                  fn) {
+  Chunk        chunk;
+  FilterResult result;
+  for (size_t b = begin; b < end; b += CaptureAnalyzer::kChunkRecords) {
+    chunk.load(records + b,
+               std::min(CaptureAnalyzer::kChunkRecords, end - b));
+    selector.select(chunk, result);
+    fn(chunk);
+  }
+}
+
+size_t period_bucket(uint64_t period_ns) {
+  uint64_t us = period_ns / 1000;
+  if (us == 0)
+    return 0;
+  size_t bucket = static_cast<size_t>(64 - __builtin_clzll(us));
+  return std::min(bucket, kPeriodBuckets - 1);
+}
+
+void add_period(IdSummary& summary, uint64_t period_ns) {
+  summary.periods++;
+  summary.period_sum_ns += period_ns;
+  summary.min_period_ns = std::min(summary.min_period_ns, period_ns);
+  summary.max_period_ns = std::max(summary.max_period_ns, period_ns);
+  summary.period_histogram[period_bucket(period_ns)]++;
+}
+
+// `from` covers records after those of `into`
+void merge_summary(IdSummary& into, const IdSummary& from) {
+  if (into.count == 0) {
+    into = from;
+    return;
+  }
+  if (from.first_ns >= into.last_ns)
+    add_period(into, from.first_ns - into.last_ns);
+  into.count += from.count;
+  into.last_ns = from.last_ns;
+  into.periods += from.periods;
+  into.period_sum_ns += from.period_sum_ns;
+  into.min_period_ns = std::min(into.min_period_ns, from.min_period_ns);
+  into.max_period_ns = std::max(into.max_period_ns, from.max_period_ns);
+  into.min_dlc       = std::min(into.min_dlc, from.min_dlc);
+  into.max_dlc       = std::max(into.max_dlc, from.max_dlc);
+  for (size_t b = 0; b < kPeriodBuckets; ++b)
+    into.period_histogram[b] += from.period_histogram[b];
+}
+
+void add_value(SignalBucket& bucket, double value) {
+  if (bucket.count == 0 || value < bucket.min)
+    bucket.min = value;
+  if (bucket.count == 0 || value > bucket.max)
+    bucket.max = value;
+  bucket.count++;
+  bucket.sum += value;
+}
+
+can_filter signal_rule(const SignalQuery& query) {
+  return can_filter{query.id, query.mask};
+}
+
+}  // namespace
+
+CaptureAnalyzer::CaptureAnalyzer(unsigned threads)
+  : threads_(threads ? threads
+                     : std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+CaptureAnalyzer::~CaptureAnalyzer() = default;
+
+bool CaptureAnalyzer::open(const std::string& path) {
+  close();
+  source_ = open_capture_source(path);
+  if (!source_) {
+    std::cerr << "Cannot open capture " << path << std::endl;
+    return false;
+  }
+  if (auto* mapped = dynamic_cast<CaptureFileReader*>(source_.get())) {
+    records_ = mapped->records();
+    count_   = mapped->size();
+    return true;
+  }
+  CaptureRecord record;
+  while (source_->next(record))
+    loaded_.push_back(record);
+  source_.reset();
+  records_ = loaded_.data();
+  count_   = loaded_.size();
+  return true;
+}
+
+void CaptureAnalyzer::close() {
+  source_.reset();
+  loaded_.clear();
+  loaded_.shrink_to_fit();
+  records_ = nullptr;
+  count_   = 0;
+}
+
+template <typename F>
+unsigned CaptureAnalyzer::parallel_ranges(F&& fn) const {
+  size_t   chunks  = (count_ + kChunkRecords - 1) / kChunkRecords;
+  unsigned workers = static_cast<unsigned>(
+    std::max<size_t>(1, std::min<size_t>(threads_, chunks)));
+  std::vector<std::thread> pool;
+  for (unsigned w = 1; w < workers; ++w) {
+    size_t begin = count_ * w / workers;
+    size_t end   = count_ * (w + 1) / workers;
+    pool.emplace_back([&fn, w, begin, end] { fn(w, begin, end); });
+  }
+  fn(0u, size_t{0}, count_ / workers);
+  for (std::thread& thread : pool)
+    thread.join();
+  return workers;
+}
+
+CaptureScanResult CaptureAnalyzer::scan(const AnalysisFilter& filter) const {
+  std::vector<CaptureScanResult> parts(threads_);
+  Selector                       selector(filter);
+  unsigned                       workers = parallel_ranges(
+    [&](unsigned worker, size_t begin, size_t end) {
+      CaptureScanResult& part = parts[worker];
+      for_each_chunk(records_, begin, end, selector, [&](const Chunk& chunk) {
+        const uint8_t* lengths = chunk.frames.lengths();
+        chunk.for_each_selected([&](size_t i) {
+          if (part.matched++ == 0)
+            part.first_ns = chunk.timestamps[i];
+          part.last_ns = chunk.timestamps[i];
+          part.payload_bytes += lengths[i];
+        });
+      });
+    });
+
+  CaptureScanResult result;
+  result.records = count_;
+  for (unsigned w = 0; w < workers; ++w) {
+    const CaptureScanResult& part = parts[w];
+    if (part.matched == 0)
+      continue;
+    if (result.matched == 0)
+      result.first_ns = part.first_ns;
+    result.matched += part.matched;
+    result.payload_bytes += part.payload_bytes;
+    result.last_ns = part.last_ns;
+  }
+  return result;
+}
+
+std::vector<IdSummary> CaptureAnalyzer::group_by_id(
+  const AnalysisFilter& filter,
+  uint64_t*             untracked) const {
+  std::vector<std::unique_ptr<IdTable<IdSummary>>> tables(threads_);
+  Selector                                         selector(filter);
+  unsigned workers = parallel_ranges(
+    [&](unsigned worker, size_t begin, size_t end) {
+      tables[worker] =
+        std::make_unique<IdTable<IdSummary>>(kEffIdCapacity);
+      IdTable<IdSummary>& table = *tables[worker];
+      for_each_chunk(records_, begin, end, selector, [&](const Chunk& chunk) {
+        const canid_t* ids     = chunk.frames.ids();
+        const uint8_t* lengths = chunk.frames.lengths();
+        chunk.for_each_selected([&](size_t i) {
+          IdSummary* summary = table.get(ids[i]);
+          if (!summary)
+            return;
+          uint64_t timestamp = chunk.timestamps[i];
+          if (summary->count++ == 0) {
+            summary->id       = IdTable<IdSummary>::key_of(ids[i]);
+            summary->first_ns = timestamp;
+          } else if (timestamp >= summary->last_ns) {
+            add_period(*summary, timestamp - summary->last_ns);
+          }
+          summary->last_ns = timestamp;
+          summary->min_dlc = std::min(summary->min_dlc, lengths[i]);
+          summary->max_dlc = std::max(summary->max_dlc, lengths[i]);
+        });
+      });
+    });
+
+  // Extended keys carry CAN_EFF_FLAG, so they sort after standard ones
+  std::map<canid_t, IdSummary> merged;
+  uint64_t                     overflow = 0;
+  for (unsigned w = 0; w < workers; ++w) {
+    tables[w]->for_each([&](canid_t key, const IdSummary& summary) {
+      merge_summary(merged[key], summary);
+    });
+    overflow += tables[w]->eff_overflow();
+  }
+  if (untracked)
+    *untracked = overflow;
+  std::vector<IdSummary> result;
+  result.reserve(merged.size());
+  for (const auto& entry : merged)
+    result.push_back(entry.second);
+  return result;
+}
+
+std::vector<SignalBucket> CaptureAnalyzer::signal_buckets(
+  const SignalQuery&    query,
+  const AnalysisFilter& filter) const {
+  using Buckets = std::map<uint64_t, SignalBucket>;
+  std::vector<Buckets> parts(threads_);
+  can_filter           rule = signal_rule(query);
+  Selector             selector(filter, &rule);
+  uint64_t             width = std::max<uint64_t>(query.bucket_ns, 1);
+  unsigned             workers = parallel_ranges(
+    [&](unsigned worker, size_t begin, size_t end) {
+      Buckets&      buckets = parts[worker];
+      SignalBucket* current = nullptr;
+      for_each_chunk(records_, begin, end, selector, [&](const Chunk& chunk) {
+        const uint64_t* payloads = chunk.frames.payloads();
+        const uint8_t*  lengths  = chunk.frames.lengths();
+        chunk.for_each_selected([&](size_t i) {
+          double value;
+          if (!decode_trigger_signal(query.signal, payloads[i], lengths[i],
+                                     value))
+            return;
+          uint64_t start = chunk.timestamps[i] / width * width;
+          // Frames in time order stay in the same bucket for a while
+          if (!current || current->start_ns != start) {
+            current           = &buckets[start];
+            current->start_ns = start;
+          }
+          add_value(*current, value);
+        });
+      });
+    });
+
+  Buckets merged;
+  for (unsigned w = 0; w < workers; ++w) {
+    for (const auto& entry : parts[w]) {
+      SignalBucket&       into = merged[entry.first];
+      const SignalBucket& from = entry.second;
+      if (into.count == 0) {
+        into = from;
+        continue;
+      }
+      into.min = std::min(into.min, from.min);
+      into.max = std::max(into.max, from.max);
+      into.count += from.count;
+      into.sum += from.sum;
+    }
+  }
+  std::vector<SignalBucket> result;
+  result.reserve(merged.size());
+  for (const auto& entry : merged)
+    result.push_back(entry.second);
+  return result;
+}
+
+std::vector<SignalSample> CaptureAnalyzer::extract_signal(
+  const SignalQuery&    query,
+  const AnalysisFilter& filter) const {
+  std::vector<std::vector<SignalSample>> parts(threads_);
+  can_filter                             rule = signal_rule(query);
+  Selector                               selector(filter, &rule);
+  unsigned                               workers = parallel_ranges(
+    [&](unsigned worker, size_t begin, size_t end) {
+      std::vector<SignalSample>& samples = parts[worker];
+      for_each_chunk(records_, begin, end, selector, [&](const Chunk& chunk) {
+        const uint64_t* payloads = chunk.frames.payloads();
+        const uint8_t*  lengths  = chunk.frames.lengths();
+        chunk.for_each_selected([&](size_t i) {
+          double value;
+          if (decode_trigger_signal(query.signal, payloads[i], lengths[i],
+                                    value))
+            samples.push_back({chunk.timestamps[i], value});
+        });
+      });
+    });
+
+  std::vector<SignalSample> result;
+  for (unsigned w = 0; w < workers; ++w)
+    result.insert(result.end(), parts[w].begin(), parts[w].end());
+  return result;
+}
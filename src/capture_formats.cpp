@@ -0,0 +1,910 @@
+#include "socket_can/capture_formats.hpp"
+#include "socket_can/compressed_capture.hpp"
+#include "socket_can/frame_formatter.hpp"
+#include "socket_can/text_format.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#ifdef SOCKET_CAN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using namespace text_format;
+
+namespace {
+
+constexpr uint64_t kNsPerSec = 1000000000ull;
+
+bool has_suffix(const std::string& s, const char* suffix) {
+  size_t n = std::strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+// Returns the next whitespace separated token of [p, end)
+const char* next_token(const char*  p,
+                       const char*  end,
+                       const char** token_end) {
+  p             = skip_spaces(p, end);
+  const char* q = p;
+  while (q < end && *q != ' ' && *q != '\t')
+    ++q;
+  *token_end = q;
+  return p;
+}
+
+bool token_equals(const char* begin, const char* end, const char* word) {
+  size_t n = std::strlen(word);
+  return static_cast<size_t>(end - begin) == n &&
+         std::memcmp(begin, word, n) == 0;
+}
+
+// "%H:%M:%S" style fields of a broken-down local time with milliseconds
+struct LocalTime {
+  struct tm tm;
+  uint32_t  ms;
+};
+
+LocalTime to_local_time(uint64_t ns) {
+  LocalTime lt;
+  time_t    sec = static_cast<time_t>(ns / kNsPerSec);
+  localtime_r(&sec, &lt.tm);
+  lt.ms = static_cast<uint32_t>(ns % kNsPerSec / 1000000);
+  return lt;
+}
+
+uint64_t from_local_time(struct tm tm, uint32_t ms) {
+  tm.tm_isdst = -1;
+  time_t sec  = mktime(&tm);
+  if (sec == -1)
+    return 0;
+  return static_cast<uint64_t>(sec) * kNsPerSec + ms * 1000000ull;
+}
+
+const char* const kWeekdays[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri",
+                                 "Sat"};
+const char* const kMonths[]   = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                 "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+}  // namespace
+
+// --- ChannelNames ----------------------------------------------------------
+
+void ChannelNames::set(uint32_t channel, const std::string& name) {
+  if (channel >= kMaxChannels)
+    return;
+  if (names_.size() <= channel)
+    names_.resize(channel + 1);
+  names_[channel] = name;
+}
+
+const std::string& ChannelNames::name(uint32_t channel) {
+  if (channel >= kMaxChannels)
+    channel = kMaxChannels - 1;
+  if (names_.size() <= channel)
+    names_.resize(channel + 1);
+  if (names_[channel].empty())
+    names_[channel] = "can" + std::to_string(channel);
+  return names_[channel];
+}
+
+bool ChannelNames::lookup(const char* begin,
+                          const char* end,
+                          uint32_t*   channel) {
+  size_t n = static_cast<size_t>(end - begin);
+  for (size_t i = 0; i < names_.size(); ++i) {
+    if (names_[i].size() == n && std::memcmp(names_[i].data(), begin, n) == 0) {
+      *channel = static_cast<uint32_t>(i);
+      return true;
+    }
+  }
+  for (size_t i = 0; i < kMaxChannels; ++i) {
+    if (i >= names_.size() || names_[i].empty()) {
+      set(static_cast<uint32_t>(i), std::string(begin, end));
+      *channel = static_cast<uint32_t>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// --- candump log -----------------------------------------------------------
+
+CandumpLogWriter::~CandumpLogWriter() {
+  close();
+}
+
+bool CandumpLogWriter::open(const std::string& path) {
+  return writer_.open(path);
+}
+
+bool CandumpLogWriter::write(const CaptureRecord& record) {
+  const std::string& name = channels_.name(record.channel);
+  char* out = writer_.reserve(name.size() + FrameFormatter::kMaxLineLength);
+  if (!out)
+    return false;
+  char* p =
+    FrameFormatter::format_candump(out, record, name.data(), name.size());
+  writer_.commit(static_cast<size_t>(p - out));
+  return true;
+}
+
+bool CandumpLogWriter::flush() {
+  return writer_.flush();
+}
+
+bool CandumpLogWriter::close() {
+  return writer_.close();
+}
+
+bool CandumpLogReader::open(const std::string& path) {
+  return reader_.open(path);
+}
+
+bool CandumpLogReader::next(CaptureRecord& record) {
+  const char* line;
+  const char* end;
+  while (reader_.read_line(&line, &end)) {
+    const char* p = skip_spaces(line, end);
+    if (p == end || *p != '(')
+      continue;
+    p = parse_seconds_ns(p + 1, end, &record.timestamp_ns);
+    if (!p || p == end || *p != ')')
+      continue;
+
+    const char* name_end;
+    const char* name = next_token(p + 1, end, &name_end);
+    if (name == name_end ||
+        !channels_.lookup(name, name_end, &record.channel))
+      continue;
+
+    const char* id_end;
+    const char* id_begin = next_token(name_end, end, &id_end);
+    uint32_t    id;
+    p = parse_hex(id_begin, id_end, &id);
+    if (!p || p == id_end || *p != '#' || (p + 1 < id_end && p[1] == '#'))
+      continue;  // malformed or CAN FD ("##") frame
+
+    std::memset(&record.frame, 0, sizeof(record.frame));
+    size_t id_digits = static_cast<size_t>(p - id_begin);
+    if (id_digits == 3)
+      record.frame.can_id = id & CAN_SFF_MASK;
+    else if (id & CAN_ERR_FLAG)
+      record.frame.can_id = id;
+    else
+      record.frame.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+
+    ++p;
+    if (p < id_end && (*p == 'R' || *p == 'r')) {
+      record.frame.can_id |= CAN_RTR_FLAG;
+      int dlc = p + 1 < id_end ? hex_value(p[1]) : 0;
+      record.frame.can_dlc = dlc > 0 && dlc <= CAN_MAX_DLEN ? dlc : 0;
+    } else {
+      uint8_t dlc = 0;
+      while (p + 1 < id_end && dlc < CAN_MAX_DLEN) {
+        if (*p == '.') {
+          ++p;
+          continue;
+        }
+        int hi = hex_value(p[0]);
+        int lo = hex_value(p[1]);
+        if (hi < 0 || lo < 0)
+          break;
+        record.frame.data[dlc++] = static_cast<uint8_t>(hi << 4 | lo);
+        p += 2;
+      }
+      record.frame.can_dlc = dlc;
+    }
+
+    const char* dir_end;
+    const char* dir = next_token(id_end, end, &dir_end);
+    record.flags    = token_equals(dir, dir_end, "T") ? kCaptureFlagTx : 0;
+    return true;
+  }
+  return false;
+}
+
+// --- Vector ASC ------------------------------------------------------------
+
+AscWriter::~AscWriter() {
+  close();
+}
+
+bool AscWriter::open(const std::string& path) {
+  header_written_ = false;
+  start_ns_       = 0;
+  return writer_.open(path);
+}
+
+bool AscWriter::write_header(uint64_t start_ns) {
+  start_ns_     = start_ns;
+  LocalTime lt  = to_local_time(start_ns);
+  int       h12 = lt.tm.tm_hour % 12 == 0 ? 12 : lt.tm.tm_hour % 12;
+  char      date[64];
+  std::snprintf(date,
+                sizeof(date),
+                "%s %s %d %02d:%02d:%02d.%03u %s %d",
+                kWeekdays[lt.tm.tm_wday],
+                kMonths[lt.tm.tm_mon],
+                lt.tm.tm_mday,
+                h12,
+                lt.tm.tm_min,
+                lt.tm.tm_sec,
+                lt.ms,
+                lt.tm.tm_hour < 12 ? "am" : "pm",
+                lt.tm.tm_year + 1900);
+
+  char header[512];
+  int  n = std::snprintf(header,
+                        sizeof(header),
+                        "date %s\n"
+                        "base hex  timestamps absolute\n"
+                        "internal events logged\n"
+                        "// version 9.0.0\n"
+                        "Begin Triggerblock %s\n"
+                        "   0.000000 Start of measurement\n",
+                        date,
+                        date);
+  header_written_ = true;
+  return writer_.append(header, static_cast<size_t>(n));
+}
+
+bool AscWriter::write(const CaptureRecord& record) {
+  if (!header_written_ && !write_header(record.timestamp_ns / 1000000 * 1000000))
+    return false;
+
+  char* out = writer_.reserve(128);
+  if (!out)
+    return false;
+  char*            p     = out;
+  const can_frame& frame = record.frame;
+
+  uint64_t rel = record.timestamp_ns >= start_ns_
+                   ? record.timestamp_ns - start_ns_
+                   : 0;
+  char     sec[20];
+  char*    sec_end = put_uint(sec, rel / kNsPerSec);
+  for (long pad = 4 - (sec_end - sec); pad > 0; --pad)
+    *p++ = ' ';
+  p    = put_str(p, sec, static_cast<size_t>(sec_end - sec));
+  *p++ = '.';
+  p    = put_uint_padded(p, rel % kNsPerSec / 1000, 6);
+  *p++ = ' ';
+  p    = put_uint(p, record.channel + 1);
+  *p++ = ' ';
+  *p++ = ' ';
+
+  if (frame.can_id & CAN_ERR_FLAG) {
+    p = put_str(p, "ErrorFrame\n", 11);
+    writer_.commit(static_cast<size_t>(p - out));
+    return true;
+  }
+
+  char* id = p;
+  if (frame.can_id & CAN_EFF_FLAG) {
+    char  digits[8];
+    char* d = put_hex(digits, frame.can_id & CAN_EFF_MASK, 8);
+    char* s = digits;
+    while (s < d - 1 && *s == '0')
+      ++s;
+    p    = put_str(p, s, static_cast<size_t>(d - s));
+    *p++ = 'x';
+  } else {
+    char  digits[3];
+    char* d = put_hex(digits, frame.can_id & CAN_SFF_MASK, 3);
+    char* s = digits;
+    while (s < d - 1 && *s == '0')
+      ++s;
+    p = put_str(p, s, static_cast<size_t>(d - s));
+  }
+  while (p - id < 16)
+    *p++ = ' ';
+
+  p           = put_str(p, record.flags & kCaptureFlagTx ? "Tx" : "Rx", 2);
+  p           = put_str(p, "   ", 3);
+  uint8_t dlc = frame.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame.can_dlc;
+  if (frame.can_id & CAN_RTR_FLAG) {
+    *p++ = 'r';
+    *p++ = ' ';
+    p    = put_hex(p, dlc, 1);
+  } else {
+    *p++ = 'd';
+    *p++ = ' ';
+    p    = put_hex(p, dlc, 1);
+    for (uint8_t i = 0; i < dlc; ++i) {
+      *p++ = ' ';
+      p    = put_hex_byte(p, frame.data[i]);
+    }
+  }
+  *p++ = '\n';
+  writer_.commit(static_cast<size_t>(p - out));
+  return true;
+}
+
+bool AscWriter::flush() {
+  return writer_.flush();
+}
+
+bool AscWriter::close() {
+  if (!writer_.is_open())
+    return true;
+  if (!header_written_)
+    write_header(capture_now_ns() / 1000000 * 1000000);
+  writer_.append("End TriggerBlock\n", 17);
+  return writer_.close();
+}
+
+bool AscReader::open(const std::string& path) {
+  start_ns_ = 0;
+  hex_base_ = true;
+  return reader_.open(path);
+}
+
+// Handles "date ...", "Begin Triggerblock ..." and "base ..." lines
+bool AscReader::parse_header_line(const char* p, const char* end) {
+  const char* tok_end;
+  const char* tok = next_token(p, end, &tok_end);
+  if (token_equals(tok, tok_end, "base")) {
+    tok       = next_token(tok_end, end, &tok_end);
+    hex_base_ = !token_equals(tok, tok_end, "dec");
+    return true;
+  }
+  if (token_equals(tok, tok_end, "Begin")) {
+    tok = next_token(tok_end, end, &tok_end);  // "Triggerblock"
+  } else if (!token_equals(tok, tok_end, "date")) {
+    return false;
+  }
+
+  // "Sat Oct 18 10:00:00.000 am 2026"; the am/pm marker is optional
+  struct tm tm = {};
+  uint32_t  ms = 0;
+  tok          = next_token(tok_end, end, &tok_end);  // weekday
+  tok          = next_token(tok_end, end, &tok_end);
+  tm.tm_mon    = -1;
+  for (int i = 0; i < 12; ++i) {
+    if (tok_end - tok == 3 && std::memcmp(tok, kMonths[i], 3) == 0)
+      tm.tm_mon = i;
+  }
+  uint64_t v;
+  tok = next_token(tok_end, end, &tok_end);
+  if (tm.tm_mon < 0 || !parse_uint(tok, tok_end, &v))
+    return true;
+  tm.tm_mday = static_cast<int>(v);
+
+  tok                = next_token(tok_end, end, &tok_end);
+  uint64_t    hms[3] = {0, 0, 0};
+  const char* q      = tok;
+  for (int i = 0; i < 3 && q; ++i) {
+    q = parse_uint(q, tok_end, &hms[i]);
+    if (q && q < tok_end && (*q == ':' || *q == '.'))
+      ++q;
+  }
+  if (!q)
+    return true;
+  uint64_t frac;
+  if (parse_uint(q, tok_end, &frac))
+    ms = static_cast<uint32_t>(frac % 1000);
+  tm.tm_hour = static_cast<int>(hms[0]);
+  tm.tm_min  = static_cast<int>(hms[1]);
+  tm.tm_sec  = static_cast<int>(hms[2]);
+
+  tok = next_token(tok_end, end, &tok_end);
+  if (token_equals(tok, tok_end, "am") || token_equals(tok, tok_end, "pm")) {
+    bool pm    = *tok == 'p';
+    tm.tm_hour = tm.tm_hour % 12 + (pm ? 12 : 0);
+    tok        = next_token(tok_end, end, &tok_end);
+  }
+  if (!parse_uint(tok, tok_end, &v))
+    return true;
+  tm.tm_year = static_cast<int>(v) - 1900;
+  start_ns_  = from_local_time(tm, ms);
+  return true;
+}
+
+bool AscReader::next(CaptureRecord& record) {
+  const char* line;
+  const char* end;
+  while (reader_.read_line(&line, &end)) {
+    const char* p = skip_spaces(line, end);
+    if (p == end)
+      continue;
+    if (*p < '0' || *p > '9') {
+      parse_header_line(p, end);
+      continue;
+    }
+
+    uint64_t rel;
+    p = parse_seconds_ns(p, end, &rel);
+    if (!p)
+      continue;
+
+    const char* tok_end;
+    const char* tok = next_token(p, end, &tok_end);
+    uint64_t    channel;
+    if (parse_uint(tok, tok_end, &channel) != tok_end || channel == 0)
+      continue;  // "Start of measurement", CANFD lines, other events
+
+    std::memset(&record, 0, sizeof(record));
+    record.timestamp_ns = start_ns_ + rel;
+    record.channel      = static_cast<uint32_t>(channel - 1);
+
+    tok = next_token(tok_end, end, &tok_end);
+    if (token_equals(tok, tok_end, "ErrorFrame")) {
+      record.frame.can_id = CAN_ERR_FLAG;
+      return true;
+    }
+
+    bool        extended = tok_end > tok && (tok_end[-1] == 'x');
+    const char* id_end   = extended ? tok_end - 1 : tok_end;
+    uint32_t    id;
+    if (hex_base_) {
+      if (parse_hex(tok, id_end, &id) != id_end)
+        continue;
+    } else {
+      uint64_t dec;
+      if (parse_uint(tok, id_end, &dec) != id_end)
+        continue;
+      id = static_cast<uint32_t>(dec);
+    }
+    record.frame.can_id = extended ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG
+                                   : id & CAN_SFF_MASK;
+
+    tok = next_token(tok_end, end, &tok_end);
+    if (token_equals(tok, tok_end, "Tx"))
+      record.flags = kCaptureFlagTx;
+    else if (!token_equals(tok, tok_end, "Rx"))
+      continue;
+
+    tok         = next_token(tok_end, end, &tok_end);
+    bool remote = token_equals(tok, tok_end, "r");
+    if (!remote && !token_equals(tok, tok_end, "d"))
+      continue;
+    if (remote)
+      record.frame.can_id |= CAN_RTR_FLAG;
+
+    tok     = next_token(tok_end, end, &tok_end);
+    int dlc = tok_end - tok == 1 ? hex_value(*tok) : -1;
+    if (dlc < 0) {
+      if (remote)
+        return true;  // "r" without a DLC
+      continue;
+    }
+    record.frame.can_dlc = dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : dlc;
+    if (remote)
+      return true;
+
+    for (uint8_t i = 0; i < record.frame.can_dlc; ++i) {
+      tok = next_token(tok_end, end, &tok_end);
+      uint32_t byte;
+      if (parse_hex(tok, tok_end, &byte) != tok_end)
+        break;
+      record.frame.data[i] = static_cast<uint8_t>(byte);
+    }
+    return true;
+  }
+  return false;
+}
+
+// --- Vector BLF ------------------------------------------------------------
+
+namespace {
+
+constexpr uint32_t kBlfFileHeaderSize     = 144;
+constexpr uint32_t kBlfObjHeaderBaseSize  = 16;
+constexpr uint32_t kBlfContainerHeaderLen = 16;
+constexpr uint32_t kBlfObjHeaderV1Size    = 16;
+constexpr uint32_t kBlfCanMessageSize     = 16;
+constexpr uint32_t kBlfCanErrorSize       = 4;
+
+constexpr uint32_t kBlfCanMessage   = 1;
+constexpr uint32_t kBlfCanError     = 2;
+constexpr uint32_t kBlfLogContainer = 10;
+constexpr uint32_t kBlfCanMessage2  = 86;
+
+constexpr uint32_t kBlfTimeOneNs   = 2;
+constexpr uint32_t kBlfTimeTenUs   = 1;
+constexpr uint32_t kBlfCanExtId    = 0x80000000u;
+constexpr uint8_t  kBlfCanDirTx    = 0x01;
+constexpr uint8_t  kBlfCanRemote   = 0x80;
+constexpr uint16_t kBlfNoCompress  = 0;
+constexpr uint16_t kBlfZlibDeflate = 2;
+
+// BLF is little-endian, as are all Linux CAN targets we build for
+template <typename T>
+void put_le(uint8_t* out, T value) {
+  std::memcpy(out, &value, sizeof(T));
+}
+
+template <typename T>
+T get_le(const uint8_t* in) {
+  T value;
+  std::memcpy(&value, in, sizeof(T));
+  return value;
+}
+
+void put_systemtime(uint8_t* out, uint64_t ns) {
+  if (ns == 0)
+    return;
+  LocalTime lt        = to_local_time(ns);
+  uint16_t  fields[8] = {static_cast<uint16_t>(lt.tm.tm_year + 1900),
+                         static_cast<uint16_t>(lt.tm.tm_mon + 1),
+                         static_cast<uint16_t>(lt.tm.tm_wday),
+                         static_cast<uint16_t>(lt.tm.tm_mday),
+                         static_cast<uint16_t>(lt.tm.tm_hour),
+                         static_cast<uint16_t>(lt.tm.tm_min),
+                         static_cast<uint16_t>(lt.tm.tm_sec),
+                         static_cast<uint16_t>(lt.ms)};
+  std::memcpy(out, fields, sizeof(fields));
+}
+
+uint64_t get_systemtime(const uint8_t* in) {
+  uint16_t fields[8];
+  std::memcpy(fields, in, sizeof(fields));
+  if (fields[0] == 0)
+    return 0;
+  struct tm tm = {};
+  tm.tm_year   = fields[0] - 1900;
+  tm.tm_mon    = fields[1] - 1;
+  tm.tm_mday   = fields[3];
+  tm.tm_hour   = fields[4];
+  tm.tm_min    = fields[5];
+  tm.tm_sec    = fields[6];
+  return from_local_time(tm, fields[7]);
+}
+
+void put_object_base(uint8_t* out,
+                     uint16_t header_size,
+                     uint16_t header_version,
+                     uint32_t object_size,
+                     uint32_t object_type) {
+  std::memcpy(out, "LOBJ", 4);
+  put_le<uint16_t>(out + 4, header_size);
+  put_le<uint16_t>(out + 6, header_version);
+  put_le<uint32_t>(out + 8, object_size);
+  put_le<uint32_t>(out + 12, object_type);
+}
+
+}  // namespace
+
+BlfWriter::BlfWriter(int compression_level)
+  : compression_level_(compression_level), container_(kContainerSize) {
+}
+
+BlfWriter::~BlfWriter() {
+  close();
+}
+
+bool BlfWriter::open(const std::string& path) {
+  if (!writer_.open(path))
+    return false;
+  container_size_    = 0;
+  start_ns_          = 0;
+  last_ns_           = 0;
+  uncompressed_size_ = kBlfFileHeaderSize;
+  object_count_      = 0;
+  return write_file_header();
+}
+
+bool BlfWriter::write_file_header() {
+  uint8_t header[kBlfFileHeaderSize] = {};
+  std::memcpy(header, "LOGG", 4);
+  put_le<uint32_t>(header + 4, kBlfFileHeaderSize);
+  header[8]  = 5;  // application id
+  header[12] = 2;  // binlog major/minor/build/patch
+  header[13] = 6;
+  header[14] = 8;
+  header[15] = 1;
+  put_le<uint64_t>(header + 16, writer_.position() > kBlfFileHeaderSize
+                                  ? writer_.position()
+                                  : kBlfFileHeaderSize);
+  put_le<uint64_t>(header + 24, uncompressed_size_);
+  put_le<uint32_t>(header + 32, object_count_);
+  put_systemtime(header + 40, start_ns_);
+  put_systemtime(header + 56, last_ns_);
+  if (writer_.position() == 0)
+    return writer_.append(header, sizeof(header));
+  return writer_.write_at(0, header, sizeof(header));
+}
+
+bool BlfWriter::write(const CaptureRecord& record) {
+  constexpr uint32_t kObjectSize =
+    kBlfObjHeaderBaseSize + kBlfObjHeaderV1Size + kBlfCanMessageSize;
+  if (container_size_ + kObjectSize > kContainerSize && !write_container())
+    return false;
+  if (start_ns_ == 0) {
+    // SYSTEMTIME has millisecond resolution; object times carry the rest
+    start_ns_ = record.timestamp_ns / 1000000 * 1000000;
+  }
+  last_ns_ = record.timestamp_ns;
+
+  uint8_t*         out   = container_.data() + container_size_;
+  const can_frame& frame = record.frame;
+  bool             error = frame.can_id & CAN_ERR_FLAG;
+  uint32_t         size  = error ? kBlfObjHeaderBaseSize + kBlfObjHeaderV1Size +
+                                  kBlfCanErrorSize
+                                : kObjectSize;
+  put_object_base(out,
+                  kBlfObjHeaderBaseSize + kBlfObjHeaderV1Size,
+                  1,
+                  size,
+                  error ? kBlfCanError : kBlfCanMessage);
+  uint64_t rel = record.timestamp_ns >= start_ns_
+                   ? record.timestamp_ns - start_ns_
+                   : 0;
+  put_le<uint32_t>(out + 16, kBlfTimeOneNs);
+  put_le<uint16_t>(out + 20, 0);  // client index
+  put_le<uint16_t>(out + 22, 0);  // object version
+  put_le<uint64_t>(out + 24, rel);
+
+  uint8_t* body = out + 32;
+  put_le<uint16_t>(body, static_cast<uint16_t>(record.channel + 1));
+  if (error) {
+    put_le<uint16_t>(body + 2, 0);
+  } else {
+    uint8_t flags = 0;
+    if (record.flags & kCaptureFlagTx)
+      flags |= kBlfCanDirTx;
+    if (frame.can_id & CAN_RTR_FLAG)
+      flags |= kBlfCanRemote;
+    body[2]     = flags;
+    body[3]     = frame.can_dlc;
+    uint32_t id = frame.can_id & CAN_EFF_FLAG
+                    ? (frame.can_id & CAN_EFF_MASK) | kBlfCanExtId
+                    : frame.can_id & CAN_SFF_MASK;
+    put_le<uint32_t>(body + 4, id);
+    std::memcpy(body + 8, frame.data, 8);
+  }
+  // Object sizes here are multiples of 4, so no padding is required
+  container_size_ += size;
+  ++object_count_;
+  return true;
+}
+
+bool BlfWriter::write_container() {
+  if (container_size_ == 0)
+    return true;
+
+  const uint8_t* data   = container_.data();
+  size_t         length = container_size_;
+  uint16_t       method = kBlfNoCompress;
+#ifdef SOCKET_CAN_HAVE_ZLIB
+  if (compression_level_ > 0) {
+    uLongf bound = compressBound(container_size_);
+    if (compressed_.size() < bound)
+      compressed_.resize(bound);
+    if (compress2(compressed_.data(),
+                  &bound,
+                  container_.data(),
+                  container_size_,
+                  compression_level_) == Z_OK) {
+      data   = compressed_.data();
+      length = bound;
+      method = kBlfZlibDeflate;
+    }
+  }
+#endif
+
+  uint32_t object_size = static_cast<uint32_t>(
+    kBlfObjHeaderBaseSize + kBlfContainerHeaderLen + length);
+  uint8_t header[kBlfObjHeaderBaseSize + kBlfContainerHeaderLen] = {};
+  put_object_base(
+    header, kBlfObjHeaderBaseSize, 1, object_size, kBlfLogContainer);
+  put_le<uint16_t>(header + 16, method);
+  put_le<uint32_t>(header + 24, static_cast<uint32_t>(container_size_));
+
+  static const uint8_t kPadding[4] = {};
+  if (!writer_.append(header, sizeof(header)) ||
+      !writer_.append(data, length) ||
+      !writer_.append(kPadding, object_size % 4))
+    return false;
+
+  uncompressed_size_ += sizeof(header) + container_size_;
+  container_size_ = 0;
+  return true;
+}
+
+bool BlfWriter::flush() {
+  return write_container() && writer_.flush();
+}
+
+bool BlfWriter::close() {
+  if (!writer_.is_open())
+    return true;
+  bool ok = write_container() && write_file_header();
+  return writer_.close() && ok;
+}
+
+bool BlfReader::open(const std::string& path) {
+  data_pos_ = data_end_ = 0;
+  if (!reader_.open(path))
+    return false;
+
+  uint8_t header[72];
+  if (!reader_.read_exact(header, sizeof(header)) ||
+      std::memcmp(header, "LOGG", 4) != 0) {
+    std::cerr << "Not a BLF file: " << path << std::endl;
+    reader_.close();
+    return false;
+  }
+  uint32_t header_size = get_le<uint32_t>(header + 4);
+  start_ns_            = get_systemtime(header + 40);
+  if (header_size < sizeof(header) ||
+      !reader_.skip(header_size - sizeof(header))) {
+    reader_.close();
+    return false;
+  }
+  return true;
+}
+
+bool BlfReader::read_container() {
+  for (;;) {
+    uint8_t base[kBlfObjHeaderBaseSize];
+    if (!reader_.read_exact(base, sizeof(base)) ||
+        std::memcmp(base, "LOBJ", 4) != 0)
+      return false;
+    uint32_t object_size = get_le<uint32_t>(base + 8);
+    uint32_t object_type = get_le<uint32_t>(base + 12);
+    if (object_size < sizeof(base))
+      return false;
+
+    if (object_type != kBlfLogContainer) {
+      if (!reader_.skip(object_size - sizeof(base) + object_size % 4))
+        return false;
+      continue;
+    }
+
+    uint8_t info[kBlfContainerHeaderLen];
+    if (object_size < sizeof(base) + sizeof(info) ||
+        !reader_.read_exact(info, sizeof(info)))
+      return false;
+    uint16_t method       = get_le<uint16_t>(info);
+    uint32_t uncompressed = get_le<uint32_t>(info + 8);
+    size_t   length       = object_size - sizeof(base) - sizeof(info);
+
+    // Objects may straddle containers: keep the unconsumed tail in front
+    size_t tail = data_end_ - data_pos_;
+    if (data_pos_ > 0 && tail > 0)
+      std::memmove(data_.data(), data_.data() + data_pos_, tail);
+    data_pos_ = 0;
+    data_end_ = tail;
+    if (data_.size() < tail + uncompressed)
+      data_.resize(tail + uncompressed);
+
+    if (method == kBlfNoCompress) {
+      if (length < uncompressed ||
+          !reader_.read_exact(data_.data() + tail, uncompressed) ||
+          !reader_.skip(length - uncompressed))
+        return false;
+    } else if (method == kBlfZlibDeflate) {
+#ifdef SOCKET_CAN_HAVE_ZLIB
+      if (compressed_.size() < length)
+        compressed_.resize(length);
+      uLongf out_len = uncompressed;
+      if (!reader_.read_exact(compressed_.data(), length) ||
+          uncompress(data_.data() + tail, &out_len, compressed_.data(), length) !=
+            Z_OK)
+        return false;
+      uncompressed = static_cast<uint32_t>(out_len);
+#else
+      std::cerr << "BLF container is compressed but zlib is unavailable"
+                << std::endl;
+      return false;
+#endif
+    } else {
+      std::cerr << "Unsupported BLF compression method " << method << std::endl;
+      return false;
+    }
+    data_end_ += uncompressed;
+    return reader_.skip(object_size % 4);
+  }
+}
+
+bool BlfReader::next(CaptureRecord& record) {
+  for (;;) {
+    size_t available = data_end_ - data_pos_;
+    const uint8_t* obj = data_.data() + data_pos_;
+    uint32_t object_size =
+      available >= kBlfObjHeaderBaseSize ? get_le<uint32_t>(obj + 8) : 0;
+    if (available < kBlfObjHeaderBaseSize || available < object_size) {
+      if (!read_container())
+        return false;
+      continue;
+    }
+    if (std::memcmp(obj, "LOBJ", 4) != 0 ||
+        object_size < kBlfObjHeaderBaseSize)
+      return false;
+
+    uint16_t header_size = get_le<uint16_t>(obj + 4);
+    uint32_t object_type = get_le<uint32_t>(obj + 12);
+    data_pos_ += object_size;
+    data_pos_ += std::min<size_t>(object_size % 4, data_end_ - data_pos_);
+
+    bool is_message =
+      object_type == kBlfCanMessage || object_type == kBlfCanMessage2;
+    if (!is_message && object_type != kBlfCanError)
+      continue;
+    uint32_t body_size = is_message ? kBlfCanMessageSize : kBlfCanErrorSize;
+    if (header_size < kBlfObjHeaderBaseSize + kBlfObjHeaderV1Size ||
+        object_size < header_size + body_size)
+      continue;
+
+    uint32_t ts_flags = get_le<uint32_t>(obj + 16);
+    uint64_t ts       = get_le<uint64_t>(obj + 24);
+    if (ts_flags == kBlfTimeTenUs)
+      ts *= 10000;
+
+    const uint8_t* body = obj + header_size;
+    uint16_t       channel = get_le<uint16_t>(body);
+    std::memset(&record, 0, sizeof(record));
+    record.timestamp_ns = start_ns_ + ts;
+    record.channel      = channel > 0 ? channel - 1u : 0;
+    if (!is_message) {
+      record.frame.can_id = CAN_ERR_FLAG;
+      return true;
+    }
+
+    uint8_t  flags = body[2];
+    uint32_t id    = get_le<uint32_t>(body + 4);
+    record.frame.can_id  = id & kBlfCanExtId ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG
+                                             : id & CAN_SFF_MASK;
+    record.frame.can_dlc = body[3] > CAN_MAX_DLEN ? CAN_MAX_DLEN : body[3];
+    if (flags & kBlfCanRemote)
+      record.frame.can_id |= CAN_RTR_FLAG;
+    else
+      std::memcpy(record.frame.data, body + 8, 8);
+    if (flags & kBlfCanDirTx)
+      record.flags = kCaptureFlagTx;
+    return true;
+  }
+}
+
+// --- Factories -------------------------------------------------------------
+
+std::unique_ptr<FrameSource> open_capture_source(const std::string& path) {
+  if (has_suffix(path, ".scap")) {
+    auto reader = std::make_unique<CaptureFileReader>();
+    return reader->open(path) ? std::move(reader) : nullptr;
+  }
+  if (has_suffix(path, ".zcap")) {
+    auto reader = std::make_unique<CompressedCaptureReader>();
+    return reader->open(path) ? std::move(reader) : nullptr;
+  }
+  if (has_suffix(path, ".log")) {
+    auto reader = std::make_unique<CandumpLogReader>();
+    return reader->open(path) ? std::move(reader) : nullptr;
+  }
+  if (has_suffix(path, ".asc")) {
+    auto reader = std::make_unique<AscReader>();
+    return reader->open(path) ? std::move(reader) : nullptr;
+  }
+  if (has_suffix(path, ".blf")) {
+    auto reader = std::make_unique<BlfReader>();
+    return reader->open(path) ? std::move(reader) : nullptr;
+  }
+  return nullptr;
+}
+
+std::unique_ptr<FrameSink> open_capture_sink(const std::string& path) {
+  if (has_suffix(path, ".scap")) {
+    auto writer = std::make_unique<CaptureLogger>();
+    return writer->open(path) ? std::move(writer) : nullptr;
+  }
+  if (has_suffix(path, ".zcap")) {
+    auto writer = std::make_unique<CompressedCaptureLogger>();
+    return writer->open(path) ? std::move(writer) : nullptr;
+  }
+  if (has_suffix(path, ".log")) {
+    auto writer = std::make_unique<CandumpLogWriter>();
+    return writer->open(path) ? std::move(writer) : nullptr;
+  }
+  if (has_suffix(path, ".asc")) {
+    auto writer = std::make_unique<AscWriter>();
+    return writer->open(path) ? std::move(writer) : nullptr;
+  }
+  if (has_suffix(path, ".blf")) {
+    auto writer = std::make_unique<BlfWriter>();
+    return writer->open(path) ? std::move(writer) : nullptr;
+  }
+  return nullptr;
+}
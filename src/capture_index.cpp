@@ -0,0 +1,250 @@
+#include "socket_can/capture_index.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// Index key of a frame: the ID plus the EFF flag, without RTR/ERR flags
+inline canid_t index_key(canid_t can_id) {
+  return can_id & CAN_EFF_FLAG ? can_id & (CAN_EFF_FLAG | CAN_EFF_MASK)
+                               : can_id & CAN_SFF_MASK;
+}
+
+inline uint32_t bloom_bit_a(canid_t key) {
+  return (key * 0x9E3779B1u) >> 23;  // 9 bits -> 512-bit filter
+}
+
+inline uint32_t bloom_bit_b(canid_t key) {
+  return ((key ^ (key >> 15)) * 0x85EBCA77u) >> 23;
+}
+
+}  // namespace
+
+void CaptureIndexEntry::add(const CaptureRecord& record) {
+  if (record_count++ == 0) {
+    min_timestamp_ns = max_timestamp_ns = record.timestamp_ns;
+  } else {
+    min_timestamp_ns = std::min(min_timestamp_ns, record.timestamp_ns);
+    max_timestamp_ns = std::max(max_timestamp_ns, record.timestamp_ns);
+  }
+  channel_mask |= 1u << std::min<uint32_t>(record.channel, 31);
+
+  canid_t key = index_key(record.frame.can_id);
+  if (key & CAN_EFF_FLAG) {
+    uint32_t a = bloom_bit_a(key);
+    uint32_t b = bloom_bit_b(key);
+    eff_bloom[a >> 6] |= 1ull << (a & 63);
+    eff_bloom[b >> 6] |= 1ull << (b & 63);
+  } else {
+    sff_bitmap[key >> 6] |= 1ull << (key & 63);
+  }
+}
+
+bool CaptureIndexEntry::may_contain(canid_t id) const {
+  canid_t key = index_key(id);
+  if (!(key & CAN_EFF_FLAG))
+    return sff_bitmap[key >> 6] & (1ull << (key & 63));
+  uint32_t a = bloom_bit_a(key);
+  uint32_t b = bloom_bit_b(key);
+  return (eff_bloom[a >> 6] & (1ull << (a & 63))) &&
+         (eff_bloom[b >> 6] & (1ull << (b & 63)));
+}
+
+CaptureIndexWriter::~CaptureIndexWriter() {
+  close();
+}
+
+bool CaptureIndexWriter::open(const std::string& capture_path,
+                              uint32_t           block_records) {
+  if (block_records == 0 || !writer_.open(capture_index_path(capture_path)))
+    return false;
+  block_records_  = block_records;
+  next_record_    = 0;
+  running_max_ns_ = 0;
+  start_block();
+
+  CaptureIndexHeader header = {};
+  std::memcpy(header.magic, kCaptureIndexMagic, sizeof(header.magic));
+  header.version       = kCaptureIndexVersion;
+  header.entry_size    = sizeof(CaptureIndexEntry);
+  header.block_records = block_records;
+  return writer_.append(&header, sizeof(header));
+}
+
+void CaptureIndexWriter::start_block() {
+  current_              = {};
+  current_.first_record = next_record_;
+}
+
+bool CaptureIndexWriter::finish_block() {
+  running_max_ns_         = std::max(running_max_ns_, current_.max_timestamp_ns);
+  current_.running_max_ns = running_max_ns_;
+  next_record_ += current_.record_count;
+  bool ok = writer_.append(&current_, sizeof(current_));
+  start_block();
+  return ok;
+}
+
+bool CaptureIndexWriter::close() {
+  if (!writer_.is_open())
+    return true;
+  bool ok = current_.record_count == 0 || finish_block();
+  return writer_.close() && ok;
+}
+
+bool write_capture_index(const std::string& capture_path,
+                         uint32_t           block_records) {
+  CaptureFileReader  capture;
+  CaptureIndexWriter index;
+  if (!capture.open(capture_path) || !index.open(capture_path, block_records))
+    return false;
+  const CaptureRecord* records = capture.records();
+  for (size_t i = 0; i < capture.size(); ++i) {
+    if (!index.add(records[i]))
+      return false;
+  }
+  return index.close();
+}
+
+CaptureIndex::~CaptureIndex() {
+  close();
+}
+
+bool CaptureIndex::open(const std::string& capture_path) {
+  close();
+  if (!capture_.open(capture_path))
+    return false;
+
+  std::string path = capture_index_path(capture_path);
+  int         fd   = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    std::cerr << "Missing capture index " << path << std::endl;
+    close();
+    return false;
+  }
+  bool mapped = map_index(fd, path);
+  ::close(fd);
+  if (!mapped) {
+    // Another format version or a damaged sidecar: rebuild it from the capture
+    std::cerr << "Rebuilding capture index " << path << std::endl;
+    fd = -1;
+    if (write_capture_index(capture_path))
+      fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    mapped = fd >= 0 && map_index(fd, path);
+    if (fd >= 0)
+      ::close(fd);
+    if (!mapped) {
+      close();
+      return false;
+    }
+  }
+
+  // After a crash the index may describe records that never reached the disk
+  while (entry_count_ > 0 &&
+         entries_[entry_count_ - 1].first_record +
+             entries_[entry_count_ - 1].record_count >
+           capture_.size())
+    --entry_count_;
+  return true;
+}
+
+bool CaptureIndex::map_index(int fd, const std::string& path) {
+  struct stat st;
+  if (fstat(fd, &st) == -1 ||
+      static_cast<size_t>(st.st_size) < sizeof(CaptureIndexHeader)) {
+    std::cerr << "Truncated capture index " << path << std::endl;
+    return false;
+  }
+  void* map = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED)
+    return false;
+
+  const CaptureIndexHeader* header =
+    static_cast<const CaptureIndexHeader*>(map);
+  if (std::memcmp(header->magic, kCaptureIndexMagic, sizeof(header->magic)) !=
+        0 ||
+      header->version != kCaptureIndexVersion ||
+      header->entry_size != sizeof(CaptureIndexEntry)) {
+    std::cerr << "Invalid capture index " << path << " (version "
+              << header->version << ")" << std::endl;
+    munmap(map, st.st_size);
+    return false;
+  }
+  map_      = map;
+  map_size_ = static_cast<size_t>(st.st_size);
+  entries_  = reinterpret_cast<const CaptureIndexEntry*>(
+    static_cast<const char*>(map_) + sizeof(CaptureIndexHeader));
+  entry_count_ =
+    (map_size_ - sizeof(CaptureIndexHeader)) / sizeof(CaptureIndexEntry);
+  return true;
+}
+
+void CaptureIndex::close() {
+  if (map_)
+    munmap(map_, map_size_);
+  map_         = nullptr;
+  map_size_    = 0;
+  entries_     = nullptr;
+  entry_count_ = 0;
+  capture_.close();
+}
+
+std::vector<size_t> CaptureIndex::candidate_blocks(
+  const CaptureQuery& query) const {
+  std::vector<size_t> blocks;
+
+  // running_max_ns is monotonic: binary search the first block that can hold
+  // timestamps >= begin_ns
+  const CaptureIndexEntry* first = std::lower_bound(
+    entries_,
+    entries_ + entry_count_,
+    query.begin_ns,
+    [](const CaptureIndexEntry& e, uint64_t t) { return e.running_max_ns < t; });
+
+  for (const CaptureIndexEntry* e = first; e < entries_ + entry_count_; ++e) {
+    if (e->min_timestamp_ns >= query.end_ns)
+      break;
+    if (e->max_timestamp_ns < query.begin_ns)
+      continue;
+    bool match = query.ids.empty();
+    for (size_t i = 0; !match && i < query.ids.size(); ++i)
+      match = e->may_contain(query.ids[i]);
+    if (match)
+      blocks.push_back(static_cast<size_t>(e - entries_));
+  }
+  return blocks;
+}
+
+size_t CaptureIndex::query(
+  const CaptureQuery&                               query,
+  const std::function<void(const CaptureRecord&)>& fn) const {
+  std::vector<canid_t> keys;
+  keys.reserve(query.ids.size());
+  for (canid_t id : query.ids)
+    keys.push_back(index_key(id));
+  std::sort(keys.begin(), keys.end());
+
+  const CaptureRecord* records = capture_.records();
+  size_t               matches = 0;
+  for (size_t block : candidate_blocks(query)) {
+    const CaptureIndexEntry& e = entries_[block];
+    for (uint64_t i = e.first_record; i < e.first_record + e.record_count;
+         ++i) {
+      const CaptureRecord& r = records[i];
+      if (r.timestamp_ns < query.begin_ns || r.timestamp_ns >= query.end_ns)
+        continue;
+      if (!keys.empty() &&
+          !std::binary_search(
+            keys.begin(), keys.end(), index_key(r.frame.can_id)))
+        continue;
+      fn(r);
+      ++matches;
+    }
+  }
+  return matches;
+}
@@ -0,0 +1,405 @@
+#include "socket_can/compressed_capture.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#ifdef SOCKET_CAN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+constexpr uint32_t kMethodStored  = 0;
+constexpr uint32_t kMethodDeflate = 1;
+constexpr size_t   kColumnCount   = 6;
+
+enum Column {
+  kDictionary = 0,
+  kIdIndex,
+  kTimestamp,
+  kChannel,
+  kDlc,
+  kPayload,
+};
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<uint8_t>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(v));
+}
+
+inline bool get_varint(const uint8_t** p, const uint8_t* end, uint64_t* v) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+    uint8_t byte = *(*p)++;
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (!(byte & 0x80)) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint64_t zigzag(int64_t v) {
+  return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v) {
+  return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+}
+
+}  // namespace
+
+bool CompressedBlockCodec::encode(const CaptureRecord*   records,
+                                  uint32_t               count,
+                                  int                    compression_level,
+                                  CompressedBlockHeader* header,
+                                  std::vector<uint8_t>*  out) {
+  for (auto& column : columns_)
+    column.clear();
+  dictionary_.clear();
+  state_.clear();
+
+  size_t table_size = 64;
+  while (table_size < count * 2u)
+    table_size <<= 1;
+  slots_.assign(table_size, 0);
+  const size_t mask = table_size - 1;
+
+  uint64_t first_ts = count ? records[0].timestamp_ns : 0;
+  uint64_t last_ts  = first_ts;
+  for (uint32_t i = 0; i < count; ++i) {
+    const CaptureRecord& r  = records[i];
+    canid_t              id = r.frame.can_id;
+
+    size_t h = (id * 0x9E3779B1u) & mask;
+    while (slots_[h] && dictionary_[slots_[h] - 1] != id)
+      h = (h + 1) & mask;
+    if (!slots_[h]) {
+      dictionary_.push_back(id);
+      state_.push_back(IdState{first_ts, 0, {}});
+      slots_[h] = static_cast<uint32_t>(dictionary_.size());
+    }
+    uint32_t index = slots_[h] - 1;
+    IdState& st    = state_[index];
+    put_varint(columns_[kIdIndex], index);
+
+    int64_t delta = static_cast<int64_t>(r.timestamp_ns - st.last_ts);
+    put_varint(columns_[kTimestamp], zigzag(delta - st.last_delta));
+    st.last_ts    = r.timestamp_ns;
+    st.last_delta = delta;
+    last_ts       = std::max(last_ts, r.timestamp_ns);
+
+    put_varint(columns_[kChannel],
+               static_cast<uint64_t>(r.channel) << 1 |
+                 (r.flags & kCaptureFlagTx ? 1 : 0));
+    columns_[kDlc].push_back(r.frame.can_dlc);
+
+    uint8_t len = std::min<uint8_t>(r.frame.can_dlc, CAN_MAX_DLEN);
+    for (uint8_t b = 0; b < len; ++b) {
+      columns_[kPayload].push_back(r.frame.data[b] ^ st.last_payload[b]);
+      st.last_payload[b] = r.frame.data[b];
+    }
+  }
+
+  columns_[kDictionary].resize(dictionary_.size() * sizeof(canid_t));
+  std::memcpy(columns_[kDictionary].data(),
+              dictionary_.data(),
+              columns_[kDictionary].size());
+
+  uint32_t sizes[kColumnCount];
+  raw_.clear();
+  raw_.resize(sizeof(sizes));
+  for (size_t c = 0; c < kColumnCount; ++c) {
+    sizes[c] = static_cast<uint32_t>(columns_[c].size());
+    raw_.insert(raw_.end(), columns_[c].begin(), columns_[c].end());
+  }
+  std::memcpy(raw_.data(), sizes, sizeof(sizes));
+
+  std::memcpy(header->magic, "ZBLK", 4);
+  header->record_count       = count;
+  header->raw_size           = static_cast<uint32_t>(raw_.size());
+  header->reserved           = 0;
+  header->first_timestamp_ns = first_ts;
+  header->last_timestamp_ns  = last_ts;
+
+#ifdef SOCKET_CAN_HAVE_ZLIB
+  if (compression_level > 0) {
+    uLongf bound = compressBound(raw_.size());
+    out->resize(bound);
+    if (compress2(out->data(),
+                  &bound,
+                  raw_.data(),
+                  raw_.size(),
+                  compression_level) == Z_OK) {
+      out->resize(bound);
+      header->method      = kMethodDeflate;
+      header->stored_size = static_cast<uint32_t>(bound);
+      return true;
+    }
+  }
+#endif
+  *out                = raw_;
+  header->method      = kMethodStored;
+  header->stored_size = header->raw_size;
+  return true;
+}
+
+bool CompressedBlockCodec::decode(const CompressedBlockHeader& header,
+                                  const uint8_t*               data,
+                                  std::vector<CaptureRecord>*  records) {
+  const uint8_t* raw = data;
+  if (header.method == kMethodDeflate) {
+#ifdef SOCKET_CAN_HAVE_ZLIB
+    raw_.resize(header.raw_size);
+    uLongf raw_size = header.raw_size;
+    if (uncompress(raw_.data(), &raw_size, data, header.stored_size) !=
+          Z_OK ||
+        raw_size != header.raw_size)
+      return false;
+    raw = raw_.data();
+#else
+    std::cerr << "Compressed capture block needs zlib" << std::endl;
+    return false;
+#endif
+  } else if (header.method != kMethodStored ||
+             header.stored_size != header.raw_size) {
+    return false;
+  }
+
+  uint32_t sizes[kColumnCount];
+  if (header.raw_size < sizeof(sizes))
+    return false;
+  std::memcpy(sizes, raw, sizeof(sizes));
+  const uint8_t* column[kColumnCount];
+  const uint8_t* column_end[kColumnCount];
+  size_t         offset = sizeof(sizes);
+  for (size_t c = 0; c < kColumnCount; ++c) {
+    if (sizes[c] > header.raw_size - offset)
+      return false;
+    column[c]     = raw + offset;
+    column_end[c] = column[c] + sizes[c];
+    offset += sizes[c];
+  }
+
+  size_t dict_size = sizes[kDictionary] / sizeof(canid_t);
+  dictionary_.resize(dict_size);
+  std::memcpy(
+    dictionary_.data(), column[kDictionary], dict_size * sizeof(canid_t));
+  state_.assign(dict_size, IdState{header.first_timestamp_ns, 0, {}});
+
+  records->resize(header.record_count);
+  for (uint32_t i = 0; i < header.record_count; ++i) {
+    CaptureRecord& r = (*records)[i];
+    uint64_t       index, dd, channel;
+    if (!get_varint(&column[kIdIndex], column_end[kIdIndex], &index) ||
+        index >= dict_size ||
+        !get_varint(&column[kTimestamp], column_end[kTimestamp], &dd) ||
+        !get_varint(&column[kChannel], column_end[kChannel], &channel) ||
+        column[kDlc] >= column_end[kDlc])
+      return false;
+
+    IdState& st    = state_[index];
+    int64_t  delta = st.last_delta + unzigzag(dd);
+    st.last_ts += static_cast<uint64_t>(delta);
+    st.last_delta = delta;
+
+    std::memset(&r, 0, sizeof(r));
+    r.timestamp_ns  = st.last_ts;
+    r.channel       = static_cast<uint32_t>(channel >> 1);
+    r.flags         = channel & 1 ? kCaptureFlagTx : 0;
+    r.frame.can_id  = dictionary_[index];
+    r.frame.can_dlc = *column[kDlc]++;
+
+    uint8_t len = std::min<uint8_t>(r.frame.can_dlc, CAN_MAX_DLEN);
+    if (column_end[kPayload] - column[kPayload] < len)
+      return false;
+    for (uint8_t b = 0; b < len; ++b) {
+      st.last_payload[b] ^= *column[kPayload]++;
+      r.frame.data[b] = st.last_payload[b];
+    }
+  }
+  return true;
+}
+
+CompressedCaptureLogger::CompressedCaptureLogger(uint32_t block_records,
+                                                 int      compression_level)
+  : block_records_(block_records ? block_records : kDefaultBlockRecords),
+    compression_level_(compression_level) {
+}
+
+CompressedCaptureLogger::~CompressedCaptureLogger() {
+  close();
+}
+
+bool CompressedCaptureLogger::open(const std::string& path) {
+  close();
+  if (!writer_.open(path)) {
+    std::cerr << "Failed to open capture file " << path << std::endl;
+    return false;
+  }
+  CompressedCaptureHeader header = {};
+  std::memcpy(header.magic, kCompressedCaptureMagic, sizeof(header.magic));
+  header.version       = kCompressedCaptureVersion;
+  header.block_records = block_records_;
+  if (!writer_.append(&header, sizeof(header))) {
+    std::cerr << "Failed to write capture header to " << path << std::endl;
+    writer_.close();
+    return false;
+  }
+
+  current_.reserve(block_records_);
+  stopping_     = false;
+  failed_       = false;
+  raw_bytes_    = 0;
+  stored_bytes_ = 0;
+  stalls_       = 0;
+  thread_       = std::thread(&CompressedCaptureLogger::worker, this);
+  return true;
+}
+
+bool CompressedCaptureLogger::write(const CaptureRecord& record) {
+  // Without the worker, a full queue would never drain
+  if (!thread_.joinable())
+    return false;
+  current_.push_back(record);
+  if (current_.size() < block_records_)
+    return true;
+  return submit_current();
+}
+
+bool CompressedCaptureLogger::submit_current() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (pending_.size() >= kMaxPendingBlocks) {
+    ++stalls_;
+    done_cv_.wait(lock, [this] { return pending_.size() < kMaxPendingBlocks; });
+  }
+  pending_.push_back(std::move(current_));
+  if (!free_blocks_.empty()) {
+    current_ = std::move(free_blocks_.back());
+    free_blocks_.pop_back();
+  } else {
+    current_ = Block();
+    current_.reserve(block_records_);
+  }
+  work_cv_.notify_one();
+  return !failed_;
+}
+
+void CompressedCaptureLogger::worker() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    work_cv_.wait(lock, [this] { return !pending_.empty() || stopping_; });
+    if (pending_.empty())
+      break;
+    Block block = std::move(pending_.front());
+    pending_.pop_front();
+    busy_ = true;
+    lock.unlock();
+
+    CompressedBlockHeader header = {};
+    bool ok = codec_.encode(block.data(),
+                            static_cast<uint32_t>(block.size()),
+                            compression_level_,
+                            &header,
+                            &encoded_) &&
+              writer_.append(&header, sizeof(header)) &&
+              writer_.append(encoded_.data(), encoded_.size());
+
+    lock.lock();
+    busy_ = false;
+    if (!ok)
+      failed_ = true;
+    raw_bytes_ += block.size() * sizeof(CaptureRecord);
+    stored_bytes_ += sizeof(header) + encoded_.size();
+    block.clear();
+    free_blocks_.push_back(std::move(block));
+    done_cv_.notify_all();
+  }
+}
+
+bool CompressedCaptureLogger::flush() {
+  if (!thread_.joinable())
+    return false;
+  if (!current_.empty() && !submit_current())
+    return false;
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return pending_.empty() && !busy_; });
+  // The worker is idle and only this thread produces work
+  return writer_.flush() && !failed_;
+}
+
+bool CompressedCaptureLogger::close() {
+  if (!thread_.joinable())
+    return true;
+  bool ok = current_.empty() || submit_current();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_cv_.notify_one();
+  thread_.join();
+  ok = writer_.close() && ok && !failed_;
+  current_.clear();
+  return ok;
+}
+
+uint64_t CompressedCaptureLogger::raw_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return raw_bytes_;
+}
+
+uint64_t CompressedCaptureLogger::stored_bytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stored_bytes_;
+}
+
+uint64_t CompressedCaptureLogger::stalls() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stalls_;
+}
+
+bool CompressedCaptureReader::open(const std::string& path) {
+  records_.clear();
+  position_ = 0;
+  CompressedCaptureHeader header;
+  if (!reader_.open(path))
+    return false;
+  if (!reader_.read_exact(&header, sizeof(header)) ||
+      std::memcmp(header.magic, kCompressedCaptureMagic, sizeof(header.magic)) !=
+        0) {
+    std::cerr << "Not a compressed capture file: " << path << std::endl;
+    reader_.close();
+    return false;
+  }
+  return true;
+}
+
+bool CompressedCaptureReader::read_block() {
+  CompressedBlockHeader header;
+  if (!reader_.read_exact(&header, sizeof(header)))
+    return false;
+  if (std::memcmp(header.magic, "ZBLK", 4) != 0) {
+    std::cerr << "Corrupt compressed capture block" << std::endl;
+    return false;
+  }
+  stored_.resize(header.stored_size);
+  if (!reader_.read_exact(stored_.data(), stored_.size()) ||
+      !codec_.decode(header, stored_.data(), &records_)) {
+    std::cerr << "Failed to decode compressed capture block" << std::endl;
+    return false;
+  }
+  position_ = 0;
+  return true;
+}
+
+bool CompressedCaptureReader::next(CaptureRecord& record) {
+  while (position_ >= records_.size()) {
+    if (!read_block())
+      return false;
+  }
+  record = records_[position_++];
+  return true;
+}
@@ -0,0 +1,278 @@
+#include "socket_can/frame_filter.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SOCKET_CAN_FILTER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+inline uint64_t scalar_word(const canid_t* ids,
+                            size_t         count,
+                            canid_t        mask,
+                            canid_t        value) {
+  uint64_t word = 0;
+  for (size_t i = 0; i < count; ++i)
+    word |= static_cast<uint64_t>((ids[i] & mask) == value) << i;
+  return word;
+}
+
+void classify_scalar(const canid_t* ids,
+                     size_t         count,
+                     const canid_t* masks,
+                     const canid_t* values,
+                     size_t         rules,
+                     size_t         words,
+                     uint64_t*      bits) {
+  for (size_t w = 0; w < words; ++w) {
+    const canid_t* block = ids + w * 64;
+    size_t         lanes = std::min<size_t>(64, count - w * 64);
+    for (size_t r = 0; r < rules; ++r)
+      bits[r * words + w] = scalar_word(block, lanes, masks[r], values[r]);
+  }
+}
+
+#ifdef SOCKET_CAN_FILTER_X86
+
+// The vector kernels take 64 frames at a time: their IDs stay in registers
+// while every rule is checked, and each rule's result is built up in one
+// word that is stored once. Frames past the last full vector go through
+// the scalar loop (none on a full word, where the shift would be 64).
+
+__attribute__((target("sse2"))) void classify_sse2(const canid_t* ids,
+                                                   size_t         count,
+                                                   const canid_t* masks,
+                                                   const canid_t* values,
+                                                   size_t         rules,
+                                                   size_t         words,
+                                                   uint64_t*      bits) {
+  for (size_t w = 0; w < words; ++w) {
+    const canid_t* block   = ids + w * 64;
+    size_t         lanes   = std::min<size_t>(64, count - w * 64);
+    size_t         vectors = lanes / 4;
+    __m128i        id[16];
+    for (size_t v = 0; v < vectors; ++v)
+      id[v] =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + v * 4));
+    for (size_t r = 0; r < rules; ++r) {
+      __m128i  mask  = _mm_set1_epi32(static_cast<int>(masks[r]));
+      __m128i  value = _mm_set1_epi32(static_cast<int>(values[r]));
+      uint64_t word  = 0;
+      for (size_t v = 0; v < vectors; ++v) {
+        __m128i equal = _mm_cmpeq_epi32(_mm_and_si128(id[v], mask), value);
+        word |= static_cast<uint64_t>(
+                  _mm_movemask_ps(_mm_castsi128_ps(equal)))
+                << (v * 4);
+      }
+      if (lanes > vectors * 4)
+        word |= scalar_word(block + vectors * 4, lanes - vectors * 4,
+                            masks[r], values[r])
+                << (vectors * 4);
+      bits[r * words + w] = word;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) void classify_avx2(const canid_t* ids,
+                                                   size_t         count,
+                                                   const canid_t* masks,
+                                                   const canid_t* values,
+                                                   size_t         rules,
+                                                   size_t         words,
+                                                   uint64_t*      bits) {
+  for (size_t w = 0; w < words; ++w) {
+    const canid_t* block   = ids + w * 64;
+    size_t         lanes   = std::min<size_t>(64, count - w * 64);
+    size_t         vectors = lanes / 8;
+    __m256i        id[8];
+    for (size_t v = 0; v < vectors; ++v)
+      id[v] =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + v * 8));
+    for (size_t r = 0; r < rules; ++r) {
+      __m256i  mask  = _mm256_set1_epi32(static_cast<int>(masks[r]));
+      __m256i  value = _mm256_set1_epi32(static_cast<int>(values[r]));
+      uint64_t word  = 0;
+      for (size_t v = 0; v < vectors; ++v) {
+        __m256i equal =
+          _mm256_cmpeq_epi32(_mm256_and_si256(id[v], mask), value);
+        word |= static_cast<uint64_t>(
+                  _mm256_movemask_ps(_mm256_castsi256_ps(equal)))
+                << (v * 8);
+      }
+      if (lanes > vectors * 8)
+        word |= scalar_word(block + vectors * 8, lanes - vectors * 8,
+                            masks[r], values[r])
+                << (vectors * 8);
+      bits[r * words + w] = word;
+    }
+  }
+}
+
+#endif
+
+FrameFilterSet::KernelFunction kernel_function(FilterKernel kernel) {
+  switch (kernel) {
+#ifdef SOCKET_CAN_FILTER_X86
+  case FilterKernel::kSse2:
+    return classify_sse2;
+  case FilterKernel::kAvx2:
+    return classify_avx2;
+#endif
+  default:
+    return classify_scalar;
+  }
+}
+
+size_t bitmap_indices(const uint64_t* bits, size_t words, uint32_t* out) {
+  size_t n = 0;
+  for (size_t w = 0; w < words; ++w) {
+    for (uint64_t word = bits[w]; word; word &= word - 1)
+      out[n++] = static_cast<uint32_t>(w * 64 + __builtin_ctzll(word));
+  }
+  return n;
+}
+
+}  // namespace
+
+const char* filter_kernel_name(FilterKernel kernel) {
+  switch (kernel) {
+  case FilterKernel::kScalar:
+    return "scalar";
+  case FilterKernel::kSse2:
+    return "sse2";
+  case FilterKernel::kAvx2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+bool filter_kernel_supported(FilterKernel kernel) {
+  switch (kernel) {
+  case FilterKernel::kScalar:
+    return true;
+#ifdef SOCKET_CAN_FILTER_X86
+  case FilterKernel::kSse2:
+    return __builtin_cpu_supports("sse2");
+  case FilterKernel::kAvx2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+FilterKernel best_filter_kernel() {
+  static const FilterKernel best = [] {
+    for (FilterKernel kernel : {FilterKernel::kAvx2, FilterKernel::kSse2}) {
+      if (filter_kernel_supported(kernel))
+        return kernel;
+    }
+    return FilterKernel::kScalar;
+  }();
+  return best;
+}
+
+void FrameBatch::push(const can_frame& frame) {
+  uint64_t payload;
+  std::memcpy(&payload, frame.data, sizeof(payload));
+  ids_.push_back(frame.can_id);
+  lengths_.push_back(frame.can_dlc);
+  payloads_.push_back(payload);
+}
+
+can_frame FrameBatch::frame(size_t index) const {
+  can_frame frame = {};
+  frame.can_id    = ids_[index];
+  frame.can_dlc   = lengths_[index];
+  std::memcpy(frame.data, &payloads_[index], sizeof(frame.data));
+  return frame;
+}
+
+size_t FilterResult::count(size_t rule) const {
+  size_t          n    = 0;
+  const uint64_t* word = bits(rule);
+  for (size_t w = 0; w < words_; ++w)
+    n += static_cast<size_t>(__builtin_popcountll(word[w]));
+  return n;
+}
+
+size_t FilterResult::indices(size_t rule, uint32_t* out) const {
+  return bitmap_indices(bits(rule), words_, out);
+}
+
+size_t FilterResult::any_indices(uint32_t* out) const {
+  return bitmap_indices(any_.data(), words_, out);
+}
+
+FrameFilterSet::FrameFilterSet() {
+  set_kernel(best_filter_kernel());
+}
+
+FrameFilterSet::FrameFilterSet(const std::vector<can_filter>& rules)
+  : FrameFilterSet() {
+  set_rules(rules);
+}
+
+void FrameFilterSet::set_rules(const std::vector<can_filter>& rules) {
+  masks_.clear();
+  values_.clear();
+  inverted_.clear();
+  for (const can_filter& rule : rules) {
+    masks_.push_back(rule.can_mask);
+    values_.push_back(rule.can_id & ~CAN_INV_FILTER & rule.can_mask);
+    inverted_.push_back((rule.can_id & CAN_INV_FILTER) != 0);
+  }
+}
+
+bool FrameFilterSet::set_kernel(FilterKernel kernel) {
+  if (!filter_kernel_supported(kernel))
+    return false;
+  kernel_   = kernel;
+  function_ = kernel_function(kernel);
+  return true;
+}
+
+void FrameFilterSet::classify(const FrameBatch& batch,
+                              FilterResult&     result) const {
+  size_t frames = batch.size();
+  size_t rules  = values_.size();
+  size_t words  = (frames + 63) / 64;
+  result.frames_ = frames;
+  result.rules_  = rules;
+  result.words_  = words;
+  result.bits_.resize(rules * words);
+  result.any_.assign(words, 0);
+  if (frames == 0)
+    return;
+
+  function_(batch.ids(), frames, masks_.data(), values_.data(), rules, words,
+            result.bits_.data());
+
+  uint64_t last = frames % 64 ? (1ull << (frames % 64)) - 1 : ~0ull;
+  for (size_t r = 0; r < rules; ++r) {
+    uint64_t* bits = &result.bits_[r * words];
+    if (inverted_[r]) {
+      for (size_t w = 0; w < words; ++w)
+        bits[w] = ~bits[w];
+      bits[words - 1] &= last;
+    }
+    for (size_t w = 0; w < words; ++w)
+      result.any_[w] |= bits[w];
+  }
+}
+
+FrameClassifier::FrameClassifier(const std::vector<can_filter>& rules,
+                                 BatchHandler                   handler)
+  : filters_(rules), handler_(std::move(handler)) {
+}
+
+void FrameClassifier::flush() {
+  if (batch_.empty())
+    return;
+  filters_.classify(batch_, result_);
+  if (handler_)
+    handler_(batch_, result_);
+  batch_.clear();
+}
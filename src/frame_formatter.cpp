@@ -0,0 +1,138 @@
+#include "socket_can/frame_formatter.hpp"
+#include "socket_can/text_format.hpp"
+#include <ctime>
+
+using namespace text_format;
+
+namespace {
+
+constexpr uint64_t kNsPerSec = 1000000000ull;
+
+constexpr uint64_t kPow10[] = {1,
+                               10,
+                               100,
+                               1000,
+                               10000,
+                               100000,
+                               1000000,
+                               10000000,
+                               100000000,
+                               1000000000};
+
+}  // namespace
+
+char* TimestampFormatter::format(char*    out,
+                                 uint64_t timestamp_ns,
+                                 int      frac_digits) {
+  int64_t sec = static_cast<int64_t>(timestamp_ns / kNsPerSec);
+  if (sec != cached_sec_) {
+    time_t    t = static_cast<time_t>(sec);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    put_uint_padded(cached_, tm.tm_hour, 2);
+    cached_[2] = ':';
+    put_uint_padded(cached_ + 3, tm.tm_min, 2);
+    cached_[5] = ':';
+    put_uint_padded(cached_ + 6, tm.tm_sec, 2);
+    cached_sec_ = sec;
+  }
+  out = put_str(out, cached_, sizeof(cached_));
+  if (frac_digits > 0) {
+    if (frac_digits > 9)
+      frac_digits = 9;
+    *out++ = '.';
+    out    = put_uint_padded(
+      out, timestamp_ns % kNsPerSec / kPow10[9 - frac_digits], frac_digits);
+  }
+  return out;
+}
+
+char* FrameFormatter::format_candump_frame(char* out, const can_frame& frame) {
+  if (frame.can_id & CAN_ERR_FLAG)
+    out = put_hex(out, frame.can_id & (CAN_ERR_MASK | CAN_ERR_FLAG), 8);
+  else if (frame.can_id & CAN_EFF_FLAG)
+    out = put_hex(out, frame.can_id & CAN_EFF_MASK, 8);
+  else
+    out = put_hex(out, frame.can_id & CAN_SFF_MASK, 3);
+  *out++ = '#';
+
+  uint8_t dlc = frame.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame.can_dlc;
+  if (frame.can_id & CAN_RTR_FLAG) {
+    *out++ = 'R';
+    if (dlc)
+      out = put_hex(out, dlc, 1);
+  } else {
+    for (uint8_t i = 0; i < dlc; ++i)
+      out = put_hex_byte(out, frame.data[i]);
+  }
+  return out;
+}
+
+char* FrameFormatter::format_candump(char*                out,
+                                     const CaptureRecord& record,
+                                     const char*          iface,
+                                     size_t               iface_len) {
+  *out++ = '(';
+  out    = put_uint(out, record.timestamp_ns / kNsPerSec);
+  *out++ = '.';
+  out    = put_uint_padded(out, record.timestamp_ns % kNsPerSec / 1000, 6);
+  *out++ = ')';
+  *out++ = ' ';
+  out    = put_str(out, iface, iface_len);
+  *out++ = ' ';
+  out    = format_candump_frame(out, record.frame);
+  if (record.flags & kCaptureFlagTx) {
+    *out++ = ' ';
+    *out++ = 'T';
+  }
+  *out++ = '\n';
+  return out;
+}
+
+char* FrameFormatter::format_human(char*            out,
+                                   const can_frame& frame,
+                                   uint64_t         timestamp_ns,
+                                   uint64_t         sequence) {
+  *out++ = '[';
+  out    = timestamp_.format(out, timestamp_ns, 3);
+  out    = put_str(out, "] Frame #", 9);
+
+  char  seq[20];
+  char* seq_end = put_uint(seq, sequence);
+  for (long pad = 6 - (seq_end - seq); pad > 0; --pad)
+    *out++ = ' ';
+  out = put_str(out, seq, static_cast<size_t>(seq_end - seq));
+
+  out = put_str(out, " - ID: 0x", 9);
+  if (frame.can_id & CAN_EFF_FLAG) {
+    out = put_hex_lower(out, frame.can_id & CAN_EFF_MASK, 8);
+    out = put_str(out, " (EXT)", 6);
+  } else {
+    out = put_hex_lower(out, frame.can_id & CAN_SFF_MASK, 3);
+    out = put_str(out, " (STD)", 6);
+  }
+  if (frame.can_id & CAN_RTR_FLAG)
+    out = put_str(out, " RTR", 4);
+
+  uint8_t dlc = frame.can_dlc > CAN_MAX_DLEN ? CAN_MAX_DLEN : frame.can_dlc;
+  out         = put_str(out, " DLC: ", 6);
+  out         = put_uint(out, frame.can_dlc);
+
+  if (dlc > 0 && !(frame.can_id & CAN_RTR_FLAG)) {
+    out = put_str(out, " Data: [", 8);
+    for (uint8_t i = 0; i < dlc; ++i) {
+      *out++ = '0';
+      *out++ = 'x';
+      out    = put_hex_byte_lower(out, frame.data[i]);
+      *out++ = i + 1 < dlc ? ' ' : ']';
+    }
+    out = put_str(out, " ASCII: \"", 9);
+    for (uint8_t i = 0; i < dlc; ++i) {
+      char c = static_cast<char>(frame.data[i]);
+      *out++ = c >= 32 && c <= 126 ? c : '.';
+    }
+    *out++ = '"';
+  }
+  *out++ = '\n';
+  return out;
+}
@@ -0,0 +1,49 @@
+#include "socket_can/frame_pool.hpp"
+
+FramePool::FramePool(size_t capacity)
+  : capacity_(capacity), slots_(new PooledFrame[capacity]) {
+  for (size_t i = capacity_; i-- > 0;) {
+    slots_[i].pool = this;
+    release(&slots_[i]);
+  }
+}
+
+size_t FramePool::take(FrameRef* refs, size_t max) {
+  if (return_head_.load(std::memory_order_relaxed))
+    reclaim();
+  size_t n = 0;
+  for (; n < max && free_; ++n) {
+    PooledFrame* slot = free_;
+    free_             = slot->next_free;
+    slot->refs        = 1;
+    refs[n]           = FrameRef(slot);
+  }
+  available_ -= n;
+  if (n < max)
+    exhausted_++;
+  return n;
+}
+
+void FramePool::reclaim() {
+  PooledFrame* slot = return_head_.exchange(nullptr, std::memory_order_acquire);
+  while (slot) {
+    // Read before `returns` is cleared: from then on another thread may push
+    // the slot again
+    PooledFrame* next = slot->next_return;
+    slot->refs -= slot->returns.exchange(0, std::memory_order_acq_rel);
+    if (slot->refs == 0)
+      release(slot);
+    slot = next;
+  }
+}
+
+void FramePool::return_slot(PooledFrame* slot) {
+  // Each slot is on the stack at most once; later returns only count
+  if (slot->returns.fetch_add(1, std::memory_order_acq_rel) != 0)
+    return;
+  PooledFrame* head = return_head_.load(std::memory_order_relaxed);
+  do {
+    slot->next_return = head;
+  } while (!return_head_.compare_exchange_weak(
+    head, slot, std::memory_order_release, std::memory_order_relaxed));
+}
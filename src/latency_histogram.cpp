@@ -0,0 +1,68 @@
+#include "socket_can/latency_histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+LatencyHistogram::LatencyHistogram() : counts_(kBucketCount, 0) {
+}
+
+void LatencyHistogram::reset() {
+  std::fill(counts_.begin(), counts_.end(), 0);
+  count_ = 0;
+  min_   = UINT64_MAX;
+  max_   = 0;
+  sum_   = 0;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  for (size_t i = 0; i < kBucketCount; ++i)
+    counts_[i] += other.counts_[i];
+  count_ += other.count_;
+  sum_ += other.sum_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+uint64_t LatencyHistogram::highest_equivalent(size_t index) {
+  if (index < kSubBuckets)
+    return index;
+  int      shift = static_cast<int>(index / (kSubBuckets / 2)) - 1;
+  uint64_t sub   = index % (kSubBuckets / 2) + kSubBuckets / 2;
+  uint64_t lower = sub << shift;
+  return lower + ((1ull << shift) - 1);
+}
+
+uint64_t LatencyHistogram::percentile(double percent) const {
+  if (count_ == 0)
+    return 0;
+  percent       = std::min(std::max(percent, 0.0), 100.0);
+  uint64_t rank = static_cast<uint64_t>(
+    std::ceil(percent / 100.0 * static_cast<double>(count_)));
+  rank = std::max<uint64_t>(rank, 1);
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < kBucketCount; ++i) {
+    seen += counts_[i];
+    if (seen >= rank)
+      return std::min(highest_equivalent(i), max_);
+  }
+  return max_;
+}
+
+std::string LatencyHistogram::summary(double divisor) const {
+  char buf[256];
+  snprintf(buf,
+           sizeof(buf),
+           "n=%llu min=%.1f mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f "
+           "p99.99=%.1f max=%.1f",
+           static_cast<unsigned long long>(count_),
+           min() / divisor,
+           mean() / divisor,
+           percentile(50) / divisor,
+           percentile(90) / divisor,
+           percentile(99) / divisor,
+           percentile(99.9) / divisor,
+           percentile(99.99) / divisor,
+           max() / divisor);
+  return buf;
+}
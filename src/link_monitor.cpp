@@ -0,0 +1,235 @@
+#include "socket_can/link_monitor.hpp"
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <linux/can/netlink.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kReceiveBufferSize = 32 * 1024;
+
+}  // namespace
+
+struct rtattr* rtnetlink_add_attribute(struct nlmsghdr* message,
+                                       size_t           capacity,
+                                       uint16_t         type,
+                                       const void*      data,
+                                       size_t           size) {
+  size_t length = RTA_LENGTH(size);
+  if (NLMSG_ALIGN(message->nlmsg_len) + RTA_ALIGN(length) > capacity)
+    return nullptr;
+  struct rtattr* attr = reinterpret_cast<struct rtattr*>(
+    reinterpret_cast<char*>(message) + NLMSG_ALIGN(message->nlmsg_len));
+  attr->rta_type = type;
+  attr->rta_len  = static_cast<uint16_t>(length);
+  if (size)
+    std::memcpy(RTA_DATA(attr), data, size);
+  message->nlmsg_len = NLMSG_ALIGN(message->nlmsg_len) + RTA_ALIGN(length);
+  return attr;
+}
+
+void rtnetlink_end_nested(struct nlmsghdr* message, struct rtattr* nested) {
+  nested->rta_len = static_cast<uint16_t>(reinterpret_cast<char*>(message) +
+                                          message->nlmsg_len -
+                                          reinterpret_cast<char*>(nested));
+}
+
+LinkMonitor::~LinkMonitor() {
+  deinit();
+}
+
+bool LinkMonitor::init(EpollEventLoop* event_loop) {
+  fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               NETLINK_ROUTE);
+  if (fd_ < 0) {
+    std::cerr << "Failed to create rtnetlink socket" << std::endl;
+    return false;
+  }
+  int size = static_cast<int>(kReceiveBufferSize * 8);
+  setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  struct sockaddr_nl addr = {};
+  addr.nl_family          = AF_NETLINK;
+  addr.nl_groups          = RTMGRP_LINK;
+  if (bind(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) !=
+      0) {
+    std::cerr << "Failed to bind rtnetlink socket" << std::endl;
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  event_loop_ = event_loop;
+  if (!event_loop_->register_event(
+        &evt_, fd_, EPOLLIN, [this](uint32_t mask) { on_readable(mask); })) {
+    std::cerr << "Failed to register rtnetlink socket" << std::endl;
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void LinkMonitor::deinit() {
+  if (fd_ < 0)
+    return;
+  event_loop_->deregister_event(evt_);
+  evt_ = nullptr;
+  close(fd_);
+  fd_ = -1;
+}
+
+int LinkMonitor::add_handler(Handler handler) {
+  handlers_[next_id_] = std::move(handler);
+  return next_id_++;
+}
+
+void LinkMonitor::remove_handler(int id) {
+  handlers_.erase(id);
+}
+
+bool LinkMonitor::request_can_restart(const std::string& interface) {
+  unsigned ifindex = if_nametoindex(interface.c_str());
+  if (fd_ < 0 || ifindex == 0)
+    return false;
+
+  alignas(struct nlmsghdr) char buf[256] = {};
+  struct nlmsghdr* message = reinterpret_cast<struct nlmsghdr*>(buf);
+  message->nlmsg_len       = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  message->nlmsg_type      = RTM_NEWLINK;
+  message->nlmsg_flags     = NLM_F_REQUEST | NLM_F_ACK;
+  message->nlmsg_seq       = ++seq_;
+  struct ifinfomsg* info =
+    static_cast<struct ifinfomsg*>(NLMSG_DATA(message));
+  info->ifi_family = AF_UNSPEC;
+  info->ifi_index  = static_cast<int>(ifindex);
+
+  static const char kKind[] = "can";
+  uint32_t          restart = 1;
+  struct rtattr*    link_info =
+    rtnetlink_add_attribute(message, sizeof(buf), IFLA_LINKINFO, nullptr, 0);
+  rtnetlink_add_attribute(message, sizeof(buf), IFLA_INFO_KIND, kKind,
+                          sizeof(kKind));
+  struct rtattr* data =
+    rtnetlink_add_attribute(message, sizeof(buf), IFLA_INFO_DATA, nullptr, 0);
+  rtnetlink_add_attribute(message, sizeof(buf), IFLA_CAN_RESTART, &restart,
+                          sizeof(restart));
+  rtnetlink_end_nested(message, data);
+  rtnetlink_end_nested(message, link_info);
+
+  struct sockaddr_nl kernel = {};
+  kernel.nl_family          = AF_NETLINK;
+  return sendto(fd_, buf, message->nlmsg_len, 0,
+                reinterpret_cast<struct sockaddr*>(&kernel),
+                sizeof(kernel)) == static_cast<ssize_t>(message->nlmsg_len);
+}
+
+bool LinkMonitor::request_dump() {
+  struct {
+    struct nlmsghdr  header;
+    struct ifinfomsg info;
+  } request               = {};
+  request.header.nlmsg_len   = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+  request.header.nlmsg_type  = RTM_GETLINK;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq   = ++seq_;
+  request.info.ifi_family    = AF_UNSPEC;
+  struct sockaddr_nl kernel  = {};
+  kernel.nl_family           = AF_NETLINK;
+  return sendto(fd_, &request, request.header.nlmsg_len, 0,
+                reinterpret_cast<struct sockaddr*>(&kernel),
+                sizeof(kernel)) ==
+         static_cast<ssize_t>(request.header.nlmsg_len);
+}
+
+bool LinkMonitor::parse(const void*             data,
+                        size_t                  size,
+                        std::vector<LinkEvent>& events) {
+  int len = static_cast<int>(size);
+  for (const struct nlmsghdr* message =
+         static_cast<const struct nlmsghdr*>(data);
+       NLMSG_OK(message, len); message = NLMSG_NEXT(message, len)) {
+    if (message->nlmsg_type == NLMSG_ERROR) {
+      const struct nlmsgerr* error =
+        static_cast<const struct nlmsgerr*>(NLMSG_DATA(message));
+      if (message->nlmsg_len >= NLMSG_LENGTH(sizeof(*error)) && error->error)
+        std::cerr << "rtnetlink request failed: " << strerror(-error->error)
+                  << std::endl;
+      continue;
+    }
+    if (message->nlmsg_type != RTM_NEWLINK &&
+        message->nlmsg_type != RTM_DELLINK)
+      continue;
+    if (message->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+      return false;
+
+    const struct ifinfomsg* info =
+      static_cast<const struct ifinfomsg*>(NLMSG_DATA(message));
+    LinkEvent event;
+    event.ifindex = info->ifi_index;
+    event.up      = (info->ifi_flags & IFF_UP) != 0;
+    event.running = (info->ifi_flags & IFF_RUNNING) != 0;
+    event.removed = message->nlmsg_type == RTM_DELLINK;
+    int attr_len  = static_cast<int>(IFLA_PAYLOAD(message));
+    for (const struct rtattr* attr = IFLA_RTA(info); RTA_OK(attr, attr_len);
+         attr = RTA_NEXT(attr, attr_len)) {
+      if (attr->rta_type == IFLA_IFNAME)
+        event.name.assign(static_cast<const char*>(RTA_DATA(attr)),
+                          strnlen(static_cast<const char*>(RTA_DATA(attr)),
+                                  RTA_PAYLOAD(attr)));
+    }
+    events.push_back(std::move(event));
+  }
+  return len == 0;
+}
+
+bool LinkMonitor::is_up(const std::string& interface) {
+  int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return false;
+  struct ifreq ifr = {};
+  std::strncpy(ifr.ifr_name, interface.c_str(), IFNAMSIZ - 1);
+  bool up = ioctl(fd, SIOCGIFFLAGS, &ifr) == 0 && (ifr.ifr_flags & IFF_UP);
+  close(fd);
+  return up;
+}
+
+void LinkMonitor::on_readable(uint32_t) {
+  alignas(struct nlmsghdr) char buf[kReceiveBufferSize];
+  std::vector<LinkEvent>        events;
+  for (;;) {
+    ssize_t n = recv(fd_, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == ENOBUFS) {
+        // Notifications were lost; the dump reports every link again
+        request_dump();
+        continue;
+      }
+      break;
+    }
+    if (n == 0)
+      break;
+    if (!parse(buf, static_cast<size_t>(n), events))
+      std::cerr << "Malformed rtnetlink message" << std::endl;
+  }
+  for (const LinkEvent& event : events)
+    dispatch(event);
+}
+
+void LinkMonitor::dispatch(const LinkEvent& event) {
+  // Look handlers up one at a time, as one may remove another
+  std::vector<int> ids;
+  for (const auto& handler : handlers_)
+    ids.push_back(handler.first);
+  for (int id : ids) {
+    auto it = handlers_.find(id);
+    if (it != handlers_.end())
+      it->second(event);
+  }
+}
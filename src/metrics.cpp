@@ -0,0 +1,461 @@
+#include "socket_can/metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr char kHttpGet[] = "GET ";
+
+void append_escaped(std::string& out, const std::string& text) {
+  for (char c : text) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+}
+
+void append_labels(std::string&        out,
+                   const MetricLabels& labels,
+                   const char*         extra_name  = nullptr,
+                   const std::string&  extra_value = std::string()) {
+  if (labels.empty() && !extra_name)
+    return;
+  out += '{';
+  bool first = true;
+  for (const auto& label : labels) {
+    if (!first)
+      out += ',';
+    first = false;
+    out += label.first;
+    out += "=\"";
+    append_escaped(out, label.second);
+    out += '"';
+  }
+  if (extra_name) {
+    if (!first)
+      out += ',';
+    out += extra_name;
+    out += "=\"";
+    out += extra_value;
+    out += '"';
+  }
+  out += '}';
+}
+
+std::string format_number(double value) {
+  char buf[32];
+  if (std::isinf(value))
+    return value > 0 ? "+Inf" : "-Inf";
+  // Integers (counts, bytes) exactly, everything else with 9 digits
+  if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0)
+    snprintf(buf, sizeof(buf), "%.0f", value);
+  else
+    snprintf(buf, sizeof(buf), "%.9g", value);
+  return buf;
+}
+
+void append_sample(std::string&        out,
+                   const std::string&  name,
+                   const char*         suffix,
+                   const MetricLabels& labels,
+                   double              value) {
+  out += name;
+  out += suffix;
+  append_labels(out, labels);
+  out += ' ';
+  out += format_number(value);
+  out += '\n';
+}
+
+void render_histogram(std::string&           out,
+                      const std::string&     name,
+                      const MetricLabels&    labels,
+                      const MetricHistogram& histogram) {
+  uint64_t cumulative = 0;
+  for (int i = 0; i <= histogram.bounds(); ++i) {
+    cumulative += histogram.bucket(i);
+    out += name;
+    out += "_bucket";
+    append_labels(out, labels, "le", format_number(histogram.bound(i)));
+    out += ' ';
+    out += format_number(static_cast<double>(cumulative));
+    out += '\n';
+  }
+  append_sample(out, name, "_count", labels, static_cast<double>(cumulative));
+  append_sample(out, name, "_sum", labels,
+                static_cast<double>(histogram.sum()) * histogram.scale());
+}
+
+const char* type_name(MetricsRegistry::Type type) {
+  switch (type) {
+    case MetricsRegistry::Type::kCounter:
+      return "counter";
+    case MetricsRegistry::Type::kGauge:
+      return "gauge";
+    case MetricsRegistry::Type::kHistogram:
+      return "histogram";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+MetricHistogram::MetricHistogram(int min_exp, int max_exp, double scale)
+  : min_exp_(min_exp),
+    n_bounds_(max_exp >= min_exp ? max_exp - min_exp + 1 : 1),
+    scale_(scale),
+    buckets_(new std::atomic<uint64_t>[n_bounds_ + 1]) {
+  for (int i = 0; i <= n_bounds_; ++i)
+    buckets_[i].store(0, std::memory_order_relaxed);
+}
+
+double MetricHistogram::bound(int index) const {
+  if (index >= n_bounds_)
+    return INFINITY;
+  return std::ldexp(1.0, min_exp_ + index) * scale_;
+}
+
+bool MetricCallback::read(double& value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return read_ && read_(value);
+}
+
+void MetricCallback::reset() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  read_ = nullptr;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+  static MetricsRegistry registry;
+  return registry;
+}
+
+MetricsRegistry::Family* MetricsRegistry::family(const std::string& name,
+                                                 const std::string& help,
+                                                 Type               type) {
+  auto it = families_.find(name);
+  if (it == families_.end())
+    return &(families_[name] = Family{type, help, {}});
+  if (it->second.type != type) {
+    std::cerr << "Metric " << name << " already registered as "
+              << type_name(it->second.type) << std::endl;
+    return nullptr;
+  }
+  // Drop series whose owners are gone, even if nobody scrapes
+  std::vector<Series>& series = it->second.series;
+  auto expired = [](const Series& s) { return s.metric.expired(); };
+  series.erase(std::remove_if(series.begin(), series.end(), expired),
+               series.end());
+  return &it->second;
+}
+
+std::shared_ptr<void> MetricsRegistry::find(Family&             family,
+                                            Kind                kind,
+                                            const MetricLabels& labels) {
+  for (const Series& series : family.series) {
+    if (series.kind != kind || series.labels != labels)
+      continue;
+    if (std::shared_ptr<void> metric = series.metric.lock())
+      return metric;
+  }
+  return nullptr;
+}
+
+std::shared_ptr<MetricCounter> MetricsRegistry::counter(
+  const std::string&  name,
+  const std::string&  help,
+  const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family* f = family(name, help, Type::kCounter);
+  if (!f)
+    return std::make_shared<MetricCounter>();  // counts, but is not exported
+  if (auto existing = find(*f, Kind::kCounter, labels))
+    return std::static_pointer_cast<MetricCounter>(existing);
+  auto metric = std::make_shared<MetricCounter>();
+  f->series.push_back({labels, Kind::kCounter, metric});
+  return metric;
+}
+
+std::shared_ptr<MetricGauge> MetricsRegistry::gauge(
+  const std::string&  name,
+  const std::string&  help,
+  const MetricLabels& labels) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family* f = family(name, help, Type::kGauge);
+  if (!f)
+    return std::make_shared<MetricGauge>();
+  if (auto existing = find(*f, Kind::kGauge, labels))
+    return std::static_pointer_cast<MetricGauge>(existing);
+  auto metric = std::make_shared<MetricGauge>();
+  f->series.push_back({labels, Kind::kGauge, metric});
+  return metric;
+}
+
+std::shared_ptr<MetricHistogram> MetricsRegistry::histogram(
+  const std::string&  name,
+  const std::string&  help,
+  const MetricLabels& labels,
+  int                 min_exp,
+  int                 max_exp,
+  double              scale) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Family* f = family(name, help, Type::kHistogram);
+  if (!f)
+    return std::make_shared<MetricHistogram>(min_exp, max_exp, scale);
+  if (auto existing = find(*f, Kind::kHistogram, labels))
+    return std::static_pointer_cast<MetricHistogram>(existing);
+  auto metric = std::make_shared<MetricHistogram>(min_exp, max_exp, scale);
+  f->series.push_back({labels, Kind::kHistogram, metric});
+  return metric;
+}
+
+std::shared_ptr<MetricCallback> MetricsRegistry::callback(
+  const std::string&   name,
+  const std::string&   help,
+  Type                 type,
+  const MetricLabels&  labels,
+  MetricCallback::Read read) {
+  auto metric = std::make_shared<MetricCallback>(std::move(read));
+  if (type == Type::kHistogram)
+    return metric;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (Family* f = family(name, help, type))
+    f->series.push_back({labels, Kind::kCallback, metric});
+  return metric;
+}
+
+std::string MetricsRegistry::render() const {
+  std::string out;
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto& entry : families_) {
+    const std::string& name   = entry.first;
+    Family&            family = entry.second;
+    std::vector<Series> live;
+    std::vector<std::shared_ptr<void>> held;  // keeps metrics alive to render
+    for (Series& series : family.series) {
+      if (auto metric = series.metric.lock()) {
+        held.push_back(metric);
+        live.push_back(series);
+      }
+    }
+    family.series = live;
+    if (live.empty())
+      continue;
+    std::string samples;
+    if (family.type == Type::kHistogram) {
+      for (size_t i = 0; i < live.size(); ++i)
+        render_histogram(samples, name, live[i].labels,
+                         *static_cast<MetricHistogram*>(held[i].get()));
+    } else {
+      // Sum series sharing labels (callbacks of several owners), sorted by
+      // labels for a stable output
+      std::map<MetricLabels, double> values;
+      for (size_t i = 0; i < live.size(); ++i) {
+        double value = 0;
+        switch (live[i].kind) {
+          case Kind::kCounter:
+            value = static_cast<double>(
+              static_cast<MetricCounter*>(held[i].get())->value());
+            break;
+          case Kind::kGauge:
+            value = static_cast<double>(
+              static_cast<MetricGauge*>(held[i].get())->value());
+            break;
+          case Kind::kCallback:
+            if (!static_cast<MetricCallback*>(held[i].get())->read(value))
+              continue;
+            break;
+          case Kind::kHistogram:
+            continue;
+        }
+        values[live[i].labels] += value;
+      }
+      const char* suffix = family.type == Type::kCounter ? "_total" : "";
+      for (const auto& sample : values)
+        append_sample(samples, name, suffix, sample.first, sample.second);
+    }
+    // Families whose callbacks all failed are left out
+    if (samples.empty())
+      continue;
+
+    out += "# TYPE " + name + " " + type_name(family.type) + "\n";
+    out += "# HELP " + name + " ";
+    append_escaped(out, family.help);
+    out += '\n';
+    out += samples;
+  }
+  out += "# EOF\n";
+  return out;
+}
+
+bool MetricsRegistry::write_file(const std::string& path) const {
+  std::string text = render();
+  std::string tmp  = path + ".tmp";
+  int         fd   = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Failed to open " << tmp << ": " << strerror(errno)
+              << std::endl;
+    return false;
+  }
+  size_t done = 0;
+  while (done < text.size()) {
+    ssize_t n = write(fd, text.data() + done, text.size() - done);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      std::cerr << "Failed to write " << tmp << ": " << strerror(errno)
+                << std::endl;
+      close(fd);
+      unlink(tmp.c_str());
+      return false;
+    }
+    done += static_cast<size_t>(n);
+  }
+  close(fd);
+  if (rename(tmp.c_str(), path.c_str()) != 0) {
+    std::cerr << "Failed to rename " << tmp << ": " << strerror(errno)
+              << std::endl;
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+MetricsServer::~MetricsServer() {
+  deinit();
+}
+
+bool MetricsServer::init(const std::string& path, EpollEventLoop* event_loop) {
+  struct sockaddr_un addr = {};
+  addr.sun_family         = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    std::cerr << "Metrics socket path too long: " << path << std::endl;
+    return false;
+  }
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  // Only a socket left behind by an earlier run is removed, never a file
+  struct stat st;
+  if (lstat(path.c_str(), &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      std::cerr << "Metrics socket path exists and is not a socket: " << path
+                << std::endl;
+      return false;
+    }
+    unlink(path.c_str());
+  }
+
+  listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) {
+    std::cerr << "Failed to create metrics socket" << std::endl;
+    return false;
+  }
+  if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
+           sizeof(addr)) != 0 ||
+      listen(listen_fd_, static_cast<int>(kMaxClients)) != 0) {
+    std::cerr << "Failed to listen on " << path << ": " << strerror(errno)
+              << std::endl;
+    close(listen_fd_);
+    listen_fd_ = -1;
+    return false;
+  }
+  path_       = path;
+  event_loop_ = event_loop;
+  if (!event_loop_->register_event(
+        &listen_evt_, listen_fd_, EPOLLIN,
+        [this](uint32_t mask) { on_accept(mask); })) {
+    std::cerr << "Failed to register metrics socket" << std::endl;
+    deinit();
+    return false;
+  }
+  return true;
+}
+
+void MetricsServer::deinit() {
+  while (!clients_.empty())
+    close_client(clients_.begin()->first);
+  if (listen_evt_)
+    event_loop_->deregister_event(listen_evt_);
+  listen_evt_ = nullptr;
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    unlink(path_.c_str());
+  }
+  listen_fd_ = -1;
+}
+
+void MetricsServer::on_accept(uint32_t) {
+  int fd;
+  while ((fd = accept4(listen_fd_, nullptr, nullptr,
+                       SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+    EpollEventLoop::EvtId evt = nullptr;
+    if (clients_.size() >= kMaxClients ||
+        !event_loop_->register_event(
+          &evt, fd, EPOLLIN | EPOLLRDHUP,
+          [this, fd](uint32_t mask) { on_client(fd, mask); })) {
+      close(fd);
+      continue;
+    }
+    clients_[fd] = evt;
+  }
+}
+
+void MetricsServer::on_client(int fd, uint32_t) {
+  char    request[512];
+  ssize_t n = read(fd, request, sizeof(request));
+  if (n < 0 && (errno == EAGAIN || errno == EINTR))
+    return;
+
+  std::string body = registry_.render();
+  std::string response;
+  if (n >= static_cast<ssize_t>(sizeof(kHttpGet) - 1) &&
+      memcmp(request, kHttpGet, sizeof(kHttpGet) - 1) == 0) {
+    response = "HTTP/1.0 200 OK\r\n"
+               "Content-Type: application/openmetrics-text; version=1.0.0; "
+               "charset=utf-8\r\n"
+               "Content-Length: " +
+               std::to_string(body.size()) + "\r\n\r\n";
+  }
+  response += body;
+
+  // The snapshot fits the socket buffer unless the client stops reading; a
+  // short wait bounds how long it can hold the loop
+  int flags = fcntl(fd, F_GETFL);
+  fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+  struct timeval timeout = {0, 100000};
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  size_t done = 0;
+  while (done < response.size()) {
+    ssize_t sent = send(fd, response.data() + done, response.size() - done,
+                        MSG_NOSIGNAL);
+    if (sent < 0 && errno == EINTR)
+      continue;
+    if (sent <= 0)
+      break;
+    done += static_cast<size_t>(sent);
+  }
+  close_client(fd);
+}
+
+void MetricsServer::close_client(int fd) {
+  auto it = clients_.find(fd);
+  if (it == clients_.end())
+    return;
+  event_loop_->deregister_event(it->second);
+  clients_.erase(it);
+  close(fd);
+}
@@ -0,0 +1,153 @@
+#include "socket_can/realtime.hpp"
+#include <alloca.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace {
+
+void add_error(RealtimeReport& report, const std::string& what) {
+  std::string message = what + ": " + std::strerror(errno);
+  std::cerr << "Realtime setup: " << message << std::endl;
+  report.errors.push_back(message);
+}
+
+// Grows the stack by `bytes` once so later calls find the pages resident
+__attribute__((noinline)) void prefault_stack(size_t bytes) {
+  volatile char* stack   = static_cast<volatile char*>(alloca(bytes));
+  long           page_sz = sysconf(_SC_PAGESIZE);
+  for (size_t i = 0; i < bytes; i += static_cast<size_t>(page_sz))
+    stack[i] = 0;
+}
+
+}  // namespace
+
+void prefault_region(void* data, size_t size) {
+  volatile char* p       = static_cast<volatile char*>(data);
+  size_t         page_sz = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  for (size_t i = 0; i < size; i += page_sz)
+    p[i] = p[i];
+  if (size)
+    p[size - 1] = p[size - 1];
+}
+
+RealtimeReport apply_realtime_config(const RealtimeConfig& config) {
+  RealtimeReport report;
+
+  if (!config.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : config.cpus)
+      CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc == 0) {
+      report.affinity_set = true;
+    } else {
+      errno = rc;
+      add_error(report, "pthread_setaffinity_np");
+    }
+  }
+
+  if (config.fifo_priority > 0) {
+    struct sched_param param = {};
+    param.sched_priority     = config.fifo_priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc == 0) {
+      report.scheduler_set = true;
+    } else {
+      errno = rc;
+      add_error(report, "SCHED_FIFO priority " +
+                          std::to_string(config.fifo_priority));
+    }
+  }
+
+  if (config.lock_memory) {
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+      report.memory_locked = true;
+    else
+      add_error(report, "mlockall");
+  }
+
+  if (config.stack_prefault_bytes) {
+    prefault_stack(config.stack_prefault_bytes);
+    report.prefaulted_bytes += config.stack_prefault_bytes;
+  }
+  return report;
+}
+
+RealtimeLoopRunner::RealtimeLoopRunner(EpollEventLoop* event_loop,
+                                       RealtimeConfig  config)
+  : event_loop_(event_loop), config_(std::move(config)) {
+}
+
+RealtimeLoopRunner::~RealtimeLoopRunner() {
+  stop();
+}
+
+void RealtimeLoopRunner::add_prefault_region(void* data, size_t size) {
+  regions_.push_back({data, size});
+}
+
+bool RealtimeLoopRunner::start() {
+  if (running_)
+    return false;
+  if (!wakeup_.init(event_loop_, [](uint32_t) {})) {
+    std::cerr << "Failed to create loop runner wakeup event" << std::endl;
+    return false;
+  }
+  stop_  = false;
+  ready_ = false;
+  dispatch_latency_.reset();
+  thread_ = std::thread(&RealtimeLoopRunner::thread_main, this);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  ready_cv_.wait(lock, [this] { return ready_; });
+  running_ = true;
+  if (config_.require_all && !report_.ok()) {
+    lock.unlock();
+    stop();
+    return false;
+  }
+  return true;
+}
+
+void RealtimeLoopRunner::stop() {
+  if (!running_)
+    return;
+  stop_ = true;
+  wakeup_.set();
+  if (thread_.joinable())
+    thread_.join();
+  event_loop_->set_dispatch_histogram(nullptr);
+  wakeup_.deinit();
+  running_ = false;
+}
+
+void RealtimeLoopRunner::thread_main() {
+  RealtimeReport report = apply_realtime_config(config_);
+  for (const Region& region : regions_) {
+    prefault_region(region.data, region.size);
+    report.prefaulted_bytes += region.size;
+  }
+  bool proceed = !config_.require_all || report.ok();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    report_ = std::move(report);
+    ready_  = true;
+  }
+  ready_cv_.notify_one();
+  if (!proceed)
+    return;
+
+  event_loop_->set_dispatch_histogram(&dispatch_latency_);
+  while (!stop_) {
+    if (event_loop_->run_once(-1) == -1) {
+      std::cerr << "Event loop failed" << std::endl;
+      break;
+    }
+  }
+}
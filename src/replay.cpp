@@ -0,0 +1,137 @@
+#include "socket_can/replay.hpp"
+#include <ctime>
+#include <iostream>
+
+namespace {
+
+constexpr uint64_t kMaxSleepNs      = 50000000;  // stay responsive to stop()
+constexpr int64_t  kLateThresholdNs = 100000;
+constexpr int      kSendRetries     = 100;
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+}  // namespace
+
+int64_t DeadlineScheduler::wait_until(uint64_t                 deadline_ns,
+                                      const std::atomic<bool>* cancel) {
+  uint64_t now = now_ns();
+  while (now + spin_ns_ < deadline_ns) {
+    if (cancel && cancel->load(std::memory_order_relaxed))
+      return -1;
+    uint64_t wake = deadline_ns - spin_ns_;
+    if (wake - now > kMaxSleepNs)
+      wake = now + kMaxSleepNs;
+    struct timespec ts = {static_cast<time_t>(wake / 1000000000ull),
+                          static_cast<long>(wake % 1000000000ull)};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+    now = now_ns();
+  }
+  while (now < deadline_ns) {
+    cpu_relax();
+    now = now_ns();
+  }
+  return static_cast<int64_t>(now - deadline_ns);
+}
+
+bool ReplayEngine::set_speed(double speed) {
+  if (speed != 0 && (speed < kMinSpeed || speed > kMaxSpeed)) {
+    std::cerr << "Replay speed must be 0 (as fast as possible) or within ["
+              << kMinSpeed << ", " << kMaxSpeed << "]" << std::endl;
+    return false;
+  }
+  speed_ = speed;
+  return true;
+}
+
+void ReplayEngine::map_channel(uint32_t channel, SocketCanIntf* output) {
+  if (outputs_.size() <= channel)
+    outputs_.resize(channel + 1, nullptr);
+  outputs_[channel] = output;
+}
+
+bool ReplayEngine::accepts(const can_frame& frame) const {
+  if (filters_.empty())
+    return true;
+  for (const can_filter& f : filters_) {
+    bool match = (frame.can_id & f.can_mask) ==
+                 (f.can_id & ~CAN_INV_FILTER & f.can_mask);
+    if (match != static_cast<bool>(f.can_id & CAN_INV_FILTER))
+      return true;
+  }
+  return false;
+}
+
+SocketCanIntf* ReplayEngine::output_for(uint32_t channel) const {
+  if (channel < outputs_.size() && outputs_[channel])
+    return outputs_[channel];
+  return default_output_;
+}
+
+bool ReplayEngine::send(SocketCanIntf* output, const can_frame& frame) {
+  // A full TX queue is back-pressure, not an error: wait for room and retry
+  for (int attempt = 0; attempt < kSendRetries; ++attempt) {
+    if (output->send_can_frame(frame))
+      return true;
+    if (stop_ || !output->wait_writable(10))
+      break;
+    // ENOBUFS leaves the socket writable while the device queue drains
+    struct timespec backoff = {0, 100000};
+    nanosleep(&backoff, nullptr);
+  }
+  return false;
+}
+
+bool ReplayEngine::run(FrameSource& source) {
+  stop_  = false;
+  stats_ = ReplayStats();
+
+  CaptureRecord record;
+  bool          started       = false;
+  uint64_t      first_ts      = 0;
+  uint64_t      start_mono_ns = 0;
+
+  while (!stop_ && source.next(record)) {
+    ++stats_.frames_read;
+    SocketCanIntf* output = output_for(record.channel);
+    if (!output || !accepts(record.frame)) {
+      ++stats_.frames_filtered;
+      continue;
+    }
+
+    if (!started) {
+      started       = true;
+      first_ts      = record.timestamp_ns;
+      start_mono_ns = DeadlineScheduler::now_ns();
+    }
+
+    if (speed_ > 0) {
+      // Deadlines are absolute, so per-frame overhead never accumulates
+      uint64_t offset = record.timestamp_ns > first_ts
+                          ? record.timestamp_ns - first_ts
+                          : 0;
+      uint64_t deadline =
+        start_mono_ns + static_cast<uint64_t>(static_cast<double>(offset) /
+                                              speed_);
+      int64_t late = scheduler_.wait_until(deadline, &stop_);
+      if (late < 0)
+        break;
+      stats_.sum_lateness_ns += static_cast<double>(late);
+      if (late > stats_.max_lateness_ns)
+        stats_.max_lateness_ns = late;
+      if (late > kLateThresholdNs)
+        ++stats_.late_frames;
+    }
+
+    if (send(output, record.frame))
+      ++stats_.frames_sent;
+    else
+      ++stats_.send_errors;
+  }
+  return stats_.send_errors == 0;
+}
@@ -0,0 +1,278 @@
+#include "socket_can/request_correlator.hpp"
+#include "socket_can/replay.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+RequestCorrelator::~RequestCorrelator() {
+  deinit();
+}
+
+bool RequestCorrelator::init(SocketCanIntf*            intf,
+                             EpollEventLoop*           event_loop,
+                             std::chrono::milliseconds tick) {
+  timerfd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd_ < 0) {
+    std::cerr << "Failed to create correlator timer" << std::endl;
+    return false;
+  }
+  if (!event_loop->register_event(&timer_evt_, timerfd_, EPOLLIN,
+                                  [this](uint32_t mask) { on_tick(mask); })) {
+    std::cerr << "Failed to register correlator timer" << std::endl;
+    close(timerfd_);
+    timerfd_ = -1;
+    return false;
+  }
+  intf_       = intf;
+  event_loop_ = event_loop;
+  tick_ns_    = static_cast<uint64_t>(std::max<int64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(tick).count(), 1));
+  base_ns_    = DeadlineScheduler::now_ns();
+  processed_  = 0;
+  wheel_.assign(kWheelSlots, List());
+  return true;
+}
+
+void RequestCorrelator::deinit() {
+  if (timerfd_ < 0)
+    return;
+  event_loop_->deregister_event(timer_evt_);
+  close(timerfd_);
+  timerfd_ = -1;
+  ticking_ = false;
+
+  // No further sends: pump() and submit() check intf_
+  intf_ = nullptr;
+  for (uint32_t index = 0; index < entries_.size(); ++index) {
+    if (entries_[index].state != State::kFree)
+      finish(index, Result::kCancelled, nullptr);
+  }
+  matches_.clear();
+  targets_.clear();
+}
+
+void RequestCorrelator::set_limit(canid_t target, size_t limit) {
+  canid_t key          = normalize(target);
+  targets_[key].limit  = limit;
+  if (intf_)
+    pump(key);
+}
+
+uint64_t RequestCorrelator::submit(Request request) {
+  if (!intf_) {
+    std::cerr << "RequestCorrelator not initialized" << std::endl;
+    return kInvalidId;
+  }
+  uint32_t index;
+  if (!free_.empty()) {
+    index = free_.back();
+    free_.pop_back();
+  } else {
+    index = static_cast<uint32_t>(entries_.size());
+    entries_.emplace_back();
+  }
+  Entry& entry    = entries_[index];
+  entry.state     = State::kQueued;
+  entry.target    = normalize(request.tx.can_id);
+  entry.match_key = match_key(request.response_id, request.key);
+  entry.request   = std::move(request);
+  uint64_t id     = make_id(index, entry.generation);
+
+  push(targets_[entry.target].queue, index);
+  ++queued_;
+  pump(entries_[index].target);
+  return id;
+}
+
+bool RequestCorrelator::cancel(uint64_t id) {
+  uint32_t index      = static_cast<uint32_t>(id) - 1;
+  uint32_t generation = static_cast<uint32_t>(id >> 32);
+  if (id == kInvalidId || index >= entries_.size() ||
+      entries_[index].state == State::kFree ||
+      entries_[index].generation != generation)
+    return false;
+  finish(index, Result::kCancelled, nullptr);
+  return true;
+}
+
+bool RequestCorrelator::on_frame(const can_frame& frame) {
+  if (!outstanding_)
+    return false;
+  uint32_t key = key_extractor_ ? key_extractor_(frame) : 0;
+  auto     it  = matches_.find(match_key(frame.can_id, key));
+  if (it == matches_.end())
+    return false;
+  finish(it->second.head, Result::kResponse, &frame);
+  return true;
+}
+
+void RequestCorrelator::push(List& list, uint32_t index) {
+  Entry& entry = entries_[index];
+  entry.prev   = list.tail;
+  entry.next   = kNone;
+  if (list.tail != kNone)
+    entries_[list.tail].next = index;
+  else
+    list.head = index;
+  list.tail = index;
+}
+
+void RequestCorrelator::remove(List& list, uint32_t index) {
+  Entry& entry = entries_[index];
+  if (entry.prev != kNone)
+    entries_[entry.prev].next = entry.next;
+  else
+    list.head = entry.next;
+  if (entry.next != kNone)
+    entries_[entry.next].prev = entry.prev;
+  else
+    list.tail = entry.prev;
+  entry.prev = entry.next = kNone;
+}
+
+void RequestCorrelator::wheel_insert(uint32_t index) {
+  Entry& entry     = entries_[index];
+  List&  slot      = wheel_[entry.deadline % kWheelSlots];
+  entry.wheel_prev = kNone;
+  entry.wheel_next = slot.head;
+  if (slot.head != kNone)
+    entries_[slot.head].wheel_prev = index;
+  else
+    slot.tail = index;
+  slot.head = index;
+}
+
+void RequestCorrelator::wheel_remove(uint32_t index) {
+  Entry& entry = entries_[index];
+  List&  slot  = wheel_[entry.deadline % kWheelSlots];
+  if (entry.wheel_prev != kNone)
+    entries_[entry.wheel_prev].wheel_next = entry.wheel_next;
+  else
+    slot.head = entry.wheel_next;
+  if (entry.wheel_next != kNone)
+    entries_[entry.wheel_next].wheel_prev = entry.wheel_prev;
+  else
+    slot.tail = entry.wheel_prev;
+  entry.wheel_prev = entry.wheel_next = kNone;
+}
+
+// Links an outstanding request into the indexes and sends it; false when
+// the send failed (the entry is still linked)
+bool RequestCorrelator::activate(uint32_t index) {
+  if (!ticking_)
+    start_ticking();
+  Entry& entry = entries_[index];
+  entry.state  = State::kOutstanding;
+  ++outstanding_;
+  ++targets_[entry.target].active;
+  push(matches_[entry.match_key], index);
+
+  uint64_t timeout_ns = static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      entry.request.timeout)
+      .count());
+  uint64_t elapsed = DeadlineScheduler::now_ns() - base_ns_;
+  entry.deadline   = std::max((elapsed + timeout_ns + tick_ns_ - 1) / tick_ns_,
+                              processed_ + 1);
+  wheel_insert(index);
+  return intf_->send_can_frame(entry.request.tx);
+}
+
+void RequestCorrelator::pump(canid_t target) {
+  while (intf_) {
+    // Handlers may add targets, so look it up again each round
+    Target& state = targets_[target];
+    if (state.queue.head == kNone || state.active >= limit_of(state))
+      return;
+    uint32_t index = state.queue.head;
+    remove(state.queue, index);
+    --queued_;
+    if (!activate(index))
+      finish(index, Result::kSendFailed, nullptr);
+  }
+}
+
+void RequestCorrelator::finish(uint32_t         index,
+                               Result           result,
+                               const can_frame* response) {
+  Entry&  entry   = entries_[index];
+  Handler handler = std::move(entry.request.handler);
+  canid_t target  = entry.target;
+  bool    active  = entry.state == State::kOutstanding;
+  if (active) {
+    auto it = matches_.find(entry.match_key);
+    remove(it->second, index);
+    if (it->second.head == kNone)
+      matches_.erase(it);
+    wheel_remove(index);
+    --outstanding_;
+    --targets_[target].active;
+  } else {
+    remove(targets_[target].queue, index);
+    --queued_;
+  }
+  entry.state   = State::kFree;
+  entry.request = Request();
+  ++entry.generation;
+  free_.push_back(index);
+  if (!outstanding_)
+    stop_ticking();
+
+  // A send failure inside pump() is finished by that pump()'s loop
+  if (active && result != Result::kSendFailed)
+    pump(target);
+  if (handler)
+    handler(result, response);
+}
+
+uint64_t RequestCorrelator::current_tick() const {
+  return (DeadlineScheduler::now_ns() - base_ns_) / tick_ns_;
+}
+
+void RequestCorrelator::start_ticking() {
+  processed_             = current_tick();
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec   = static_cast<time_t>(tick_ns_ / 1000000000ULL);
+  spec.it_value.tv_nsec  = static_cast<long>(tick_ns_ % 1000000000ULL);
+  spec.it_interval       = spec.it_value;
+  if (timerfd_settime(timerfd_, 0, &spec, nullptr) != 0)
+    std::cerr << "Failed to start correlator timer" << std::endl;
+  ticking_ = true;
+}
+
+void RequestCorrelator::stop_ticking() {
+  if (!ticking_ || timerfd_ < 0)
+    return;
+  struct itimerspec spec = {};
+  timerfd_settime(timerfd_, 0, &spec, nullptr);
+  ticking_ = false;
+}
+
+void RequestCorrelator::on_tick(uint32_t) {
+  uint64_t expirations;
+  while (read(timerfd_, &expirations, sizeof(expirations)) > 0) {
+  }
+  uint64_t now = current_tick();
+  if (!ticking_ || now <= processed_)
+    return;
+
+  // Collect the batch first; handlers may submit, cancel or reuse entries
+  expired_.clear();
+  uint64_t slots = std::min<uint64_t>(now - processed_, kWheelSlots);
+  for (uint64_t i = 1; i <= slots; ++i) {
+    const List& slot = wheel_[(processed_ + i) % kWheelSlots];
+    for (uint32_t index = slot.head; index != kNone;
+         index          = entries_[index].wheel_next) {
+      if (entries_[index].deadline <= now)
+        expired_.push_back(make_id(index, entries_[index].generation));
+    }
+  }
+  processed_ = now;
+  for (uint64_t id : expired_) {
+    uint32_t index = static_cast<uint32_t>(id) - 1;
+    if (entries_[index].state == State::kOutstanding &&
+        entries_[index].generation == static_cast<uint32_t>(id >> 32))
+      finish(index, Result::kTimeout, nullptr);
+  }
+}
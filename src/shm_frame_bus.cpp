@@ -0,0 +1,298 @@
+#include "socket_can/shm_frame_bus.hpp"
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <iostream>
+#include <linux/futex.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kWaiterTimeoutMs = 100;
+
+// Shared (not FUTEX_PRIVATE) operations: the word lives in a segment mapped by
+// several processes
+void futex_wait(std::atomic<uint32_t>* word,
+                uint32_t               expected,
+                int                    timeout_ms) {
+  struct timespec timeout = {timeout_ms / 1000,
+                             (timeout_ms % 1000) * 1000000L};
+  syscall(SYS_futex,
+          reinterpret_cast<uint32_t*>(word),
+          FUTEX_WAIT,
+          expected,
+          &timeout,
+          nullptr,
+          0);
+}
+
+void futex_wake_all(std::atomic<uint32_t>* word) {
+  syscall(SYS_futex,
+          reinterpret_cast<uint32_t*>(word),
+          FUTEX_WAKE,
+          INT_MAX,
+          nullptr,
+          nullptr,
+          0);
+}
+
+size_t bus_size(uint64_t slot_count) {
+  return sizeof(ShmBusHeader) + slot_count * sizeof(ShmBusSlot);
+}
+
+}  // namespace
+
+std::string shm_bus_path(const std::string& name) {
+  return "/socket_can." + name;
+}
+
+ShmFramePublisher::~ShmFramePublisher() {
+  close();
+}
+
+bool ShmFramePublisher::open(const std::string& name, size_t slot_count) {
+  close();
+  size_t capacity = 2;
+  while (capacity < slot_count)
+    capacity <<= 1;
+
+  path_ = shm_bus_path(name);
+  shm_unlink(path_.c_str());
+  int fd = shm_open(path_.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+  if (fd < 0) {
+    std::cerr << "Failed to create shared memory " << path_ << std::endl;
+    return false;
+  }
+  size_t size = bus_size(capacity);
+  if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+    std::cerr << "Failed to size shared memory " << path_ << std::endl;
+    ::close(fd);
+    shm_unlink(path_.c_str());
+    return false;
+  }
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    std::cerr << "Failed to map shared memory " << path_ << std::endl;
+    shm_unlink(path_.c_str());
+    return false;
+  }
+
+  // ftruncate() zero-filled the segment, so every slot sequence starts at 0
+  header_             = new (mem) ShmBusHeader();
+  header_->version    = ShmBusHeader::kVersion;
+  header_->slot_size  = sizeof(ShmBusSlot);
+  header_->slot_count = capacity;
+  header_->head.store(0, std::memory_order_relaxed);
+  header_->wake_seq.store(0, std::memory_order_relaxed);
+  header_->waiters.store(0, std::memory_order_relaxed);
+  slots_ = reinterpret_cast<ShmBusSlot*>(header_ + 1);
+  size_  = size;
+  mask_  = capacity - 1;
+  std::atomic_thread_fence(std::memory_order_release);
+  std::memcpy(header_->magic, ShmBusHeader::kMagic, sizeof(header_->magic));
+  return true;
+}
+
+void ShmFramePublisher::close() {
+  if (!header_)
+    return;
+  munmap(header_, size_);
+  shm_unlink(path_.c_str());
+  header_ = nullptr;
+  slots_  = nullptr;
+}
+
+bool ShmFramePublisher::publish(const can_frame& frame) {
+  if (!header_)
+    return false;
+  uint64_t    pos  = header_->head.load(std::memory_order_relaxed);
+  ShmBusSlot& slot = slots_[pos & mask_];
+  slot.seq.store(2 * pos + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.frame = frame;
+  slot.seq.store(2 * pos + 2, std::memory_order_release);
+  header_->head.store(pos + 1, std::memory_order_seq_cst);
+
+  // Pairs with the waiters increment and head re-check in the subscriber
+  if (header_->waiters.load(std::memory_order_seq_cst) != 0) {
+    header_->wake_seq.fetch_add(1, std::memory_order_release);
+    futex_wake_all(&header_->wake_seq);
+  }
+  return true;
+}
+
+uint64_t ShmFramePublisher::published() const {
+  return header_ ? header_->head.load(std::memory_order_acquire) : 0;
+}
+
+ShmFrameSubscriber::~ShmFrameSubscriber() {
+  deinit();
+}
+
+bool ShmFrameSubscriber::attach(const std::string& name) {
+  std::string path = shm_bus_path(name);
+  int         fd   = shm_open(path.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    std::cerr << "Frame bus " << path << " does not exist" << std::endl;
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 ||
+      static_cast<size_t>(st.st_size) < sizeof(ShmBusHeader)) {
+    std::cerr << "Frame bus " << path << " is not initialized" << std::endl;
+    ::close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(st.st_size);
+  // Writable because waiting registers in the header
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    std::cerr << "Failed to map frame bus " << path << std::endl;
+    return false;
+  }
+
+  ShmBusHeader* header = static_cast<ShmBusHeader*>(mem);
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (std::memcmp(header->magic, ShmBusHeader::kMagic, 8) != 0 ||
+      header->version != ShmBusHeader::kVersion ||
+      header->slot_size != sizeof(ShmBusSlot) ||
+      bus_size(header->slot_count) != size ||
+      (header->slot_count & (header->slot_count - 1)) != 0) {
+    std::cerr << "Frame bus " << path << " has an unsupported layout"
+              << std::endl;
+    munmap(mem, size);
+    return false;
+  }
+
+  header_ = header;
+  slots_  = reinterpret_cast<ShmBusSlot*>(header_ + 1);
+  size_   = size;
+  mask_   = header->slot_count - 1;
+  cursor_ = header_->head.load(std::memory_order_acquire);
+  delivered_.store(cursor_, std::memory_order_release);
+  return true;
+}
+
+void ShmFrameSubscriber::detach() {
+  if (!header_)
+    return;
+  munmap(header_, size_);
+  header_ = nullptr;
+  slots_  = nullptr;
+}
+
+bool ShmFrameSubscriber::init(const std::string& name,
+                              EpollEventLoop*    event_loop,
+                              FrameProcessor     frame_processor) {
+  deinit();
+  frame_processor_ = std::move(frame_processor);
+  if (!attach(name))
+    return false;
+  if (!event_.init(event_loop, [this](uint32_t mask) { on_event(mask); })) {
+    detach();
+    return false;
+  }
+  stopping_ = false;
+  notified_ = false;
+  thread_   = std::thread(&ShmFrameSubscriber::waiter, this);
+  return true;
+}
+
+void ShmFrameSubscriber::deinit() {
+  if (!header_)
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  drained_cv_.notify_one();
+  header_->wake_seq.fetch_add(1, std::memory_order_release);
+  futex_wake_all(&header_->wake_seq);
+  if (thread_.joinable())
+    thread_.join();
+  event_.deinit();
+  detach();
+}
+
+void ShmFrameSubscriber::on_event(uint32_t) {
+  drain();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    notified_ = false;
+  }
+  drained_cv_.notify_one();
+}
+
+void ShmFrameSubscriber::drain() {
+  can_frame frame;
+  for (;;) {
+    const ShmBusSlot& slot     = slots_[cursor_ & mask_];
+    uint64_t          expected = 2 * cursor_ + 2;
+    uint64_t          seq      = slot.seq.load(std::memory_order_acquire);
+    if (seq == expected) {
+      // 16-byte copy so a concurrent overwrite can be detected before the
+      // frame is handed out
+      frame = slot.frame;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) == expected) {
+        ++cursor_;
+        ++received_;
+        frame_processor_(frame);
+        continue;
+      }
+    } else if (seq < expected) {
+      break;
+    }
+
+    // Lapped: resume from the oldest slot; if the publisher is still in the
+    // middle of overwriting it, retry on the next notification
+    uint64_t head     = header_->head.load(std::memory_order_acquire);
+    uint64_t capacity = mask_ + 1;
+    uint64_t oldest   = head > capacity ? head - capacity : 0;
+    if (oldest <= cursor_)
+      break;
+    overruns_ += oldest - cursor_;
+    cursor_ = oldest;
+  }
+  delivered_.store(cursor_, std::memory_order_release);
+}
+
+void ShmFrameSubscriber::waiter() {
+  for (;;) {
+    {
+      // Wait until the loop has drained the previous notification
+      std::unique_lock<std::mutex> lock(mutex_);
+      drained_cv_.wait(lock, [this] { return !notified_ || stopping_; });
+      if (stopping_)
+        return;
+    }
+
+    uint32_t seq = header_->wake_seq.load(std::memory_order_acquire);
+    if (header_->head.load(std::memory_order_acquire) ==
+        delivered_.load(std::memory_order_acquire)) {
+      header_->waiters.fetch_add(1, std::memory_order_seq_cst);
+      if (header_->head.load(std::memory_order_seq_cst) ==
+          delivered_.load(std::memory_order_acquire))
+        futex_wait(&header_->wake_seq, seq, kWaiterTimeoutMs);
+      header_->waiters.fetch_sub(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      notified_ = true;
+    }
+    if (!event_.set()) {
+      std::cerr << "Failed to signal frame bus subscriber" << std::endl;
+      return;
+    }
+  }
+}
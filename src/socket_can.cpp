@@ -1,105 +1,244 @@
 #include "socket_can/socket_can.hpp"
-#include <unistd.h>
+#include <cerrno>
 #include <cstring>
+#include <ctime>
 #include <iostream>
-#include <sys/socket.h>
-#include <sys/uio.h>
-#include <sys/types.h>
-#include <linux/can.h>
-#include <linux/can/raw.h>
-#include <cerrno>
-#include <net/if.h>
+#include <linux/sockios.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
+
+namespace {
+
+uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+}  // namespace
 
 bool SocketCanIntf::init(const std::string& interface,
                          EpollEventLoop*    event_loop,
                          FrameProcessor     frame_processor) {
-  interface_       = interface;
-  event_loop_      = event_loop;
-  frame_processor_ = std::move(frame_processor);
-  socket_id_       = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
-  if (socket_id_ == -1) {
-    std::cerr << "Failed to create socket" << std::endl;
+  std::unique_ptr<CanTransport> transport = make_can_transport(interface);
+  if (!transport->open(interface))
     return false;
-  }
+  return init(std::move(transport), event_loop, std::move(frame_processor));
+}
 
-  struct ifreq ifr;
-  std::strcpy(ifr.ifr_name, interface_.c_str());
-  if (ioctl(socket_id_, SIOCGIFINDEX, &ifr) == -1) {
-    std::cerr << "Failed to get interface index" << std::endl;
-    close(socket_id_);
-    return false;
-  }
+bool SocketCanIntf::init(std::unique_ptr<CanTransport> transport,
+                         EpollEventLoop*               event_loop,
+                         FrameProcessor                frame_processor) {
+  transport_       = std::move(transport);
+  interface_       = transport_->name();
+  event_loop_      = event_loop;
+  frame_processor_ = std::move(frame_processor);
+  broken_          = false;
+  down_            = false;
+  register_metrics();
 
-  struct sockaddr_can addr;
-  std::memset(&addr, 0, sizeof(addr));
-  addr.can_family  = AF_CAN;
-  addr.can_ifindex = ifr.ifr_ifindex;
-  if (bind(socket_id_,
-           reinterpret_cast<struct sockaddr*>(&addr),
-           sizeof(addr)) == -1) {
-    std::cerr << "Failed to bind socket" << std::endl;
-    close(socket_id_);
+  if (!register_socket()) {
+    release_metrics();
+    transport_->close();
+    transport_.reset();
     return false;
   }
 
-  struct msghdr message = {.msg_name       = nullptr,
-                           .msg_namelen    = 0,
-                           .msg_iov        = nullptr,
-                           .msg_iovlen     = 0,
-                           .msg_control    = nullptr,
-                           .msg_controllen = 0,
-                           .msg_flags      = 0};
-
-  int retcode = recvmsg(socket_id_, &message, 0);
-  if (retcode < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
-    close(socket_id_);
-    socket_id_ = 0;
-    return false;
-  }
+  return true;
+}
 
+bool SocketCanIntf::register_socket() {
   if (!event_loop_->register_event(
-        &socket_evt_id_, socket_id_, EPOLLIN, [this](uint32_t mask) {
+        &socket_evt_id_, transport_->fd(), EPOLLIN, [this](uint32_t mask) {
           on_socket_event(mask);
         })) {
     std::cerr << "Failed to register socket with event loop" << std::endl;
-    close(socket_id_);
-    socket_id_ = 0;
     return false;
   }
-
   return true;
 }
 
 void SocketCanIntf::deinit() {
-  if (!broken_) {
+  if (link_monitor_) {
+    link_monitor_->remove_handler(link_handler_);
+    link_monitor_ = nullptr;
+  }
+  if (!transport_)
+    return;
+  if (!broken_ && !down_) {
     event_loop_->deregister_event(socket_evt_id_);
   }
-  close(socket_id_);
+  release_metrics();
+  transport_->close();
   broken_ = true;
 }
 
+bool SocketCanIntf::set_filters(const std::vector<can_filter>& filters) {
+  filters_ = filters;
+  return !transport_ || down_ ||
+         transport_->set_filters(filters_.data(), filters_.size());
+}
+
+bool SocketCanIntf::set_error_handler(ErrorHandler   handler,
+                                      can_err_mask_t mask) {
+  error_handler_ = std::move(handler);
+  error_mask_    = mask;
+  return !transport_ || down_ || transport_->set_error_mask(error_mask_);
+}
+
+bool SocketCanIntf::apply_socket_options() {
+  bool ok = true;
+  if (!filters_.empty())
+    ok = transport_->set_filters(filters_.data(), filters_.size()) && ok;
+  if (error_mask_)
+    ok = transport_->set_error_mask(error_mask_) && ok;
+  return ok;
+}
+
+void SocketCanIntf::enable_recovery(LinkMonitor* monitor,
+                                    bool         restart_bus_off) {
+  if (link_monitor_)
+    link_monitor_->remove_handler(link_handler_);
+  link_monitor_    = monitor;
+  restart_bus_off_ = restart_bus_off;
+  link_handler_    = monitor->add_handler(
+    [this](const LinkEvent& event) { on_link_event(event); });
+}
+
+void SocketCanIntf::on_link_event(const LinkEvent& event) {
+  if (broken_ || event.name != interface_)
+    return;
+  if (event.removed || !event.up) {
+    link_lost(event.removed ? "removed" : "down");
+  } else if (down_) {
+    reopen();
+  }
+}
+
+void SocketCanIntf::link_lost(const char* reason) {
+  if (down_)
+    return;
+  std::cerr << interface_ << " " << reason << ", waiting for it to come back"
+            << std::endl;
+  down_    = true;
+  down_ns_ = monotonic_ns();
+  metrics_.link_up->set(0);
+  event_loop_->deregister_event(socket_evt_id_);
+  release_metrics();
+  transport_->close();
+}
+
+bool SocketCanIntf::reopen() {
+  if (!transport_->open(interface_))
+    return false;
+  if (!register_socket()) {
+    transport_->close();
+    return false;
+  }
+  down_ = false;
+  apply_socket_options();
+  register_queue_metrics();
+  metrics_.link_up->set(1);
+
+  uint64_t downtime = monotonic_ns() - down_ns_;
+  metrics_.link_recoveries->inc();
+  metrics_.link_downtime->observe(downtime);
+  std::cerr << interface_ << " recovered after " << downtime / 1000000.0
+            << " ms" << std::endl;
+  return true;
+}
+
 bool SocketCanIntf::send_can_frame(const can_frame& frame) {
-  ssize_t nbytes = write(socket_id_, &frame, sizeof(frame));
-  if (nbytes == -1) {
+  if (down_) {
+    errno = ENETDOWN;
+    return false;
+  }
+  if (!transport_) {
     std::cerr << "Failed to send CAN frame" << std::endl;
     return false;
   }
+  if (!transport_->send(frame)) {
+    // A full TX queue is back-pressure the caller handles with wait_writable()
+    if (errno == EAGAIN || errno == ENOBUFS) {
+      metrics_.tx_queue_full->inc();
+    } else {
+      metrics_.errors->inc();
+      std::cerr << "Failed to send CAN frame" << std::endl;
+    }
+    return false;
+  }
 
+  metrics_.tx_frames->inc();
   return true;
 }
 
+size_t SocketCanIntf::send_can_frames(const can_frame* frames, size_t count) {
+  if (down_ || !transport_ || count == 0)
+    return 0;
+  ssize_t n_sent = transport_->send_batch(frames, count);
+  if (n_sent < 0) {
+    metrics_.errors->inc();
+    std::cerr << "Failed to send CAN frames" << std::endl;
+    return 0;
+  }
+  if (static_cast<size_t>(n_sent) < count)
+    metrics_.tx_queue_full->inc();
+  metrics_.tx_frames->inc(static_cast<uint64_t>(n_sent));
+  return static_cast<size_t>(n_sent);
+}
+
+bool SocketCanIntf::wait_writable(int timeout_ms) {
+  return transport_ && transport_->wait_writable(timeout_ms);
+}
+
 void SocketCanIntf::on_socket_event(uint32_t mask) {
   if (mask & EPOLLIN) {
-    while (read_nonblocking() && !broken_)
-      ;
+    can_frame frames[kReadBatch];
+    ssize_t   n;
+    do {
+      uint64_t error_frames = 0;
+      if (frame_pool_) {
+        n = receive_pooled(kReadBatch, error_frames);
+      } else {
+        n = transport_->receive_batch(frames, kReadBatch);
+        for (ssize_t i = 0; i < n && !broken_; ++i) {
+          error_frames += (frames[i].can_id & CAN_ERR_FLAG) != 0;
+          process_can_frame(frames[i]);
+        }
+      }
+      if (n < 0) {
+        metrics_.errors->inc();
+        break;
+      }
+      metrics_.rx_frames->inc(static_cast<uint64_t>(n));
+      if (error_frames)
+        metrics_.rx_error_frames->inc(error_frames);
+      if (n > 0 && batch_end_handler_ && !broken_)
+        batch_end_handler_();
+    } while (n == static_cast<ssize_t>(kReadBatch) && !broken_);
   }
-  if (mask & EPOLLERR) {
+  if (broken_)
+    return;
+  if (mask & (EPOLLERR | EPOLLHUP)) {
+    metrics_.errors->inc();
+    // Only kernel interfaces come back with a link event
+    if (link_monitor_ && transport_->has_link_state()) {
+      int       error  = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(transport_->fd(), SOL_SOCKET, SO_ERROR, &error, &length);
+      link_lost(error ? strerror(error) : "hung up");
+      // Not a link change, or one already undone: no link event will follow.
+      // Binding succeeds on a down interface too, so check before re-opening.
+      if (LinkMonitor::is_up(interface_))
+        reopen();
+      return;
+    }
     std::cerr << "interface disappeared" << std::endl;
     deinit();
     return;
   }
-  if (mask & ~(EPOLLIN | EPOLLERR)) {
+  if (mask & ~(EPOLLIN | EPOLLERR | EPOLLHUP)) {
     std::cerr << "unexpected event " << mask << std::endl;
     deinit();
     return;
@@ -107,35 +246,147 @@ void SocketCanIntf::on_socket_event(uint32_t mask) {
   return;
 }
 
-bool SocketCanIntf::read_nonblocking() {
-  struct can_frame frame;
-  struct cmsghdr   ctrlmsg;
-
-  struct iovec  vec     = {.iov_base = &frame, .iov_len = sizeof(frame)};
-  struct msghdr message = {.msg_name       = nullptr,
-                           .msg_namelen    = 0,
-                           .msg_iov        = &vec,
-                           .msg_iovlen     = 1,
-                           .msg_control    = &ctrlmsg,
-                           .msg_controllen = sizeof(ctrlmsg),
-                           .msg_flags      = 0};
-
-  ssize_t n_received = recvmsg(socket_id_, &message, MSG_DONTWAIT);
-  if (n_received < 0) {
-    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-      // std::cerr << "no message received" << std::endl;
-      return false;
+void SocketCanIntf::on_error_frame(const can_frame& frame) {
+  CanErrorInfo info;
+  decode_can_error(frame, info);
+  if (error_tracker_.update(info)) {
+    CanControllerState state = error_tracker_.state();
+    metrics_.controller_state->set(static_cast<int64_t>(state));
+    if (state == CanControllerState::kBusOff) {
+      bus_off_ns_ = monotonic_ns();
+      metrics_.bus_off->inc();
+      if (restart_bus_off_ && link_monitor_ &&
+          transport_->has_link_state())
+        link_monitor_->request_can_restart(interface_);
+    } else if (bus_off_ns_) {
+      metrics_.bus_off_recoveries->inc();
+      metrics_.bus_off_downtime->observe(monotonic_ns() - bus_off_ns_);
+      bus_off_ns_ = 0;
+    }
+  }
+  if (error_handler_)
+    error_handler_(info);
+}
+
+ssize_t SocketCanIntf::receive_pooled(size_t max, uint64_t& error_frames) {
+  FrameRef   refs[kReadBatch];
+  can_frame  scratch[kReadBatch];
+  can_frame* buffers[kReadBatch];
+  size_t     n_slots = frame_pool_->take(refs, max);
+  for (size_t i = 0; i < max; ++i)
+    buffers[i] = i < n_slots ? refs[i].data() : &scratch[i];
+
+  ssize_t  n       = transport_->receive_scatter(buffers, max);
+  uint64_t dropped = 0;
+  for (ssize_t i = 0; i < n && !broken_; ++i) {
+    const can_frame& frame = *buffers[i];
+    if (frame.can_id & CAN_ERR_FLAG) {
+      error_frames++;
+      on_error_frame(frame);
+    } else if (static_cast<size_t>(i) < n_slots) {
+      pooled_processor_(refs[i]);
     } else {
-      std::cerr << "Socket read failed: " << std::endl;
-      return false;
+      dropped++;
     }
   }
+  if (dropped)
+    frame_pool_->count_dropped(dropped);
+  // Slots nobody kept go back to the free list here
+  return n;
+}
 
-  if (n_received < static_cast<ssize_t>(sizeof(struct can_frame))) {
-    std::cerr << "invalid message length " << n_received << std::endl;
+bool SocketCanIntf::read_nonblocking() {
+  if (down_ || !transport_)
+    return false;
+  if (frame_pool_) {
+    uint64_t error_frames = 0;
+    if (receive_pooled(1, error_frames) != 1)
+      return false;
+    metrics_.rx_frames->inc();
+    if (error_frames)
+      metrics_.rx_error_frames->inc();
     return true;
   }
+  can_frame frame;
+  if (transport_->receive(frame) != 1)
+    return false;
 
+  metrics_.rx_frames->inc();
   process_can_frame(frame);
   return true;
-}
\ No newline at end of file
+}
+
+void SocketCanIntf::register_metrics() {
+  MetricsRegistry& registry = MetricsRegistry::global();
+  MetricLabels     labels   = {
+    {"interface", interface_.empty() ? "unnamed" : interface_}};
+  metrics_.rx_frames =
+    registry.counter("socket_can_rx_frames", "Frames received", labels);
+  metrics_.rx_error_frames = registry.counter(
+    "socket_can_rx_error_frames", "Error frames received", labels);
+  metrics_.tx_frames =
+    registry.counter("socket_can_tx_frames", "Frames sent", labels);
+  metrics_.tx_queue_full = registry.counter(
+    "socket_can_tx_queue_full",
+    "Sends refused because the socket TX queue was full", labels);
+  metrics_.errors = registry.counter(
+    "socket_can_errors", "Socket read, send and interface errors", labels);
+  metrics_.controller_state = registry.gauge(
+    "socket_can_controller_state",
+    "0 error-active, 1 error-warning, 2 error-passive, 3 bus-off", labels);
+  metrics_.controller_state->set(
+    static_cast<int64_t>(error_tracker_.state()));
+  metrics_.link_up = registry.gauge(
+    "socket_can_link_up", "1 while the socket is open on a live link", labels);
+  metrics_.link_up->set(1);
+  metrics_.bus_off = registry.counter(
+    "socket_can_bus_off", "Times the controller went bus-off", labels);
+
+  MetricLabels link = labels, bus_off = labels;
+  link.push_back({"kind", "link"});
+  bus_off.push_back({"kind", "bus_off"});
+  metrics_.link_recoveries = registry.counter(
+    "socket_can_recoveries", "Recoveries from link loss or bus-off", link);
+  metrics_.bus_off_recoveries = registry.counter(
+    "socket_can_recoveries", "Recoveries from link loss or bus-off", bus_off);
+  // 1 ms to 68 s
+  metrics_.link_downtime = registry.histogram(
+    "socket_can_downtime_seconds", "Time until a recovery", link, 20, 36,
+    1e-9);
+  metrics_.bus_off_downtime = registry.histogram(
+    "socket_can_downtime_seconds", "Time until a recovery", bus_off, 20, 36,
+    1e-9);
+
+  register_queue_metrics();
+}
+
+void SocketCanIntf::register_queue_metrics() {
+  MetricsRegistry& registry = MetricsRegistry::global();
+  MetricLabels     labels   = {
+    {"interface", interface_.empty() ? "unnamed" : interface_}};
+  // Read on the scraping thread; release_metrics() disables them before the
+  // transport closes
+  CanTransport* transport = transport_.get();
+  auto queued = [transport](unsigned long request, double& value) {
+    int bytes = 0;
+    if (ioctl(transport->fd(), request, &bytes) != 0)
+      return false;  // not supported by every socket family
+    value = bytes;
+    return true;
+  };
+  metrics_.queues = {
+    registry.callback("socket_can_rx_queue_bytes",
+                      "Bytes waiting in the socket receive queue",
+                      MetricsRegistry::Type::kGauge, labels,
+                      [queued](double& v) { return queued(SIOCINQ, v); }),
+    registry.callback("socket_can_tx_queue_bytes",
+                      "Bytes queued in the socket send buffer",
+                      MetricsRegistry::Type::kGauge, labels,
+                      [queued](double& v) { return queued(SIOCOUTQ, v); })};
+}
+
+void SocketCanIntf::release_metrics() {
+  for (const auto& queue : metrics_.queues)
+    queue->reset();
+  metrics_.queues.clear();
+}
@@ -0,0 +1,276 @@
+#include "socket_can/traffic_generator.hpp"
+#include "socket_can/can_bit_timing.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// "123" is a standard ID, "12345678" an extended one
+bool parse_id(const std::string& token, canid_t* id) {
+  if (token.empty() || token.size() > 8)
+    return false;
+  char*         end;
+  unsigned long v = std::strtoul(token.c_str(), &end, 16);
+  if (*end != '\0')
+    return false;
+  if (token.size() > 3)
+    *id = static_cast<canid_t>(v & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  else if (v <= CAN_SFF_MASK)
+    *id = static_cast<canid_t>(v);
+  else
+    return false;
+  return true;
+}
+
+bool parse_range(const std::string& token, std::string* lo, std::string* hi) {
+  size_t dash = token.find('-');
+  *lo         = token.substr(0, dash);
+  *hi         = dash == std::string::npos ? *lo : token.substr(dash + 1);
+  return !lo->empty() && !hi->empty();
+}
+
+bool parse_dlc(const std::string& token, uint8_t* dlc) {
+  char*         end;
+  unsigned long v = std::strtoul(token.c_str(), &end, 10);
+  if (token.empty() || *end != '\0' || v > CAN_MAX_DLEN)
+    return false;
+  *dlc = static_cast<uint8_t>(v);
+  return true;
+}
+
+bool parse_positive(const std::string& token, double* value) {
+  char*  end;
+  double v = std::strtod(token.c_str(), &end);
+  if (token.empty() || *end != '\0' || !(v > 0))
+    return false;
+  *value = v;
+  return true;
+}
+
+// Whole number of frames, at least one
+bool parse_count(const std::string& token, uint32_t* count) {
+  char*         end;
+  unsigned long v = std::strtoul(token.c_str(), &end, 10);
+  if (token.empty() || token[0] == '-' || *end != '\0' || v == 0 ||
+      v > UINT32_MAX)
+    return false;
+  *count = static_cast<uint32_t>(v);
+  return true;
+}
+
+}  // namespace
+
+double TrafficSource::frames_per_second() const {
+  double per_interval = kind == kBurst ? burst_frames : 1;
+  return per_interval * 1000.0 / interval_ms;
+}
+
+double TrafficSource::bits_per_frame() const {
+  can_frame frame = {};
+  frame.can_id    = id;
+  if (kind != kRandom) {
+    frame.can_dlc = dlc;
+    return can_frame_bits_worst_case(frame);
+  }
+  // Random DLCs are uniform over [dlc, dlc_max]
+  double total = 0;
+  for (uint32_t d = dlc; d <= dlc_max; ++d) {
+    frame.can_dlc = static_cast<uint8_t>(d);
+    total += can_frame_bits_worst_case(frame);
+  }
+  return total / (dlc_max - dlc + 1);
+}
+
+bool TrafficProfile::parse(std::istream& in) {
+  std::string line;
+  int         line_number = 0;
+  while (std::getline(in, line)) {
+    line_number++;
+    size_t hash = line.find('#');
+    if (hash != std::string::npos)
+      line.erase(hash);
+    std::istringstream       tokens(line);
+    std::vector<std::string> t;
+    std::string              token;
+    while (tokens >> token)
+      t.push_back(token);
+    if (t.empty())
+      continue;
+
+    bool          ok = false;
+    TrafficSource source;
+    if (t[0] == "bitrate" && t.size() == 2) {
+      double v;
+      ok = parse_positive(t[1], &v) && v <= 10000000;
+      if (ok)
+        bitrate = static_cast<uint32_t>(v);
+    } else if (t[0] == "load" && t.size() == 2) {
+      char* end;
+      load = std::strtod(t[1].c_str(), &end);
+      ok   = *end == '\0' && load >= 0 && load <= 100;
+    } else if (t[0] == "periodic" && t.size() == 4) {
+      source.kind = TrafficSource::kPeriodic;
+      ok = parse_id(t[1], &source.id) && parse_dlc(t[2], &source.dlc) &&
+           parse_positive(t[3], &source.interval_ms);
+    } else if (t[0] == "burst" && t.size() == 5) {
+      source.kind = TrafficSource::kBurst;
+      ok = parse_id(t[1], &source.id) && parse_dlc(t[2], &source.dlc) &&
+           parse_count(t[3], &source.burst_frames) &&
+           parse_positive(t[4], &source.interval_ms);
+    } else if (t[0] == "random" && t.size() == 4) {
+      std::string lo, hi, dlc_lo, dlc_hi;
+      source.kind = TrafficSource::kRandom;
+      ok = parse_range(t[1], &lo, &hi) && parse_id(lo, &source.id) &&
+           parse_id(hi, &source.id_max) &&
+           (source.id & CAN_EFF_FLAG) == (source.id_max & CAN_EFF_FLAG) &&
+           source.id <= source.id_max &&
+           parse_range(t[2], &dlc_lo, &dlc_hi) &&
+           parse_dlc(dlc_lo, &source.dlc) &&
+           parse_dlc(dlc_hi, &source.dlc_max) &&
+           source.dlc <= source.dlc_max &&
+           parse_positive(t[3], &source.interval_ms);
+    }
+    if (!ok) {
+      std::cerr << "Invalid traffic profile line " << line_number << ": "
+                << line << std::endl;
+      return false;
+    }
+    if (t[0] != "bitrate" && t[0] != "load")
+      sources.push_back(source);
+  }
+  if (sources.empty()) {
+    std::cerr << "Traffic profile has no sources" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool TrafficProfile::load_file(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "Cannot open traffic profile " << path << std::endl;
+    return false;
+  }
+  return parse(in);
+}
+
+double TrafficProfile::offered_bits_per_second() const {
+  double bits = 0;
+  for (const TrafficSource& source : sources)
+    bits += source.frames_per_second() * source.bits_per_frame();
+  return bits;
+}
+
+TrafficProfile TrafficProfile::default_mix() {
+  std::istringstream in("periodic 0C0 8 10\n"
+                        "periodic 0F0 8 10\n"
+                        "periodic 1A0 6 20\n"
+                        "periodic 2B0 8 50\n"
+                        "periodic 3C0 4 100\n"
+                        "periodic 18FEF100 8 100\n"
+                        "burst 7E8 8 16 500\n"
+                        "random 600-6FF 0-8 20\n");
+  TrafficProfile     profile;
+  profile.parse(in);
+  return profile;
+}
+
+TrafficGenerator::TrafficGenerator(const TrafficProfile& profile, uint64_t seed)
+  : rng_state_(seed ? seed : 1) {
+  double offered = profile.offered_bits_per_second();
+  if (profile.load > 0 && profile.bitrate && offered > 0)
+    scale_ = profile.load / 100.0 * profile.bitrate / offered;
+
+  sources_.reserve(profile.sources.size());
+  heap_.reserve(profile.sources.size());
+  for (const TrafficSource& config : profile.sources) {
+    Source source;
+    source.config      = config;
+    source.interval_ns = std::max<uint64_t>(
+      1, static_cast<uint64_t>(config.interval_ms * 1e6 / scale_));
+    sources_.push_back(source);
+  }
+}
+
+void TrafficGenerator::start(uint64_t now_ns) {
+  heap_.clear();
+  for (uint32_t i = 0; i < sources_.size(); ++i) {
+    Source& source = sources_[i];
+    // Spread periodic phases so sources with equal periods do not collide
+    uint64_t offset = source.config.kind == TrafficSource::kPeriodic
+                        ? random_u64() % source.interval_ns
+                        : random_interval(source.interval_ns);
+    heap_.push_back({now_ns + offset, i});
+    std::push_heap(heap_.begin(), heap_.end(), Later());
+  }
+}
+
+size_t TrafficGenerator::poll(uint64_t   until_ns,
+                              can_frame* frames,
+                              size_t     max) {
+  size_t n = 0;
+  while (n < max && !heap_.empty() && heap_.front().deadline_ns <= until_ns) {
+    std::pop_heap(heap_.begin(), heap_.end(), Later());
+    Entry&  entry  = heap_.back();
+    Source& source = sources_[entry.source];
+    make_frame(source, frames[n++]);
+
+    switch (source.config.kind) {
+      case TrafficSource::kPeriodic:
+        entry.deadline_ns += source.interval_ns;
+        break;
+      case TrafficSource::kBurst:
+        // Burst frames are queued back to back on the same deadline
+        if (source.burst_left == 0)
+          source.burst_left = std::max<uint32_t>(source.config.burst_frames, 1);
+        if (--source.burst_left == 0)
+          entry.deadline_ns += random_interval(source.interval_ns);
+        break;
+      case TrafficSource::kRandom:
+        entry.deadline_ns += random_interval(source.interval_ns);
+        break;
+    }
+    std::push_heap(heap_.begin(), heap_.end(), Later());
+  }
+  return n;
+}
+
+void TrafficGenerator::make_frame(Source& source, can_frame& frame) {
+  const TrafficSource& config = source.config;
+  frame                       = {};
+  frame.can_id                = config.id;
+  frame.can_dlc               = config.dlc;
+  if (config.kind == TrafficSource::kRandom) {
+    uint64_t r  = random_u64();
+    uint32_t id = config.id & CAN_EFF_MASK;
+    uint32_t n  = (config.id_max & CAN_EFF_MASK) - id + 1;
+    frame.can_id =
+      (config.id & CAN_EFF_FLAG) | (id + static_cast<uint32_t>(r % n));
+    frame.can_dlc = static_cast<uint8_t>(
+      config.dlc + (r >> 32) % (config.dlc_max - config.dlc + 1u));
+  }
+  // A per-source counter makes gaps visible on the receiving side
+  std::memcpy(frame.data, &source.counter, sizeof(source.counter));
+  source.counter++;
+  generated_++;
+  generated_bits_ += can_frame_bits_worst_case(frame);
+}
+
+uint64_t TrafficGenerator::random_interval(uint64_t mean_ns) {
+  // Exponential gap: -mean * ln(u), u in (0, 1]
+  double u = static_cast<double>((random_u64() >> 11) + 1) * 0x1.0p-53;
+  return static_cast<uint64_t>(-std::log(u) * static_cast<double>(mean_ns));
+}
+
+uint64_t TrafficGenerator::random_u64() {
+  // xorshift64*
+  rng_state_ ^= rng_state_ >> 12;
+  rng_state_ ^= rng_state_ << 25;
+  rng_state_ ^= rng_state_ >> 27;
+  return rng_state_ * 0x2545F4914F6CDD1Dull;
+}
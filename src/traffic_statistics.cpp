@@ -0,0 +1,60 @@
+#include "socket_can/traffic_statistics.hpp"
+#include "socket_can/replay.hpp"
+#include <cmath>
+#include <thread>
+
+double IdStats::jitter_ns() const {
+  return count > 2 ? std::sqrt(m2_interval / static_cast<double>(count - 2))
+                   : 0;
+}
+
+double IdStats::rate_hz() const {
+  if (count < 2 || last_ns == first_ns)
+    return 0;
+  return static_cast<double>(count - 1) * 1e9 /
+         static_cast<double>(last_ns - first_ns);
+}
+
+uint64_t IdStats::overdue_ns(uint64_t now_ns) const {
+  if (count < 2 || now_ns <= last_ns)
+    return 0;
+  double late = static_cast<double>(now_ns - last_ns) - mean_interval_ns;
+  return late > 0 ? static_cast<uint64_t>(late) : 0;
+}
+
+FrameProcessor TrafficStatistics::frame_processor() {
+  return [this](const can_frame& frame) {
+    record(frame, DeadlineScheduler::now_ns());
+  };
+}
+
+bool TrafficStatistics::read(const Entry& entry, IdStats& stats) {
+  for (;;) {
+    uint32_t seq = entry.seq.load(std::memory_order_acquire);
+    if (seq & 1) {
+      std::this_thread::yield();
+      continue;
+    }
+    stats = entry.stats;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (entry.seq.load(std::memory_order_relaxed) == seq)
+      return stats.count != 0;
+  }
+}
+
+bool TrafficStatistics::snapshot(canid_t can_id, IdStats& stats) const {
+  const Entry* entry = table_.find(can_id);
+  return entry && read(*entry, stats);
+}
+
+std::vector<std::pair<canid_t, IdStats>>
+TrafficStatistics::snapshot_all() const {
+  std::vector<std::pair<canid_t, IdStats>> all;
+  all.reserve(table_.size());
+  table_.for_each([&all](canid_t key, const Entry& entry) {
+    IdStats stats;
+    if (read(entry, stats))
+      all.emplace_back(key, stats);
+  });
+  return all;
+}
@@ -0,0 +1,361 @@
+#include "socket_can/trigger_engine.hpp"
+#include "socket_can/capture_formats.hpp"
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+#include <iostream>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace {
+
+// Condition that names one ID exactly, so it can go into the ID table
+bool exact_id(const TriggerCondition& condition) {
+  canid_t id_bits =
+    condition.id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK;
+  return (condition.mask & (CAN_EFF_FLAG | id_bits)) ==
+         (CAN_EFF_FLAG | id_bits);
+}
+
+std::string file_name_part(const std::string& name) {
+  std::string part = name;
+  for (char& c : part) {
+    if (!isalnum(static_cast<unsigned char>(c)) && c != '-' && c != '_')
+      c = '_';
+  }
+  return part;
+}
+
+}  // namespace
+
+TriggerEngine::TriggerEngine() = default;
+
+TriggerEngine::~TriggerEngine() {
+  deinit();
+}
+
+bool TriggerEngine::init(EpollEventLoop*                 event_loop,
+                         const std::vector<TriggerRule>& rules,
+                         size_t                          buses,
+                         const TriggerConfig&            config) {
+  deinit();
+  if (rules.size() > UINT16_MAX || buses == 0) {
+    std::cerr << "Invalid trigger configuration" << std::endl;
+    return false;
+  }
+  config_ = config;
+  rules_.clear();
+  exact_.reset(new IdTable<ProbeList>());
+  masked_.clear();
+  missing_rules_.clear();
+  uint64_t now = capture_now_ns();
+  for (size_t i = 0; i < rules.size(); ++i) {
+    const TriggerRule& rule = rules[i];
+    if (rule.conditions.empty() ||
+        (rule.kind != TriggerRule::Kind::kSequence &&
+         rule.conditions.size() != 1) ||
+        rule.conditions.size() > UINT16_MAX ||
+        (rule.kind != TriggerRule::Kind::kFrame && rule.window_ns == 0)) {
+      std::cerr << "Invalid trigger rule " << rule.name << std::endl;
+      return false;
+    }
+    RuleState state;
+    state.rule         = rule;
+    state.last_seen_ns = now;
+    if (state.rule.name.empty())
+      state.rule.name = "rule" + std::to_string(i);
+    rules_.push_back(std::move(state));
+    if (rule.kind == TriggerRule::Kind::kMissing)
+      missing_rules_.push_back(i);
+
+    for (size_t step = 0; step < rule.conditions.size(); ++step) {
+      Probe probe = {static_cast<uint16_t>(i), static_cast<uint16_t>(step)};
+      const TriggerCondition& condition = rule.conditions[step];
+      ProbeList* list = exact_id(condition) ? exact_->get(condition.id)
+                                            : nullptr;
+      (list ? list : &masked_)->push_back(probe);
+    }
+  }
+
+  rings_.assign(buses, Ring());
+  for (Ring& ring : rings_)
+    ring.records.resize(std::max<size_t>(config_.pre_frames, 1));
+
+  event_loop_ = event_loop;
+  timerfd_    = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  struct itimerspec spec = {};
+  uint64_t interval = std::max<uint64_t>(config_.check_interval_ns, 1000000);
+  spec.it_interval.tv_sec  = static_cast<time_t>(interval / 1000000000ull);
+  spec.it_interval.tv_nsec = static_cast<long>(interval % 1000000000ull);
+  spec.it_value            = spec.it_interval;
+  if (timerfd_ < 0 || timerfd_settime(timerfd_, 0, &spec, nullptr) != 0 ||
+      !event_loop_->register_event(&timer_evt_, timerfd_, EPOLLIN,
+                                   [this](uint32_t mask) { on_timer(mask); })) {
+    std::cerr << "Failed to create trigger timer" << std::endl;
+    deinit();
+    return false;
+  }
+
+  stopping_ = false;
+  writer_   = std::thread([this]() { writer_main(); });
+  return true;
+}
+
+void TriggerEngine::deinit() {
+  if (writer_.joinable()) {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    writer_.join();
+  }
+  if (timer_evt_) {
+    event_loop_->deregister_event(timer_evt_);
+    timer_evt_ = nullptr;
+  }
+  if (timerfd_ >= 0) {
+    close(timerfd_);
+    timerfd_ = -1;
+  }
+}
+
+FrameProcessor TriggerEngine::frame_processor(uint32_t bus) {
+  return [this, bus](const can_frame& frame) {
+    on_frame(bus, frame, capture_now_ns());
+  };
+}
+
+void TriggerEngine::on_frame(uint32_t         bus,
+                             const can_frame& frame,
+                             uint64_t         timestamp_ns) {
+  if (bus >= rings_.size())
+    return;
+  stats_.frames++;
+  CaptureRecord record = {timestamp_ns, bus, 0, frame};
+  Ring&         ring   = rings_[bus];
+  ring.records[ring.head] = record;
+  ring.head               = (ring.head + 1) % ring.records.size();
+  ring.count              = std::min(ring.count + 1, ring.records.size());
+
+  if (capture_) {
+    if (timestamp_ns >= capture_end_ns_) {
+      finish_capture();
+    } else if (capture_->post_frames < config_.max_post_frames) {
+      capture_->records.push_back(record);
+      capture_->post_frames++;
+    } else {
+      stats_.truncated++;
+    }
+  }
+
+  if (!(frame.can_id & CAN_ERR_FLAG)) {
+    if (const ProbeList* probes = exact_->find(frame.can_id)) {
+      for (const Probe& probe : *probes)
+        evaluate(probe, bus, frame, timestamp_ns);
+    }
+  }
+  for (const Probe& probe : masked_)
+    evaluate(probe, bus, frame, timestamp_ns);
+}
+
+bool TriggerEngine::matches(const TriggerCondition& condition,
+                            const can_frame&        frame) {
+  stats_.checks++;
+  if ((frame.can_id ^ condition.id) & condition.mask)
+    return false;
+  for (size_t i = 0; i < CAN_MAX_DLEN; ++i) {
+    if ((frame.data[i] & condition.data_mask[i]) != condition.data_value[i])
+      return false;
+  }
+  if (condition.compare == TriggerCompare::kAny)
+    return true;
+  double value;
+  if (!decode_trigger_signal(condition.signal, frame, value))
+    return false;
+  switch (condition.compare) {
+  case TriggerCompare::kEqual:
+    return value == condition.threshold;
+  case TriggerCompare::kNotEqual:
+    return value != condition.threshold;
+  case TriggerCompare::kGreater:
+    return value > condition.threshold;
+  case TriggerCompare::kLess:
+    return value < condition.threshold;
+  case TriggerCompare::kOutside:
+    return value < condition.threshold || value > condition.threshold_high;
+  default:
+    return true;
+  }
+}
+
+void TriggerEngine::evaluate(const Probe&     probe,
+                             uint32_t         bus,
+                             const can_frame& frame,
+                             uint64_t         timestamp_ns) {
+  RuleState&         state = rules_[probe.rule];
+  const TriggerRule& rule  = state.rule;
+  if (rule.bus >= 0 && static_cast<uint32_t>(rule.bus) != bus)
+    return;
+  if (!matches(rule.conditions[probe.step], frame))
+    return;
+
+  switch (rule.kind) {
+  case TriggerRule::Kind::kFrame:
+    fire(probe.rule, bus, frame, timestamp_ns);
+    break;
+  case TriggerRule::Kind::kSequence:
+    if (state.next_step > 0 &&
+        timestamp_ns - state.sequence_ns > rule.window_ns)
+      state.next_step = 0;  // too slow, start over
+    if (probe.step == state.next_step) {
+      if (probe.step == 0)
+        state.sequence_ns = timestamp_ns;
+      if (++state.next_step == rule.conditions.size()) {
+        state.next_step = 0;
+        fire(probe.rule, bus, frame, timestamp_ns);
+      }
+    } else if (probe.step == 0) {
+      state.sequence_ns = timestamp_ns;
+      state.next_step   = 1;
+    }
+    break;
+  case TriggerRule::Kind::kMissing:
+    state.last_seen_ns = timestamp_ns;
+    state.missing      = false;
+    break;
+  }
+}
+
+void TriggerEngine::fire(size_t           rule,
+                         uint32_t         bus,
+                         const can_frame& frame,
+                         uint64_t         timestamp_ns) {
+  RuleState& state = rules_[rule];
+  if (state.fired && timestamp_ns - state.fired_ns < state.rule.holdoff_ns) {
+    stats_.suppressed++;
+    return;
+  }
+  state.fired    = true;
+  state.fired_ns = timestamp_ns;
+  stats_.triggers++;
+
+  if (capture_)
+    capture_end_ns_ =
+      std::max(capture_end_ns_, timestamp_ns + config_.post_ns);
+  else
+    start_capture(rule, timestamp_ns);
+
+  if (trigger_handler_) {
+    TriggerEvent event = {rule, &state.rule.name, bus, timestamp_ns, frame};
+    trigger_handler_(event);
+  }
+}
+
+void TriggerEngine::start_capture(size_t rule, uint64_t timestamp_ns) {
+  capture_.reset(new Capture);
+  capture_end_ns_ = timestamp_ns + config_.post_ns;
+
+  char      stamp[32];
+  struct tm local;
+  time_t    seconds = static_cast<time_t>(timestamp_ns / 1000000000ull);
+  localtime_r(&seconds, &local);
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &local);
+  capture_->path = config_.directory + "/trigger-" + stamp + "-" +
+                   std::to_string(++capture_serial_) + "-" +
+                   file_name_part(rules_[rule].rule.name) + config_.extension;
+
+  // Pre-trigger frames of every bus, the triggering frame included
+  uint64_t since =
+    timestamp_ns > config_.pre_ns ? timestamp_ns - config_.pre_ns : 0;
+  size_t total = 0;
+  for (const Ring& ring : rings_)
+    total += ring.count;
+  capture_->records.reserve(total + 1024);
+  for (const Ring& ring : rings_) {
+    size_t size  = ring.records.size();
+    size_t first = (ring.head + size - ring.count) % size;
+    for (size_t i = 0; i < ring.count; ++i) {
+      const CaptureRecord& record = ring.records[(first + i) % size];
+      if (record.timestamp_ns >= since)
+        capture_->records.push_back(record);
+    }
+  }
+}
+
+void TriggerEngine::finish_capture() {
+  if (!capture_)
+    return;
+  stats_.captures++;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.push_back(std::move(capture_));
+  }
+  cv_.notify_all();
+}
+
+void TriggerEngine::on_timer(uint32_t) {
+  uint64_t expirations;
+  while (read(timerfd_, &expirations, sizeof(expirations)) > 0) {
+  }
+  uint64_t now = capture_now_ns();
+  for (size_t i : missing_rules_) {
+    RuleState& state = rules_[i];
+    if (state.missing || now - state.last_seen_ns <= state.rule.window_ns)
+      continue;
+    // Once per absence; the next matching frame re-arms the rule
+    state.missing = true;
+    fire(i, state.rule.bus >= 0 ? static_cast<uint32_t>(state.rule.bus) : 0,
+         can_frame{}, now);
+  }
+  if (capture_ && now >= capture_end_ns_)
+    finish_capture();
+}
+
+void TriggerEngine::flush() {
+  finish_capture();
+  std::unique_lock<std::mutex> lock(mutex_);
+  cv_.wait(lock, [this]() { return queue_.empty() && !writing_; });
+}
+
+TriggerEngine::Stats TriggerEngine::stats() const {
+  Stats stats   = stats_;
+  stats.written = written_.load(std::memory_order_relaxed);
+  stats.failed  = failed_.load(std::memory_order_relaxed);
+  return stats;
+}
+
+void TriggerEngine::writer_main() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+    if (queue_.empty())
+      return;
+    std::unique_ptr<Capture> capture = std::move(queue_.front());
+    queue_.pop_front();
+    writing_ = true;
+    lock.unlock();
+
+    // Buses were appended one after the other
+    std::stable_sort(capture->records.begin(), capture->records.end(),
+                     [](const CaptureRecord& a, const CaptureRecord& b) {
+                       return a.timestamp_ns < b.timestamp_ns;
+                     });
+    std::unique_ptr<FrameSink> sink = open_capture_sink(capture->path);
+    bool                       ok   = sink != nullptr;
+    for (size_t i = 0; ok && i < capture->records.size(); ++i)
+      ok = sink->write(capture->records[i]);
+    if (sink)
+      ok = sink->close() && ok;
+    if (!ok)
+      std::cerr << "Failed to write capture " << capture->path << std::endl;
+    (ok ? written_ : failed_).fetch_add(1, std::memory_order_relaxed);
+    if (capture_handler_)
+      capture_handler_(capture->path, capture->records.size(), ok);
+
+    lock.lock();
+    writing_ = false;
+    cv_.notify_all();
+  }
+}
@@ -0,0 +1,45 @@
+#include "socket_can/trigger_signal.hpp"
+#include <cstring>
+#include <endian.h>
+
+bool decode_trigger_signal(const TriggerSignal& signal,
+                           const can_frame&     frame,
+                           double&              value) {
+  uint64_t payload;
+  std::memcpy(&payload, frame.data, sizeof(payload));
+  return decode_trigger_signal(signal, payload, frame.can_dlc, value);
+}
+
+bool decode_trigger_signal(const TriggerSignal& signal,
+                           uint64_t             payload,
+                           uint8_t              length,
+                           double&              value) {
+  if (signal.length == 0 || signal.length > 64)
+    return false;
+  uint64_t raw;
+  if (!signal.big_endian) {
+    if (signal.start_bit + signal.length > length * 8u)
+      return false;
+    raw = le64toh(payload) >> signal.start_bit;
+  } else {
+    // Motorola: position of the MSB counted from the first bit on the wire
+    unsigned msb = signal.start_bit / 8 * 8 + (7 - signal.start_bit % 8);
+    if (msb + signal.length > length * 8u)
+      return false;
+    raw = (be64toh(payload) << msb) >> (64 - signal.length);
+  }
+  if (signal.length < 64)
+    raw &= (uint64_t{1} << signal.length) - 1;
+
+  double decoded;
+  if (signal.is_signed && signal.length < 64 &&
+      (raw >> (signal.length - 1)) & 1)
+    decoded = static_cast<double>(static_cast<int64_t>(
+      raw | ~((uint64_t{1} << signal.length) - 1)));
+  else if (signal.is_signed)
+    decoded = static_cast<double>(static_cast<int64_t>(raw));
+  else
+    decoded = static_cast<double>(raw);
+  value = decoded * signal.scale + signal.offset;
+  return true;
+}
@@ -0,0 +1,480 @@
+#include "socket_can/udp_bridge.hpp"
+#include "socket_can/replay.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <endian.h>
+#include <iostream>
+#include <netdb.h>
+#include <random>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kSendBufferSize    = 1 << 20;
+constexpr int kReceiveBufferSize = 4 << 20;
+
+uint64_t realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL +
+         static_cast<uint64_t>(ts.tv_nsec);
+}
+
+}  // namespace
+
+bool parse_udp_endpoint(const std::string&       text,
+                        struct sockaddr_storage& address,
+                        socklen_t&               length) {
+  size_t colon = text.rfind(':');
+  if (colon == std::string::npos || colon + 1 == text.size())
+    return false;
+  std::string host = text.substr(0, colon);
+  std::string port = text.substr(colon + 1);
+  if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+    host = host.substr(1, host.size() - 2);
+
+  struct addrinfo hints = {};
+  hints.ai_family       = AF_UNSPEC;
+  hints.ai_socktype     = SOCK_DGRAM;
+  hints.ai_flags        = AI_NUMERICSERV | (host.empty() ? AI_PASSIVE : 0);
+  struct addrinfo* result = nullptr;
+  if (getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints,
+                  &result) != 0 ||
+      !result)
+    return false;
+  std::memcpy(&address, result->ai_addr, result->ai_addrlen);
+  length = result->ai_addrlen;
+  freeaddrinfo(result);
+  return true;
+}
+
+UdpBridgeSender::~UdpBridgeSender() {
+  deinit();
+}
+
+bool UdpBridgeSender::init(EpollEventLoop*                 event_loop,
+                           const std::vector<std::string>& interfaces,
+                           const std::string&              destination,
+                           std::chrono::microseconds       flush_budget,
+                           size_t                          max_datagram) {
+  struct sockaddr_storage address;
+  socklen_t               length;
+  if (!parse_udp_endpoint(destination, address, length)) {
+    std::cerr << "Invalid UDP destination " << destination << std::endl;
+    return false;
+  }
+  if (interfaces.size() > 256 || max_datagram > 65507 ||
+      max_datagram < UdpBridgeHeader::kSize + UdpBridgeRecord::kSize) {
+    std::cerr << "Invalid UDP bridge configuration" << std::endl;
+    return false;
+  }
+  // The record offsets are 32-bit nanoseconds
+  budget_ns_ = static_cast<uint64_t>(std::min<int64_t>(
+    std::max<int64_t>(flush_budget.count(), 1) * 1000, UINT32_MAX));
+  capacity_ =
+    (max_datagram - UdpBridgeHeader::kSize) / UdpBridgeRecord::kSize;
+  for (Datagram& datagram : queue_) {
+    datagram.bytes.resize(UdpBridgeHeader::kSize +
+                          capacity_ * UdpBridgeRecord::kSize);
+    datagram.count = 0;
+  }
+  MetricsRegistry& registry = MetricsRegistry::global();
+  MetricLabels     labels   = {{"destination", destination}};
+  frames_metric_            = registry.counter(
+    "socket_can_bridge_tx_frames", "Frames sent over the UDP bridge", labels);
+  datagrams_metric_ = registry.counter("socket_can_bridge_tx_datagrams",
+                                       "UDP bridge datagrams sent", labels);
+  dropped_metric_   = registry.counter(
+    "socket_can_bridge_tx_dropped_datagrams",
+    "UDP bridge datagrams dropped because the socket buffer was full",
+    labels);
+  head_     = 0;
+  pending_  = 0;
+  stream_   = std::random_device()();
+  sequence_ = 0;
+
+  fd_ = socket(address.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               0);
+  if (fd_ < 0 ||
+      connect(fd_, reinterpret_cast<struct sockaddr*>(&address), length) !=
+        0) {
+    std::cerr << "Failed to open UDP socket to " << destination << ": "
+              << strerror(errno) << std::endl;
+    deinit();
+    return false;
+  }
+  setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &kSendBufferSize,
+             sizeof(kSendBufferSize));
+
+  event_loop_ = event_loop;
+  timerfd_    = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (timerfd_ < 0 ||
+      !event_loop_->register_event(&timer_evt_, timerfd_, EPOLLIN,
+                                   [this](uint32_t mask) { on_timer(mask); })) {
+    std::cerr << "Failed to create UDP bridge timer" << std::endl;
+    deinit();
+    return false;
+  }
+
+  for (size_t i = 0; i < interfaces.size(); ++i) {
+    auto    intf    = std::make_unique<SocketCanIntf>();
+    uint8_t channel = static_cast<uint8_t>(i);
+    if (!intf->init(interfaces[i], event_loop_,
+                    [this, channel](const can_frame& frame) {
+                      enqueue(channel, frame);
+                    })) {
+      deinit();
+      return false;
+    }
+    // Full datagrams leave once per RX batch
+    intf->set_batch_end_handler([this]() {
+      if (pending_)
+        send_pending();
+    });
+    interfaces_.push_back(std::move(intf));
+  }
+
+  return true;
+}
+
+void UdpBridgeSender::deinit() {
+  for (auto& intf : interfaces_)
+    intf->deinit();
+  interfaces_.clear();
+  if (fd_ >= 0 && timerfd_ >= 0)
+    flush();
+  if (timer_evt_) {
+    event_loop_->deregister_event(timer_evt_);
+    timer_evt_ = nullptr;
+  }
+  if (timerfd_ >= 0) {
+    close(timerfd_);
+    timerfd_ = -1;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  timer_armed_ = false;
+}
+
+void UdpBridgeSender::enqueue(uint8_t channel, const can_frame& frame) {
+  if (fd_ < 0)
+    return;
+  uint64_t  now      = DeadlineScheduler::now_ns();
+  Datagram* datagram = &current();
+  if (datagram->count && now - datagram->first_ns > UINT32_MAX) {
+    complete();
+    datagram = &current();
+  }
+  if (!datagram->count)
+    datagram->first_ns = now;
+
+  UdpBridgeRecord record = {};
+  record.offset_ns = htole32(static_cast<uint32_t>(now - datagram->first_ns));
+  record.can_id    = htole32(frame.can_id);
+  record.channel   = channel;
+  record.can_dlc   = frame.can_dlc;
+  std::memcpy(record.data, frame.data, CAN_MAX_DLEN);
+  std::memcpy(datagram->bytes.data() + UdpBridgeHeader::kSize +
+                datagram->count * UdpBridgeRecord::kSize,
+              &record, sizeof(record));
+  stats_.frames++;
+  frames_metric_->inc();
+
+  if (++datagram->count == capacity_)
+    complete();
+  else if (datagram->count == 1 && !timer_armed_)
+    arm_timer(now + budget_ns_);
+}
+
+void UdpBridgeSender::flush() {
+  complete();
+  send_pending();
+}
+
+void UdpBridgeSender::complete() {
+  Datagram& datagram = current();
+  if (!datagram.count)
+    return;
+  UdpBridgeHeader header = {};
+  header.magic           = htole32(UdpBridgeHeader::kMagic);
+  header.version         = UdpBridgeHeader::kVersion;
+  header.header_size     = UdpBridgeHeader::kSize;
+  header.count           = htole16(static_cast<uint16_t>(datagram.count));
+  header.sequence        = htole32(sequence_++);
+  header.stream          = htole32(stream_);
+  header.base_ns         = htole64(datagram.first_ns + realtime_ns() -
+                                   DeadlineScheduler::now_ns());
+  std::memcpy(datagram.bytes.data(), &header, sizeof(header));
+
+  ++pending_;
+  current().count = 0;
+  // Keep a free slot to fill; when the socket buffer stays full, the oldest
+  // datagram goes and the receiver sees the sequence gap
+  if (pending_ == kQueueDatagrams - 1) {
+    send_pending();
+    if (pending_ == kQueueDatagrams - 1) {
+      head_ = (head_ + 1) % kQueueDatagrams;
+      --pending_;
+      stats_.dropped_datagrams++;
+      dropped_metric_->inc();
+    }
+  }
+}
+
+void UdpBridgeSender::send_pending() {
+  struct mmsghdr messages[kQueueDatagrams];
+  struct iovec   iovecs[kQueueDatagrams];
+  for (int attempt = 0; attempt < 2 && pending_; ++attempt) {
+    std::memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < pending_; ++i) {
+      Datagram& datagram = queue_[(head_ + i) % kQueueDatagrams];
+      uint16_t  count;
+      std::memcpy(&count, datagram.bytes.data() + 6, sizeof(count));
+      iovecs[i].iov_base = datagram.bytes.data();
+      iovecs[i].iov_len  = UdpBridgeHeader::kSize +
+                          le16toh(count) * UdpBridgeRecord::kSize;
+      messages[i].msg_hdr.msg_iov    = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    int n = sendmmsg(fd_, messages, static_cast<unsigned>(pending_), 0);
+    stats_.send_calls++;
+    if (n > 0) {
+      head_ = (head_ + static_cast<size_t>(n)) % kQueueDatagrams;
+      pending_ -= static_cast<size_t>(n);
+      stats_.datagrams += static_cast<uint64_t>(n);
+      datagrams_metric_->inc(static_cast<uint64_t>(n));
+      return;
+    }
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+      return;
+    // Usually an ICMP error left by an earlier datagram (nobody listening
+    // yet); the send itself is retried once
+  }
+  if (pending_ && errno != EAGAIN && errno != EWOULDBLOCK &&
+      errno != ENOBUFS) {
+    stats_.dropped_datagrams += pending_;
+    dropped_metric_->inc(pending_);
+    head_    = (head_ + pending_) % kQueueDatagrams;
+    pending_ = 0;
+  }
+}
+
+void UdpBridgeSender::arm_timer(uint64_t deadline_ns) {
+  struct itimerspec spec = {};
+  spec.it_value.tv_sec   = static_cast<time_t>(deadline_ns / 1000000000ULL);
+  spec.it_value.tv_nsec  = static_cast<long>(deadline_ns % 1000000000ULL);
+  if (timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+    std::cerr << "Failed to arm UDP bridge timer" << std::endl;
+    return;
+  }
+  timer_armed_ = true;
+}
+
+void UdpBridgeSender::on_timer(uint32_t) {
+  uint64_t expirations;
+  while (read(timerfd_, &expirations, sizeof(expirations)) > 0) {
+  }
+  timer_armed_ = false;
+
+  uint64_t now = DeadlineScheduler::now_ns();
+  if (current().count && now - current().first_ns >= budget_ns_)
+    complete();
+  if (pending_)
+    send_pending();
+  // The datagram being filled started after the timer was armed
+  if (current().count)
+    arm_timer(current().first_ns + budget_ns_);
+  else if (pending_)
+    arm_timer(now + budget_ns_);
+}
+
+UdpBridgeReceiver::~UdpBridgeReceiver() {
+  deinit();
+}
+
+bool UdpBridgeReceiver::init(EpollEventLoop*                 event_loop,
+                             const std::string&              listen,
+                             const std::vector<std::string>& outputs) {
+  struct sockaddr_storage address;
+  socklen_t               length;
+  if (!parse_udp_endpoint(listen, address, length)) {
+    std::cerr << "Invalid UDP listen address " << listen << std::endl;
+    return false;
+  }
+  fd_ = socket(address.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               0);
+  if (fd_ < 0 ||
+      bind(fd_, reinterpret_cast<struct sockaddr*>(&address), length) != 0) {
+    std::cerr << "Failed to bind UDP socket to " << listen << ": "
+              << strerror(errno) << std::endl;
+    deinit();
+    return false;
+  }
+  // Bursts from several buses arrive between two loop iterations
+  if (setsockopt(fd_, SOL_SOCKET, SO_RCVBUFFORCE, &kReceiveBufferSize,
+                 sizeof(kReceiveBufferSize)) != 0)
+    setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &kReceiveBufferSize,
+               sizeof(kReceiveBufferSize));
+
+  event_loop_ = event_loop;
+  outputs_.resize(outputs.size());
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    if (outputs[i].empty())
+      continue;  // frame handler only
+    outputs_[i].intf = std::make_unique<SocketCanIntf>();
+    if (!outputs_[i].intf->init(outputs[i], event_loop_,
+                                [](const can_frame&) {})) {
+      deinit();
+      return false;
+    }
+  }
+  buffers_.resize(kReceiveBatch * kBufferSize);
+  have_stream_ = false;
+
+  if (!event_loop_->register_event(
+        &evt_, fd_, EPOLLIN, [this](uint32_t mask) { on_readable(mask); })) {
+    std::cerr << "Failed to register UDP bridge socket" << std::endl;
+    deinit();
+    return false;
+  }
+
+  MetricsRegistry& registry = MetricsRegistry::global();
+  MetricLabels     labels   = {{"listen", listen}};
+  frames_metric_            = registry.counter(
+    "socket_can_bridge_rx_frames", "Frames received over the UDP bridge",
+    labels);
+  lost_metric_ = registry.counter("socket_can_bridge_lost_datagrams",
+                                  "UDP bridge sequence gaps", labels);
+  return true;
+}
+
+void UdpBridgeReceiver::deinit() {
+  if (evt_) {
+    event_loop_->deregister_event(evt_);
+    evt_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  for (Output& output : outputs_) {
+    if (output.intf)
+      output.intf->deinit();
+  }
+  outputs_.clear();
+}
+
+uint16_t UdpBridgeReceiver::port() const {
+  struct sockaddr_storage address;
+  socklen_t               length = sizeof(address);
+  if (fd_ < 0 || getsockname(fd_, reinterpret_cast<struct sockaddr*>(&address),
+                             &length) != 0)
+    return 0;
+  if (address.ss_family == AF_INET6)
+    return ntohs(reinterpret_cast<struct sockaddr_in6*>(&address)->sin6_port);
+  return ntohs(reinterpret_cast<struct sockaddr_in*>(&address)->sin_port);
+}
+
+void UdpBridgeReceiver::on_readable(uint32_t) {
+  struct mmsghdr messages[kReceiveBatch];
+  struct iovec   iovecs[kReceiveBatch];
+  int            n;
+  do {
+    std::memset(messages, 0, sizeof(messages));
+    for (size_t i = 0; i < kReceiveBatch; ++i) {
+      iovecs[i].iov_base             = buffers_.data() + i * kBufferSize;
+      iovecs[i].iov_len              = kBufferSize;
+      messages[i].msg_hdr.msg_iov    = &iovecs[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+    }
+    n = recvmmsg(fd_, messages, kReceiveBatch, MSG_DONTWAIT, nullptr);
+    stats_.receive_calls++;
+    for (int i = 0; i < n; ++i)
+      on_datagram(buffers_.data() + i * kBufferSize, messages[i].msg_len);
+  } while (n == static_cast<int>(kReceiveBatch));
+
+  for (Output& output : outputs_) {
+    if (output.tx_count)
+      flush(output);
+  }
+}
+
+void UdpBridgeReceiver::on_datagram(const uint8_t* data, size_t size) {
+  UdpBridgeHeader header;
+  if (size < sizeof(header)) {
+    stats_.malformed++;
+    return;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  size_t count = le16toh(header.count);
+  if (le32toh(header.magic) != UdpBridgeHeader::kMagic ||
+      header.version != UdpBridgeHeader::kVersion ||
+      header.header_size < UdpBridgeHeader::kSize ||
+      size < header.header_size + count * UdpBridgeRecord::kSize) {
+    stats_.malformed++;
+    return;
+  }
+  stats_.datagrams++;
+
+  uint32_t stream   = le32toh(header.stream);
+  uint32_t sequence = le32toh(header.sequence);
+  if (!have_stream_ || stream != stream_) {
+    have_stream_ = true;
+    stream_      = stream;
+    expected_    = sequence;
+  }
+  int32_t gap = static_cast<int32_t>(sequence - expected_);
+  if (gap < 0) {
+    stats_.reordered++;
+  } else {
+    if (gap > 0) {
+      stats_.lost_datagrams += static_cast<uint64_t>(gap);
+      lost_metric_->inc(static_cast<uint64_t>(gap));
+    }
+    expected_ = sequence + 1;
+  }
+
+  uint64_t       base    = le64toh(header.base_ns);
+  const uint8_t* records = data + header.header_size;
+  size_t         frames  = 0;
+  for (size_t i = 0; i < count; ++i) {
+    UdpBridgeRecord record;
+    std::memcpy(&record, records + i * UdpBridgeRecord::kSize,
+                sizeof(record));
+    if (record.can_dlc > CAN_MAX_DLEN) {
+      stats_.malformed++;
+      continue;
+    }
+    frames++;
+    can_frame frame = {};
+    frame.can_id    = le32toh(record.can_id);
+    frame.can_dlc   = record.can_dlc;
+    std::memcpy(frame.data, record.data, CAN_MAX_DLEN);
+    if (frame_handler_)
+      frame_handler_(record.channel, frame, base + le32toh(record.offset_ns));
+
+    if (record.channel >= outputs_.size() || !outputs_[record.channel].intf) {
+      stats_.unrouted_frames++;
+      continue;
+    }
+    Output& output = outputs_[record.channel];
+    if (output.tx_count == kTxBatch)
+      flush(output);
+    output.tx[output.tx_count++] = frame;
+  }
+  stats_.frames += frames;
+  frames_metric_->inc(frames);
+}
+
+void UdpBridgeReceiver::flush(Output& output) {
+  size_t n_sent = output.intf->send_can_frames(output.tx.data(),
+                                               output.tx_count);
+  stats_.replay_dropped += output.tx_count - n_sent;
+  output.tx_count = 0;
+}
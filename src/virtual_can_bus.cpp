@@ -0,0 +1,215 @@
+#include "socket_can/virtual_can_bus.hpp"
+#include "socket_can/can_bit_timing.hpp"
+#include "socket_can/replay.hpp"
+#include <cerrno>
+#include <cstdlib>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kMaxEventsPerIteration = 64;
+// Receive buffering of a node, like a CAN_RAW socket's rcvbuf
+constexpr int kNodeBufferBytes = 1 << 20;
+
+}  // namespace
+
+std::shared_ptr<VirtualCanBus> VirtualCanBus::get(const std::string& name) {
+  static std::mutex                                           registry_mutex;
+  static std::map<std::string, std::weak_ptr<VirtualCanBus>> registry;
+
+  std::lock_guard<std::mutex>    lock(registry_mutex);
+  std::shared_ptr<VirtualCanBus> bus = registry[name].lock();
+  if (bus)
+    return bus;
+  bus.reset(new VirtualCanBus());
+  if (!bus->start()) {
+    std::cerr << "Failed to start virtual CAN bus " << name << std::endl;
+    return nullptr;
+  }
+  registry[name] = bus;
+  return bus;
+}
+
+VirtualCanBus::VirtualCanBus() = default;
+
+VirtualCanBus::~VirtualCanBus() {
+  if (thread_.joinable()) {
+    stopping_             = true;
+    const uint64_t wakeup = 1;
+    if (write(wakefd_, &wakeup, sizeof(wakeup)) != sizeof(wakeup))
+      std::cerr << "Failed to wake virtual CAN bus" << std::endl;
+    thread_.join();
+  }
+  for (auto& node : nodes_)
+    close(node->fd);
+  if (wakefd_ >= 0)
+    close(wakefd_);
+  if (epollfd_ >= 0)
+    close(epollfd_);
+}
+
+bool VirtualCanBus::start() {
+  epollfd_ = epoll_create1(EPOLL_CLOEXEC);
+  wakefd_  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollfd_ < 0 || wakefd_ < 0)
+    return false;
+  struct epoll_event ev = {.events = EPOLLIN, .data = {.ptr = nullptr}};
+  if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, wakefd_, &ev) == -1)
+    return false;
+  thread_ = std::thread(&VirtualCanBus::run, this);
+  return true;
+}
+
+int VirtualCanBus::attach() {
+  int fds[2];
+  if (socketpair(AF_UNIX,
+                 SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                 0,
+                 fds) == -1) {
+    std::cerr << "Failed to create virtual CAN node" << std::endl;
+    return -1;
+  }
+  // Frames queued towards the node are charged to the bus end's send buffer
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &kNodeBufferBytes, sizeof(int));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  nodes_.push_back(std::make_unique<Node>(fds[0]));
+  struct epoll_event ev = {.events = EPOLLIN,
+                           .data   = {.ptr = nodes_.back().get()}};
+  if (epoll_ctl(epollfd_, EPOLL_CTL_ADD, fds[0], &ev) == -1) {
+    nodes_.pop_back();
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  return fds[1];
+}
+
+void VirtualCanBus::fill(Node& node) {
+  if (node.pending || node.closed)
+    return;
+  ssize_t n = recv(node.fd, &node.frame, sizeof(node.frame), MSG_DONTWAIT);
+  if (n == static_cast<ssize_t>(sizeof(node.frame)))
+    node.pending = true;
+  else if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    node.closed = true;
+}
+
+void VirtualCanBus::deliver(const Node& sender) {
+  for (const auto& node : nodes_) {
+    if (node.get() == &sender || node->closed)
+      continue;
+    if (send(node->fd, &sender.frame, sizeof(sender.frame), MSG_DONTWAIT) !=
+        static_cast<ssize_t>(sizeof(sender.frame)))
+      dropped_++;
+  }
+  delivered_++;
+}
+
+void VirtualCanBus::run() {
+  struct epoll_event events[kMaxEventsPerIteration];
+  DeadlineScheduler  scheduler(0);
+  uint64_t           bus_free_ns = 0;
+  bool               contending  = false;
+
+  while (!stopping_) {
+    // Block only when no node has a frame waiting for the bus
+    int n = epoll_wait(
+      epollfd_, events, kMaxEventsPerIteration, contending ? 0 : -1);
+    if (n == -1 && errno != EINTR) {
+      std::cerr << "Virtual CAN bus failed" << std::endl;
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (int i = 0; i < n; ++i) {
+      Node* node = static_cast<Node*>(events[i].data.ptr);
+      if (!node) {
+        uint64_t value;
+        if (read(wakefd_, &value, sizeof(value)) != sizeof(value))
+          std::cerr << "Failed to read virtual CAN bus wakeup" << std::endl;
+        continue;
+      }
+      fill(*node);
+    }
+
+    // Drop nodes whose owner closed them once their last frame went out
+    Node* winner = nullptr;
+    for (size_t i = 0; i < nodes_.size();) {
+      Node& node = *nodes_[i];
+      if (node.closed && !node.pending) {
+        epoll_ctl(epollfd_, EPOLL_CTL_DEL, node.fd, nullptr);
+        close(node.fd);
+        nodes_.erase(nodes_.begin() + static_cast<long>(i));
+        continue;
+      }
+      if (node.pending && (!winner || can_arbitration_key(node.frame) <
+                                        can_arbitration_key(winner->frame)))
+        winner = &node;
+      ++i;
+    }
+    contending = winner != nullptr;
+    if (!winner)
+      continue;
+
+    uint32_t bitrate = bitrate_;
+    if (bitrate) {
+      // Arbitration happens when the bus becomes idle; frames queued while
+      // the previous frame was on the wire take part in it
+      uint64_t now = DeadlineScheduler::now_ns();
+      if (bus_free_ns > now) {
+        lock.unlock();
+        scheduler.wait_until(bus_free_ns, &stopping_);
+        continue;
+      }
+      uint64_t end_ns =
+        now +
+        can_frame_duration_ns(can_frame_bits_exact(winner->frame), bitrate);
+      lock.unlock();
+      scheduler.wait_until(end_ns, &stopping_);
+      lock.lock();
+      bus_free_ns = end_ns;
+    }
+
+    deliver(*winner);
+    winner->pending = false;
+    fill(*winner);
+  }
+}
+
+bool LoopbackTransport::open(const std::string& interface) {
+  close();
+  std::string name = interface;
+  if (name.compare(0, kVirtualBusPrefixLength, kVirtualBusPrefix) == 0)
+    name.erase(0, kVirtualBusPrefixLength);
+
+  uint32_t bitrate = 0;
+  size_t   at      = name.find('@');
+  if (at != std::string::npos) {
+    bitrate = static_cast<uint32_t>(
+      std::strtoul(name.c_str() + at + 1, nullptr, 10));
+    name.erase(at);
+  }
+
+  bus_ = VirtualCanBus::get(name);
+  if (!bus_)
+    return false;
+  if (bitrate)
+    bus_->set_bitrate(bitrate);
+  fd_ = bus_->attach();
+  if (fd_ < 0) {
+    bus_.reset();
+    return false;
+  }
+  name_ = interface;
+  return true;
+}
+
+void LoopbackTransport::close() {
+  DatagramCanTransport::close();
+  bus_.reset();
+}
@@ -0,0 +1,250 @@
+#include "socket_can/capture_analysis.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Offline analysis of capture files: frame counts, per-ID periods and
+// signal statistics, computed on all cores
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name
+            << " [options] scan|ids|signal|extract <capture>" << std::endl;
+  std::cout << "  scan       number of matching frames and payload bytes"
+            << std::endl;
+  std::cout << "  ids        per-ID count and period (mean/min/max)"
+            << std::endl;
+  std::cout << "  signal     min/mean/max of a signal per time bucket"
+            << std::endl;
+  std::cout << "  extract    every signal value as CSV" << std::endl;
+  std::cout << "  -i <id>[/<mask>]  hex CAN ID filter, suffix x for 29-bit "
+               "IDs; repeatable"
+            << std::endl;
+  std::cout << "  -c <n>     only channel n" << std::endl;
+  std::cout << "  -b <sec>   start, seconds after the first frame" << std::endl;
+  std::cout << "  -e <sec>   end (exclusive), seconds after the first frame"
+            << std::endl;
+  std::cout << "  -j <n>     threads (default: one per core)" << std::endl;
+  std::cout << "  -H         ids: print the period histogram of each ID"
+            << std::endl;
+  std::cout << "  -I <id>    signal: ID of the frames carrying the signal"
+            << std::endl;
+  std::cout << "  -s <start>:<len>[:be][:signed]  signal: position (DBC)"
+            << std::endl;
+  std::cout << "  -k <f>     signal: scale (default 1)" << std::endl;
+  std::cout << "  -o <f>     signal: offset (default 0)" << std::endl;
+  std::cout << "  -w <sec>   signal: bucket width (default 60)" << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name
+            << " -I 0CF00400x -s 24:16 -k 0.125 -w 60 signal drive.scap"
+            << std::endl;
+}
+
+bool parse_id(std::string arg, canid_t& id) {
+  bool ext = !arg.empty() && (arg.back() == 'x' || arg.size() > 3);
+  if (ext && arg.back() == 'x')
+    arg.pop_back();
+  char* end;
+  id = static_cast<canid_t>(std::strtoul(arg.c_str(), &end, 16));
+  if (arg.empty() || *end)
+    return false;
+  if (ext)
+    id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+  return true;
+}
+
+bool parse_filter(const std::string& arg, can_filter& filter) {
+  size_t slash = arg.find('/');
+  if (!parse_id(arg.substr(0, slash), filter.can_id))
+    return false;
+  filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG |
+                    (filter.can_id & CAN_EFF_FLAG ? CAN_EFF_MASK
+                                                  : CAN_SFF_MASK);
+  if (slash != std::string::npos)
+    filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG |
+                      static_cast<canid_t>(std::strtoul(
+                        arg.c_str() + slash + 1, nullptr, 16));
+  return true;
+}
+
+bool parse_signal(const std::string& arg, TriggerSignal& signal) {
+  std::istringstream       fields(arg);
+  std::string              field;
+  std::vector<std::string> parts;
+  while (std::getline(fields, field, ':'))
+    parts.push_back(field);
+  if (parts.size() < 2)
+    return false;
+  signal.start_bit = static_cast<uint16_t>(std::atoi(parts[0].c_str()));
+  signal.length    = static_cast<uint8_t>(std::atoi(parts[1].c_str()));
+  for (size_t i = 2; i < parts.size(); ++i) {
+    if (parts[i] == "be")
+      signal.big_endian = true;
+    else if (parts[i] == "signed")
+      signal.is_signed = true;
+    else
+      return false;
+  }
+  return signal.length > 0 && signal.length <= 64;
+}
+
+std::string format_id(canid_t id) {
+  char text[16];
+  if (id & CAN_EFF_FLAG)
+    snprintf(text, sizeof(text), "%08X", id & CAN_EFF_MASK);
+  else
+    snprintf(text, sizeof(text), "%03X", id);
+  return text;
+}
+
+int main(int argc, char* argv[]) {
+  AnalysisFilter filter;
+  SignalQuery    query;
+  double         begin_s   = -1;
+  double         end_s     = -1;
+  unsigned       threads   = 0;
+  bool           histogram = false;
+  bool           signal_id = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:c:b:e:j:HI:s:k:o:w:h")) != -1) {
+    switch (opt) {
+      case 'i': {
+        can_filter rule;
+        if (!parse_filter(optarg, rule)) {
+          std::cerr << "Invalid ID: " << optarg << std::endl;
+          return 1;
+        }
+        filter.ids.push_back(rule);
+        break;
+      }
+      case 'c':
+        filter.channel = std::atoi(optarg);
+        break;
+      case 'b':
+        begin_s = std::atof(optarg);
+        break;
+      case 'e':
+        end_s = std::atof(optarg);
+        break;
+      case 'j':
+        threads = static_cast<unsigned>(std::atoi(optarg));
+        break;
+      case 'H':
+        histogram = true;
+        break;
+      case 'I':
+        if (!parse_id(optarg, query.id)) {
+          std::cerr << "Invalid ID: " << optarg << std::endl;
+          return 1;
+        }
+        signal_id = true;
+        break;
+      case 's':
+        if (!parse_signal(optarg, query.signal)) {
+          std::cerr << "Invalid signal: " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'k':
+        query.signal.scale = std::atof(optarg);
+        break;
+      case 'o':
+        query.signal.offset = std::atof(optarg);
+        break;
+      case 'w':
+        query.bucket_ns = static_cast<uint64_t>(std::atof(optarg) * 1e9);
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string command = argv[optind];
+  std::string path    = argv[optind + 1];
+  bool        signal  = command == "signal" || command == "extract";
+  if (command != "scan" && command != "ids" && !signal) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  if (signal && (!signal_id || query.signal.length == 0)) {
+    std::cerr << command << " needs -I and -s" << std::endl;
+    return 1;
+  }
+
+  CaptureAnalyzer analyzer(threads);
+  if (!analyzer.open(path))
+    return 1;
+  uint64_t first = analyzer.first_timestamp_ns();
+  if (begin_s >= 0)
+    filter.begin_ns = first + static_cast<uint64_t>(begin_s * 1e9);
+  if (end_s >= 0)
+    filter.end_ns = first + static_cast<uint64_t>(end_s * 1e9);
+
+  auto start = std::chrono::steady_clock::now();
+  if (command == "scan") {
+    CaptureScanResult result = analyzer.scan(filter);
+    std::cout << result.matched << " of " << result.records << " frames, "
+              << result.payload_bytes << " payload bytes";
+    if (result.matched)
+      std::cout << ", " << (result.last_ns - result.first_ns) / 1e9 << " s";
+    std::cout << std::endl;
+  } else if (command == "ids") {
+    printf("%-8s %10s %12s %12s %12s %5s\n", "ID", "frames", "mean ms",
+           "min ms", "max ms", "DLC");
+    uint64_t untracked = 0;
+    for (const IdSummary& id : analyzer.group_by_id(filter, &untracked)) {
+      bool periodic = id.periods > 0;
+      printf("%-8s %10llu %12.3f %12.3f %12.3f %2u-%u\n",
+             format_id(id.id).c_str(),
+             static_cast<unsigned long long>(id.count),
+             id.mean_period_ns() / 1e6,
+             periodic ? id.min_period_ns / 1e6 : 0.0,
+             periodic ? id.max_period_ns / 1e6 : 0.0, id.min_dlc, id.max_dlc);
+      if (!histogram)
+        continue;
+      for (size_t b = 0; b < kPeriodBuckets; ++b) {
+        if (id.period_histogram[b])
+          printf("         >= %10.3f ms %10llu\n",
+                 period_bucket_floor_ns(b) / 1e6,
+                 static_cast<unsigned long long>(id.period_histogram[b]));
+      }
+    }
+    if (untracked)
+      printf("%llu frames of extended IDs not tracked (too many distinct "
+             "IDs)\n",
+             static_cast<unsigned long long>(untracked));
+  } else if (command == "signal") {
+    printf("%-20s %10s %14s %14s %14s\n", "start", "frames", "min", "mean",
+           "max");
+    for (const SignalBucket& bucket : analyzer.signal_buckets(query, filter))
+      printf("%-20.3f %10llu %14.6g %14.6g %14.6g\n",
+             bucket.start_ns / 1e9,
+             static_cast<unsigned long long>(bucket.count), bucket.min,
+             bucket.mean(), bucket.max);
+  } else {
+    printf("timestamp,value\n");
+    for (const SignalSample& sample : analyzer.extract_signal(query, filter))
+      printf("%.6f,%.10g\n", sample.timestamp_ns / 1e9, sample.value);
+  }
+
+  double elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  std::cerr << analyzer.size() << " records in " << elapsed * 1000
+            << " ms on " << analyzer.threads() << " threads ("
+            << analyzer.size() * sizeof(CaptureRecord) / elapsed / 1e6
+            << " MB/s)" << std::endl;
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/udp_bridge.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <signal.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// CAN over UDP for remote monitoring:
+//
+//   can_bridge send -d 192.168.1.20:29536 can0 can1
+//   can_bridge recv -l :29536 vcan0 vcan1
+//
+// Channel N on the sender is the Nth interface; the receiver replays it into
+// its Nth output ("-" leaves the channel out).
+
+volatile sig_atomic_t interrupted = 0;
+
+void signal_handler(int) {
+  interrupted = 1;
+}
+
+void print_usage(const char* program) {
+  std::cout
+    << "Usage: " << program << " send -d <host:port> [options] <if>...\n"
+    << "       " << program << " recv -l <[host]:port> [options] <out>...\n"
+    << "  -d <host:port>  Destination of the datagrams (send)\n"
+    << "  -l <addr:port>  Address to listen on (recv)\n"
+    << "  -b <us>         Flush budget in microseconds (send, default 1000)\n"
+    << "  -m <bytes>      Maximum datagram size (send, default 1472)\n"
+    << "  -s <sec>        Print statistics every <sec> seconds\n"
+    << "  -h              Show this help\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string mode = argv[1];
+  if (mode != "send" && mode != "recv") {
+    print_usage(argv[0]);
+    return mode == "-h" ? 0 : 1;
+  }
+
+  std::string address;
+  long        budget_us    = 1000;
+  size_t      max_datagram = 1472;
+  int         stats_period = 0;
+  int         opt;
+  optind = 2;
+  while ((opt = getopt(argc, argv, "d:l:b:m:s:h")) != -1) {
+    switch (opt) {
+    case 'd':
+    case 'l':
+      address = optarg;
+      break;
+    case 'b':
+      budget_us = std::atol(optarg);
+      break;
+    case 'm':
+      max_datagram = static_cast<size_t>(std::atol(optarg));
+      break;
+    case 's':
+      stats_period = std::atoi(optarg);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  std::vector<std::string> interfaces;
+  for (int i = optind; i < argc; ++i)
+    interfaces.push_back(std::string(argv[i]) == "-" ? "" : argv[i]);
+  if (address.empty() || interfaces.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  EpollEventLoop    loop;
+  UdpBridgeSender   sender;
+  UdpBridgeReceiver receiver;
+  if (mode == "send") {
+    if (!sender.init(&loop, interfaces, address,
+                     std::chrono::microseconds(budget_us), max_datagram))
+      return 1;
+  } else if (!receiver.init(&loop, address, interfaces)) {
+    return 1;
+  }
+
+  uint64_t next_stats = DeadlineScheduler::now_ns() +
+                        static_cast<uint64_t>(stats_period) * 1000000000ull;
+  while (!interrupted) {
+    if (loop.run_once(100) == -1)
+      break;
+    if (stats_period <= 0 || DeadlineScheduler::now_ns() < next_stats)
+      continue;
+    next_stats += static_cast<uint64_t>(stats_period) * 1000000000ull;
+    if (mode == "send") {
+      const UdpBridgeSender::Stats& stats = sender.stats();
+      std::cout << stats.frames << " frames, " << stats.datagrams
+                << " datagrams, " << stats.send_calls << " sendmmsg, "
+                << stats.dropped_datagrams << " dropped" << std::endl;
+    } else {
+      const UdpBridgeReceiver::Stats& stats = receiver.stats();
+      std::cout << stats.frames << " frames, " << stats.datagrams
+                << " datagrams, " << stats.receive_calls << " recvmmsg, "
+                << stats.lost_datagrams << " lost, " << stats.reordered
+                << " reordered, " << stats.malformed << " malformed, "
+                << stats.replay_dropped << " replay dropped" << std::endl;
+    }
+  }
+
+  sender.deinit();
+  receiver.deinit();
+  return 0;
+}
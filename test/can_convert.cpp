@@ -0,0 +1,61 @@
+#include "socket_can/capture_formats.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+// Converts between capture formats, picked by file extension:
+//   .scap (native), .zcap (compressed native), .log (candump),
+//   .asc (Vector ASC), .blf (Vector BLF)
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " <input> <output>" << std::endl;
+  std::cout << "  Supported extensions: .scap .zcap .log .asc .blf" << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name << " drive.log drive.blf" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 3) {
+    print_usage(argv[0]);
+    return argc == 2 && (std::string(argv[1]) == "-h" ||
+                         std::string(argv[1]) == "--help")
+             ? 0
+             : 1;
+  }
+
+  std::unique_ptr<FrameSource> source = open_capture_source(argv[1]);
+  if (!source) {
+    std::cerr << "Cannot open input " << argv[1] << std::endl;
+    return 1;
+  }
+  std::unique_ptr<FrameSink> sink = open_capture_sink(argv[2]);
+  if (!sink) {
+    std::cerr << "Cannot open output " << argv[2] << std::endl;
+    return 1;
+  }
+
+  auto          start = std::chrono::steady_clock::now();
+  CaptureRecord record;
+  uint64_t      count = 0;
+  while (source->next(record)) {
+    if (!sink->write(record)) {
+      std::cerr << "Write failed after " << count << " frames" << std::endl;
+      return 1;
+    }
+    ++count;
+  }
+  if (!sink->close()) {
+    std::cerr << "Failed to finalize " << argv[2] << std::endl;
+    return 1;
+  }
+
+  auto elapsed = std::chrono::duration<double>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  std::cout << "Converted " << count << " frames in " << elapsed << " s";
+  if (elapsed > 0)
+    std::cout << " (" << static_cast<uint64_t>(count / elapsed)
+              << " frames/s)";
+  std::cout << std::endl;
+  return 0;
+}
@@ -0,0 +1,234 @@
+#include "socket_can/can_gateway.hpp"
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/metrics.hpp"
+#include "socket_can/replay.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Gateway between CAN interfaces, driven by rules such as
+//
+//   can0 can1 123                    forward 0x123 as is
+//   can0 can1 100/700 set=500/700    0x100-0x1FF, rewritten to 0x500-0x5FF
+//   can0 can2 * rate=100/10          everything, at most 100 frames/s
+//   can0 can2 18DAF110 xor=00FF000000000000 name=diag
+//
+// IDs are hex; more than three digits makes a 29-bit ID. Without a mask the
+// ID matches exactly, "*" matches every frame.
+
+volatile sig_atomic_t interrupted = 0;
+
+void signal_handler(int) {
+  interrupted = 1;
+}
+
+void print_usage(const char* program) {
+  std::cout
+    << "Usage: " << program << " [options]\n"
+    << "  -r <rule>    Add a rule: <from> <to> <id>[/<mask>]|*\n"
+    << "               [set=<id>/<mask>] [and=<hex>] [or=<hex>] [xor=<hex>]\n"
+    << "               [rate=<n>[/<burst>]] [name=<label>] [nooffload]\n"
+    << "  -f <file>    Read rules from a file, one per line (# comments)\n"
+    << "  -n           Never offload rules to can-gw\n"
+    << "  -s <sec>     Print route statistics every <sec> seconds\n"
+    << "  -m <socket>  Serve OpenMetrics on a Unix socket\n"
+    << "  -h           Show this help\n";
+}
+
+canid_t parse_id(const std::string& text) {
+  canid_t id = static_cast<canid_t>(std::strtoul(text.c_str(), nullptr, 16));
+  return text.size() > 3 ? id | CAN_EFF_FLAG : id;
+}
+
+bool parse_data(const std::string&                 text,
+                std::array<uint8_t, CAN_MAX_DLEN>& data) {
+  if (text.size() != 2 * CAN_MAX_DLEN)
+    return false;
+  for (size_t i = 0; i < CAN_MAX_DLEN; ++i) {
+    data[i] = static_cast<uint8_t>(
+      std::strtoul(text.substr(2 * i, 2).c_str(), nullptr, 16));
+  }
+  return true;
+}
+
+bool parse_rule(const std::string& line, GatewayRule& rule) {
+  std::istringstream       in(line);
+  std::vector<std::string> tokens;
+  std::string              token;
+  while (in >> token)
+    tokens.push_back(token);
+  if (tokens.size() < 3)
+    return false;
+  rule.from = tokens[0];
+  rule.to   = tokens[1];
+
+  const std::string& match = tokens[2];
+  if (match != "*") {
+    size_t slash = match.find('/');
+    rule.id      = parse_id(match.substr(0, slash));
+    rule.mask =
+      slash == std::string::npos
+        ? CAN_EFF_FLAG | CAN_RTR_FLAG |
+            (rule.id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK)
+        : CAN_EFF_FLAG | CAN_RTR_FLAG |
+            static_cast<canid_t>(
+              std::strtoul(match.substr(slash + 1).c_str(), nullptr, 16));
+  }
+
+  for (size_t i = 3; i < tokens.size(); ++i) {
+    const std::string& option = tokens[i];
+    size_t             equals = option.find('=');
+    std::string        key    = option.substr(0, equals);
+    std::string        value =
+      equals == std::string::npos ? "" : option.substr(equals + 1);
+    if (key == "set") {
+      size_t slash = value.find('/');
+      if (slash == std::string::npos)
+        return false;
+      rule.new_id          = parse_id(value.substr(0, slash));
+      rule.id_rewrite_mask = static_cast<canid_t>(
+        std::strtoul(value.substr(slash + 1).c_str(), nullptr, 16));
+    } else if (key == "and") {
+      if (!parse_data(value, rule.data_and))
+        return false;
+    } else if (key == "or") {
+      if (!parse_data(value, rule.data_or))
+        return false;
+    } else if (key == "xor") {
+      if (!parse_data(value, rule.data_xor))
+        return false;
+    } else if (key == "rate") {
+      size_t slash    = value.find('/');
+      rule.rate_limit = std::atof(value.substr(0, slash).c_str());
+      if (slash != std::string::npos)
+        rule.burst =
+          static_cast<uint32_t>(std::atoi(value.c_str() + slash + 1));
+    } else if (key == "name") {
+      rule.name = value;
+    } else if (key == "nooffload") {
+      rule.allow_offload = false;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<GatewayRule> rules;
+  bool                     offload      = true;
+  int                      stats_period = 0;
+  std::string              metrics_socket;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:f:ns:m:h")) != -1) {
+    switch (opt) {
+    case 'r': {
+      GatewayRule rule;
+      if (!parse_rule(optarg, rule)) {
+        std::cerr << "Invalid rule: " << optarg << std::endl;
+        return 1;
+      }
+      rules.push_back(rule);
+      break;
+    }
+    case 'f': {
+      std::ifstream file(optarg);
+      if (!file) {
+        std::cerr << "Failed to open " << optarg << std::endl;
+        return 1;
+      }
+      std::string line;
+      while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t") == std::string::npos)
+          continue;
+        GatewayRule rule;
+        if (!parse_rule(line, rule)) {
+          std::cerr << "Invalid rule: " << line << std::endl;
+          return 1;
+        }
+        rules.push_back(rule);
+      }
+      break;
+    }
+    case 'n':
+      offload = false;
+      break;
+    case 's':
+      stats_period = std::atoi(optarg);
+      break;
+    case 'm':
+      metrics_socket = optarg;
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rules.empty()) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  EpollEventLoop loop;
+  CanGateway     gateway;
+  if (!gateway.init(&loop, rules, offload))
+    return 1;
+  for (size_t i = 0; i < gateway.routes(); ++i) {
+    std::cout << "route " << i << ": " << rules[i].from << " -> "
+              << rules[i].to
+              << (gateway.stats(i).offloaded ? " (can-gw)" : " (user space)")
+              << std::endl;
+  }
+
+  // Scrapes are served on their own thread, away from the forwarding loop
+  std::atomic<bool> stop{false};
+  std::thread       metrics_thread;
+  if (!metrics_socket.empty()) {
+    metrics_thread = std::thread([&metrics_socket, &stop]() {
+      EpollEventLoop metrics_loop;
+      MetricsServer  server;
+      if (!server.init(metrics_socket, &metrics_loop))
+        return;
+      while (!stop)
+        metrics_loop.run_once(100);
+      server.deinit();
+    });
+  }
+
+  uint64_t next_stats = DeadlineScheduler::now_ns() +
+                        static_cast<uint64_t>(stats_period) * 1000000000ull;
+  while (!interrupted) {
+    if (loop.run_once(100) == -1)
+      break;
+    if (stats_period > 0 && DeadlineScheduler::now_ns() >= next_stats) {
+      next_stats += static_cast<uint64_t>(stats_period) * 1000000000ull;
+      for (size_t i = 0; i < gateway.routes(); ++i) {
+        CanGateway::RouteStats stats = gateway.stats(i);
+        std::cout << "route " << i << ": " << stats.forwarded
+                  << " forwarded, " << stats.rate_dropped << " rate-limited, "
+                  << stats.queue_dropped << " dropped (TX queue full)"
+                  << std::endl;
+      }
+    }
+  }
+
+  stop = true;
+  if (metrics_thread.joinable())
+    metrics_thread.join();
+  gateway.deinit();
+  return 0;
+}
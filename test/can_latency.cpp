@@ -0,0 +1,367 @@
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/latency_histogram.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/socket_can.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <signal.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+// Request/response latency between two SocketCanIntf instances. The pinger
+// sends requests at a fixed offered rate with at most `window` outstanding;
+// each payload carries a sequence number and the low 32 bits of the send time
+// (CLOCK_MONOTONIC ns). The ponger echoes requests under the response ID.
+//
+// Raw latency is measured from the actual send time. Corrected latency is
+// measured from the time the request was scheduled to go out, so requests
+// delayed by a slow response (coordinated omission) count their waiting time.
+//
+// Request `seq` occupies slot seq % window until its response arrives or it is
+// declared lost; responses that match no occupied slot (late, duplicated) are
+// ignored, so every sent request ends up either received or lost.
+
+volatile sig_atomic_t interrupted = 0;
+
+void signal_handler(int) {
+  interrupted = 1;
+}
+
+struct Payload {
+  uint32_t seq;
+  uint32_t send_ns;  // low 32 bits, differences are valid below ~4.29 s
+};
+
+static_assert(sizeof(Payload) == CAN_MAX_DLEN, "payload fills a frame");
+
+uint64_t now_ns() {
+  return DeadlineScheduler::now_ns();
+}
+
+// Echoes requests and records frame-to-callback (one-way) latency
+class Ponger {
+public:
+  Ponger(canid_t request_id, canid_t response_id)
+    : request_id_(request_id), response_id_(response_id) {
+  }
+
+  bool init(const std::string& iface) {
+    return can_.init(iface, &loop_, [this](const can_frame& frame) {
+      on_frame(frame);
+    });
+  }
+
+  void run(const std::atomic<bool>& stop) {
+    while (!stop && !interrupted) {
+      if (loop_.run_once(100) == -1)
+        break;
+    }
+    can_.deinit();
+  }
+
+  const LatencyHistogram& one_way() const {
+    return one_way_;
+  }
+
+private:
+  void on_frame(const can_frame& frame) {
+    if ((frame.can_id & CAN_EFF_MASK) != request_id_ || frame.can_dlc != 8)
+      return;
+    Payload payload;
+    std::memcpy(&payload, frame.data, sizeof(payload));
+    one_way_.record(static_cast<uint32_t>(now_ns()) - payload.send_ns);
+
+    can_frame response = frame;
+    response.can_id    = response_id_;
+    while (!can_.send_can_frame(response) && can_.wait_writable(10))
+      ;
+  }
+
+  canid_t          request_id_;
+  canid_t          response_id_;
+  EpollEventLoop   loop_;
+  SocketCanIntf    can_;
+  LatencyHistogram one_way_;
+};
+
+class Pinger {
+public:
+  Pinger(canid_t request_id, canid_t response_id)
+    : request_id_(request_id), response_id_(response_id) {
+  }
+
+  bool init(const std::string& iface) {
+    return can_.init(iface, &loop_, [this](const can_frame& frame) {
+      on_frame(frame);
+    });
+  }
+
+  // Sends `count` requests at `rate` per second (0 = back-to-back, one
+  // window at a time) and collects the responses
+  void run(uint64_t count, double rate, uint32_t window) {
+    count_    = count;
+    interval_ = rate > 0 ? static_cast<uint64_t>(1e9 / rate) : 0;
+    start_ns_ = now_ns() + 1000000;
+    window_   = window;
+    in_flight_.reset(new std::atomic<uint64_t>[window]);
+    for (uint32_t i = 0; i < window; ++i)
+      in_flight_[i] = 0;
+
+    std::thread sender([this]() { send_loop(); });
+    uint64_t    idle_since = 0;
+    while (!interrupted) {
+      int n = loop_.run_once(10);
+      if (n == -1)
+        break;
+      if (sent_done_ && received_ + lost_ >= sent_)
+        break;
+      // Give the last responses a second to arrive
+      if (sent_done_ && n == 0) {
+        if (!idle_since)
+          idle_since = now_ns();
+        else if (now_ns() - idle_since > 1000000000ull)
+          break;
+      } else {
+        idle_since = 0;
+      }
+    }
+    stop_ = true;
+    sender.join();
+    can_.deinit();
+    // Requests still unanswered are lost
+    for (uint32_t i = 0; i < window_; ++i) {
+      if (in_flight_[i].exchange(0))
+        lost_++;
+    }
+  }
+
+  const LatencyHistogram& raw() const {
+    return raw_;
+  }
+  const LatencyHistogram& corrected() const {
+    return corrected_;
+  }
+  uint64_t received() const {
+    return received_;
+  }
+  uint64_t sent() const {
+    return sent_;
+  }
+  uint64_t lost() const {
+    return lost_;
+  }
+
+private:
+  void send_loop() {
+    DeadlineScheduler scheduler;
+    for (uint64_t seq = 0; seq < count_ && !stop_ && !interrupted; ++seq) {
+      if (interval_)
+        scheduler.wait_until(intended_ns(seq), &stop_);
+
+      // Window full: wait for the response to seq - window; after 1 s that
+      // request is lost and its response is ignored if it still arrives
+      std::atomic<uint64_t>& slot       = in_flight_[seq % window_];
+      uint64_t               wait_start = now_ns();
+      while (uint64_t oldest = slot.load()) {
+        if (stop_)
+          break;
+        if (now_ns() - wait_start > 1000000000ull) {
+          if (slot.compare_exchange_strong(oldest, 0))
+            lost_++;
+          break;
+        }
+        std::this_thread::yield();
+      }
+      if (stop_)
+        break;
+
+      can_frame frame = {};
+      frame.can_id    = request_id_;
+      frame.can_dlc   = 8;
+      Payload payload = {static_cast<uint32_t>(seq), 0};
+      payload.send_ns = static_cast<uint32_t>(now_ns());
+      std::memcpy(frame.data, &payload, sizeof(payload));
+      slot = seq + 1;
+      while (!can_.send_can_frame(frame) && !stop_)
+        can_.wait_writable(10);
+      sent_++;
+    }
+    sent_done_ = true;
+  }
+
+  uint64_t intended_ns(uint64_t seq) const {
+    return start_ns_ + seq * interval_;
+  }
+
+  void on_frame(const can_frame& frame) {
+    if ((frame.can_id & CAN_EFF_MASK) != response_id_ || frame.can_dlc != 8)
+      return;
+    uint64_t now = now_ns();
+    Payload  payload;
+    std::memcpy(&payload, frame.data, sizeof(payload));
+
+    // Rebuild the full sequence number from its low 32 bits; the request was
+    // sent at most shortly before sent_ was incremented
+    uint64_t sent = sent_;
+    uint64_t seq  = (sent & ~0xFFFFFFFFull) | payload.seq;
+    if (seq > sent && seq >= (1ull << 32))
+      seq -= 1ull << 32;
+    uint64_t expected = seq + 1;
+    if (!in_flight_[seq % window_].compare_exchange_strong(expected, 0))
+      return;  // already declared lost, or not ours
+
+    raw_.record(static_cast<uint32_t>(now) - payload.send_ns);
+    if (interval_)
+      corrected_.record(now - intended_ns(seq));
+    received_++;
+  }
+
+  canid_t               request_id_;
+  canid_t               response_id_;
+  EpollEventLoop        loop_;
+  SocketCanIntf         can_;
+  LatencyHistogram      raw_;
+  LatencyHistogram      corrected_;
+  uint64_t              count_    = 0;
+  uint64_t              interval_ = 0;
+  uint64_t              start_ns_ = 0;
+  uint32_t              window_   = 1;
+  std::atomic<uint64_t> sent_{0};
+  std::atomic<uint64_t> received_{0};
+  std::atomic<uint64_t> lost_{0};
+  std::atomic<bool>     sent_done_{false};
+  std::atomic<bool>     stop_{false};
+
+  // seq + 1 of the request occupying each slot, 0 when free
+  std::unique_ptr<std::atomic<uint64_t>[]> in_flight_;
+};
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options]" << std::endl;
+  std::cout << "  -i <iface>   interface (default: vbus:latency, in-process)"
+            << std::endl;
+  std::cout << "  -m <mode>    both (default), ping or pong; ping and pong run "
+               "in separate processes on a kernel interface"
+            << std::endl;
+  std::cout << "  -n <count>   requests to send (default: 10000)" << std::endl;
+  std::cout << "  -R <rate>    offered requests per second (default: 1000; 0 "
+               "= back-to-back)"
+            << std::endl;
+  std::cout << "  -w <window>  max outstanding requests (default: 1)"
+            << std::endl;
+  std::cout << "  -q <id>      request ID, hex (default: 7E0)" << std::endl;
+  std::cout << "  -r <id>      response ID, hex (default: 7E8)" << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name << " -i vcan0 -m pong &" << std::endl;
+  std::cout << "  " << program_name << " -i vcan0 -m ping -R 5000 -w 4"
+            << std::endl;
+}
+
+void print_histogram(const char* label, const LatencyHistogram& histogram) {
+  std::cout << label << " (us): " << histogram.summary(1000) << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::string iface       = "vbus:latency";
+  std::string mode        = "both";
+  uint64_t    count       = 10000;
+  double      rate        = 1000;
+  uint32_t    window      = 1;
+  canid_t     request_id  = 0x7E0;
+  canid_t     response_id = 0x7E8;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:m:n:R:w:q:r:h")) != -1) {
+    switch (opt) {
+      case 'i':
+        iface = optarg;
+        break;
+      case 'm':
+        mode = optarg;
+        break;
+      case 'n':
+        count = std::strtoull(optarg, nullptr, 0);
+        break;
+      case 'R':
+        rate = std::atof(optarg);
+        break;
+      case 'w':
+        window = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 0));
+        break;
+      case 'q':
+        request_id = static_cast<canid_t>(std::strtoul(optarg, nullptr, 16));
+        break;
+      case 'r':
+        response_id = static_cast<canid_t>(std::strtoul(optarg, nullptr, 16));
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if ((mode != "both" && mode != "ping" && mode != "pong") || window == 0 ||
+      rate < 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  Ponger            ponger(request_id, response_id);
+  std::atomic<bool> stop_ponger{false};
+  std::thread       ponger_thread;
+  if (mode != "ping") {
+    if (!ponger.init(iface)) {
+      std::cerr << "Failed to initialize ponger on " << iface << std::endl;
+      return 1;
+    }
+    if (mode == "pong") {
+      std::cout << "Echoing 0x" << std::hex << request_id << " as 0x"
+                << response_id << std::dec << " on " << iface
+                << ", Ctrl+C to stop" << std::endl;
+      ponger.run(stop_ponger);
+      print_histogram("One-way", ponger.one_way());
+      return 0;
+    }
+    ponger_thread = std::thread([&]() { ponger.run(stop_ponger); });
+  }
+
+  Pinger pinger(request_id, response_id);
+  if (!pinger.init(iface)) {
+    std::cerr << "Failed to initialize pinger on " << iface << std::endl;
+    stop_ponger = true;
+    if (ponger_thread.joinable())
+      ponger_thread.join();
+    return 1;
+  }
+  std::cout << "Sending " << count << " requests on " << iface << " at "
+            << (rate > 0 ? std::to_string(static_cast<uint64_t>(rate)) + "/s"
+                         : std::string("full speed"))
+            << ", window " << window << std::endl;
+  pinger.run(count, rate, window);
+
+  stop_ponger = true;
+  if (ponger_thread.joinable())
+    ponger_thread.join();
+
+  std::cout << "Sent " << pinger.sent() << ", received " << pinger.received()
+            << ", lost " << pinger.lost() << std::endl;
+  if (mode == "both")
+    print_histogram("One-way", ponger.one_way());
+  print_histogram("Round-trip", pinger.raw());
+  if (rate > 0)
+    print_histogram("Round-trip, corrected", pinger.corrected());
+  // Lost responses fail the run (and the smoke test)
+  return interrupted || (pinger.lost() == 0 &&
+                         pinger.received() == pinger.sent())
+           ? 0
+           : 1;
+}
@@ -1,10 +1,18 @@
 #include "socket_can/socket_can.hpp"
 #include "socket_can/epoll_event_loop.hpp"
-#include <iostream>
+#include "socket_can/buffered_file.hpp"
+#include "socket_can/frame_formatter.hpp"
+#include "socket_can/metrics.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/traffic_statistics.hpp"
+#include <atomic>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
 #include <thread>
-#include <iomanip>
 #include <signal.h>
+#include <unistd.h>
 
 // Global flag để stop monitoring
 volatile bool running = true;
@@ -16,13 +24,38 @@ void signal_handler(int signum) {
 
 class CanMonitor {
 public:
-    CanMonitor() : frame_count_(0) {}
+    explicit CanMonitor(bool candump_format = false, bool statistics = false,
+                        uint32_t bitrate = 0)
+        : output_(64 * 1024), frame_count_(0), candump_format_(candump_format),
+          statistics_(statistics) {
+        if (bitrate) {
+            stats_.enable_bus_load(bitrate);
+        }
+    }
     
     bool init(const std::string& interface) {
+        interface_ = interface;
         std::cout << "Initializing CAN monitor on interface: " << interface << std::endl;
         
         // Khởi tạo event loop
         event_loop_ = std::make_unique<EpollEventLoop>();
+        event_loop_->enable_metrics("monitor", MetricsRegistry::global());
+        const BusLoadEstimator* bus_load = statistics_ ? stats_.bus_load() : nullptr;
+        if (bus_load) {
+            // Tải bus được tính khi scrape, không tốn gì trên đường nhận
+            static const char* const kWindowNames[] = {"100ms", "1s", "10s"};
+            for (size_t w = 0; w < BusLoadEstimator::kWindows; ++w) {
+                bus_load_metrics_.push_back(MetricsRegistry::global().callback(
+                    "socket_can_bus_load_ratio",
+                    "Fraction of time frames occupied the bus",
+                    MetricsRegistry::Type::kGauge,
+                    {{"interface", interface}, {"window", kWindowNames[w]}},
+                    [bus_load, w](double& value) {
+                        value = bus_load->load(w, DeadlineScheduler::now_ns());
+                        return true;
+                    }));
+            }
+        }
         
         // Khởi tạo socket CAN với callback
         bool success = socket_can_.init(interface, event_loop_.get(), 
@@ -34,6 +67,15 @@ public:
             std::cerr << "Failed to initialize CAN interface: " << interface << std::endl;
             return false;
         }
+
+        // Error frame được giải mã (error-passive, bus-off, ...); khi interface
+        // down rồi up lại, socket tự mở lại mà không cần khởi động lại monitor
+        socket_can_.set_error_handler([this](const CanErrorInfo& error) {
+            log_error_frame(error);
+        });
+        if (link_monitor_.init(event_loop_.get())) {
+            socket_can_.enable_recovery(&link_monitor_);
+        }
         
         std::cout << "CAN monitor initialized successfully on " << interface << std::endl;
         return true;
@@ -41,103 +83,172 @@ public:
     
     void log_received_frame(const can_frame& frame) {
         frame_count_++;
-        
-        // Get current time for timestamp
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()) % 1000;
-        
-        // Format timestamp
-        std::cout << "[" << std::put_time(std::localtime(&time_t), "%H:%M:%S");
-        std::cout << "." << std::setfill('0') << std::setw(3) << ms.count() << "] ";
-        
-        // Frame counter
-        std::cout << "Frame #" << std::setw(6) << frame_count_ << " - ";
-        
-        // CAN ID với format phù hợp
-        if (frame.can_id & CAN_EFF_FLAG) {
-            // Extended frame
-            std::cout << "ID: 0x" << std::hex << std::setfill('0') << std::setw(8) 
-                      << (frame.can_id & CAN_EFF_MASK) << " (EXT)";
-        } else {
-            // Standard frame  
-            std::cout << "ID: 0x" << std::hex << std::setfill('0') << std::setw(3)
-                      << (frame.can_id & CAN_SFF_MASK) << " (STD)";
+        if (statistics_) {
+            stats_.record(frame, DeadlineScheduler::now_ns());
+            return;
         }
-        
-        // RTR flag
-        if (frame.can_id & CAN_RTR_FLAG) {
-            std::cout << " RTR";
+
+        // Format thẳng vào buffer output, không dùng iostream cho từng frame
+        char* out = output_.reserve(FrameFormatter::kMaxLineLength +
+                                    interface_.size());
+        if (!out) {
+            return;
         }
-        
-        // Data length
-        std::cout << " DLC: " << std::dec << (int)frame.can_dlc;
-        
-        // Data bytes
-        if (frame.can_dlc > 0 && !(frame.can_id & CAN_RTR_FLAG)) {
-            std::cout << " Data: [";
-            for (int i = 0; i < frame.can_dlc; i++) {
-                std::cout << "0x" << std::hex << std::setfill('0') << std::setw(2) 
-                          << (int)frame.data[i];
-                if (i < frame.can_dlc - 1) std::cout << " ";
-            }
-            std::cout << "]";
-            
-            // ASCII representation nếu có thể đọc được
-            std::cout << " ASCII: \"";
-            for (int i = 0; i < frame.can_dlc; i++) {
-                char c = frame.data[i];
-                if (c >= 32 && c <= 126) {  // Printable ASCII
-                    std::cout << c;
-                } else {
-                    std::cout << ".";
-                }
-            }
-            std::cout << "\"";
+        char* end;
+        if (candump_format_) {
+            CaptureRecord record = {};
+            record.timestamp_ns  = capture_now_ns();
+            record.frame         = frame;
+            end = FrameFormatter::format_candump(out, record, interface_.data(),
+                                                 interface_.size());
+        } else {
+            end = formatter_.format_human(out, frame, capture_now_ns(),
+                                          frame_count_);
         }
-        
-        std::cout << std::endl;
-        std::cout.flush();  // Force flush để hiện ngay
+        output_.commit(static_cast<size_t>(end - out));
     }
     
+    // Snapshot OpenMetrics: qua Unix socket (thread và event loop riêng)
+    // và/hoặc ghi ra file mỗi giây
+    void set_metrics_output(const std::string& socket_path,
+                            const std::string& file_path) {
+        metrics_socket_ = socket_path;
+        metrics_file_ = file_path;
+    }
+
+    void log_error_frame(const CanErrorInfo& error) {
+        std::string text = error.describe();
+        char* out = output_.reserve(text.size() + interface_.size() + 16);
+        if (!out) {
+            return;
+        }
+        int n = snprintf(out, text.size() + interface_.size() + 16,
+                         "%s ERROR %s\n", interface_.c_str(), text.c_str());
+        output_.commit(static_cast<size_t>(n));
+    }
+
     void start_monitoring() {
         std::cout << "\n=== Starting CAN Monitor ===" << std::endl;
         std::cout << "Press Ctrl+C to stop monitoring\n" << std::endl;
         
-        // Chạy event loop trong thread riêng
-        std::thread monitor_thread([this]() {
-            while (running && event_loop_) {
-                // Sử dụng epoll_wait với timeout để có thể check running flag
-                // Tạm thời dùng polling approach đơn giản
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
-            }
-        });
-        
-        // Main thread chờ signal hoặc running flag
+        // Chạy event loop với timeout để có thể check running flag; output
+        // của mỗi vòng lặp được ghi ra stdout bằng một lần write()
+        output_.attach(STDOUT_FILENO);
+        std::atomic<bool> stop_reporter{false};
+        std::thread reporter;
+        if (statistics_ || !metrics_file_.empty()) {
+            // Đọc snapshot từ thread khác, không làm gián đoạn việc nhận frame
+            reporter = std::thread([this, &stop_reporter]() {
+                while (!stop_reporter) {
+                    std::this_thread::sleep_for(std::chrono::seconds(1));
+                    if (statistics_) {
+                        print_statistics();
+                    }
+                    if (!metrics_file_.empty()) {
+                        MetricsRegistry::global().write_file(metrics_file_);
+                    }
+                }
+            });
+        }
+        std::thread metrics_thread;
+        EpollEventLoop metrics_loop;
+        MetricsServer metrics_server;
+        if (!metrics_socket_.empty() &&
+            metrics_server.init(metrics_socket_, &metrics_loop)) {
+            std::cout << "Serving metrics on " << metrics_socket_ << std::endl;
+            metrics_thread = std::thread([&metrics_loop, &stop_reporter]() {
+                while (!stop_reporter) {
+                    metrics_loop.run_once(100);
+                }
+            });
+        }
         while (running) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            if (event_loop_->run_once(100) == -1) {
+                std::cerr << "Event loop failed" << std::endl;
+                break;
+            }
+            output_.flush();
         }
+        output_.close();
+        stop_reporter = true;
+        if (reporter.joinable()) {
+            reporter.join();
+        }
+        if (metrics_thread.joinable()) {
+            metrics_thread.join();
+        }
+        metrics_server.deinit();
         
         std::cout << "\nStopping monitor..." << std::endl;
         
-        if (monitor_thread.joinable()) {
-            monitor_thread.join();
+        for (const auto& metric : bus_load_metrics_) {
+            metric->reset();
         }
-        
         socket_can_.deinit();
+        link_monitor_.deinit();
         
         std::cout << "\nMonitoring stopped. Total frames received: " << frame_count_ << std::endl;
     }
     
+    // Bảng thống kê theo ID; ID nào quá hạn so với chu kỳ trung bình được
+    // đánh dấu LATE
+    void print_statistics() {
+        uint64_t now = DeadlineScheduler::now_ns();
+        auto all = stats_.snapshot_all();
+        if (const BusLoadEstimator* bus_load = stats_.bus_load()) {
+            printf("\nBus load at %u bit/s: %.1f%% (100 ms) %.1f%% (1 s) "
+                   "%.1f%% (10 s)\n",
+                   bus_load->bitrate(), bus_load->load(0, now) * 100,
+                   bus_load->load(1, now) * 100, bus_load->load(2, now) * 100);
+        }
+        printf("\n%-10s %10s %10s %12s %12s %12s %6s %12s\n", "ID", "count",
+               "rate/s", "period ms", "jitter ms", "max gap ms", "dlc+-",
+               "overdue ms");
+        for (const auto& entry : all) {
+            const IdStats& s = entry.second;
+            char id[16];
+            if (entry.first & CAN_EFF_FLAG) {
+                snprintf(id, sizeof(id), "%08X", entry.first & CAN_EFF_MASK);
+            } else {
+                snprintf(id, sizeof(id), "%03X", entry.first);
+            }
+            uint64_t overdue = s.overdue_ns(now);
+            printf("%-10s %10llu %10.1f %12.3f %12.3f %12.3f %6u %12.3f%s\n",
+                   id, static_cast<unsigned long long>(s.count), s.rate_hz(),
+                   s.mean_interval_ns / 1e6, s.jitter_ns() / 1e6,
+                   s.max_interval_ns / 1e6, s.dlc_changes, overdue / 1e6,
+                   overdue > s.mean_interval_ns ? "  LATE" : "");
+        }
+        if (stats_.untracked()) {
+            printf("(%llu frames of untracked extended IDs)\n",
+                   static_cast<unsigned long long>(stats_.untracked()));
+        }
+        fflush(stdout);
+    }
+
 private:
     std::unique_ptr<EpollEventLoop> event_loop_;
+    LinkMonitor link_monitor_;
     SocketCanIntf socket_can_;
-    int frame_count_;
+    std::string interface_;
+    BufferedFileWriter output_;
+    FrameFormatter formatter_;
+    uint64_t frame_count_;
+    bool candump_format_;
+    bool statistics_;
+    TrafficStatistics stats_;
+    std::string metrics_socket_;
+    std::string metrics_file_;
+    std::vector<std::shared_ptr<MetricCallback>> bus_load_metrics_;
 };
 
 void print_usage(const char* program_name) {
-    std::cout << "Usage: " << program_name << " [interface]" << std::endl;
+    std::cout << "Usage: " << program_name << " [-l|-s [-b bitrate]] [-m socket] [-M file] [interface]" << std::endl;
+    std::cout << "  -l: print candump log lines instead of the readable format" << std::endl;
+    std::cout << "  -s: print per-ID statistics (rate, period, jitter, gaps) every second" << std::endl;
+    std::cout << "  -b <bitrate>: with -s, also print the bus load (exact frame lengths)" << std::endl;
+    std::cout << "  -m <socket>: serve OpenMetrics on a Unix socket (curl --unix-socket <socket> http://localhost/metrics)" << std::endl;
+    std::cout << "  -M <file>: write OpenMetrics to a file every second" << std::endl;
     std::cout << "  interface: CAN interface name (default: vcan0)" << std::endl;
     std::cout << "\nExample:" << std::endl;
     std::cout << "  " << program_name << " vcan0" << std::endl;
@@ -157,20 +268,39 @@ int main(int argc, char* argv[]) {
     signal(SIGTERM, signal_handler);
     
     std::string interface = "vcan0";  // Default interface
+    bool candump_format = false;
+    bool statistics = false;
+    uint32_t bitrate = 0;
+    std::string metrics_socket;
+    std::string metrics_file;
     
     // Parse command line arguments
-    if (argc > 1) {
-        if (std::string(argv[1]) == "-h" || std::string(argv[1]) == "--help") {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "-h" || arg == "--help") {
             print_usage(argv[0]);
             return 0;
         }
-        interface = argv[1];
+        if (arg == "-l") {
+            candump_format = true;
+        } else if (arg == "-s") {
+            statistics = true;
+        } else if (arg == "-b" && i + 1 < argc) {
+            bitrate = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "-m" && i + 1 < argc) {
+            metrics_socket = argv[++i];
+        } else if (arg == "-M" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else {
+            interface = arg;
+        }
     }
     
     std::cout << "=== CAN Frame Monitor ===" << std::endl;
     std::cout << "Interface: " << interface << std::endl;
     
-    CanMonitor monitor;
+    CanMonitor monitor(candump_format, statistics, bitrate);
+    monitor.set_metrics_output(metrics_socket, metrics_file);
     
     if (!monitor.init(interface)) {
         std::cerr << "Failed to initialize CAN monitor" << std::endl;
@@ -0,0 +1,111 @@
+#include "socket_can/capture_formats.hpp"
+#include "socket_can/capture_index.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+// Indexed time/ID queries over native capture files
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options] <capture.scap>"
+            << std::endl;
+  std::cout << "  -b <sec>   start, seconds after the first frame" << std::endl;
+  std::cout << "  -e <sec>   end (exclusive), seconds after the first frame"
+            << std::endl;
+  std::cout << "  -i <id>    hex CAN ID, suffix x for 29-bit IDs; repeatable"
+            << std::endl;
+  std::cout << "  -r         (re)build the .idx sidecar before querying"
+            << std::endl;
+  std::cout << "  -c         only print the number of matches" << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name << " -b 2520 -e 2580 -i 1A0 drive.scap"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  double       begin_s = -1;
+  double       end_s   = -1;
+  CaptureQuery query;
+  bool         rebuild    = false;
+  bool         count_only = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:i:rch")) != -1) {
+    switch (opt) {
+      case 'b':
+        begin_s = std::atof(optarg);
+        break;
+      case 'e':
+        end_s = std::atof(optarg);
+        break;
+      case 'i': {
+        std::string arg = optarg;
+        bool        ext = !arg.empty() && (arg.back() == 'x' || arg.size() > 3);
+        if (ext && arg.back() == 'x')
+          arg.pop_back();
+        canid_t id = std::stoul(arg, nullptr, 16);
+        query.ids.push_back(ext ? (id & CAN_EFF_MASK) | CAN_EFF_FLAG : id);
+        break;
+      }
+      case 'r':
+        rebuild = true;
+        break;
+      case 'c':
+        count_only = true;
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  std::string path = argv[optind];
+
+  if (rebuild && !write_capture_index(path)) {
+    std::cerr << "Failed to build index for " << path << std::endl;
+    return 1;
+  }
+
+  auto         start = std::chrono::steady_clock::now();
+  CaptureIndex index;
+  if (!index.open(path)) {
+    std::cerr << "Cannot open " << path << " (use -r to build the index)"
+              << std::endl;
+    return 1;
+  }
+
+  uint64_t origin = index.capture().header().first_timestamp_ns;
+  if (origin == 0 && index.capture().size() > 0)
+    origin = index.capture().records()[0].timestamp_ns;
+  if (begin_s >= 0)
+    query.begin_ns = origin + static_cast<uint64_t>(begin_s * 1e9);
+  if (end_s >= 0)
+    query.end_ns = origin + static_cast<uint64_t>(end_s * 1e9);
+
+  CandumpLogWriter out;
+  if (!count_only && !out.open("/dev/stdout")) {
+    std::cerr << "Cannot write to stdout" << std::endl;
+    return 1;
+  }
+  size_t blocks  = index.candidate_blocks(query).size();
+  size_t matches = index.query(query, [&](const CaptureRecord& record) {
+    if (!count_only)
+      out.write(record);
+  });
+  out.close();
+
+  auto elapsed = std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  std::cerr << matches << " frames, " << blocks << "/" << index.block_count()
+            << " blocks scanned in " << elapsed << " ms" << std::endl;
+  return 0;
+}
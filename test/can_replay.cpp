@@ -0,0 +1,160 @@
+#include "socket_can/capture_formats.hpp"
+#include "socket_can/replay.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <signal.h>
+#include <string>
+#include <unistd.h>
+
+// Replays a capture file onto CAN interfaces with the original timing
+
+ReplayEngine* g_engine = nullptr;
+
+void signal_handler(int) {
+  if (g_engine)
+    g_engine->stop();
+}
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name
+            << " [options] <capture.{scap,log,asc,blf}>" << std::endl;
+  std::cout << "  -i <iface>        default output interface (default: vcan0)"
+            << std::endl;
+  std::cout << "  -m <ch>=<iface>   send capture channel <ch> to <iface>; "
+               "repeatable"
+            << std::endl;
+  std::cout << "  -s <speed>        speed factor 0.1 - 100 (default: 1.0)"
+            << std::endl;
+  std::cout << "  -a                as fast as possible" << std::endl;
+  std::cout << "  -f <id>:<mask>    only replay matching IDs (hex); prefix "
+               "with ~ to exclude; repeatable"
+            << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name << " -m 0=vcan0 -m 1=vcan1 -s 2 drive.blf"
+            << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::string                     default_iface = "vcan0";
+  std::map<uint32_t, std::string> channel_map;
+  std::vector<can_filter>         filters;
+  double                          speed = 1.0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:m:s:af:h")) != -1) {
+    switch (opt) {
+      case 'i':
+        default_iface = optarg;
+        break;
+      case 'm': {
+        std::string arg = optarg;
+        size_t      eq  = arg.find('=');
+        if (eq == std::string::npos) {
+          print_usage(argv[0]);
+          return 1;
+        }
+        channel_map[std::stoul(arg.substr(0, eq))] = arg.substr(eq + 1);
+        break;
+      }
+      case 's':
+        speed = std::atof(optarg);
+        break;
+      case 'a':
+        speed = 0;
+        break;
+      case 'f': {
+        std::string arg    = optarg;
+        bool        invert = !arg.empty() && arg[0] == '~';
+        if (invert)
+          arg = arg.substr(1);
+        size_t     colon = arg.find(':');
+        can_filter f     = {};
+        f.can_id         = std::stoul(arg.substr(0, colon), nullptr, 16);
+        f.can_mask       = colon == std::string::npos
+                             ? CAN_EFF_MASK
+                             : std::stoul(arg.substr(colon + 1), nullptr, 16);
+        if (invert)
+          f.can_id |= CAN_INV_FILTER;
+        filters.push_back(f);
+        break;
+      }
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind != argc - 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  std::unique_ptr<FrameSource> source = open_capture_source(argv[optind]);
+  if (!source) {
+    std::cerr << "Cannot open capture " << argv[optind] << std::endl;
+    return 1;
+  }
+
+  EpollEventLoop                                        event_loop;
+  std::map<std::string, std::unique_ptr<SocketCanIntf>> interfaces;
+  auto open_iface = [&](const std::string& name) -> SocketCanIntf* {
+    auto& intf = interfaces[name];
+    if (!intf) {
+      intf = std::make_unique<SocketCanIntf>();
+      if (!intf->init(name, &event_loop, [](const can_frame&) {})) {
+        std::cerr << "Failed to initialize " << name << std::endl;
+        return nullptr;
+      }
+    }
+    return intf.get();
+  };
+
+  ReplayEngine engine;
+  if (!engine.set_speed(speed))
+    return 1;
+  for (const auto& f : filters)
+    engine.add_filter(f);
+  if (channel_map.empty()) {
+    SocketCanIntf* intf = open_iface(default_iface);
+    if (!intf)
+      return 1;
+    engine.set_default_output(intf);
+  }
+  for (const auto& [channel, name] : channel_map) {
+    SocketCanIntf* intf = open_iface(name);
+    if (!intf)
+      return 1;
+    engine.map_channel(channel, intf);
+  }
+
+  g_engine = &engine;
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  std::cout << "Replaying " << argv[optind] << " at "
+            << (speed > 0 ? std::to_string(speed) + "x" : "full speed")
+            << std::endl;
+  engine.run(*source);
+
+  const ReplayStats& stats = engine.stats();
+  std::cout << "Frames read:     " << stats.frames_read << std::endl;
+  std::cout << "Frames sent:     " << stats.frames_sent << std::endl;
+  std::cout << "Frames filtered: " << stats.frames_filtered << std::endl;
+  std::cout << "Send errors:     " << stats.send_errors << std::endl;
+  if (speed > 0 && stats.frames_sent > 0) {
+    std::cout << "Mean lateness:   "
+              << stats.sum_lateness_ns / stats.frames_sent / 1000.0 << " us"
+              << std::endl;
+    std::cout << "Max lateness:    " << stats.max_lateness_ns / 1000.0
+              << " us" << std::endl;
+    std::cout << "Late (>100us):   " << stats.late_frames << std::endl;
+  }
+
+  for (auto& [name, intf] : interfaces)
+    intf->deinit();
+  return stats.send_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,155 @@
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/request_correlator.hpp"
+#include "socket_can/socket_can.hpp"
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <signal.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Finds diagnostic ECUs: sends a UDS TesterPresent (3E 00) to every request
+// ID in a range at once and reports which ones answer on request ID +
+// offset. All requests are correlated by RequestCorrelator, so scanning the
+// whole 11-bit diagnostic range takes about one timeout.
+
+volatile sig_atomic_t interrupted = 0;
+
+void signal_handler(int) {
+  interrupted = 1;
+}
+
+void print_usage(const char* program) {
+  std::cout
+    << "Usage: " << program << " [options] <interface>\n"
+    << "  -f <id>      First request ID (hex, default 7E0)\n"
+    << "  -l <id>      Last request ID (hex, default 7E7)\n"
+    << "  -o <offset>  Response ID offset (hex, default 8)\n"
+    << "  -t <ms>      Timeout per request (default 100)\n"
+    << "  -r <n>       Requests per ECU (default 1)\n"
+    << "  -h           Show this help\n";
+}
+
+// Service ID a single-frame UDS response answers: positive responses carry
+// SID + 0x40, negative ones 7F SID NRC
+uint32_t response_sid(const can_frame& frame) {
+  if (frame.can_dlc < 2 || (frame.data[0] >> 4) != 0)
+    return 0;
+  if (frame.data[1] == 0x7F && frame.can_dlc >= 3)
+    return frame.data[2] + 0x40u;
+  return frame.data[1];
+}
+
+int main(int argc, char* argv[]) {
+  canid_t first   = 0x7E0;
+  canid_t last    = 0x7E7;
+  canid_t offset  = 0x8;
+  int     timeout = 100;
+  int     repeat  = 1;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "f:l:o:t:r:h")) != -1) {
+    switch (opt) {
+    case 'f':
+      first = static_cast<canid_t>(std::strtoul(optarg, nullptr, 16));
+      break;
+    case 'l':
+      last = static_cast<canid_t>(std::strtoul(optarg, nullptr, 16));
+      break;
+    case 'o':
+      offset = static_cast<canid_t>(std::strtoul(optarg, nullptr, 16));
+      break;
+    case 't':
+      timeout = std::atoi(optarg);
+      break;
+    case 'r':
+      repeat = std::atoi(optarg);
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind >= argc || first > last || last > CAN_SFF_MASK || repeat < 1) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  EpollEventLoop    loop;
+  SocketCanIntf     can;
+  RequestCorrelator correlator;
+  if (!can.init(argv[optind], &loop, [&correlator](const can_frame& frame) {
+        correlator.on_frame(frame);
+      }))
+    return 1;
+  if (!correlator.init(&can, &loop))
+    return 1;
+  correlator.set_key_extractor(response_sid);
+
+  struct Ecu {
+    int  answered = 0;
+    bool negative = false;
+  };
+  std::vector<Ecu> ecus(last - first + 1);
+  uint64_t         start = DeadlineScheduler::now_ns();
+  size_t           lost  = 0;
+
+  for (int round = 0; round < repeat; ++round) {
+    for (canid_t id = first; id <= last; ++id) {
+      RequestCorrelator::Request request;
+      request.tx.can_id   = id;
+      request.tx.can_dlc  = 8;
+      request.tx.data[0]  = 0x02;
+      request.tx.data[1]  = 0x3E;
+      request.response_id = id + offset;
+      request.key         = 0x7E;
+      request.timeout     = std::chrono::milliseconds(timeout);
+      Ecu& ecu            = ecus[id - first];
+      request.handler     = [&ecu, &lost](RequestCorrelator::Result result,
+                                      const can_frame*          response) {
+        if (result != RequestCorrelator::Result::kResponse) {
+          lost += result == RequestCorrelator::Result::kSendFailed;
+          return;
+        }
+        ecu.answered++;
+        ecu.negative |= response->data[1] == 0x7F;
+      };
+      correlator.submit(std::move(request));
+    }
+  }
+  while (!interrupted && (correlator.outstanding() || correlator.queued())) {
+    if (loop.run_once(100) == -1)
+      break;
+  }
+  double elapsed_ms = (DeadlineScheduler::now_ns() - start) / 1e6;
+
+  size_t found = 0;
+  for (canid_t id = first; id <= last; ++id) {
+    const Ecu& ecu = ecus[id - first];
+    if (!ecu.answered)
+      continue;
+    found++;
+    std::cout << std::hex << std::uppercase << std::setw(3)
+              << std::setfill('0') << id << " -> " << std::setw(3)
+              << id + offset << std::dec << std::setfill(' ') << "  "
+              << ecu.answered << "/" << repeat << " responses"
+              << (ecu.negative ? " (negative response)" : "") << std::endl;
+  }
+  std::cout << found << " ECUs answered out of " << ecus.size()
+            << " IDs in " << std::fixed << std::setprecision(1) << elapsed_ms
+            << " ms";
+  if (lost)
+    std::cout << ", " << lost << " requests not sent";
+  std::cout << std::endl;
+
+  correlator.deinit();
+  can.deinit();
+  return 0;
+}
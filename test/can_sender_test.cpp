@@ -1,9 +1,16 @@
 #include "socket_can/socket_can.hpp"
 #include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/traffic_generator.hpp"
+#include <atomic>
 #include <iostream>
 #include <iomanip>
 #include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
 #include <thread>
+#include <unistd.h>
 #include <vector>
 
 class CanSender {
@@ -134,19 +141,193 @@ void demo_continuous_data(CanSender& sender) {
   }
 }
 
-int main() {
-  std::cout << "=== CAN Frame Sender Test (vcan0) ===" << std::endl;
-  std::cout << "This will send various CAN frames to vcan0" << std::endl;
+// Generator mode: one thread drives a TrafficGenerator per interface on
+// absolute deadlines, sending everything due within the batch window with
+// one send_batch() call per bus
+std::atomic<bool> stop_requested{false};
+
+void signal_handler(int) {
+  stop_requested = true;
+}
+
+struct GeneratedBus {
+  std::string                   interface;
+  std::unique_ptr<CanTransport> transport;
+  TrafficGenerator              generator;
+  uint64_t                      sent    = 0;
+  uint64_t                      dropped = 0;
+};
+
+int run_generator(const std::vector<std::string>& interfaces,
+                  const TrafficProfile&           profile,
+                  double                          duration_s,
+                  uint64_t                        batch_window_ns) {
+  std::vector<std::unique_ptr<GeneratedBus>> buses;
+  for (size_t i = 0; i < interfaces.size(); ++i) {
+    std::unique_ptr<GeneratedBus> bus(
+      new GeneratedBus{interfaces[i],
+                       make_can_transport(interfaces[i]),
+                       TrafficGenerator(profile, i + 1)});
+    if (!bus->transport->open(interfaces[i])) {
+      std::cerr << "❌ Failed to open " << interfaces[i] << std::endl;
+      return 1;
+    }
+    buses.push_back(std::move(bus));
+  }
+
+  std::cout << "🚀 Generating " << std::fixed << std::setprecision(1)
+            << profile.offered_bits_per_second() * buses[0]->generator.scale() /
+                 profile.bitrate * 100
+            << "% load at " << profile.bitrate << " bit/s on "
+            << buses.size() << " bus(es)";
+  if (duration_s > 0)
+    std::cout << " for " << duration_s << " s";
+  std::cout << ", Ctrl+C to stop" << std::endl;
+
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  DeadlineScheduler scheduler;
+  uint64_t          start = DeadlineScheduler::now_ns();
+  uint64_t          end   = duration_s > 0
+                              ? start + static_cast<uint64_t>(duration_s * 1e9)
+                              : UINT64_MAX;
+  for (auto& bus : buses)
+    bus->generator.start(start);
+
+  can_frame batch[DatagramCanTransport::kMaxBatch];
+  while (!stop_requested) {
+    uint64_t next = UINT64_MAX;
+    for (auto& bus : buses)
+      next = std::min(next, bus->generator.next_deadline());
+    if (next >= end)
+      break;
+    if (scheduler.wait_until(next, &stop_requested) < 0)
+      break;
+
+    uint64_t until = DeadlineScheduler::now_ns() + batch_window_ns;
+    for (auto& bus : buses) {
+      size_t n;
+      while ((n = bus->generator.poll(until, batch, std::size(batch))) > 0) {
+        ssize_t n_sent = bus->transport->send_batch(batch, n);
+        if (n_sent < 0) {
+          std::cerr << "❌ Send failed on " << bus->interface << std::endl;
+          return 1;
+        }
+        // A full TX queue drops the rest, as an overloaded node would
+        bus->sent += static_cast<uint64_t>(n_sent);
+        bus->dropped += n - static_cast<uint64_t>(n_sent);
+      }
+    }
+  }
+
+  double elapsed = (DeadlineScheduler::now_ns() - start) / 1e9;
+  for (auto& bus : buses) {
+    double load = bus->generator.generated_bits() / elapsed / profile.bitrate;
+    std::cout << bus->interface << ": sent " << bus->sent << ", dropped "
+              << bus->dropped << " in " << std::setprecision(2) << elapsed
+              << " s (" << std::setprecision(0) << bus->sent / elapsed
+              << " frames/s, " << std::setprecision(1) << load * 100
+              << "% offered load)" << std::endl;
+  }
+  return 0;
+}
+
+void print_usage(const char* program_name) {
+  std::cout << "Usage: " << program_name << " [options] [interface...]"
+            << std::endl;
+  std::cout << "Without -p/-l, sends the demo frames to the first interface "
+               "(default: vcan0)."
+            << std::endl;
+  std::cout << "  -p <file>    traffic profile (see traffic_generator.hpp)"
+            << std::endl;
+  std::cout << "  -l <load>    target bus load in percent; uses the built-in "
+               "mix without -p"
+            << std::endl;
+  std::cout << "  -b <bps>     bitrate the load refers to (default: 500000 or "
+               "the profile's)"
+            << std::endl;
+  std::cout << "  -d <sec>     run time (default: until Ctrl+C)" << std::endl;
+  std::cout << "  -B <us>      batch window: frames due within it are sent "
+               "together (default: 100)"
+            << std::endl;
+  std::cout << "\nExample:" << std::endl;
+  std::cout << "  " << program_name << " -l 80 -b 500000 -d 10 vcan0"
+            << std::endl;
+  std::cout << "  " << program_name
+            << " -p traffic.profile vbus:a@500000 vbus:b@500000" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  std::string profile_path;
+  double      load            = -1;
+  double      bitrate         = 0;
+  double      duration_s      = 0;
+  uint64_t    batch_window_ns = 100000;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "p:l:b:d:B:h")) != -1) {
+    switch (opt) {
+      case 'p':
+        profile_path = optarg;
+        break;
+      case 'l':
+        load = std::atof(optarg);
+        break;
+      case 'b':
+        bitrate = std::atof(optarg);
+        break;
+      case 'd':
+        duration_s = std::atof(optarg);
+        break;
+      case 'B':
+        batch_window_ns = static_cast<uint64_t>(std::atof(optarg) * 1000);
+        break;
+      case 'h':
+        print_usage(argv[0]);
+        return 0;
+      default:
+        print_usage(argv[0]);
+        return 1;
+    }
+  }
+  std::vector<std::string> interfaces(argv + optind, argv + argc);
+  if (interfaces.empty())
+    interfaces.push_back("vcan0");
+
+  if (!profile_path.empty() || load >= 0) {
+    TrafficProfile profile;
+    if (profile_path.empty())
+      profile = TrafficProfile::default_mix();
+    else if (!profile.load_file(profile_path))
+      return 1;
+    if (load >= 0)
+      profile.load = load;
+    if (bitrate > 0)
+      profile.bitrate = static_cast<uint32_t>(bitrate);
+    if (profile.load > 100 || profile.bitrate == 0) {
+      print_usage(argv[0]);
+      return 1;
+    }
+    return run_generator(interfaces, profile, duration_s, batch_window_ns);
+  }
+
+  std::cout << "=== CAN Frame Sender Test (" << interfaces[0] << ") ==="
+            << std::endl;
+  std::cout << "This will send various CAN frames to " << interfaces[0]
+            << std::endl;
   std::cout << "Run can_reader_test in another terminal to see the frames"
             << std::endl;
   std::cout << std::string(60, '=') << std::endl;
 
   CanSender sender;
 
-  // Khởi tạo với vcan0
-  std::cout << "Initializing CAN sender on vcan0..." << std::endl;
-  if (!sender.init("vcan0")) {
-    std::cerr << "❌ Failed to initialize vcan0!" << std::endl;
+  // Khởi tạo với interface đã chọn (mặc định vcan0)
+  std::cout << "Initializing CAN sender on " << interfaces[0] << "..."
+            << std::endl;
+  if (!sender.init(interfaces[0])) {
+    std::cerr << "❌ Failed to initialize " << interfaces[0] << "!"
+              << std::endl;
     std::cerr << "Make sure virtual CAN interface is up:" << std::endl;
     std::cerr << "  sudo modprobe vcan" << std::endl;
     std::cerr << "  sudo ip link add dev vcan0 type vcan" << std::endl;
@@ -154,7 +335,7 @@ int main() {
     return 1;
   }
 
-  std::cout << "✅ Successfully connected to vcan0" << std::endl;
+  std::cout << "✅ Successfully connected to " << interfaces[0] << std::endl;
   std::cout << "🚀 Starting to send test frames..." << std::endl;
 
   // Demo các loại frames khác nhau
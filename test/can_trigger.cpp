@@ -0,0 +1,248 @@
+#include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/socket_can.hpp"
+#include "socket_can/trigger_engine.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <signal.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+// Captures the frames around intermittent faults, from rules such as
+//
+//   dtc frame 7E8 data=0359/FFFF          payload match (masked bytes)
+//   overspeed frame 200 signal=0:16 scale=0.01 gt=180
+//   restart seq 500 700 701 702           IDs in order within 500 ms
+//   heartbeat missing 100 18FF0010 bus=1  absent for 100 ms on bus 1
+//
+// IDs are hex; more than three digits makes a 29-bit ID. Bus N is the Nth
+// interface on the command line.
+
+volatile sig_atomic_t interrupted = 0;
+
+void signal_handler(int) {
+  interrupted = 1;
+}
+
+void print_usage(const char* program) {
+  std::cout
+    << "Usage: " << program << " [options] -r <rule>... <if>...\n"
+    << "  -r <rule>  <name> frame <id>[/<mask>] [data=<hex>/<mask>]\n"
+    << "             [signal=<start>:<len>[:be][:signed] [scale=<f>]\n"
+    << "             [offset=<f>] gt|lt|eq|ne=<v> | outside=<lo>:<hi>]\n"
+    << "             <name> seq <window ms> <id>...\n"
+    << "             <name> missing <window ms> <id>\n"
+    << "             any rule: [bus=<n>] [holdoff=<ms>]\n"
+    << "  -d <dir>   Directory for the captures (default .)\n"
+    << "  -x <ext>   Capture format: .scap, .zcap, .log, .asc, .blf\n"
+    << "  -b <sec>   Seconds before a trigger (default 5)\n"
+    << "  -a <sec>   Seconds after the last trigger (default 2)\n"
+    << "  -n <n>     Pre-trigger ring size per bus (default 65536)\n"
+    << "  -h         Show this help\n";
+}
+
+canid_t parse_id(const std::string& text) {
+  canid_t id = static_cast<canid_t>(std::strtoul(text.c_str(), nullptr, 16));
+  return text.size() > 3 ? id | CAN_EFF_FLAG : id;
+}
+
+TriggerCondition id_condition(const std::string& text) {
+  TriggerCondition condition;
+  size_t           slash = text.find('/');
+  condition.id           = parse_id(text.substr(0, slash));
+  if (slash != std::string::npos)
+    condition.mask = CAN_EFF_FLAG | CAN_RTR_FLAG |
+                     static_cast<canid_t>(std::strtoul(
+                       text.substr(slash + 1).c_str(), nullptr, 16));
+  return condition;
+}
+
+bool parse_bytes(const std::string&                 text,
+                 std::array<uint8_t, CAN_MAX_DLEN>& bytes) {
+  if (text.size() % 2 || text.size() > 2 * CAN_MAX_DLEN)
+    return false;
+  for (size_t i = 0; i < text.size() / 2; ++i) {
+    bytes[i] = static_cast<uint8_t>(
+      std::strtoul(text.substr(2 * i, 2).c_str(), nullptr, 16));
+  }
+  return true;
+}
+
+bool parse_rule(const std::string& line, TriggerRule& rule) {
+  std::istringstream       in(line);
+  std::vector<std::string> tokens;
+  std::string              token;
+  while (in >> token)
+    tokens.push_back(token);
+  if (tokens.size() < 3)
+    return false;
+  rule.name = tokens[0];
+
+  size_t options;
+  if (tokens[1] == "frame") {
+    rule.kind = TriggerRule::Kind::kFrame;
+    rule.conditions.push_back(id_condition(tokens[2]));
+    options = 3;
+  } else if (tokens[1] == "seq" || tokens[1] == "missing") {
+    rule.kind      = tokens[1] == "seq" ? TriggerRule::Kind::kSequence
+                                        : TriggerRule::Kind::kMissing;
+    rule.window_ns = std::strtoull(tokens[2].c_str(), nullptr, 10) * 1000000;
+    for (options = 3; options < tokens.size() &&
+                      tokens[options].find('=') == std::string::npos;
+         ++options)
+      rule.conditions.push_back(id_condition(tokens[options]));
+  } else {
+    return false;
+  }
+
+  TriggerCondition& condition = rule.conditions.front();
+  for (size_t i = options; i < tokens.size(); ++i) {
+    const std::string& option = tokens[i];
+    size_t             equals = option.find('=');
+    if (equals == std::string::npos)
+      return false;
+    std::string key   = option.substr(0, equals);
+    std::string value = option.substr(equals + 1);
+    if (key == "bus") {
+      rule.bus = std::atoi(value.c_str());
+    } else if (key == "holdoff") {
+      rule.holdoff_ns = std::strtoull(value.c_str(), nullptr, 10) * 1000000;
+    } else if (key == "data") {
+      size_t slash = value.find('/');
+      if (slash == std::string::npos ||
+          !parse_bytes(value.substr(0, slash), condition.data_value) ||
+          !parse_bytes(value.substr(slash + 1), condition.data_mask))
+        return false;
+      for (size_t b = 0; b < CAN_MAX_DLEN; ++b)
+        condition.data_value[b] &= condition.data_mask[b];
+    } else if (key == "signal") {
+      std::istringstream fields(value);
+      std::string        field;
+      std::vector<std::string> parts;
+      while (std::getline(fields, field, ':'))
+        parts.push_back(field);
+      if (parts.size() < 2)
+        return false;
+      condition.signal.start_bit =
+        static_cast<uint16_t>(std::atoi(parts[0].c_str()));
+      condition.signal.length =
+        static_cast<uint8_t>(std::atoi(parts[1].c_str()));
+      for (size_t p = 2; p < parts.size(); ++p) {
+        if (parts[p] == "be")
+          condition.signal.big_endian = true;
+        else if (parts[p] == "signed")
+          condition.signal.is_signed = true;
+        else
+          return false;
+      }
+    } else if (key == "scale") {
+      condition.signal.scale = std::atof(value.c_str());
+    } else if (key == "offset") {
+      condition.signal.offset = std::atof(value.c_str());
+    } else if (key == "gt" || key == "lt" || key == "eq" || key == "ne") {
+      condition.compare   = key == "gt"   ? TriggerCompare::kGreater
+                            : key == "lt" ? TriggerCompare::kLess
+                            : key == "eq" ? TriggerCompare::kEqual
+                                          : TriggerCompare::kNotEqual;
+      condition.threshold = std::atof(value.c_str());
+    } else if (key == "outside") {
+      size_t colon = value.find(':');
+      if (colon == std::string::npos)
+        return false;
+      condition.compare        = TriggerCompare::kOutside;
+      condition.threshold      = std::atof(value.substr(0, colon).c_str());
+      condition.threshold_high = std::atof(value.c_str() + colon + 1);
+    } else {
+      return false;
+    }
+  }
+  return condition.compare == TriggerCompare::kAny ||
+         condition.signal.length > 0;
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<TriggerRule> rules;
+  TriggerConfig            config;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "r:d:x:b:a:n:h")) != -1) {
+    switch (opt) {
+    case 'r': {
+      TriggerRule rule;
+      if (!parse_rule(optarg, rule)) {
+        std::cerr << "Invalid rule: " << optarg << std::endl;
+        return 1;
+      }
+      rules.push_back(rule);
+      break;
+    }
+    case 'd':
+      config.directory = optarg;
+      break;
+    case 'x':
+      config.extension = optarg;
+      break;
+    case 'b':
+      config.pre_ns = static_cast<uint64_t>(std::atof(optarg) * 1e9);
+      break;
+    case 'a':
+      config.post_ns = static_cast<uint64_t>(std::atof(optarg) * 1e9);
+      break;
+    case 'n':
+      config.pre_frames = static_cast<size_t>(std::atol(optarg));
+      break;
+    case 'h':
+      print_usage(argv[0]);
+      return 0;
+    default:
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (rules.empty() || optind >= argc) {
+    print_usage(argv[0]);
+    return 1;
+  }
+  signal(SIGINT, signal_handler);
+  signal(SIGTERM, signal_handler);
+
+  EpollEventLoop loop;
+  TriggerEngine  engine;
+  size_t         buses = static_cast<size_t>(argc - optind);
+  engine.set_trigger_handler([](const TriggerEvent& event) {
+    std::cout << "trigger " << *event.name << " on bus " << event.bus
+              << std::endl;
+  });
+  engine.set_capture_handler(
+    [](const std::string& path, uint64_t records, bool ok) {
+      if (ok)
+        std::cout << "wrote " << records << " frames to " << path
+                  << std::endl;
+    });
+  if (!engine.init(&loop, rules, buses, config))
+    return 1;
+
+  std::vector<std::unique_ptr<SocketCanIntf>> interfaces;
+  for (size_t bus = 0; bus < buses; ++bus) {
+    auto intf = std::make_unique<SocketCanIntf>();
+    if (!intf->init(argv[optind + bus], &loop,
+                    engine.frame_processor(static_cast<uint32_t>(bus))))
+      return 1;
+    interfaces.push_back(std::move(intf));
+  }
+
+  while (!interrupted) {
+    if (loop.run_once(100) == -1)
+      break;
+  }
+
+  for (auto& intf : interfaces)
+    intf->deinit();
+  engine.deinit();
+  TriggerEngine::Stats stats = engine.stats();
+  std::cout << stats.frames << " frames, " << stats.triggers << " triggers, "
+            << stats.written << " captures written" << std::endl;
+  return 0;
+}
@@ -0,0 +1,233 @@
+#include "socket_can/can_coro.hpp"
+#include "socket_can/epoll_event_loop.hpp"
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Simple test framework
+#define TEST(name) void test_##name()
+#define RUN_TEST(name)                                                         \
+  do {                                                                         \
+    std::cout << "Running test: " << #name << "...";                           \
+    test_##name();                                                             \
+    std::cout << " PASSED" << std::endl;                                       \
+  } while (0)
+
+// Chạy loop tới khi `done` hoặc quá 5 giây
+template <typename Done>
+void run_until(EpollEventLoop& loop, Done done) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (!done() && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+}
+
+CoTask<int> add_later(int a, int b) {
+  co_await sleep_for(5ms);
+  co_return a + b;
+}
+
+CoTask<void> nested_adds(int& result, bool& done) {
+  int x  = co_await add_later(1, 2);
+  result = co_await add_later(x, 10);
+  done   = true;
+}
+
+CoTask<void> sleeper(std::vector<int>& order, int id, int delay_ms) {
+  co_await sleep_for(std::chrono::milliseconds(delay_ms));
+  order.push_back(id);
+}
+
+TEST(tasks_and_timers) {
+  EpollEventLoop loop;
+  CoScheduler    scheduler(&loop);
+  assert(CoScheduler::current() == &scheduler);
+
+  // Task lồng nhau trả giá trị; sleep không chặn loop
+  int  result = 0;
+  bool done   = false;
+  auto start  = CoScheduler::now_ns();
+  // Lambda coroutine có capture sẽ dangling sau spawn(), nên dùng hàm tự do
+  scheduler.spawn(nested_adds(result, done));
+  assert(!done);
+  run_until(loop, [&] { return done; });
+  assert(done && result == 13);
+  assert(CoScheduler::now_ns() - start >= 10000000ULL);
+
+  // Thứ tự hết hạn theo deadline, không theo thứ tự đăng ký
+  std::vector<int> order;
+  scheduler.spawn(sleeper(order, 3, 30));
+  scheduler.spawn(sleeper(order, 1, 10));
+  scheduler.spawn(sleeper(order, 2, 20));
+  scheduler.spawn(sleeper(order, 0, 0));
+  assert(order.size() == 1 && order[0] == 0);
+  assert(scheduler.pending_timers() == 3);
+  run_until(loop, [&] { return order.size() == 4; });
+  assert((order == std::vector<int>{0, 1, 2, 3}));
+  assert(scheduler.pending_timers() == 0);
+
+  // Huỷ task đang ngủ thì timer cũng bị gỡ
+  {
+    CoTask<int> task = add_later(1, 1);
+    CoTask<int>::Handle handle = task.release();
+    handle.resume();
+    assert(scheduler.pending_timers() == 1);
+    handle.destroy();
+    assert(scheduler.pending_timers() == 0);
+  }
+}
+
+// ECU giả: trả lời 0x7E0 bằng 0x7E8, data[1] = data[0] + 1
+CoTask<void> responder(CoCanBus& ecu, int& served) {
+  while (true) {
+    std::optional<can_frame> request = co_await ecu.next_frame(0x7E0);
+    if (!request)
+      co_return;
+    can_frame response = *request;
+    response.can_id    = 0x7E8;
+    response.data[1]   = static_cast<uint8_t>(request->data[0] + 1);
+    ecu.send(response);
+    ++served;
+  }
+}
+
+CoTask<bool> one_request(CoCanBus& tester, uint8_t n) {
+  can_frame tx = {};
+  tx.can_id    = 0x7E0;
+  tx.can_dlc   = 2;
+  tx.data[0]   = n;
+  std::optional<can_frame> rx = co_await tester.request(tx, 0x7E8, 1s);
+  co_return rx && rx->data[0] == n &&
+    rx->data[1] == static_cast<uint8_t>(n + 1);
+}
+
+CoTask<void> request_loop(CoCanBus& tester,
+                          int&      ok,
+                          uint64_t& heap_before,
+                          bool&     done) {
+  ok += co_await one_request(tester, 0);
+  heap_before = CoFramePool::heap_allocations();
+  for (int i = 1; i < 200; ++i)
+    ok += co_await one_request(tester, static_cast<uint8_t>(i));
+  done = true;
+}
+
+CoTask<void> unanswered(CoCanBus&                 tester,
+                        std::optional<can_frame>& result,
+                        bool&                     done) {
+  can_frame tx = {};
+  tx.can_id    = 0x123;
+  result       = co_await tester.request(tx, 0x456, 20ms);
+  done         = true;
+}
+
+CoTask<void> collect(CoCanBus&             bus,
+                     CanIdMatch            match,
+                     std::vector<canid_t>& ids) {
+  std::optional<can_frame> frame = co_await bus.next_frame(match);
+  if (frame)
+    ids.push_back(frame->can_id);
+}
+
+// Thử lại sau mỗi timeout, chỉ dừng khi bus đã đóng
+CoTask<void> retry_until_closed(CoCanBus& bus, int& attempts, bool& done) {
+  while (true) {
+    ++attempts;
+    std::optional<can_frame> frame = co_await bus.next_frame(0x555, 5ms);
+    if (!frame && bus.closed())
+      break;
+  }
+  done = true;
+}
+
+TEST(frames_requests_and_timeouts) {
+  EpollEventLoop loop;
+  CoScheduler    scheduler(&loop);
+  CoCanBus       tester(scheduler), ecu(scheduler);
+  size_t         callback_frames = 0;
+  bool success = tester.init("vbus:coro", &loop, [&](const can_frame&) {
+    ++callback_frames;
+  });
+  assert(success);
+  success = ecu.init("vbus:coro", &loop);
+  assert(success);
+
+  int served = 0;
+  scheduler.spawn(responder(ecu, served));
+  assert(ecu.pending() == 1);
+
+  // Request/response tuần tự; sau lần đầu frame coroutine lấy từ pool
+  int      ok          = 0;
+  bool     done        = false;
+  uint64_t heap_before = 0;
+  scheduler.spawn(request_loop(tester, ok, heap_before, done));
+  run_until(loop, [&] { return done; });
+  assert(done && ok == 200 && served == 200);
+  assert(CoFramePool::heap_allocations() == heap_before);
+  // API callback vẫn thấy mọi frame
+  assert(callback_frames == 200);
+
+  // Không ai trả lời: timeout trả về nullopt
+  std::optional<can_frame> missing;
+  bool                     timed_out = false;
+  scheduler.spawn(unanswered(tester, missing, timed_out));
+  run_until(loop, [&] { return timed_out; });
+  assert(timed_out && !missing && tester.pending() == 0);
+
+  // Match theo mask: mọi waiter khớp đều nhận frame
+  std::vector<canid_t> masked, exact;
+  scheduler.spawn(collect(tester, CanIdMatch(0x100, 0x700), masked));
+  scheduler.spawn(collect(tester, 0x123, exact));
+  can_frame frame = {};
+  frame.can_id    = 0x200;
+  ecu.send(frame);
+  frame.can_id = 0x123;
+  ecu.send(frame);
+  run_until(loop, [&] { return !masked.empty() && !exact.empty(); });
+  assert(masked.size() == 1 && masked[0] == 0x123);
+  assert(exact.size() == 1 && exact[0] == 0x123);
+
+  // deinit() đánh thức waiter đang chờ bằng nullopt
+  ecu.deinit();
+  assert(ecu.pending() == 0);
+  tester.deinit();
+}
+
+TEST(deinit_ends_retrying_waiters) {
+  EpollEventLoop loop;
+  CoScheduler    scheduler(&loop);
+  CoCanBus       bus(scheduler);
+  bool           success = bus.init("vbus:coro_close", &loop);
+  assert(success && !bus.closed());
+
+  // Coroutine thử lại khi timeout: deinit() vẫn kết thúc được
+  int  attempts = 0;
+  bool done     = false;
+  scheduler.spawn(retry_until_closed(bus, attempts, done));
+  run_until(loop, [&] { return attempts >= 3; });
+  assert(attempts >= 3 && !done);
+  bus.deinit();
+  assert(done && bus.closed() && bus.pending() == 0);
+
+  // Await bắt đầu sau deinit() không treo, kể cả khi không có timeout
+  std::vector<canid_t> ids;
+  attempts = 0;
+  done     = false;
+  scheduler.spawn(collect(bus, 0x123, ids));
+  scheduler.spawn(retry_until_closed(bus, attempts, done));
+  assert(ids.empty() && done && attempts == 1 && bus.pending() == 0);
+}
+
+int main() {
+  std::cout << "=== SocketCAN Coroutine Tests ===" << std::endl;
+
+  RUN_TEST(tasks_and_timers);
+  RUN_TEST(frames_requests_and_timeouts);
+  RUN_TEST(deinit_ends_retrying_waiters);
+
+  std::cout << "\n=== All tests PASSED! ===" << std::endl;
+  return 0;
+}
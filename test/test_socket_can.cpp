@@ -1,9 +1,45 @@
 #include "socket_can/socket_can.hpp"
 #include "socket_can/epoll_event_loop.hpp"
+#include "socket_can/bus_load.hpp"
+#include "socket_can/can_bit_timing.hpp"
+#include "socket_can/can_error.hpp"
+#include "socket_can/can_gateway.hpp"
+#include "socket_can/capture_analysis.hpp"
+#include "socket_can/capture_formats.hpp"
+#include "socket_can/capture_index.hpp"
+#include "socket_can/compressed_capture.hpp"
+#include "socket_can/frame_filter.hpp"
+#include "socket_can/frame_formatter.hpp"
+#include "socket_can/frame_pool.hpp"
+#include "socket_can/latency_histogram.hpp"
+#include "socket_can/link_monitor.hpp"
+#include "socket_can/metrics.hpp"
+#include "socket_can/realtime.hpp"
+#include "socket_can/replay.hpp"
+#include "socket_can/request_correlator.hpp"
+#include "socket_can/ring_buffer.hpp"
+#include "socket_can/shm_frame_bus.hpp"
+#include "socket_can/traffic_generator.hpp"
+#include "socket_can/traffic_statistics.hpp"
+#include "socket_can/trigger_engine.hpp"
+#include "socket_can/udp_bridge.hpp"
+#include "socket_can/virtual_can_bus.hpp"
+#include <atomic>
 #include <iostream>
+#include <algorithm>
+#include <map>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <chrono>
+#include <sstream>
 #include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 // Simple test framework
 #define TEST(name) void test_##name()
@@ -150,6 +186,316 @@ TEST(epoll_event_basic) {
   event.deinit();
 }
 
+// Tạo một tập frame mẫu (STD, EXT, RTR) cho các test capture
+std::vector<CaptureRecord> make_capture_records(size_t count) {
+  std::vector<CaptureRecord> records;
+  uint64_t                   ts = 1700000000ull * 1000000000ull + 123456000;
+  for (size_t i = 0; i < count; i++) {
+    CaptureRecord rec = {};
+    rec.timestamp_ns  = ts + i * 250000;  // 250us, đúng độ phân giải µs
+    rec.channel       = i % 3;
+    rec.flags         = i % 5 == 0 ? kCaptureFlagTx : 0;
+    switch (i % 4) {
+      case 0:
+        rec.frame.can_id = 0x100 + i % 0x700;
+        break;
+      case 1:
+        rec.frame.can_id = (0x18DA0000 + i) | CAN_EFF_FLAG;
+        break;
+      case 2:
+        rec.frame.can_id = 0x7DF | CAN_RTR_FLAG;
+        break;
+      default:
+        rec.frame.can_id = 0x001;
+        break;
+    }
+    rec.frame.can_dlc = i % 9;
+    if (!(rec.frame.can_id & CAN_RTR_FLAG)) {
+      for (int b = 0; b < rec.frame.can_dlc; b++) {
+        rec.frame.data[b] = static_cast<uint8_t>(i * 7 + b);
+      }
+    }
+    records.push_back(rec);
+  }
+  return records;
+}
+
+bool same_capture_record(const CaptureRecord& a, const CaptureRecord& b) {
+  return a.timestamp_ns == b.timestamp_ns && a.channel == b.channel &&
+         a.flags == b.flags && a.frame.can_id == b.frame.can_id &&
+         a.frame.can_dlc == b.frame.can_dlc &&
+         std::memcmp(a.frame.data, b.frame.data, a.frame.can_dlc) == 0;
+}
+
+TEST(capture_formats_round_trip) {
+  // 50000 frames để BLF phải dùng nhiều container
+  std::vector<CaptureRecord> records = make_capture_records(50000);
+
+  for (const char* ext : {".scap", ".zcap", ".log", ".asc", ".blf"}) {
+    std::string path = "/tmp/socket_can_test_capture" + std::string(ext);
+    {
+      std::unique_ptr<FrameSink> sink = open_capture_sink(path);
+      assert(sink && "Failed to open capture sink");
+      bool success = true;
+      for (const auto& rec : records) {
+        success = sink->write(rec);
+        assert(success);
+      }
+      success = sink->close();
+      assert(success);
+    }
+
+    std::unique_ptr<FrameSource> source = open_capture_source(path);
+    assert(source && "Failed to open capture source");
+    CaptureRecord rec;
+    size_t        n = 0;
+    while (source->next(rec)) {
+      assert(n < records.size());
+      assert(same_capture_record(rec, records[n]) && "Record mismatch");
+      n++;
+    }
+    assert(n == records.size() && "Record count mismatch");
+    unlink(path.c_str());
+    unlink(capture_index_path(path).c_str());
+  }
+}
+
+TEST(capture_index_query) {
+  const std::string          path    = "/tmp/socket_can_test_index.scap";
+  std::vector<CaptureRecord> records = make_capture_records(20000);
+  {
+    CaptureLogger logger;
+    // Logger chưa mở hoặc đã đóng: write() trả về false
+    bool success = !logger.write(records[0]);
+    assert(success);
+    success = logger.open(path, 256);
+    assert(success);
+    for (const auto& rec : records) {
+      success = logger.write(rec);
+      assert(success);
+    }
+    success = logger.close();
+    assert(success);
+    success = !logger.write(records[0]);
+    assert(success);
+  }
+
+  CaptureIndex index;
+  bool success = index.open(path);
+  assert(success && "Failed to open capture index");
+  assert(index.block_count() == (records.size() + 255) / 256);
+
+  CaptureQuery query;
+  query.begin_ns = records[5000].timestamp_ns;
+  query.end_ns   = records[6000].timestamp_ns;
+  query.ids      = {0x7DF, (0x18DA0000 + 5001) | CAN_EFF_FLAG};
+
+  // So sánh với quét tuyến tính
+  std::vector<CaptureRecord> expected;
+  for (const auto& rec : records) {
+    canid_t id = rec.frame.can_id & ~CAN_RTR_FLAG;
+    if (rec.timestamp_ns >= query.begin_ns && rec.timestamp_ns < query.end_ns &&
+        (id == query.ids[0] || id == query.ids[1])) {
+      expected.push_back(rec);
+    }
+  }
+
+  std::vector<CaptureRecord> found;
+  size_t                     n = index.query(
+    query, [&found](const CaptureRecord& rec) { found.push_back(rec); });
+  assert(n == expected.size() && n == found.size());
+  for (size_t i = 0; i < n; i++) {
+    assert(same_capture_record(found[i], expected[i]));
+  }
+
+  // Chỉ các block trong khoảng thời gian được quét
+  assert(index.candidate_blocks(query).size() <= 5);
+  index.close();
+
+  // Index của version khác bị bỏ qua và được dựng lại từ capture
+  std::string  index_path = capture_index_path(path);
+  const size_t at         = offsetof(CaptureIndexHeader, version);
+  uint32_t     version    = kCaptureIndexVersion + 1;
+  int          fd         = open(index_path.c_str(), O_WRONLY);
+  success = pwrite(fd, &version, sizeof(version), at) == sizeof(version);
+  assert(success);
+  close(fd);
+  success = index.open(path);
+  assert(success);
+  assert(index.block_count() ==
+         (records.size() + kDefaultIndexBlockRecords - 1) /
+           kDefaultIndexBlockRecords);
+  found.clear();
+  n = index.query(
+    query, [&found](const CaptureRecord& rec) { found.push_back(rec); });
+  assert(n == expected.size());
+  index.close();
+
+  fd      = open(index_path.c_str(), O_RDONLY);
+  success = pread(fd, &version, sizeof(version), at) == sizeof(version);
+  assert(success && version == kCaptureIndexVersion);
+  close(fd);
+
+  unlink(path.c_str());
+  unlink(capture_index_path(path).c_str());
+}
+
+TEST(compressed_capture_ratio) {
+  // Traffic tuần hoàn điển hình: 50 ID, chu kỳ 10ms, payload thay đổi ít
+  const std::string path = "/tmp/socket_can_test_ratio.zcap";
+  const size_t      n    = 200000;
+  {
+    CompressedCaptureLogger logger;
+    bool success = logger.open(path);
+    assert(success);
+    uint64_t t0 = 1700000000ull * 1000000000ull;
+    for (size_t i = 0; i < n; i++) {
+      CaptureRecord rec = {};
+      size_t        id  = i % 50;
+      rec.timestamp_ns  = t0 + (i / 50) * 10000000 + id * 200000 +
+                         (i * 7919) % 3000;  // jitter < 3us
+      rec.frame.can_id  = 0x100 + id;
+      rec.frame.can_dlc = 8;
+      rec.frame.data[0] = static_cast<uint8_t>(i / 50);  // counter
+      rec.frame.data[1] = static_cast<uint8_t>(id);
+      rec.frame.data[2] = static_cast<uint8_t>((i / 5000) & 0xFF);
+      success = logger.write(rec);
+      assert(success);
+    }
+    success = logger.flush();
+    assert(success);
+    double ratio = static_cast<double>(logger.raw_bytes()) /
+                   static_cast<double>(logger.stored_bytes());
+    std::cout << " (ratio " << ratio << "x)";
+#ifdef SOCKET_CAN_HAVE_ZLIB
+    assert(ratio > 5.0 && "Compression ratio below 5x");
+#else
+    // Không có zlib: block chỉ được mã hoá theo cột, không nén thêm
+    assert(ratio > 2.0 && "Columnar encoding ratio below 2x");
+#endif
+    success = logger.close();
+    assert(success);
+  }
+
+  CompressedCaptureReader reader;
+  bool success = reader.open(path);
+  assert(success);
+  CaptureRecord rec;
+  size_t        count = 0;
+  while (reader.next(rec)) {
+    assert(rec.frame.can_id == 0x100 + count % 50);
+    count++;
+  }
+  assert(count == n);
+  unlink(path.c_str());
+
+  // Logger chưa mở hoặc đã đóng: write() trả về false thay vì chờ mãi khi
+  // hàng đợi block đầy
+  CompressedCaptureLogger idle(4);
+  size_t                  accepted = 0;
+  for (size_t i = 0; i < 1000; i++)
+    accepted += idle.write(rec);
+  assert(accepted == 0);
+  bool opened = idle.open(path);
+  assert(opened);
+  bool closed = idle.close();
+  assert(closed);
+  for (size_t i = 0; i < 1000; i++)
+    accepted += idle.write(rec);
+  assert(accepted == 0);
+  unlink(path.c_str());
+}
+
+// FrameSource đọc từ vector, dùng cho test replay
+struct VectorFrameSource : FrameSource {
+  std::vector<CaptureRecord> records;
+  size_t                     pos = 0;
+
+  bool next(CaptureRecord& record) override {
+    if (pos >= records.size())
+      return false;
+    record = records[pos++];
+    return true;
+  }
+};
+
+TEST(replay_scheduler_and_filters) {
+  // Deadline tuyệt đối: không bao giờ trả về trước deadline
+  DeadlineScheduler scheduler;
+  uint64_t          deadline = DeadlineScheduler::now_ns() + 2000000;
+  int64_t           late     = scheduler.wait_until(deadline);
+  assert(late >= 0 && "Released before deadline");
+  assert(DeadlineScheduler::now_ns() >= deadline);
+
+  ReplayEngine engine;
+  bool success = !engine.set_speed(0.05);
+  assert(success && "Speed below 0.1x must be rejected");
+  success = !engine.set_speed(200);
+  assert(success && "Speed above 100x must be rejected");
+  success = engine.set_speed(0);
+  assert(success);
+
+  // Không có output nào được map: mọi frame đều bị bỏ qua, không gửi gì
+  VectorFrameSource source;
+  source.records = make_capture_records(100);
+  success = engine.run(source);
+  assert(success);
+  assert(engine.stats().frames_read == 100);
+  assert(engine.stats().frames_filtered == 100);
+  assert(engine.stats().frames_sent == 0);
+
+  // Replay channel 0 vào vbus ở tốc độ 2x: frame cách nhau 10 ms trong
+  // capture đến bên nhận cách nhau khoảng 5 ms; channel 1 không được map
+  EpollEventLoop loop;
+  SocketCanIntf  output, receiver;
+  std::vector<uint64_t> received_ns;
+  success = output.init("vbus:test_replay", &loop, [](const can_frame&) {});
+  assert(success);
+  success = receiver.init("vbus:test_replay", &loop,
+                          [&received_ns](const can_frame&) {
+                            received_ns.push_back(DeadlineScheduler::now_ns());
+                          });
+  assert(success);
+  constexpr size_t   kFrames   = 20;
+  constexpr uint64_t kPeriodNs = 10000000;
+  VectorFrameSource  timed;
+  for (size_t i = 0; i < kFrames; ++i) {
+    CaptureRecord rec = {};
+    rec.timestamp_ns  = 1700000000000000000ull + i * kPeriodNs;
+    rec.frame.can_id  = 0x123;
+    rec.frame.can_dlc = 1;
+    timed.records.push_back(rec);
+    rec.channel = 1;
+    timed.records.push_back(rec);
+  }
+  engine.map_channel(0, &output);
+  success = engine.set_speed(2);
+  assert(success);
+  uint64_t          start_ns = DeadlineScheduler::now_ns();
+  std::atomic<bool> done{false};
+  std::thread       player([&]() {
+    bool ok = engine.run(timed);
+    assert(ok);
+    done = true;
+  });
+  auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((!done || received_ns.size() < kFrames) &&
+         std::chrono::steady_clock::now() < timeout)
+    loop.run_once(1);
+  player.join();
+  assert(engine.stats().frames_sent == kFrames);
+  assert(engine.stats().frames_filtered == kFrames);
+  assert(received_ns.size() == kFrames);
+  // Deadline tuyệt đối: frame i không đến trước start + i * 5 ms
+  for (size_t i = 0; i < kFrames; ++i)
+    assert(received_ns[i] - start_ns >= i * kPeriodNs / 2);
+  uint64_t span = received_ns.back() - received_ns.front();
+  assert(span >= (kFrames - 1) * kPeriodNs / 2 - 5000000);
+  assert(span < (kFrames - 1) * kPeriodNs / 2 + 100000000);
+  output.deinit();
+  receiver.deinit();
+}
+
 // Utility function để print frame info
 void print_frame_info(const can_frame& frame) {
   std::cout << "CAN Frame - ID: 0x" << std::hex << (frame.can_id & CAN_EFF_MASK)
@@ -160,6 +506,1914 @@ void print_frame_info(const can_frame& frame) {
   std::cout << std::endl;
 }
 
+TEST(frame_formatter_lines) {
+  can_frame frame = {};
+  frame.can_id    = 0x123;
+  frame.can_dlc   = 4;
+  frame.data[0]   = 0xDE;
+  frame.data[1]   = 0xAD;
+  frame.data[2]   = 'A';
+  frame.data[3]   = 0x00;
+
+  CaptureRecord record = {};
+  record.timestamp_ns  = 1436509052249713000ull;
+  record.frame         = frame;
+
+  char  line[FrameFormatter::kMaxLineLength + 16];
+  char* end = FrameFormatter::format_candump(line, record, "vcan0", 5);
+  assert(std::string(line, end) == "(1436509052.249713) vcan0 123#DEAD4100\n");
+
+  record.frame.can_id  = 0x12345678 | CAN_EFF_FLAG | CAN_RTR_FLAG;
+  record.frame.can_dlc = 2;
+  record.flags         = kCaptureFlagTx;
+  end                  = FrameFormatter::format_candump(line, record, "c", 1);
+  assert(std::string(line, end) == "(1436509052.249713) c 12345678#R2 T\n");
+
+  // Phần giây được cache, so sánh với strftime cho cả hai giây liên tiếp
+  FrameFormatter formatter;
+  for (uint64_t ts : {1436509052249713000ull,
+                      1436509052999999999ull,
+                      1436509053000000000ull}) {
+    end = formatter.format_human(line, frame, ts, 42);
+
+    time_t    t = static_cast<time_t>(ts / 1000000000ull);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char expected[64];
+    size_t n = strftime(expected, sizeof(expected), "[%H:%M:%S.", &tm);
+    snprintf(expected + n,
+             sizeof(expected) - n,
+             "%03u]",
+             static_cast<unsigned>(ts % 1000000000ull / 1000000));
+    assert(std::string(line, end).rfind(expected, 0) == 0);
+  }
+  std::string tail(std::strchr(line, ']'), end);
+  assert(tail == "] Frame #    42 - ID: 0x123 (STD) DLC: 4 "
+                 "Data: [0xde 0xad 0x41 0x00] ASCII: \"..A.\"\n");
+}
+
+TEST(ring_buffers) {
+  // SPSC: consumer thread nhận đúng thứ tự, producer không bao giờ chờ
+  constexpr uint32_t  kCount = 1000000;
+  SpscRing<can_frame> spsc(1024);
+  assert(spsc.capacity() == 1024);
+  std::thread consumer([&spsc]() {
+    can_frame frame;
+    uint32_t  expected = 0;
+    while (expected < kCount) {
+      if (spsc.pop(frame)) {
+        assert(frame.can_id == expected);
+        expected++;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+  can_frame frame = {};
+  for (uint32_t i = 0; i < kCount; ++i) {
+    frame.can_id = i;
+    while (!spsc.push(frame))
+      std::this_thread::yield();
+  }
+  consumer.join();
+  assert(spsc.size() == 0);
+
+  // Ring đầy thì frame mới bị drop và được đếm
+  SpscRing<can_frame> full(4);
+  for (int i = 0; i < 6; ++i)
+    full.push(frame);
+  assert(full.size() == 4 && full.dropped() == 2);
+
+  // Broadcast: reader nhanh nhận hết, reader chậm bị overrun
+  BroadcastRing<can_frame>         ring(64);
+  BroadcastRing<can_frame>::Reader fast = ring.subscribe();
+  BroadcastRing<can_frame>::Reader slow = ring.subscribe();
+  FrameProcessor                   publish = ring_frame_processor(ring);
+  uint32_t                         next    = 0;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    frame.can_id = i;
+    publish(frame);
+    while (fast.read(frame)) {
+      assert(frame.can_id == next);
+      next++;
+    }
+  }
+  assert(next == 1000 && fast.overruns() == 0);
+
+  assert(slow.pending() == 64);
+  uint32_t received = 0;
+  uint32_t last     = 0;
+  while (slow.read(frame)) {
+    assert(received == 0 || frame.can_id == last + 1);
+    last = frame.can_id;
+    received++;
+  }
+  assert(last == 999);
+  assert(received + slow.overruns() == 1000);
+  assert(slow.overruns() > 0);
+}
+
+TEST(shm_frame_bus) {
+  ShmFramePublisher publisher;
+  bool success = publisher.open("socket_can_test", 256);
+  assert(success);
+
+  // Subscriber dùng cùng signature với SocketCanIntf::init()
+  EpollEventLoop     loop;
+  ShmFrameSubscriber subscriber;
+  uint32_t           next = 0;
+  success =
+    subscriber.init("socket_can_test", &loop, [&next](const can_frame& f) {
+      assert(f.can_id == next);
+      next++;
+    });
+  assert(success);
+
+  constexpr uint32_t kCount = 20000;
+  std::thread        producer([&publisher]() {
+    can_frame frame = {};
+    for (uint32_t i = 0; i < kCount; ++i) {
+      frame.can_id = i;
+      publisher.publish(frame);
+      if (i % 64 == 63)
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  });
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (next < kCount && std::chrono::steady_clock::now() < deadline) {
+    success = loop.run_once(100) >= 0;
+    assert(success);
+  }
+  producer.join();
+  assert(next == kCount && subscriber.overruns() == 0);
+
+  // Subscriber chậm bị publisher ghi đè: frame mất được đếm vào overruns
+  can_frame frame = {};
+  for (uint32_t i = 0; i < 1000; ++i) {
+    frame.can_id = kCount + 744 + i;
+    publisher.publish(frame);
+  }
+  next     = kCount + 744 + 1000 - 256;
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+  while (subscriber.received() < kCount + 256 &&
+         std::chrono::steady_clock::now() < deadline) {
+    success = loop.run_once(100) >= 0;
+    assert(success);
+  }
+  assert(subscriber.received() == kCount + 256);
+  assert(subscriber.overruns() == 1000 - 256);
+
+  subscriber.deinit();
+  publisher.close();
+  ShmFrameSubscriber missing;
+  success = !missing.init("socket_can_test", &loop, [](const can_frame&) {});
+  assert(success);
+
+  // Publisher đã đóng từ chối publish thay vì truy cập segment đã unmap
+  success = !publisher.publish(frame) && publisher.published() == 0;
+  assert(success);
+}
+
+TEST(latency_histogram_and_runner) {
+  LatencyHistogram histogram;
+  for (uint64_t v = 1; v <= 100000; ++v)
+    histogram.record(v);
+  assert(histogram.count() == 100000);
+  assert(histogram.min() == 1 && histogram.max() == 100000);
+  // Sai số tương đối của bucket < 1.6%
+  for (double p : {50.0, 90.0, 99.0, 99.99}) {
+    double exact = p * 1000;
+    double got   = static_cast<double>(histogram.percentile(p));
+    assert(got >= exact && got <= exact * 1.016);
+  }
+  assert(histogram.percentile(100) == 100000);
+  const uint64_t edges[] = {0, 127, 128, 1ull << 40, UINT64_MAX};
+  for (uint64_t v : edges)
+    assert(LatencyHistogram::index_of(v) < LatencyHistogram::kBucketCount);
+
+  // Runner không có quyền realtime vẫn chạy loop và báo lỗi qua report()
+  EpollEventLoop     loop;
+  RealtimeConfig     config;
+  std::vector<char>  buffer(1 << 20);
+  RealtimeLoopRunner runner(&loop, config);
+  runner.add_prefault_region(buffer.data(), buffer.size());
+  std::atomic<int> triggered{0};
+  EpollEvent       event;
+  bool success = event.init(&loop, [&triggered](uint32_t) { triggered++; });
+  assert(success);
+  success = runner.start();
+  assert(success);
+  assert(runner.report().prefaulted_bytes >= buffer.size());
+  for (int i = 0; i < 10; ++i) {
+    event.set();
+    while (triggered <= i)
+      std::this_thread::yield();
+  }
+  runner.stop();
+  event.deinit();
+  assert(runner.dispatch_latency().count() >= 10);
+}
+
+TEST(virtual_bus_rx_tx) {
+  // Toàn bộ đường RX/TX của SocketCanIntf trên bus ảo, không cần vcan/root
+  EpollEventLoop         loop;
+  SocketCanIntf          node_a, node_b, node_c;
+  std::vector<can_frame> rx_a, rx_b, rx_c;
+  bool success =
+    node_a.init("vbus:test_rx_tx", &loop, [&rx_a](const can_frame& f) {
+      rx_a.push_back(f);
+    });
+  assert(success);
+  success = node_b.init("vbus:test_rx_tx", &loop, [&rx_b](const can_frame& f) {
+    rx_b.push_back(f);
+  });
+  assert(success);
+  success = node_c.init("vbus:test_rx_tx", &loop, [&rx_c](const can_frame& f) {
+    rx_c.push_back(f);
+  });
+  assert(success);
+
+  can_frame frame = {};
+  frame.can_dlc   = 2;
+  for (uint32_t i = 0; i < 100; ++i) {
+    frame.can_id  = i;
+    frame.data[0] = static_cast<uint8_t>(i);
+    success = node_a.send_can_frame(frame);
+    assert(success);
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((rx_b.size() < 100 || rx_c.size() < 100) &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  // Broadcast tới mọi node khác, không gửi lại cho chính sender
+  assert(rx_a.empty() && rx_b.size() == 100 && rx_c.size() == 100);
+  for (uint32_t i = 0; i < 100; ++i)
+    assert(rx_b[i].can_id == i && rx_c[i].data[0] == i);
+
+  node_a.deinit();
+  node_b.deinit();
+  node_c.deinit();
+}
+
+TEST(virtual_bus_arbitration_and_pacing) {
+  // 10 kbit/s: một frame 8 byte chiếm bus khoảng 13.5 ms
+  std::shared_ptr<VirtualCanBus> bus = VirtualCanBus::get("test_arbitration");
+  bus->set_bitrate(10000);
+
+  LoopbackTransport sender[4];
+  LoopbackTransport receiver;
+  bool success = receiver.open("vbus:test_arbitration");
+  assert(success);
+  for (auto& t : sender) {
+    success = t.open("vbus:test_arbitration");
+    assert(success);
+  }
+
+  can_frame frame = {};
+  frame.can_dlc   = 8;
+  frame.can_id    = 0x700;
+  success = sender[0].send(frame);
+  assert(success);  // chiếm bus trước
+  std::this_thread::sleep_for(std::chrono::milliseconds(3));
+  frame.can_id = 0x300;
+  success = sender[1].send(frame);
+  assert(success);
+  frame.can_id = 0x100 | CAN_EFF_FLAG;  // base ID 0 thắng mọi ID 11-bit
+  success = sender[2].send(frame);
+  assert(success);
+  frame.can_id = 0x200;
+  success = sender[3].send(frame);
+  assert(success);
+
+  auto      start = std::chrono::steady_clock::now();
+  canid_t   order[4];
+  size_t    n = 0;
+  can_frame rx;
+  while (n < 4) {
+    int rc = receiver.receive(rx);
+    assert(rc >= 0);
+    if (rc == 1)
+      order[n++] = rx.can_id;
+    else
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    assert(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+  }
+  double elapsed_ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  assert(order[0] == 0x700);
+  assert(order[1] == (0x100 | CAN_EFF_FLAG));
+  assert(order[2] == 0x200 && order[3] == 0x300);
+  // 4 frame ở 10 kbit/s không thể nhanh hơn ~4 * 13 ms
+  assert(elapsed_ms > 40);
+  assert(bus->frames_delivered() == 4);
+}
+
+TEST(socket_can_intf_on_opened_transport) {
+  // Intf dựng từ transport đã mở mang tên của transport trong metrics
+  EpollEventLoop loop;
+  auto           transport = std::make_unique<LoopbackTransport>();
+  bool           success   = transport->open("vbus:test_named");
+  assert(success);
+  assert(transport->name() == "vbus:test_named");
+  assert(!transport->has_link_state());
+  SocketCanIntf intf;
+  success = intf.init(std::move(transport), &loop, [](const can_frame&) {});
+  assert(success);
+  std::string text = MetricsRegistry::global().render();
+  assert(text.find("socket_can_tx_frames_total{interface=\"vbus:"
+                   "test_named\"} 0\n") != std::string::npos);
+  intf.deinit();
+}
+
+TEST(traffic_generator_load) {
+  std::istringstream in("bitrate 250000\n"
+                        "load 80  # phần trăm\n"
+                        "periodic 123 8 10\n"
+                        "burst 18DA00F1 8 4 100\n"
+                        "random 600-60F 0-8 5\n");
+  TrafficProfile     profile;
+  bool success = profile.parse(in);
+  assert(success);
+  assert(profile.bitrate == 250000 && profile.load == 80);
+  assert(profile.sources.size() == 3);
+  assert(profile.sources[1].id == (0x18DA00F1 | CAN_EFF_FLAG));
+  assert(profile.sources[2].id_max == 0x60F && profile.sources[2].dlc_max == 8);
+
+  std::istringstream bad("periodic 800 8 10\n");  // ID 11-bit không hợp lệ
+  TrafficProfile     rejected;
+  success = !rejected.parse(bad);
+  assert(success);
+  // Số frame của burst phải là số nguyên >= 1
+  for (const char* line : {"burst 123 8 0.5 100\n", "burst 123 8 0 100\n",
+                           "burst 123 8 -1 100\n", "burst 123 8 2.5 100\n"}) {
+    std::istringstream burst(line);
+    TrafficProfile     burst_profile;
+    success = !burst_profile.parse(burst);
+    assert(success);
+  }
+
+  // Burst tạo bằng code với burst_frames = 0 vẫn chỉ gửi một frame mỗi lần
+  TrafficProfile zero_burst;
+  TrafficSource  source;
+  source.kind         = TrafficSource::kBurst;
+  source.id           = 0x123;
+  source.burst_frames = 0;
+  source.interval_ms  = 100;
+  zero_burst.sources.push_back(source);
+  TrafficGenerator zero_generator(zero_burst);
+  zero_generator.start(0);
+  can_frame burst_frames[64];
+  size_t    burst_sent = 0, polled;
+  while ((polled = zero_generator.poll(1000000000, burst_frames, 64)) > 0)
+    burst_sent += polled;
+  assert(burst_sent < 100);
+
+  // Thời gian giả lập: 10 s trên bus, tải sinh ra phải sát 80%
+  TrafficGenerator generator(profile);
+  generator.start(0);
+  can_frame frames[64];
+  uint64_t  periodic = 0;
+  for (uint64_t t = 0; t < 10000000000ull; t += 1000000) {
+    size_t n;
+    while ((n = generator.poll(t, frames, 64)) > 0) {
+      for (size_t i = 0; i < n; ++i) {
+        if (frames[i].can_id == 0x123)
+          periodic++;
+        if ((frames[i].can_id & CAN_EFF_MASK) >= 0x600 &&
+            (frames[i].can_id & CAN_EFF_MASK) <= 0x60F)
+          assert(frames[i].can_dlc <= 8);
+      }
+    }
+    assert(generator.next_deadline() > t);
+  }
+  double load = generator.generated_bits() / 10.0 / profile.bitrate;
+  assert(load > 0.77 && load < 0.83);
+  // Nguồn periodic không bị trôi: đúng 10 s / chu kỳ đã scale
+  double period_ms = 10 / generator.scale();
+  assert(std::abs(periodic - 10000 / period_ms) <= 1);
+
+  // send_batch() qua sendmmsg trên bus ảo
+  LoopbackTransport tx, rx;
+  success = tx.open("vbus:test_generator") && rx.open("vbus:test_generator");
+  assert(success);
+  success = tx.send_batch(frames, 8) == 8;
+  assert(success);
+  size_t received = 0;
+  auto   deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (received < 8 && std::chrono::steady_clock::now() < deadline) {
+    ssize_t n = rx.receive_batch(frames + 8, 8);
+    assert(n >= 0);
+    received += static_cast<size_t>(n);
+  }
+  assert(received == 8);
+}
+
+TEST(traffic_statistics_per_id) {
+  TrafficStatistics stats;
+  can_frame         frame = {};
+  frame.can_id            = 0x123;
+  frame.can_dlc           = 8;
+  // Chu kỳ 10 ms ± 1 ms, một lần mất 3 frame (khoảng trống 39 ms)
+  uint64_t t = 1000000000;
+  for (int i = 0; i < 100; ++i) {
+    t += (i == 50 ? 40000000 : 10000000) + (i % 2 ? 1000000 : -1000000);
+    if (i == 70)
+      frame.can_dlc = 4;
+    stats.record(frame, t);
+  }
+  IdStats s;
+  bool success = stats.snapshot(0x123 | CAN_RTR_FLAG, s);
+  assert(success);  // RTR cùng ID
+  assert(s.count == 100 && s.dlc_changes == 1 && s.dlc == 4);
+  assert(s.min_interval_ns == 9000000 && s.max_interval_ns == 39000000);
+  assert(s.mean_interval_ns > 10000000 && s.mean_interval_ns < 10500000);
+  assert(s.jitter_ns() > 1000000 && s.jitter_ns() < 4000000);
+  assert(s.overdue_ns(t + 5000000) == 0);
+  assert(s.overdue_ns(t + 30000000) > 19000000);
+  success = !stats.snapshot(0x124, s);
+  assert(success);
+}
+
+TEST(traffic_statistics_table_full) {
+  TrafficStatistics stats(8);  // hash nhỏ: tối đa 6 ID extended
+  can_frame         frame = {};
+  frame.can_dlc           = 8;
+  frame.can_id            = 0x123;
+  stats.record(frame, 1000);
+  for (canid_t id = 0; id < 10; ++id) {
+    frame.can_id = (0x18DA0000 + id) | CAN_EFF_FLAG;
+    stats.record(frame, 2000);
+  }
+  // ID không còn chỗ chỉ được đếm vào untracked()
+  assert(stats.ids() == 7 && stats.untracked() == 4);
+  IdStats s;
+  bool    success =
+    stats.snapshot(0x18DA0005 | CAN_EFF_FLAG, s) && s.count == 1;
+  assert(success);
+  assert(stats.snapshot_all().size() == 7);
+  frame.can_id = 0x123 | CAN_ERR_FLAG;  // error frame không được tính
+  stats.record(frame, 3000);
+  assert(stats.frames() == 7);
+}
+
+TEST(traffic_statistics_concurrent_snapshot) {
+  // Snapshot từ thread khác trong khi vẫn ghi: không bao giờ thấy bản ghi
+  // bị xé (last_ns luôn khớp với count)
+  TrafficStatistics live;
+  can_frame         frame = {};
+  frame.can_dlc           = 8;
+  std::atomic<bool> done{false};
+  std::thread       reader([&]() {
+    IdStats r;
+    while (!done) {
+      if (live.snapshot(0x321, r))
+        assert(r.last_ns == r.count * 1000);
+    }
+  });
+  frame.can_id = 0x321;
+  for (uint64_t i = 1; i <= 200000; ++i)
+    live.record(frame, i * 1000);
+  done = true;
+  reader.join();
+}
+
+// Tham chiếu từng bit: serialize frame, CRC-15 và đếm stuff bit
+uint32_t reference_frame_bits(const can_frame& frame) {
+  std::vector<int> bits;
+  auto put = [&bits](uint32_t value, int n) {
+    for (int i = n - 1; i >= 0; --i)
+      bits.push_back((value >> i) & 1);
+  };
+  bool rtr = frame.can_id & CAN_RTR_FLAG;
+  put(0, 1);
+  if (frame.can_id & CAN_EFF_FLAG) {
+    put((frame.can_id & CAN_EFF_MASK) >> 18, 11);
+    put(3, 2);
+    put(frame.can_id & 0x3FFFF, 18);
+    put(rtr, 1);
+    put(0, 2);
+  } else {
+    put(frame.can_id & CAN_SFF_MASK, 11);
+    put(rtr, 1);
+    put(0, 2);
+  }
+  put(frame.can_dlc, 4);
+  for (int i = 0; i < (rtr ? 0 : frame.can_dlc); ++i)
+    put(frame.data[i], 8);
+  uint32_t crc = 0;
+  for (int bit : bits) {
+    int next = bit ^ ((crc >> 14) & 1);
+    crc      = (crc << 1) & 0x7FFF;
+    if (next)
+      crc ^= 0x4599;
+  }
+  put(crc, 15);
+  uint32_t stuff = 0;
+  int      last  = -1, run = 0;
+  for (int bit : bits) {
+    run  = bit == last ? run + 1 : 1;
+    last = bit;
+    if (run == 5) {
+      stuff++;
+      last = !bit;
+      run  = 1;
+    }
+  }
+  return static_cast<uint32_t>(bits.size()) + stuff + 13;
+}
+
+TEST(bus_load_exact_bits) {
+  // Frame toàn bit 0: stuff bit tối đa
+  can_frame frame = {};
+  frame.can_dlc   = 8;
+  assert(can_frame_bits_exact(frame) == reference_frame_bits(frame));
+  assert(can_frame_bits_exact(frame) <= can_frame_bits_worst_case(frame));
+  // Data xen kẽ 0x55: không cần stuff trong vùng data
+  frame.can_id = 0x555;
+  std::memset(frame.data, 0x55, 8);
+  assert(can_frame_bits_exact(frame) == reference_frame_bits(frame));
+  assert(can_frame_bits_exact(frame) < can_frame_bits_worst_case(frame) - 10);
+
+  uint64_t rng = 12345;
+  for (int i = 0; i < 20000; ++i) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    frame.can_id = static_cast<canid_t>(rng & CAN_EFF_MASK);
+    if (rng & (1ull << 40))
+      frame.can_id |= CAN_EFF_FLAG;
+    else
+      frame.can_id &= CAN_SFF_MASK;
+    if ((rng & (0xFull << 44)) == 0)
+      frame.can_id |= CAN_RTR_FLAG;
+    frame.can_dlc = static_cast<uint8_t>((rng >> 32) % 9);
+    for (int b = 0; b < 8; ++b)  // data ít bit → nhiều stuff bit
+      frame.data[b] = static_cast<uint8_t>((rng >> (b * 3)) & (rng >> 50));
+    uint32_t exact = can_frame_bits_exact(frame);
+    assert(exact == reference_frame_bits(frame));
+    assert(exact <= can_frame_bits_worst_case(frame));
+  }
+
+  // CAN FD: data phase ở 2 Mbit/s ngắn hơn nhiều so với 500 kbit/s
+  canfd_frame fd = {};
+  fd.can_id      = 0x123;
+  fd.len         = 64;
+  uint64_t slow  = canfd_frame_duration_ns(fd, 500000, 2000000);
+  fd.flags       = CANFD_BRS;
+  uint64_t fast  = canfd_frame_duration_ns(fd, 500000, 2000000);
+  assert(slow > 1000000 && fast < slow / 2 && fast > slow / 4);
+
+  // 1000 frame/s trong 3 s: tải 1 s và 10 s khớp với thời gian trên dây
+  BusLoadEstimator estimator(500000);
+  frame        = {};
+  frame.can_id = 0x100;
+  frame.can_dlc = 8;
+  std::memset(frame.data, 0x55, 8);
+  uint64_t frame_ns = can_frame_bits_exact(frame) * 2000ull;
+  uint64_t t0       = 5000000000ull;
+  uint64_t t        = t0;
+  for (int i = 0; i < 3000; ++i) {
+    t = t0 + i * 1000000ull;
+    estimator.add(frame, t);
+  }
+  double expected = frame_ns / 1e6;  // một frame mỗi ms
+  assert(std::abs(estimator.load(1, t) - expected) < expected * 0.05);
+  assert(std::abs(estimator.load(2, t) - expected) < expected * 0.05);
+  assert(std::abs(estimator.load(0, t) - expected) < expected * 0.15);
+  assert(estimator.load(1, t + 5000000000ull) == 0);  // bus im lặng
+  assert(estimator.busy_ns() == 3000 * frame_ns);
+
+  TrafficStatistics stats;
+  stats.enable_bus_load(500000);
+  stats.record(frame, t0);
+  assert(stats.bus_load() && stats.bus_load()->busy_ns() == frame_ns);
+}
+
+TEST(metrics_registry_and_server) {
+  MetricsRegistry registry;
+  auto counter = registry.counter("test_frames", "Frames", {{"bus", "a"}});
+  counter->inc(3);
+  // Cùng tên và label trả về cùng một counter
+  registry.counter("test_frames", "Frames", {{"bus", "a"}})->inc();
+  auto histogram =
+    registry.histogram("test_latency_seconds", "Latency", {}, 10, 12, 1e-9);
+  histogram->observe(1000);  // <= 1024 ns
+  histogram->observe(3000);  // <= 4096 ns
+  histogram->observe(1u << 20);
+  auto depth = registry.callback("test_depth", "Depth",
+                                 MetricsRegistry::Type::kGauge, {},
+                                 [](double& v) {
+                                   v = 2.5;
+                                   return true;
+                                 });
+  std::string text = registry.render();
+  assert(text.find("# TYPE test_frames counter\n") != std::string::npos);
+  assert(text.find("test_frames_total{bus=\"a\"} 4\n") != std::string::npos);
+  assert(text.find("test_latency_seconds_bucket{le=\"1.024e-06\"} 1\n") !=
+         std::string::npos);
+  assert(text.find("test_latency_seconds_bucket{le=\"4.096e-06\"} 2\n") !=
+         std::string::npos);
+  assert(text.find("test_latency_seconds_bucket{le=\"+Inf\"} 3\n") !=
+         std::string::npos);
+  assert(text.find("test_latency_seconds_count 3\n") != std::string::npos);
+  assert(text.find("test_depth 2.5\n") != std::string::npos);
+  assert(text.size() >= 6 && text.compare(text.size() - 6, 6, "# EOF\n") == 0);
+  // Series biến mất khi owner giải phóng nó
+  depth->reset();
+  counter.reset();
+  text = registry.render();
+  assert(text.find("test_frames") == std::string::npos);
+  assert(text.find("test_depth") == std::string::npos);
+
+  // Counter của SocketCanIntf và event loop trong registry toàn cục
+  EpollEventLoop loop;
+  loop.enable_metrics("test", MetricsRegistry::global());
+  SocketCanIntf  node_a, node_b;
+  size_t         received = 0;
+  bool success =
+    node_a.init("vbus:test_metrics", &loop, [](const can_frame&) {});
+  assert(success);
+  success = node_b.init("vbus:test_metrics", &loop,
+                        [&received](const can_frame&) { received++; });
+  assert(success);
+  can_frame frame = {};
+  for (int i = 0; i < 10; ++i) {
+    success = node_a.send_can_frame(frame);
+    assert(success);
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (received < 10 && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(received == 10);
+
+  // Client HTTP qua Unix socket; server chạy trên chính loop này
+  std::string    path = "/tmp/socket_can_test_metrics.sock";
+  MetricsServer  server;
+  success = server.init(path, &loop);
+  assert(success);
+  int            fd   = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un    addr = {};
+  addr.sun_family     = AF_UNIX;
+  std::strcpy(addr.sun_path, path.c_str());
+  success = connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  assert(success);
+  const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+  success = write(fd, request, sizeof(request) - 1) == sizeof(request) - 1;
+  assert(success);
+  for (int i = 0; i < 5; ++i)
+    loop.run_once(10);
+  std::string response;
+  char        buf[4096];
+  ssize_t     n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0)
+    response.append(buf, static_cast<size_t>(n));
+  close(fd);
+  assert(response.compare(0, 15, "HTTP/1.0 200 OK") == 0);
+  // Node a đã gửi 10 frame, node b đã nhận 10 frame
+  assert(response.find("socket_can_tx_frames_total{interface=\"vbus:"
+                       "test_metrics\"} 10\n") != std::string::npos);
+  assert(response.find("socket_can_rx_frames_total{interface=\"vbus:"
+                       "test_metrics\"} 10\n") != std::string::npos);
+  assert(response.find("socket_can_loop_callback_seconds_count{loop="
+                       "\"test\"}") != std::string::npos);
+  assert(response.find("socket_can_tx_queue_bytes{interface=") !=
+         std::string::npos);
+
+  server.deinit();
+  // Không xoá file thường trùng đường dẫn socket
+  std::string file_path = "/tmp/socket_can_test_metrics.txt";
+  close(open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+  success = server.init(file_path, &loop);
+  assert(!success);
+  success = access(file_path.c_str(), F_OK) == 0;
+  assert(success);
+  unlink(file_path.c_str());
+
+  node_a.deinit();
+  node_b.deinit();
+  // Sau deinit không còn đọc queue của transport đã đóng
+  text = MetricsRegistry::global().render();
+  assert(text.find("socket_can_tx_queue_bytes") == std::string::npos);
+}
+
+TEST(error_frames_and_link_recovery) {
+  // Giải mã error frame theo linux/can/error.h
+  can_frame    frame = {};
+  CanErrorInfo info;
+  bool success = !decode_can_error(frame, info);
+  assert(success);
+  frame.can_id  = CAN_ERR_FLAG | CAN_ERR_CRTL | CAN_ERR_CNT;
+  frame.can_dlc = CAN_ERR_DLC;
+  frame.data[1] = CAN_ERR_CRTL_TX_PASSIVE;
+  frame.data[6] = 130;
+  success = decode_can_error(frame, info);
+  assert(success);
+  assert(info.state_known && info.state == CanControllerState::kErrorPassive);
+  assert(info.tx_errors == 130 && info.rx_errors == 0);
+  assert(info.describe() == "error-passive (tx 130, rx 0)");
+  frame.can_id  = CAN_ERR_FLAG | CAN_ERR_PROT | CAN_ERR_ACK;
+  frame.data[2] = CAN_ERR_PROT_STUFF;
+  success = decode_can_error(frame, info) && !info.state_known;
+  assert(success);
+  assert(info.describe() == "protocol stuff, no ack");
+
+  // Message rtnetlink: vcan9 down rồi bị xóa
+  alignas(nlmsghdr) char buf[256] = {};
+  size_t                 size     = 0;
+  for (uint16_t type : {RTM_NEWLINK, RTM_DELLINK}) {
+    nlmsghdr* message    = reinterpret_cast<nlmsghdr*>(buf + size);
+    message->nlmsg_type  = type;
+    ifinfomsg* ifi       = static_cast<ifinfomsg*>(NLMSG_DATA(message));
+    ifi->ifi_index       = 9;
+    ifi->ifi_flags       = type == RTM_NEWLINK ? 0 : IFF_UP;
+    rtattr* name         = IFLA_RTA(ifi);
+    name->rta_type       = IFLA_IFNAME;
+    name->rta_len        = RTA_LENGTH(6);
+    std::memcpy(RTA_DATA(name), "vcan9", 6);
+    message->nlmsg_len =
+      NLMSG_LENGTH(sizeof(ifinfomsg)) + RTA_ALIGN(name->rta_len);
+    size += NLMSG_ALIGN(message->nlmsg_len);
+  }
+  std::vector<LinkEvent> events;
+  success = LinkMonitor::parse(buf, size, events) && events.size() == 2;
+  assert(success);
+  assert(events[0].name == "vcan9" && events[0].ifindex == 9);
+  assert(!events[0].up && !events[0].removed);
+  assert(events[1].up && events[1].removed);
+
+  // Error frame đi vào error handler, không vào frame processor
+  EpollEventLoop loop;
+  LinkMonitor    monitor;
+  success = monitor.init(&loop);
+  assert(success);
+  SocketCanIntf             node_a, node_b;
+  std::vector<can_frame>    rx;
+  std::vector<CanErrorInfo> errors;
+  success = node_a.init("vbus:test_recovery", &loop,
+                        [&rx](const can_frame& f) { rx.push_back(f); });
+  assert(success);
+  success = node_b.init("vbus:test_recovery", &loop, [](const can_frame&) {});
+  assert(success);
+  node_a.set_error_handler(
+    [&errors](const CanErrorInfo& e) { errors.push_back(e); });
+  node_a.enable_recovery(&monitor);
+  can_frame bus_off = {};
+  bus_off.can_id    = CAN_ERR_FLAG | CAN_ERR_BUSOFF;
+  bus_off.can_dlc   = CAN_ERR_DLC;
+  can_frame restarted = bus_off;
+  restarted.can_id    = CAN_ERR_FLAG | CAN_ERR_RESTARTED;
+  can_frame data      = {};
+  data.can_id         = 0x123;
+  success = node_b.send_can_frame(bus_off);
+  assert(success);
+  auto run_until = [&loop](const std::function<bool()>& done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done() && std::chrono::steady_clock::now() < deadline)
+      loop.run_once(10);
+    return done();
+  };
+  success = run_until([&errors] { return errors.size() == 1; });
+  assert(success);
+  assert(node_a.controller_state() == CanControllerState::kBusOff);
+  success = node_b.send_can_frame(restarted);
+  assert(success);
+  success = node_b.send_can_frame(data);
+  assert(success);
+  success = run_until([&rx] { return rx.size() == 1; });
+  assert(success);
+  assert(errors.size() == 2 && errors[1].restarted);
+  assert(node_a.controller_state() == CanControllerState::kErrorActive);
+
+  // Link mất rồi quay lại: socket được mở lại, frame lại đi qua
+  LinkEvent event;
+  event.name = "vbus:test_recovery";
+  node_a.on_link_event(event);
+  assert(!node_a.link_up());
+  success = !node_a.send_can_frame(data) && errno == ENETDOWN;
+  assert(success);
+  event.up = true;
+  node_a.on_link_event(event);
+  assert(node_a.link_up());
+  success = node_b.send_can_frame(data);
+  assert(success);
+  success = run_until([&rx] { return rx.size() == 2; });
+  assert(success);
+  success = node_a.send_can_frame(data);
+  assert(success);
+
+  std::string text = MetricsRegistry::global().render();
+  assert(text.find("socket_can_recoveries_total{interface=\"vbus:"
+                   "test_recovery\",kind=\"link\"} 1\n") != std::string::npos);
+  assert(text.find("socket_can_recoveries_total{interface=\"vbus:"
+                   "test_recovery\",kind=\"bus_off\"} 1\n") !=
+         std::string::npos);
+  assert(text.find("socket_can_bus_off_total{interface=\"vbus:"
+                   "test_recovery\"} 1\n") != std::string::npos);
+
+  node_a.deinit();
+  node_b.deinit();
+  monitor.deinit();
+}
+
+TEST(request_correlator_limits_and_timeouts) {
+  // Ba ECU trả lời request 0x7E0+n bằng 0x7E8+n, echo data[1] làm key;
+  // ECU 0x7E3 không trả lời
+  EpollEventLoop loop;
+  SocketCanIntf  tester, ecu;
+  std::map<canid_t, size_t> in_flight, max_in_flight;
+  std::vector<can_frame>    pending_responses;
+  RequestCorrelator         correlator;
+  bool success = tester.init("vbus:correlator", &loop, [&](const can_frame& f) {
+    if (correlator.on_frame(f))
+      --in_flight[f.can_id - 8];
+  });
+  assert(success);
+  success = ecu.init("vbus:correlator", &loop, [&](const can_frame& f) {
+    if (f.can_id == 0x7E3)
+      return;
+    can_frame response = f;
+    response.can_id    = f.can_id + 8;
+    pending_responses.push_back(response);
+  });
+  assert(success);
+  success = correlator.init(&tester, &loop);
+  assert(success);
+  correlator.set_key_extractor([](const can_frame& f) { return f.data[1]; });
+  correlator.set_limit(0x7E2, 2);
+
+  std::map<RequestCorrelator::Result, int> results;
+  std::vector<std::pair<canid_t, uint8_t>> order;
+  for (uint8_t i = 0; i < 4; ++i) {
+    for (canid_t target = 0x7E0; target <= 0x7E3; ++target) {
+      RequestCorrelator::Request request;
+      request.tx.can_id   = target;
+      request.tx.can_dlc  = 2;
+      request.tx.data[1]  = i;
+      request.response_id = target + 8;
+      request.key         = i;
+      request.timeout     = std::chrono::milliseconds(20);
+      request.handler     = [&, target, i](RequestCorrelator::Result r,
+                                       const can_frame* response) {
+        ++results[r];
+        if (r == RequestCorrelator::Result::kResponse) {
+          assert(response && response->data[1] == i);
+          order.emplace_back(target, i);
+        }
+      };
+      success = correlator.submit(request) != RequestCorrelator::kInvalidId;
+      assert(success);
+    }
+  }
+  // Mặc định mỗi target 1 request outstanding, 0x7E2 được 2
+  assert(correlator.outstanding() == 5 && correlator.queued() == 11);
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((correlator.outstanding() || correlator.queued()) &&
+         std::chrono::steady_clock::now() < deadline) {
+    for (auto& [target, n] : in_flight)
+      max_in_flight[target] = std::max(max_in_flight[target], n);
+    loop.run_once(5);
+    // ECU trả lời sau khi loop đã xử lý xong request, đảo thứ tự để kiểm key
+    std::reverse(pending_responses.begin(), pending_responses.end());
+    for (const can_frame& response : pending_responses) {
+      ++in_flight[response.can_id - 8];
+      ecu.send_can_frame(response);
+    }
+    pending_responses.clear();
+  }
+  assert(correlator.outstanding() == 0 && correlator.queued() == 0);
+  assert(results[RequestCorrelator::Result::kResponse] == 12);
+  assert(results[RequestCorrelator::Result::kTimeout] == 4);
+  // Limit 1 thì response theo thứ tự gửi; 0x7E2 nhận ngược nhưng vẫn khớp
+  // đúng request nhờ key
+  for (canid_t target = 0x7E0; target <= 0x7E2; ++target) {
+    uint8_t next = 0, reordered = 0;
+    for (auto& [t, i] : order) {
+      if (t != target)
+        continue;
+      reordered += i != next++;
+    }
+    assert(next == 4 && (target == 0x7E2) == (reordered > 0));
+    assert(max_in_flight[target] == (target == 0x7E2 ? 2u : 1u));
+  }
+
+  // Cancel request đang chờ và request còn trong hàng đợi
+  RequestCorrelator::Request request;
+  request.tx.can_id   = 0x7E3;
+  request.response_id = 0x7EB;
+  request.timeout     = std::chrono::seconds(10);
+  int cancelled       = 0;
+  request.handler     = [&](RequestCorrelator::Result r, const can_frame*) {
+    assert(r == RequestCorrelator::Result::kCancelled);
+    ++cancelled;
+  };
+  uint64_t first  = correlator.submit(request);
+  uint64_t second = correlator.submit(request);
+  assert(correlator.outstanding() == 1 && correlator.queued() == 1);
+  success = correlator.cancel(second) && !correlator.cancel(second);
+  assert(success);
+  success = correlator.cancel(first) && cancelled == 2;
+  assert(success);
+  correlator.submit(request);
+  correlator.deinit();
+  assert(cancelled == 3 && correlator.outstanding() == 0);
+  success = correlator.submit(request) == RequestCorrelator::kInvalidId;
+  assert(success);
+
+  tester.deinit();
+  ecu.deinit();
+}
+
+TEST(gateway_routes_rewrites_and_limits) {
+  // Sửa frame giống can-gw: AND, OR rồi XOR; DLC giữ nguyên
+  GatewayRule rewrite;
+  rewrite.from            = "vbus:gw_powertrain";
+  rewrite.to              = "vbus:gw_chassis";
+  rewrite.id              = 0x100;
+  rewrite.mask            = CAN_EFF_FLAG | CAN_RTR_FLAG | 0x700;
+  rewrite.id_rewrite_mask = 0x700;
+  rewrite.new_id          = 0x500;
+  rewrite.data_and[0]     = 0x0F;
+  rewrite.data_or[1]      = 0x80;
+  rewrite.data_xor[2]     = 0xFF;
+  can_frame modified      = {};
+  modified.can_id         = 0x123;
+  modified.can_dlc        = 3;
+  modified.data[0]        = 0xAB;
+  modified.data[2]        = 0x0F;
+  CanGateway::modify(rewrite, modified);
+  assert(modified.can_id == 0x523 && modified.can_dlc == 3);
+  assert(modified.data[0] == 0x0B && modified.data[1] == 0x80 &&
+         modified.data[2] == 0xF0);
+
+  // Frame 29-bit chính xác, và route giới hạn 100 frame/s, burst 5
+  GatewayRule eff;
+  eff.from = "vbus:gw_powertrain";
+  eff.to   = "vbus:gw_diag";
+  eff.id   = CAN_EFF_FLAG | 0x18DAF110;
+  eff.mask = CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_EFF_MASK;
+  GatewayRule limited;
+  limited.name       = "limited";
+  limited.from       = "vbus:gw_powertrain";
+  limited.to         = "vbus:gw_diag";
+  limited.id         = 0x200;
+  limited.mask       = CAN_EFF_FLAG | CAN_SFF_MASK;
+  limited.rate_limit = 100;
+  limited.burst      = 5;
+
+  EpollEventLoop loop;
+  CanGateway     gateway;
+  bool success = gateway.init(&loop, {rewrite, eff, limited});
+  assert(success);
+  assert(gateway.routes() == 3 && !gateway.stats(0).offloaded);
+
+  SocketCanIntf          powertrain, chassis, diag;
+  std::vector<can_frame> rx_chassis, rx_diag;
+  success =
+    powertrain.init("vbus:gw_powertrain", &loop, [](const can_frame&) {});
+  assert(success);
+  success = chassis.init("vbus:gw_chassis", &loop, [&](const can_frame& f) {
+    rx_chassis.push_back(f);
+  });
+  assert(success);
+  success = diag.init("vbus:gw_diag", &loop, [&](const can_frame& f) {
+    rx_diag.push_back(f);
+  });
+  assert(success);
+
+  can_frame frame = {};
+  frame.can_dlc   = 8;
+  for (canid_t id : {0x123u, 0x1FFu, 0x223u, 0x7FFu}) {
+    frame.can_id = id;
+    success = powertrain.send_can_frame(frame);
+    assert(success);
+  }
+  frame.can_id = CAN_EFF_FLAG | 0x18DAF110;
+  success = powertrain.send_can_frame(frame);
+  assert(success);
+  frame.can_id = CAN_EFF_FLAG | 0x18DAF111;
+  success = powertrain.send_can_frame(frame);
+  assert(success);
+  frame.can_id = 0x200;
+  for (int i = 0; i < 20; ++i) {
+    success = powertrain.send_can_frame(frame);
+    assert(success);
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((rx_chassis.size() < 2 || rx_diag.size() < 6) &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  for (int i = 0; i < 5; ++i)
+    loop.run_once(1);
+
+  assert(rx_chassis.size() == 2);
+  assert(rx_chassis[0].can_id == 0x523 && rx_chassis[1].can_id == 0x5FF);
+  assert(rx_chassis[0].data[2] == 0xFF);
+  assert(rx_diag.size() == 6);
+  assert(rx_diag[0].can_id == (CAN_EFF_FLAG | 0x18DAF110));
+  for (size_t i = 1; i < rx_diag.size(); ++i)
+    assert(rx_diag[i].can_id == 0x200);
+  assert(gateway.stats(0).forwarded == 2 && gateway.stats(1).forwarded == 1);
+  CanGateway::RouteStats stats = gateway.stats(2);
+  assert(stats.forwarded == 5 && stats.rate_dropped == 15);
+  assert(stats.queue_dropped == 0);
+
+  std::string text = MetricsRegistry::global().render();
+  assert(text.find("socket_can_gateway_drops_total{route=\"limited\","
+                   "reason=\"rate\"} 15") != std::string::npos);
+  assert(text.find("socket_can_gateway_latency_seconds_count{route=\""
+                   "limited\"} 5") != std::string::npos);
+
+  gateway.deinit();
+  powertrain.deinit();
+  chassis.deinit();
+  diag.deinit();
+}
+
+TEST(udp_bridge_endpoints) {
+  struct sockaddr_storage address;
+  socklen_t               length;
+  bool success = parse_udp_endpoint("127.0.0.1:29536", address, length);
+  assert(success);
+  success = parse_udp_endpoint("[::1]:29536", address, length);
+  assert(success);
+  assert(address.ss_family == AF_INET6);
+  success = !parse_udp_endpoint("127.0.0.1", address, length);
+  assert(success);
+}
+
+TEST(udp_bridge_localhost) {
+  // Ba bus gửi qua 127.0.0.1, kênh 0 và 1 phát lại vào bus khác, kênh 2 chỉ
+  // qua frame handler
+  EpollEventLoop    loop;
+  UdpBridgeReceiver receiver;
+  bool success = receiver.init(&loop, "127.0.0.1:0",
+                               {"vbus:bridge_out0", "vbus:bridge_out1", ""});
+  assert(success);
+  assert(receiver.port() != 0);
+  std::vector<std::pair<uint8_t, can_frame>> handled;
+  receiver.set_frame_handler(
+    [&](uint8_t channel, const can_frame& f, uint64_t timestamp_ns) {
+      assert(timestamp_ns > 0);
+      handled.emplace_back(channel, f);
+    });
+
+  UdpBridgeSender sender;
+  success = sender.init(
+    &loop, {"vbus:bridge_in0", "vbus:bridge_in1", "vbus:bridge_in2"},
+    "127.0.0.1:" + std::to_string(receiver.port()),
+    std::chrono::milliseconds(2));
+  assert(success);
+
+  SocketCanIntf          in[3], out[2];
+  std::vector<can_frame> rx[2];
+  for (int i = 0; i < 3; ++i) {
+    success = in[i].init("vbus:bridge_in" + std::to_string(i), &loop,
+                         [](const can_frame&) {});
+    assert(success);
+  }
+  for (int i = 0; i < 2; ++i) {
+    success =
+      out[i].init("vbus:bridge_out" + std::to_string(i), &loop,
+                  [&rx, i](const can_frame& f) { rx[i].push_back(f); });
+    assert(success);
+  }
+
+  constexpr uint32_t kFrames = 200;
+  can_frame          frame   = {};
+  frame.can_dlc              = 4;
+  for (uint32_t n = 0; n < kFrames; ++n) {
+    for (int i = 0; i < 3; ++i) {
+      frame.can_id = 0x100 * (i + 1) + (n & 0xFF);
+      std::memcpy(frame.data, &n, sizeof(n));
+      success = in[i].send_can_frame(frame);
+      assert(success);
+    }
+    if (n % 20 == 19)
+      loop.run_once(0);
+  }
+
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((rx[0].size() < kFrames || rx[1].size() < kFrames ||
+          handled.size() < 3 * kFrames) &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+
+  // Thứ tự giữ nguyên trong mỗi kênh, không mất datagram nào
+  for (int i = 0; i < 2; ++i) {
+    assert(rx[i].size() == kFrames);
+    for (uint32_t n = 0; n < kFrames; ++n) {
+      uint32_t value;
+      std::memcpy(&value, rx[i][n].data, sizeof(value));
+      assert(value == n && rx[i][n].can_dlc == 4);
+      assert(rx[i][n].can_id == 0x100 * (i + 1) + (n & 0xFF));
+    }
+  }
+  assert(handled.size() == 3 * kFrames);
+  const UdpBridgeSender::Stats&   tx    = sender.stats();
+  const UdpBridgeReceiver::Stats& stats = receiver.stats();
+  assert(tx.frames == 3 * kFrames && tx.dropped_datagrams == 0);
+  assert(stats.frames == 3 * kFrames && stats.datagrams == tx.datagrams);
+  assert(stats.unrouted_frames == kFrames);
+  assert(stats.lost_datagrams == 0 && stats.reordered == 0);
+  assert(stats.malformed == 0 && stats.replay_dropped == 0);
+  // Nhiều frame mỗi datagram, nhiều datagram mỗi syscall
+  assert(tx.send_calls * 8 <= tx.frames);
+
+  sender.deinit();
+  receiver.deinit();
+  for (auto& intf : in)
+    intf.deinit();
+  for (auto& intf : out)
+    intf.deinit();
+}
+
+// Gửi datagram tự dựng tới receiver trên 127.0.0.1
+void send_udp_probe(uint16_t port, const void* data, size_t size) {
+  int probe = socket(AF_INET, SOCK_DGRAM, 0);
+  assert(probe >= 0);
+  struct sockaddr_in target = {};
+  target.sin_family         = AF_INET;
+  target.sin_port           = htons(port);
+  target.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  ssize_t sent = sendto(probe, data, size, 0,
+                        reinterpret_cast<struct sockaddr*>(&target),
+                        sizeof(target));
+  assert(sent == static_cast<ssize_t>(size));
+  close(probe);
+}
+
+UdpBridgeHeader udp_bridge_header(uint32_t stream, uint32_t sequence) {
+  UdpBridgeHeader header = {};
+  header.magic           = UdpBridgeHeader::kMagic;
+  header.version         = UdpBridgeHeader::kVersion;
+  header.header_size     = UdpBridgeHeader::kSize;
+  header.stream          = stream;
+  header.sequence        = sequence;
+  return header;
+}
+
+TEST(udp_bridge_receiver_sequence) {
+  EpollEventLoop    loop;
+  UdpBridgeReceiver receiver;
+  bool success = receiver.init(&loop, "127.0.0.1:0", {""});
+  assert(success);
+
+  // Datagram lạ bị bỏ qua; sequence nhảy thì tính là mất, datagram đến muộn
+  // là reordered
+  uint8_t garbage[32] = {1, 2, 3};
+  send_udp_probe(receiver.port(), garbage, sizeof(garbage));
+  for (uint32_t sequence : {10u, 13u, 11u}) {
+    UdpBridgeHeader header = udp_bridge_header(0xC0FFEE, sequence);
+    send_udp_probe(receiver.port(), &header, sizeof(header));
+  }
+  const UdpBridgeReceiver::Stats& stats = receiver.stats();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (stats.malformed + stats.reordered < 2 &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(stats.malformed == 1);
+  assert(stats.lost_datagrams == 2 && stats.reordered == 1);
+  receiver.deinit();
+}
+
+TEST(udp_bridge_receiver_bad_record) {
+  EpollEventLoop    loop;
+  UdpBridgeReceiver receiver;
+  bool success = receiver.init(&loop, "127.0.0.1:0", {"vbus:bridge_bad"});
+  assert(success);
+  SocketCanIntf          out;
+  std::vector<can_frame> rx;
+  success = out.init("vbus:bridge_bad", &loop,
+                     [&rx](const can_frame& f) { rx.push_back(f); });
+  assert(success);
+
+  // Record có DLC > 8 bị bỏ qua, các record còn lại vẫn được chuyển tiếp
+  uint8_t         datagram[UdpBridgeHeader::kSize + 2 * UdpBridgeRecord::kSize];
+  UdpBridgeHeader header     = udp_bridge_header(0xC0FFEE, 0);
+  UdpBridgeRecord records[2] = {};
+  records[0].can_id          = 0x7F0;
+  records[0].can_dlc         = 15;
+  records[1].can_id          = 0x7F1;
+  records[1].can_dlc         = 2;
+  header.count               = 2;
+  header.base_ns             = 1;
+  std::memcpy(datagram, &header, sizeof(header));
+  std::memcpy(datagram + sizeof(header), records, sizeof(records));
+  send_udp_probe(receiver.port(), datagram, sizeof(datagram));
+
+  const UdpBridgeReceiver::Stats& stats = receiver.stats();
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (rx.empty() && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(stats.malformed == 1 && stats.frames == 1);
+  assert(rx.size() == 1 && rx[0].can_id == 0x7F1);
+  receiver.deinit();
+  out.deinit();
+}
+
+TEST(basic_socket_can_policies) {
+  // Tính năng không chọn thì không chiếm chỗ
+  auto count_only = [](const can_frame&) {};
+  using Plain     = BasicSocketCan<decltype(count_only)>;
+  using Counted   = BasicSocketCan<decltype(count_only), CanStatistics>;
+  static_assert(Plain::kBatch == 1 && !Plain::kTimestamps && !Plain::kFd);
+  static_assert(sizeof(Plain::Stats) == 1 && sizeof(Counted::Stats) == 32);
+  static_assert(
+    BasicSocketCan<FrameProcessor, CanStatistics, CanBatching<8>>::kBatch ==
+    8);
+  static_assert(std::is_same_v<
+                BasicSocketCan<FrameProcessor, CanFd>::Frame, canfd_frame>);
+
+  EpollEventLoop         loop;
+  std::vector<can_frame> received;
+  std::vector<uint64_t>  timestamps;
+  auto on_frame = [&](const can_frame& frame, uint64_t timestamp_ns) {
+    received.push_back(frame);
+    timestamps.push_back(timestamp_ns);
+  };
+  BasicSocketCan<decltype(on_frame), CanTimestamps, CanBatching<8>,
+                 CanStatistics>
+    rx(on_frame);
+  bool success = rx.init("vbus:basic", &loop);
+  assert(success);
+
+  // Gửi bằng send_frames() theo batch, và cả SocketCanIntf trên cùng bus
+  BasicSocketCan<decltype(count_only), CanStatistics> tx(count_only);
+  success = tx.init("vbus:basic", &loop);
+  assert(success);
+  SocketCanIntf legacy;
+  success = legacy.init("vbus:basic", &loop, [](const can_frame&) {});
+  assert(success);
+  std::vector<can_frame> frames(40);
+  for (size_t i = 0; i < frames.size(); ++i) {
+    frames[i].can_id  = 0x300 + static_cast<canid_t>(i);
+    frames[i].can_dlc = 1;
+    frames[i].data[0] = static_cast<uint8_t>(i);
+  }
+  success = tx.send_frames(frames.data(), frames.size()) == frames.size();
+  assert(success);
+  can_frame last = {};
+  last.can_id    = 0x7FF;
+  success = legacy.send_can_frame(last);
+  assert(success);
+  assert(tx.stats().tx_frames == frames.size());
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  uint64_t start = static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+                   static_cast<uint64_t>(now.tv_nsec);
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (received.size() < frames.size() + 1 &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+
+  assert(received.size() == frames.size() + 1);
+  for (size_t i = 0; i < frames.size(); ++i)
+    assert(received[i].can_id == frames[i].can_id &&
+           received[i].data[0] == i);
+  assert(received.back().can_id == 0x7FF);
+  // Timestamp của kernel, CLOCK_REALTIME
+  for (uint64_t timestamp : timestamps)
+    assert(timestamp + 1000000000ull > start && timestamp < start + 5e9);
+  assert(rx.stats().rx_frames == received.size());
+  assert(rx.stats().rx_batches >= 6 && rx.stats().errors == 0);
+
+  // CAN FD cần interface SocketCAN
+  auto on_fd_frame = [](const canfd_frame&) {};
+  BasicSocketCan<decltype(on_fd_frame), CanFd> fd_intf(on_fd_frame);
+  success = !fd_intf.init("vbus:basic", &loop);
+  assert(success);
+
+  rx.deinit();
+  tx.deinit();
+  legacy.deinit();
+}
+
+TEST(frame_pool_handles_and_fan_out) {
+  // Handle đếm tham chiếu; slot trả về free list khi handle cuối biến mất
+  FramePool pool(4);
+  assert(pool.capacity() == 4 && pool.available() == 4);
+  FrameRef refs[8];
+  bool success = pool.take(refs, 8) == 4 && pool.exhausted() == 1;
+  assert(success);
+  success = !refs[4] && !pool.take();
+  assert(success);
+  refs[0].data()->can_id = 0x123;
+  FrameRef copy          = refs[0];
+  assert(copy.use_count() == 2 && copy->can_id == 0x123);
+  assert(&*copy == &*refs[0]);
+  for (FrameRef& ref : refs)
+    ref.reset();
+  assert(pool.available() == 3 && copy.use_count() == 1);
+
+  // Handle chia sẻ sang thread khác trả slot qua return stack
+  std::vector<SharedFrameRef> shared;
+  for (int i = 0; i < 100; ++i)
+    shared.push_back(copy.share());
+  assert(copy.use_count() == 2);
+  copy.reset();
+  assert(pool.available() == 3);
+  std::thread worker([&shared]() {
+    for (SharedFrameRef& ref : shared) {
+      assert(ref->can_id == 0x123);
+      ref.reset();
+    }
+  });
+  worker.join();
+  pool.reclaim();
+  assert(pool.available() == 4);
+
+  // Đọc thẳng vào pool: nhiều consumer giữ cùng một frame, không copy
+  EpollEventLoop loop;
+  FramePool      rx_pool(8);
+  SocketCanIntf  rx, tx;
+  std::vector<FrameRef> logger, decoder, stats;
+  rx.set_frame_pool(&rx_pool, [&](const FrameRef& frame) {
+    logger.push_back(frame);
+    decoder.push_back(frame);
+    if (frame->can_id & 1)
+      stats.push_back(frame);
+  });
+  success = rx.init("vbus:pool", &loop, [](const can_frame&) {
+    assert(false);  // không dùng khi có pool
+  });
+  assert(success);
+  success = tx.init("vbus:pool", &loop, [](const can_frame&) {});
+  assert(success);
+  can_frame frame = {};
+  frame.can_dlc   = 1;
+  for (canid_t id = 0; id < 20; ++id) {
+    frame.can_id  = 0x200 + id;
+    frame.data[0] = static_cast<uint8_t>(id);
+    success = tx.send_can_frame(frame);
+    assert(success);
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (logger.size() + rx_pool.dropped() < 20 &&
+         std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+
+  // Burst lớn hơn pool: 8 frame được giữ, phần còn lại bị drop
+  assert(logger.size() == 8 && rx_pool.dropped() == 12);
+  assert(rx_pool.available() == 0);
+  for (size_t i = 0; i < logger.size(); ++i) {
+    assert(logger[i]->can_id == 0x200 + i && logger[i]->data[0] == i);
+    assert(&*logger[i] == &*decoder[i]);
+  }
+  assert(stats.size() == 4 && stats[0].use_count() == 3);
+
+  // Consumer nhả frame thì pool nhận tiếp
+  logger.clear();
+  decoder.clear();
+  stats.clear();
+  assert(rx_pool.available() == 8);
+  frame.can_id = 0x300;
+  success = tx.send_can_frame(frame);
+  assert(success);
+  deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (logger.empty() && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(logger.size() == 1 && logger[0]->can_id == 0x300);
+  logger.clear();
+  decoder.clear();
+
+  rx.deinit();
+  tx.deinit();
+}
+
+TEST(trigger_signal_decode) {
+  // Signal kiểu Intel và Motorola như trong DBC
+  can_frame frame = {};
+  frame.can_dlc   = 4;
+  frame.data[0]   = 0x5A;
+  frame.data[1]   = 0xF3;
+  double        value;
+  TriggerSignal intel;
+  intel.start_bit = 4;
+  intel.length    = 12;
+  bool success = decode_trigger_signal(intel, frame, value) && value == 0xF35;
+  assert(success);
+  intel.is_signed = true;
+  intel.scale     = 0.5;
+  success = decode_trigger_signal(intel, frame, value) && value == -101.5;
+  assert(success);
+  TriggerSignal motorola;
+  motorola.start_bit  = 7;
+  motorola.length     = 16;
+  motorola.big_endian = true;
+  success = decode_trigger_signal(motorola, frame, value) && value == 0x5AF3;
+  assert(success);
+  motorola.start_bit = 23;
+  motorola.length    = 24;
+  success = !decode_trigger_signal(motorola, frame, value);
+  assert(success);  // ngoài DLC
+}
+
+// Cấu hình ghi capture vào một thư mục tạm, xoá bằng remove_trigger_captures()
+TriggerConfig trigger_test_config() {
+  char directory[] = "/tmp/socket_can_trigger_XXXXXX";
+  bool success     = mkdtemp(directory) != nullptr;
+  assert(success);
+  TriggerConfig config;
+  config.directory         = directory;
+  config.pre_frames        = 40;
+  config.pre_ns            = 1000000000;
+  config.post_ns           = 100000000;
+  config.check_interval_ns = 5000000;
+  return config;
+}
+
+void remove_trigger_captures(const TriggerConfig& config) {
+  DIR* dir = opendir(config.directory.c_str());
+  assert(dir);
+  while (struct dirent* entry = readdir(dir)) {
+    if (entry->d_name[0] != '.')
+      unlink((config.directory + "/" + entry->d_name).c_str());
+  }
+  closedir(dir);
+  rmdir(config.directory.c_str());
+}
+
+// Rule một frame: ID 0x100, nibble cao của byte đầu là 0xA
+TriggerRule payload_trigger_rule() {
+  TriggerRule payload;
+  payload.name                     = "payload";
+  payload.conditions.resize(1);
+  payload.conditions[0].id         = 0x100;
+  payload.conditions[0].data_mask  = {0xF0};
+  payload.conditions[0].data_value = {0xA0};
+  return payload;
+}
+
+TEST(trigger_engine_pre_post_capture) {
+  TriggerConfig            config = trigger_test_config();
+  EpollEventLoop           loop;
+  TriggerEngine            engine;
+  std::vector<std::string> paths;
+  std::mutex               paths_mutex;
+  engine.set_capture_handler(
+    [&](const std::string& path, uint64_t records, bool ok) {
+      assert(ok && records > 0);
+      std::lock_guard<std::mutex> lock(paths_mutex);
+      paths.push_back(path);
+    });
+  bool success = engine.init(&loop, {payload_trigger_rule()}, 2, config);
+  assert(success);
+
+  // 100 ms nền trên hai bus (1 ms/frame), rồi frame trigger
+  uint64_t  t     = capture_now_ns();
+  can_frame noise = {};
+  noise.can_id    = 0x123;
+  noise.can_dlc   = 8;
+  for (int i = 0; i < 100; ++i, t += 1000000)
+    engine.on_frame(static_cast<uint32_t>(i & 1), noise, t);
+  assert(engine.stats().checks == 0 && !engine.capturing());
+
+  can_frame trigger = {};
+  trigger.can_id    = 0x100;
+  trigger.can_dlc   = 1;
+  trigger.data[0]   = 0x3A;  // sai payload
+  engine.on_frame(0, trigger, t);
+  assert(!engine.capturing());
+  trigger.data[0]     = 0xA5;
+  uint64_t trigger_ns = t + 1;
+  engine.on_frame(0, trigger, trigger_ns);
+  assert(engine.stats().triggers == 1 && engine.capturing());
+  engine.on_frame(0, trigger, trigger_ns + 1);  // holdoff
+  assert(engine.stats().suppressed == 1);
+
+  // Post-trigger: 150 ms nữa, capture kết thúc sau 100 ms
+  for (int i = 0; i < 150; ++i) {
+    t += 1000000;
+    engine.on_frame(static_cast<uint32_t>(i & 1), noise, t);
+  }
+  assert(!engine.capturing() && engine.stats().captures == 1);
+  engine.flush();
+
+  // Frame trước trigger (tối đa 40 mỗi bus) và 100 ms sau
+  TriggerEngine::Stats stats = engine.stats();
+  assert(stats.written == 1 && stats.failed == 0 && stats.truncated == 0);
+  {
+    std::lock_guard<std::mutex> lock(paths_mutex);
+    assert(paths.size() == 1);
+    assert(paths[0].find("payload.scap") != std::string::npos);
+  }
+  CaptureFileReader reader;
+  success = reader.open(paths[0]);
+  assert(success);
+  size_t        before = 0, after = 0;
+  CaptureRecord record, previous = {};
+  while (reader.next(record)) {
+    assert(record.timestamp_ns >= previous.timestamp_ns);
+    previous = record;
+    if (record.timestamp_ns <= trigger_ns)
+      before++;
+    else
+      after++;
+    assert(record.timestamp_ns < trigger_ns + config.post_ns);
+  }
+  assert(before == 80);  // 2 x 40 frame, gồm cả frame trigger
+  assert(after == 101);  // frame holdoff + 100 frame nền
+  reader.close();
+
+  engine.deinit();
+  remove_trigger_captures(config);
+}
+
+TEST(trigger_engine_threshold_and_sequence) {
+  TriggerRule threshold;
+  threshold.name                        = "speed";
+  threshold.bus                         = 1;
+  threshold.conditions.resize(1);
+  threshold.conditions[0].id            = 0x200;
+  threshold.conditions[0].signal.length = 16;
+  threshold.conditions[0].compare       = TriggerCompare::kGreater;
+  threshold.conditions[0].threshold     = 1000;
+  TriggerRule sequence;
+  sequence.name      = "sequence";
+  sequence.kind      = TriggerRule::Kind::kSequence;
+  sequence.window_ns = 50000000;
+  for (canid_t id : {0x300u, 0x301u, 0x302u}) {
+    TriggerCondition step;
+    step.id = id;
+    sequence.conditions.push_back(step);
+  }
+
+  TriggerConfig            config = trigger_test_config();
+  EpollEventLoop           loop;
+  TriggerEngine            engine;
+  std::vector<std::string> fired;
+  engine.set_trigger_handler(
+    [&](const TriggerEvent& event) { fired.push_back(*event.name); });
+  bool success = engine.init(&loop, {threshold, sequence}, 2, config);
+  assert(success);
+
+  // Ngưỡng chỉ trên bus 1
+  uint64_t  t     = capture_now_ns();
+  can_frame speed = {};
+  speed.can_id    = 0x200;
+  speed.can_dlc   = 2;
+  speed.data[0]   = 0xE8;
+  speed.data[1]   = 0x03;  // 1000
+  engine.on_frame(1, speed, t += 1000000);
+  speed.data[0] = 0xE9;
+  engine.on_frame(0, speed, t += 1000000);
+  assert(fired.empty());
+  engine.on_frame(1, speed, t += 1000000);
+  assert(fired.size() == 1 && fired[0] == "speed");
+
+  // Chuỗi phải đúng thứ tự và đủ nhanh
+  can_frame step = {};
+  for (canid_t id : {0x300u, 0x302u, 0x301u}) {
+    step.can_id = id;
+    engine.on_frame(0, step, t += 20000000);  // bước cuối quá cửa sổ
+  }
+  step.can_id = 0x302;
+  engine.on_frame(0, step, t += 20000000);
+  assert(fired.size() == 1);
+  for (canid_t id : {0x300u, 0x301u, 0x302u}) {
+    step.can_id = id;
+    engine.on_frame(1, step, t += 10000000);
+  }
+  assert(fired.size() == 2 && fired[1] == "sequence");
+
+  engine.deinit();
+  remove_trigger_captures(config);
+}
+
+TEST(trigger_engine_missing_id) {
+  TriggerRule missing;
+  missing.name      = "heartbeat";
+  missing.kind      = TriggerRule::Kind::kMissing;
+  missing.window_ns = 30000000;
+  missing.conditions.resize(1);
+  missing.conditions[0].id = 0x400;
+
+  TriggerConfig            config = trigger_test_config();
+  EpollEventLoop           loop;
+  TriggerEngine            engine;
+  std::vector<std::string> fired;
+  engine.set_trigger_handler(
+    [&](const TriggerEvent& event) { fired.push_back(*event.name); });
+  bool success = engine.init(&loop, {missing}, 1, config);
+  assert(success);
+
+  // Heartbeat 0x400 không xuất hiện: timer báo sau 30 ms, một lần
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (fired.empty() && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(fired.size() == 1 && fired[0] == "heartbeat");
+  for (int i = 0; i < 10; ++i)
+    loop.run_once(5);
+  assert(fired.size() == 1 && engine.stats().triggers == 1);
+
+  engine.deinit();
+  remove_trigger_captures(config);
+}
+
+TEST(trigger_engine_reinit) {
+  TriggerConfig  config = trigger_test_config();
+  EpollEventLoop loop;
+  TriggerEngine  engine;
+  bool success = engine.init(&loop, {payload_trigger_rule()}, 1, config);
+  assert(success);
+  can_frame trigger = {};
+  trigger.can_id    = 0x100;
+  trigger.can_dlc   = 1;
+  trigger.data[0]   = 0xA5;
+  engine.on_frame(0, trigger, capture_now_ns());
+  assert(engine.capturing());
+
+  // init lần hai dừng writer cũ trước, không gọi std::terminate
+  success = engine.init(&loop, {payload_trigger_rule()}, 2, config);
+  assert(success && !engine.capturing());
+
+  engine.deinit();
+  remove_trigger_captures(config);
+}
+
+TEST(frame_filter_kernels_agree) {
+  // Rule kiểu CAN_RAW_FILTER: exact, dải ID, ID 29-bit, RTR, đảo ngược
+  std::vector<can_filter> rules = {
+    {0x123, CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_SFF_MASK},
+    {0x100, 0x700},
+    {CAN_EFF_FLAG | 0x18FF0000, CAN_EFF_FLAG | 0x1FFF0000},
+    {CAN_RTR_FLAG, CAN_RTR_FLAG},
+    {0x100 | CAN_INV_FILTER, 0x700},
+  };
+  for (canid_t i = 0; i < 40; ++i)
+    rules.push_back({0x200 + i * 3, CAN_SFF_MASK});
+
+  // Batch 150 frame: 2 word đầy đủ và 1 word lẻ, có phần dư không chia hết
+  // cho độ rộng vector
+  FrameBatch batch;
+  uint32_t   seed = 12345;
+  for (size_t i = 0; i < 150; ++i) {
+    seed            = seed * 1103515245 + 12345;
+    can_frame frame = {};
+    frame.can_id    = (seed >> 8) & 0x7FF;
+    if (i % 7 == 0)
+      frame.can_id = CAN_EFF_FLAG | 0x18FF0000 | (seed & 0xFFFF);
+    if (i % 11 == 0)
+      frame.can_id |= CAN_RTR_FLAG;
+    if (i % 13 == 0)
+      frame.can_id = 0x123;
+    frame.can_dlc = static_cast<uint8_t>(i % 9);
+    frame.data[0] = static_cast<uint8_t>(i);
+    batch.push(frame);
+  }
+  assert(batch.size() == 150);
+  can_frame copy = batch.frame(14);
+  assert(copy.can_dlc == 14 % 9 && copy.data[0] == 14);
+
+  auto reference = [&](size_t rule, size_t index) {
+    canid_t id     = batch.ids()[index];
+    canid_t mask   = rules[rule].can_mask;
+    bool    invert = rules[rule].can_id & CAN_INV_FILTER;
+    bool    match  = (id & mask) == (rules[rule].can_id & ~CAN_INV_FILTER &
+                                  mask);
+    return match != invert;
+  };
+
+  FrameFilterSet filters(rules);
+  assert(filters.rule_count() == rules.size());
+  assert(filters.kernel() == best_filter_kernel());
+  size_t kernels = 0;
+  for (FilterKernel kernel :
+       {FilterKernel::kScalar, FilterKernel::kSse2, FilterKernel::kAvx2}) {
+    if (!filters.set_kernel(kernel)) {
+      assert(!filter_kernel_supported(kernel));
+      continue;
+    }
+    kernels++;
+    FilterResult result;
+    filters.classify(batch, result);
+    assert(result.frames() == 150 && result.words() == 3);
+    for (size_t r = 0; r < rules.size(); ++r) {
+      size_t expected = 0;
+      for (size_t i = 0; i < batch.size(); ++i) {
+        assert(result.matches(r, i) == reference(r, i));
+        expected += reference(r, i);
+      }
+      assert(result.count(r) == expected);
+    }
+    // Rule đảo ngược không được bật bit ngoài batch
+    assert((result.bits(4)[2] >> (150 - 128)) == 0);
+
+    std::vector<uint32_t> indices(150);
+    size_t n = result.indices(0, indices.data());
+    assert(n == result.count(0) && n >= 12);
+    for (size_t i = 0; i < n; ++i)
+      assert(indices[i] % 13 == 0 && (i == 0 || indices[i] > indices[i - 1]));
+    n = result.any_indices(indices.data());
+    for (size_t i = 0; i < batch.size(); ++i) {
+      bool any = false;
+      for (size_t r = 0; r < rules.size(); ++r)
+        any = any || reference(r, i);
+      assert(any == std::binary_search(indices.begin(), indices.begin() + n,
+                                       static_cast<uint32_t>(i)));
+    }
+  }
+  assert(kernels >= 1);
+
+  // Batch là bội số của 64: mọi word đều đầy, kernel vector không có phần
+  // dư; kết quả phải giống hệt kernel scalar
+  FrameBatch full;
+  for (size_t i = 0; i < 256; ++i)
+    full.push(batch.frame(i % batch.size()));
+  FrameFilterSet scalar_filters(rules);
+  bool           scalar_set = scalar_filters.set_kernel(FilterKernel::kScalar);
+  assert(scalar_set);
+  FilterResult expected_bits;
+  scalar_filters.classify(full, expected_bits);
+  assert(expected_bits.words() == 4);
+  for (FilterKernel kernel : {FilterKernel::kSse2, FilterKernel::kAvx2}) {
+    if (!filters.set_kernel(kernel))
+      continue;
+    FilterResult result;
+    filters.classify(full, result);
+    for (size_t r = 0; r < rules.size(); ++r) {
+      for (size_t w = 0; w < result.words(); ++w)
+        assert(result.bits(r)[w] == expected_bits.bits(r)[w]);
+    }
+  }
+
+  // Stage sau receive theo batch: mỗi batch được phân loại một lần
+  EpollEventLoop loop;
+  SocketCanIntf  rx, tx;
+  size_t         batches = 0, frames = 0, exact = 0;
+  FrameClassifier classifier(
+    {{0x123, CAN_SFF_MASK}},
+    [&](const FrameBatch& batch, const FilterResult& result) {
+      batches++;
+      frames += batch.size();
+      exact += result.count(0);
+    });
+  bool success = rx.init("vbus:filter", &loop, classifier.frame_processor());
+  assert(success);
+  rx.set_batch_end_handler([&] { classifier.flush(); });
+  success = tx.init("vbus:filter", &loop, [](const can_frame&) {});
+  assert(success);
+  can_frame frame = {};
+  for (canid_t id = 0; id < 20; ++id) {
+    frame.can_id = id % 4 ? 0x300 + id : 0x123;
+    success = tx.send_can_frame(frame);
+    assert(success);
+  }
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (frames < 20 && std::chrono::steady_clock::now() < deadline)
+    loop.run_once(10);
+  assert(frames == 20 && exact == 5 && batches >= 2);
+
+  rx.deinit();
+  tx.deinit();
+}
+
+TEST(capture_analysis_columnar_queries) {
+  // 200 s: 0x100 mỗi 5 ms, 0x200 mỗi 100 ms trên channel 1, ID 29-bit mỗi
+  // 50 ms mang signal 16-bit (scale 0.1) => nhiều chunk, chia cho 4 thread
+  const uint64_t t0   = 1700000000000000000ull;
+  std::string    path = "/tmp/socket_can_analysis_test.scap";
+  std::string    log  = "/tmp/socket_can_analysis_test.log";
+  CaptureLogger  logger;
+  bool success = logger.open(path);
+  assert(success);
+  auto     text  = open_capture_sink(log);
+  uint64_t total = 0, signals = 0;
+  assert(text);
+  for (uint64_t ms = 0; ms < 200000; ms += 5) {
+    CaptureRecord record = {};
+    record.timestamp_ns  = t0 + ms * 1000000;
+    record.frame.can_id  = 0x100;
+    record.frame.can_dlc = 2;
+    std::vector<CaptureRecord> batch = {record};
+    if (ms % 100 == 0) {
+      record.channel      = 1;
+      record.frame.can_id = 0x200;
+      batch.push_back(record);
+    }
+    if (ms % 50 == 0) {
+      uint16_t value       = static_cast<uint16_t>(signals++ % 1000);
+      record.channel       = 0;
+      record.frame.can_id  = CAN_EFF_FLAG | 0x18FF0010;
+      record.frame.can_dlc = 8;
+      std::memcpy(record.frame.data, &value, sizeof(value));
+      batch.push_back(record);
+    }
+    for (const CaptureRecord& rec : batch) {
+      success = logger.write(rec) && text->write(rec);
+      assert(success);
+      total++;
+    }
+  }
+  success = logger.close() && text->close();
+  assert(success);
+
+  CaptureAnalyzer analyzer(4), serial(1);
+  success = analyzer.open(path) && serial.open(path);
+  assert(success);
+  assert(analyzer.size() == total && total == 46000);
+  assert(analyzer.first_timestamp_ns() == t0);
+
+  // Scan với bộ lọc ID, channel và khoảng thời gian
+  AnalysisFilter all;
+  CaptureScanResult scan = analyzer.scan(all);
+  assert(scan.records == total && scan.matched == total);
+  assert(scan.first_ns == t0 && scan.last_ns == t0 + 199995000000ull);
+  assert(scan.payload_bytes == 40000 * 2 + 2000 * 2 + 4000 * 8);
+  AnalysisFilter by_id;
+  by_id.ids = {{0x200, CAN_SFF_MASK}};
+  assert(analyzer.scan(by_id).matched == 2000);
+  AnalysisFilter by_channel;
+  by_channel.channel = 1;
+  assert(analyzer.scan(by_channel).matched == 2000);
+  AnalysisFilter window;
+  window.begin_ns = t0 + 10000000000ull;
+  window.end_ns   = t0 + 20000000000ull;
+  assert(analyzer.scan(window).matched == 2000 + 100 + 200);
+
+  // Group theo ID: chu kỳ nối liền qua ranh giới giữa các thread
+  std::vector<IdSummary> ids = analyzer.group_by_id(all);
+  assert(ids.size() == 3);
+  assert(ids[0].id == 0x100 && ids[1].id == 0x200);
+  assert(ids[2].id == (CAN_EFF_FLAG | 0x18FF0010));
+  assert(ids[0].count == 40000 && ids[0].periods == 39999);
+  assert(ids[0].min_period_ns == 5000000 && ids[0].max_period_ns == 5000000);
+  assert(ids[0].mean_period_ns() == 5000000);
+  assert(ids[0].period_histogram[13] == 39999);  // 4096..8192 us
+  assert(period_bucket_floor_ns(13) == 4096000);
+  assert(ids[1].count == 2000 && ids[1].first_ns == t0);
+  assert(ids[1].mean_period_ns() == 100000000);
+  assert(ids[2].min_dlc == 8 && ids[2].max_dlc == 8);
+  std::vector<IdSummary> single = serial.group_by_id(all);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    assert(single[i].count == ids[i].count);
+    assert(single[i].periods == ids[i].periods);
+    assert(single[i].period_sum_ns == ids[i].period_sum_ns);
+    assert(single[i].period_histogram == ids[i].period_histogram);
+  }
+
+  // Min/max signal theo từng giây
+  SignalQuery query;
+  query.id            = CAN_EFF_FLAG | 0x18FF0010;
+  query.signal.length = 16;
+  query.signal.scale  = 0.1;
+  query.bucket_ns     = 1000000000;
+  std::vector<SignalBucket> buckets = analyzer.signal_buckets(query);
+  assert(buckets.size() == 200);
+  assert(buckets[0].start_ns == t0 && buckets[0].count == 20);
+  assert(buckets[0].min == 0 && std::fabs(buckets[0].max - 1.9) < 1e-9);
+  // Giá trị quay vòng sau 1000: giây 50 lại là 0.0 .. 1.9
+  assert(std::fabs(buckets[50].mean() - 0.95) < 1e-9);
+  std::vector<SignalSample> samples = analyzer.extract_signal(query, window);
+  assert(samples.size() == 200);
+  assert(samples[0].timestamp_ns == window.begin_ns);
+  assert(std::fabs(samples[5].value - 20.5) < 1e-9);
+
+  // Định dạng khác được nạp vào bộ nhớ trước
+  CaptureAnalyzer text_analyzer(2);
+  success = text_analyzer.open(log);
+  assert(success);
+  assert(text_analyzer.size() == total);
+  assert(text_analyzer.scan(by_id).matched == 2000);
+  assert(text_analyzer.group_by_id(all).size() == 3);
+
+  // Quá 6144 ID 29-bit trong một thread: frame của ID dư được đếm lại
+  std::string   many_path = "/tmp/socket_can_analysis_many_ids.scap";
+  CaptureLogger many;
+  success = many.open(many_path);
+  assert(success);
+  for (canid_t id = 0; id < 7000; ++id) {
+    CaptureRecord record = {};
+    record.timestamp_ns  = t0 + id;
+    record.frame.can_id  = CAN_EFF_FLAG | (0x10000 + id);
+    success              = many.write(record);
+    assert(success);
+  }
+  success = many.close();
+  assert(success);
+  CaptureAnalyzer many_analyzer(1);
+  success = many_analyzer.open(many_path);
+  assert(success);
+  uint64_t untracked = 0;
+  success = many_analyzer.group_by_id(all, &untracked).size() == 6144;
+  assert(success);
+  assert(untracked == 7000 - 6144);
+  success = analyzer.group_by_id(all, &untracked).size() == 3;
+  assert(success && untracked == 0);
+  unlink(many_path.c_str());
+  unlink(capture_index_path(many_path).c_str());
+
+  success = !analyzer.open("/tmp/socket_can_analysis_missing.scap");
+  assert(success);
+  unlink(path.c_str());
+  unlink(capture_index_path(path).c_str());
+  unlink(log.c_str());
+}
+
 int main() {
   std::cout << "=== SocketCAN Library Tests ===" << std::endl;
 
@@ -170,6 +2424,39 @@ int main() {
     RUN_TEST(can_frame_creation);
     RUN_TEST(frame_processor_callback);
     RUN_TEST(epoll_event_basic);
+    RUN_TEST(capture_formats_round_trip);
+    RUN_TEST(replay_scheduler_and_filters);
+    RUN_TEST(capture_index_query);
+    RUN_TEST(compressed_capture_ratio);
+    RUN_TEST(frame_formatter_lines);
+    RUN_TEST(ring_buffers);
+    RUN_TEST(shm_frame_bus);
+    RUN_TEST(latency_histogram_and_runner);
+    RUN_TEST(virtual_bus_rx_tx);
+    RUN_TEST(virtual_bus_arbitration_and_pacing);
+    RUN_TEST(socket_can_intf_on_opened_transport);
+    RUN_TEST(traffic_generator_load);
+    RUN_TEST(traffic_statistics_per_id);
+    RUN_TEST(traffic_statistics_table_full);
+    RUN_TEST(traffic_statistics_concurrent_snapshot);
+    RUN_TEST(bus_load_exact_bits);
+    RUN_TEST(metrics_registry_and_server);
+    RUN_TEST(error_frames_and_link_recovery);
+    RUN_TEST(request_correlator_limits_and_timeouts);
+    RUN_TEST(gateway_routes_rewrites_and_limits);
+    RUN_TEST(udp_bridge_endpoints);
+    RUN_TEST(udp_bridge_localhost);
+    RUN_TEST(udp_bridge_receiver_sequence);
+    RUN_TEST(udp_bridge_receiver_bad_record);
+    RUN_TEST(basic_socket_can_policies);
+    RUN_TEST(frame_pool_handles_and_fan_out);
+    RUN_TEST(trigger_signal_decode);
+    RUN_TEST(trigger_engine_pre_post_capture);
+    RUN_TEST(trigger_engine_threshold_and_sequence);
+    RUN_TEST(trigger_engine_missing_id);
+    RUN_TEST(trigger_engine_reinit);
+    RUN_TEST(frame_filter_kernels_agree);
+    RUN_TEST(capture_analysis_columnar_queries);
 
     std::cout << "\n=== All tests PASSED! ===" << std::endl;
 